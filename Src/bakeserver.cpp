@@ -0,0 +1,523 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "bakeserver.h"
+#include "fornos.h"
+#include "json.h"
+#include "logging.h"
+#include "taskgraph.h"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	static const double k_progressInterval = 0.5; // Seconds between the progress events of a job
+
+	//
+	// Local socket (named pipe on Windows) with line based messages
+	//
+
+	class JobConnection
+	{
+	public:
+		JobConnection() {}
+		~JobConnection() { close(); }
+
+		/// Client side connection to a listening server
+		bool connect(const std::string &path)
+		{
+#ifdef _WIN32
+			for (;;)
+			{
+				_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+				if (_handle != INVALID_HANDLE_VALUE) return true;
+				// Every pipe instance is busy with another client
+				if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(path.c_str(), NMPWAIT_WAIT_FOREVER)) return false;
+			}
+#else
+			sockaddr_un address = {};
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path)) return false;
+			path.copy(address.sun_path, path.size());
+			_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (_fd < 0) return false;
+			return ::connect(_fd, (const sockaddr*)&address, sizeof(address)) == 0;
+#endif
+		}
+
+		/// Reads the next line without the end of line
+		/// @return False once the other side closed the connection
+		bool readLine(std::string &o_line)
+		{
+			for (;;)
+			{
+				const size_t end = _buffer.find('\n');
+				if (end != std::string::npos)
+				{
+					o_line = _buffer.substr(0, end);
+					if (!o_line.empty() && o_line.back() == '\r') o_line.pop_back();
+					_buffer.erase(0, end + 1);
+					return true;
+				}
+				char data[4096];
+				const int size = read(data, sizeof(data));
+				if (size <= 0)
+				{
+					// The last line doesn't need an end of line
+					if (_buffer.empty()) return false;
+					o_line.swap(_buffer);
+					_buffer.clear();
+					return true;
+				}
+				_buffer.append(data, (size_t)size);
+			}
+		}
+
+		bool writeLine(const std::string &line)
+		{
+			const std::string data = line + "\n";
+			size_t offset = 0;
+			while (offset < data.size())
+			{
+				const int size = write(data.data() + offset, data.size() - offset);
+				if (size <= 0) return false;
+				offset += (size_t)size;
+			}
+			return true;
+		}
+
+		void close()
+		{
+#ifdef _WIN32
+			if (_handle != INVALID_HANDLE_VALUE)
+			{
+				if (_serverPipe)
+				{
+					FlushFileBuffers(_handle);
+					DisconnectNamedPipe(_handle);
+				}
+				CloseHandle(_handle);
+				_handle = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (_fd >= 0)
+			{
+				::close(_fd);
+				_fd = -1;
+			}
+#endif
+		}
+
+	private:
+		friend class JobListener;
+
+		int read(char *data, size_t size)
+		{
+#ifdef _WIN32
+			DWORD count = 0;
+			if (!ReadFile(_handle, data, (DWORD)size, &count, nullptr)) return -1;
+			return (int)count;
+#else
+			return (int)recv(_fd, data, size, 0);
+#endif
+		}
+
+		int write(const char *data, size_t size)
+		{
+#ifdef _WIN32
+			DWORD count = 0;
+			if (!WriteFile(_handle, data, (DWORD)size, &count, nullptr)) return -1;
+			return (int)count;
+#else
+#ifdef MSG_NOSIGNAL
+			const int flags = MSG_NOSIGNAL; // A client that went away can't kill the server
+#else
+			const int flags = 0;
+#endif
+			return (int)send(_fd, data, size, flags);
+#endif
+		}
+
+		JobConnection(const JobConnection &) = delete;
+		JobConnection& operator=(const JobConnection &) = delete;
+
+#ifdef _WIN32
+		HANDLE _handle = INVALID_HANDLE_VALUE;
+		bool _serverPipe = false;
+#else
+		int _fd = -1;
+#endif
+		std::string _buffer; // Received data after the last line read
+	};
+
+	class JobListener
+	{
+	public:
+		JobListener() {}
+		~JobListener()
+		{
+#ifndef _WIN32
+			if (_fd >= 0)
+			{
+				close(_fd);
+				unlink(_path.c_str());
+			}
+#endif
+		}
+
+		bool listen(const std::string &path)
+		{
+			_path = path;
+#ifdef _WIN32
+			return true; // Every client gets its own pipe instance when accepted
+#else
+			sockaddr_un address = {};
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path)) return false;
+			path.copy(address.sun_path, path.size());
+			unlink(path.c_str()); // Left behind by a server that didn't shut down
+			_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (_fd < 0) return false;
+			return bind(_fd, (const sockaddr*)&address, sizeof(address)) == 0 && ::listen(_fd, 8) == 0;
+#endif
+		}
+
+		/// Waits for the next client
+		bool accept(JobConnection &o_connection)
+		{
+#ifdef _WIN32
+			HANDLE pipe = CreateNamedPipeA(_path.c_str(), PIPE_ACCESS_DUPLEX,
+				PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, PIPE_UNLIMITED_INSTANCES, 1 << 16, 1 << 16, 0, nullptr);
+			if (pipe == INVALID_HANDLE_VALUE) return false;
+			if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+			{
+				CloseHandle(pipe);
+				return false;
+			}
+			o_connection._handle = pipe;
+			o_connection._serverPipe = true;
+			return true;
+#else
+			const int fd = ::accept(_fd, nullptr, nullptr);
+			if (fd < 0) return false;
+			o_connection._fd = fd;
+			return true;
+#endif
+		}
+
+	private:
+		std::string _path;
+#ifndef _WIN32
+		int _fd = -1;
+#endif
+	};
+
+	//
+	// Jobs
+	//
+
+	void readString(const JsonValue &object, const char *key, std::string &o_value)
+	{
+		if (object[key].isString()) o_value = object[key].string();
+	}
+
+	void readBool(const JsonValue &object, const char *key, bool &o_value)
+	{
+		o_value = object[key].boolean(o_value);
+	}
+
+	void addError(std::string &o_errors, const std::string &message)
+	{
+		if (!o_errors.empty()) o_errors += "; ";
+		o_errors += message;
+	}
+
+	void readInt(const JsonValue &object, const char *key, int &o_value, std::string &o_errors)
+	{
+		if (!object[key].isNumber()) return;
+		const double value = object[key].number();
+		if (value >= INT_MIN && value <= INT_MAX) o_value = (int)value;
+		else addError(o_errors, std::string(key) + " is out of range");
+	}
+
+	void readFloat(const JsonValue &object, const char *key, float &o_value)
+	{
+		if (object[key].isNumber()) o_value = (float)object[key].number();
+	}
+
+	/// Enums are valid from 0 to their last value
+	template <typename E>
+	void readEnum(const JsonValue &object, const char *key, E last, E &o_value, std::string &o_errors)
+	{
+		if (!object[key].isNumber()) return;
+		const double value = object[key].number();
+		if (value >= 0.0 && value <= (double)last && value == std::floor(value)) o_value = (E)(int)value;
+		else addError(o_errors, std::string(key) + " is not a valid value");
+	}
+
+	/// Jobs have the FornosParameters members with the same names, enums by value.
+	/// Missing members keep their defaults.
+	/// @return False if a member has an invalid value, o_errors lists them
+	bool readParameters(const JsonValue &job, FornosParameters &o_params, std::string &o_errors)
+	{
+		const JsonValue &shared = job["shared"];
+		readString(shared, "loPolyMeshPath", o_params.shared.loPolyMeshPath);
+		readString(shared, "hiPolyMeshPath", o_params.shared.hiPolyMeshPath);
+		readEnum(shared, "loPolyMeshNormal", NormalImport::ComputePerVertex, o_params.shared.loPolyMeshNormal, o_errors);
+		readEnum(shared, "hiPolyMeshNormal", NormalImport::ComputePerVertex, o_params.shared.hiPolyMeshNormal, o_errors);
+		readBool(shared, "weldObjVertices", o_params.shared.weldObjVertices);
+		readBool(shared, "compactHiPolyMesh", o_params.shared.compactHiPolyMesh);
+		readBool(shared, "instanceRepeatedGroups", o_params.shared.instanceRepeatedGroups);
+		readInt(shared, "bvhTrisPerNode", o_params.shared.bvhTrisPerNode, o_errors);
+		readInt(shared, "texWidth", o_params.shared.texWidth, o_errors);
+		readInt(shared, "texHeight", o_params.shared.texHeight, o_errors);
+		readInt(shared, "texDilation", o_params.shared.texDilation, o_errors);
+		readInt(shared, "tileSize", o_params.shared.tileSize, o_errors);
+		readInt(shared, "supersampling", o_params.shared.supersampling, o_errors);
+		readEnum(shared, "sampleFilter", SampleFilter::Gaussian, o_params.shared.sampleFilter, o_errors);
+		readBool(shared, "udim", o_params.shared.udim);
+		readBool(shared, "matchGroupsByName", o_params.shared.matchGroupsByName);
+		readBool(shared, "ignoreBackfaces", o_params.shared.ignoreBackfaces);
+		readEnum(shared, "mapping", MeshMappingMethod::Hybrid, o_params.shared.mapping, o_errors);
+		readFloat(shared, "mappingEdge", o_params.shared.mappingEdge);
+
+		const JsonValue &height = job["height"];
+		readBool(height, "enabled", o_params.height.enabled);
+		readString(height, "outputPath", o_params.height.outputPath);
+		readBool(height, "normalizeOutput", o_params.height.normalizeOutput);
+		readFloat(height, "maxDistance", o_params.height.maxDistance);
+
+		const JsonValue &positions = job["positions"];
+		readBool(positions, "enabled", o_params.positions.enabled);
+		readString(positions, "outputPath", o_params.positions.outputPath);
+
+		const JsonValue &normals = job["normals"];
+		readBool(normals, "enabled", o_params.normals.enabled);
+		readBool(normals, "tangentSpace", o_params.normals.tangentSpace);
+		readString(normals, "outputPath", o_params.normals.outputPath);
+
+		const JsonValue &ao = job["ao"];
+		readBool(ao, "enabled", o_params.ao.enabled);
+		readInt(ao, "sampleCount", o_params.ao.sampleCount, o_errors);
+		readFloat(ao, "minDistance", o_params.ao.minDistance);
+		readFloat(ao, "maxDistance", o_params.ao.maxDistance);
+		readString(ao, "outputPath", o_params.ao.outputPath);
+
+		const JsonValue &bentNormals = job["bentNormals"];
+		readBool(bentNormals, "enabled", o_params.bentNormals.enabled);
+		readInt(bentNormals, "sampleCount", o_params.bentNormals.sampleCount, o_errors);
+		readFloat(bentNormals, "minDistance", o_params.bentNormals.minDistance);
+		readFloat(bentNormals, "maxDistance", o_params.bentNormals.maxDistance);
+		readBool(bentNormals, "tangentSpace", o_params.bentNormals.tangentSpace);
+		readString(bentNormals, "outputPath", o_params.bentNormals.outputPath);
+
+		const JsonValue &thickness = job["thickness"];
+		readBool(thickness, "enabled", o_params.thickness.enabled);
+		readInt(thickness, "sampleCount", o_params.thickness.sampleCount, o_errors);
+		readFloat(thickness, "minDistance", o_params.thickness.minDistance);
+		readFloat(thickness, "maxDistance", o_params.thickness.maxDistance);
+		readString(thickness, "outputPath", o_params.thickness.outputPath);
+		return o_errors.empty();
+	}
+
+	/// Values the bakers can't run with, the runner only checks the sample count of the texture
+	/// @return False if a value is invalid, o_errors lists them
+	bool validateParameters(const FornosParameters &params, std::string &o_errors)
+	{
+		if (params.shared.texWidth <= 0 || params.shared.texHeight <= 0) addError(o_errors, "texWidth and texHeight must be positive");
+		if (params.shared.supersampling < 1 || params.shared.supersampling > k_maxSupersampling)
+		{
+			addError(o_errors, "supersampling must be from 1 to " + std::to_string(k_maxSupersampling));
+		}
+		if (params.ao.sampleCount <= 0) addError(o_errors, "ao sampleCount must be positive");
+		if (params.bentNormals.sampleCount <= 0) addError(o_errors, "bentNormals sampleCount must be positive");
+		if (params.thickness.sampleCount <= 0) addError(o_errors, "thickness sampleCount must be positive");
+		return o_errors.empty();
+	}
+
+	std::string errorReply(const std::string &id, const std::string &message)
+	{
+		return "{\"id\": " + jsonString(id) + ", \"event\": \"error\", \"message\": " + jsonString(message) + "}";
+	}
+
+	double secondsSince(const std::chrono::steady_clock::time_point &begin)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	/// Bakes a job and writes its replies, the job ends with a done or error reply
+	/// @return False if the client went away
+	bool runJob(FornosRunner &runner, const JsonValue &job, JobConnection &connection)
+	{
+		const std::string id = job["id"].string();
+		FornosParameters params;
+		std::string errors;
+		if (!readParameters(job, params, errors) || !validateParameters(params, errors)) return connection.writeLine(errorReply(id, errors));
+
+		const auto jobBegin = std::chrono::steady_clock::now();
+		if (!runner.start(params, errors)) return connection.writeLine(errorReply(id, errors));
+
+		bool connected = true;
+		auto lastProgress = std::chrono::steady_clock::now();
+		while (runner.pending())
+		{
+			const size_t taskCount = runner.taskCount();
+			runner.run();
+			const FornosTask *task = runner.currentTask();
+			const bool finished = runner.taskCount() < taskCount;
+			if (connected && task && (finished || secondsSince(lastProgress) >= k_progressInterval))
+			{
+				std::ostringstream reply;
+				reply << "{\"id\": " << jsonString(id) << ", \"event\": \"progress\", \"task\": " << jsonString(task->name())
+					<< ", \"progress\": " << task->progress() << ", \"tasksLeft\": " << runner.taskCount() << "}";
+				connected = connection.writeLine(reply.str());
+				lastProgress = std::chrono::steady_clock::now();
+			}
+		}
+
+		// The loading stages fail after start
+		if (!runner.errors().empty()) return connected && connection.writeLine(errorReply(id, runner.errors()));
+
+		// Tasks run at the same time on the workers, their times overlap
+		std::ostringstream stages;
+		const char *separator = "";
+		stages << "[";
+		for (const TaskTiming &timing : runner.taskTimings())
+		{
+			stages << separator << "{\"name\": " << jsonString(timing.name) << ", \"seconds\": " << timing.seconds
+				<< ", \"exportSeconds\": " << timing.exportSeconds << "}";
+			separator = ", ";
+		}
+		stages << "]";
+
+		std::ostringstream reply;
+		reply << "{\"id\": " << jsonString(id) << ", \"event\": \"done\", \"seconds\": " << secondsSince(jobBegin)
+			<< ", \"stages\": " << stages.str() << "}";
+		logDebug("Server", "Job " + id + " baked in " + std::to_string(secondsSince(jobBegin)) + " seconds");
+		return connected && connection.writeLine(reply.str());
+	}
+}
+
+bool runBakeServer(const BakeServerParameters &params)
+{
+	JobListener listener;
+	if (!listener.listen(params.socketPath))
+	{
+		logError("Server", "Cannot listen to " + params.socketPath);
+		return false;
+	}
+	logDebug("Server", "Waiting for bake jobs at " + params.socketPath);
+
+	FornosRunner runner;
+	runner.setSessionCount(params.sessionCount);
+	runner.setStatsOutputPath(params.statsOutputPath);
+	runner.setTraceOutputPath(params.traceOutputPath);
+	runner.setMappingCacheDir(params.mappingCacheDir);
+	bool running = true;
+	while (running)
+	{
+		JobConnection connection;
+		if (!listener.accept(connection))
+		{
+			logError("Server", "Cannot accept a client at " + params.socketPath);
+			break;
+		}
+
+		std::string line;
+		while (running && connection.readLine(line))
+		{
+			if (line.find_first_not_of(" \t") == std::string::npos) continue;
+			JsonValue job;
+			if (!JsonValue::parse(line.data(), line.data() + line.size(), job) || !job.isObject())
+			{
+				if (!connection.writeLine(errorReply("", "A job has to be a JSON object in a single line"))) break;
+				continue;
+			}
+			if (job["shutdown"].boolean())
+			{
+				connection.writeLine("{\"id\": " + jsonString(job["id"].string()) + ", \"event\": \"shutdown\"}");
+				running = false;
+				break;
+			}
+			if (!runJob(runner, job, connection)) break;
+		}
+	}
+
+	runner.releaseSessions();
+	logDebug("Server", "Shut down");
+	return true;
+}
+
+bool submitBakeJobs(const std::string &socketPath, const std::string &jobsPath)
+{
+	std::ifstream jobs(jobsPath);
+	if (!jobs)
+	{
+		logError("Server", "Cannot read the jobs of " + jobsPath);
+		return false;
+	}
+
+	JobConnection connection;
+	if (!connection.connect(socketPath))
+	{
+		logError("Server", "Cannot connect to a bake server at " + socketPath);
+		return false;
+	}
+
+	// Jobs are sent one at a time, every job ends with its done or error reply
+	bool ok = true;
+	std::string job;
+	while (std::getline(jobs, job))
+	{
+		if (job.find_first_not_of(" \t\r") == std::string::npos) continue;
+		if (!connection.writeLine(job)) return false;
+
+		std::string reply;
+		for (;;)
+		{
+			if (!connection.readLine(reply)) return false;
+			printf("%s\n", reply.c_str());
+			fflush(stdout);
+			JsonValue event;
+			JsonValue::parse(reply.data(), reply.data() + reply.size(), event);
+			const std::string &type = event["event"].string();
+			if (type == "error") ok = false;
+			if (type != "progress") break;
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,46 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+struct BakeServerParameters
+{
+	std::string socketPath; // Unix domain socket, or named pipe (\\.\pipe\NAME) on Windows
+	size_t sessionCount = 4; // Bakes whose meshes, BVH and mapping are kept for the next jobs
+	std::string statsOutputPath; // See FornosRunner
+	std::string traceOutputPath;
+	std::string mappingCacheDir;
+};
+
+/// Runs the bake jobs sent to a local socket, one after another, until a shutdown job.
+/// Clients write a job per line: a JSON object with the FornosParameters fields and an optional id,
+/// and read a JSON reply per line: progress events while baking and a done or error event per job.
+/// Requires a current OpenGL context, shader programs and the kept meshes are reused by the next jobs.
+/// @return False if the socket can't be opened
+bool runBakeServer(const BakeServerParameters &params);
+
+/// Sends the jobs of a file (one JSON object per line) to a bake server and prints its replies
+/// @return False if the server can't be reached or any of the jobs failed
+bool submitBakeJobs(const std::string &socketPath, const std::string &jobsPath);
@@ -0,0 +1,481 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "benchmark.h"
+#include "bvh.h"
+#include "compute.h"
+#include "fornos.h"
+#include "gpustats.h"
+#include "json.h"
+#include "logging.h"
+#include "math.h"
+#include "mesh.h"
+#include "meshmapping.h"
+#include "profiler.h"
+#include "timing.h"
+
+#include "solver_ao.h"
+#include "solver_bentnormals.h"
+#include "solver_height.h"
+#include "solver_normals.h"
+#include "solver_position.h"
+#include "solver_thickness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+
+namespace
+{
+	//
+	// Deterministic procedural geometry
+	//
+
+	uint32_t hash3(int32_t x, int32_t y, int32_t z)
+	{
+		uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		return h;
+	}
+
+	float hashFloat(int32_t x, int32_t y, int32_t z)
+	{
+		return (float)(hash3(x, y, z) & 0xFFFFFF) / (float)0xFFFFFF * 2.0f - 1.0f;
+	}
+
+	float valueNoise(const Vector3 &p)
+	{
+		const float fx = std::floor(p.x), fy = std::floor(p.y), fz = std::floor(p.z);
+		const int32_t ix = (int32_t)fx, iy = (int32_t)fy, iz = (int32_t)fz;
+		auto smooth = [](float t) { return t * t * (3.0f - 2.0f * t); };
+		const float tx = smooth(p.x - fx), ty = smooth(p.y - fy), tz = smooth(p.z - fz);
+		auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+		float layers[2];
+		for (int z = 0; z < 2; ++z)
+		{
+			const float a = lerp(hashFloat(ix, iy, iz + z), hashFloat(ix + 1, iy, iz + z), tx);
+			const float b = lerp(hashFloat(ix, iy + 1, iz + z), hashFloat(ix + 1, iy + 1, iz + z), tx);
+			layers[z] = lerp(a, b, ty);
+		}
+		return lerp(layers[0], layers[1], tz);
+	}
+
+	float fbm(Vector3 p, int octaves)
+	{
+		float res = 0.0f;
+		float amplitude = 0.5f;
+		for (int i = 0; i < octaves; ++i)
+		{
+			res += valueNoise(p) * amplitude;
+			p = p * 2.03f;
+			amplitude *= 0.5f;
+		}
+		return res;
+	}
+
+	typedef std::function<void(float u, float v, size_t i, size_t j, Vector3 &o_p, Vector3 &o_n)> GridFunction;
+
+	/// Writes a (rows x cols) quad grid as a Wavefront OBJ file.
+	/// With poles the first and last rows collapse to a point and their degenerate triangles are skipped.
+	bool writeGridObj(const std::string &path, size_t rows, size_t cols, bool poles, bool attributes, const GridFunction &fn)
+	{
+		FILE *f = fopen(path.c_str(), "wb");
+		if (!f) return false;
+		std::vector<char> buffer(1 << 20);
+		setvbuf(f, &buffer[0], _IOFBF, buffer.size());
+
+		for (size_t i = 0; i <= rows; ++i)
+		{
+			const float v = (float)i / (float)rows;
+			for (size_t j = 0; j <= cols; ++j)
+			{
+				const float u = (float)j / (float)cols;
+				Vector3 p, n;
+				fn(u, v, i, j, p, n);
+				fprintf(f, "v %.6f %.6f %.6f\n", p.x, p.y, p.z);
+				if (attributes)
+				{
+					fprintf(f, "vt %.6f %.6f\nvn %.6f %.6f %.6f\n", u, 1.0f - v, n.x, n.y, n.z);
+				}
+			}
+		}
+
+		// Counter-clockwise seen from the side the u x v cross product points to
+		const char *format = attributes ? "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n" : "f %zu %zu %zu\n";
+		auto face = [&](size_t a, size_t b, size_t c)
+		{
+			if (attributes) fprintf(f, format, a, a, a, b, b, b, c, c, c);
+			else fprintf(f, format, a, b, c);
+		};
+		for (size_t i = 0; i < rows; ++i)
+		{
+			for (size_t j = 0; j < cols; ++j)
+			{
+				const size_t a = i * (cols + 1) + j + 1; // OBJ indices are 1 based
+				const size_t b = a + 1;
+				const size_t c = a + cols + 1;
+				const size_t d = c + 1;
+				if (!poles || i > 0) face(a, b, c);
+				if (!poles || i + 1 < rows) face(b, d, c);
+			}
+		}
+
+		const bool ok = ferror(f) == 0;
+		fclose(f);
+		return ok;
+	}
+
+	Vector3 spherePoint(float u, float v)
+	{
+		const float phi = (float)(2.0 * PI) * u;
+		const float theta = (float)PI * v;
+		return Vector3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+	}
+
+	/// Writes the hi-poly and low-poly pair of a benchmark mesh
+	bool generateMeshes(const std::string &name, size_t triangleCount, const std::string &hiPath, const std::string &loPath)
+	{
+		if (name == "sphere")
+		{
+			// Latitude-longitude sphere with cols = 2 * rows: 4 * rows * (rows - 1) triangles
+			const size_t rows = std::max<size_t>(2, (size_t)std::sqrt((double)triangleCount / 4.0));
+			const bool hi = writeGridObj(hiPath, rows, rows * 2, true, false,
+				[](float u, float v, size_t, size_t, Vector3 &o_p, Vector3 &)
+			{
+				const Vector3 n = spherePoint(u, v);
+				o_p = n * (1.0f + 0.08f * fbm(n * 4.0f + Vector3(10.0f), 6));
+			});
+			const bool lo = writeGridObj(loPath, 32, 64, true, true,
+				[](float u, float v, size_t, size_t, Vector3 &o_p, Vector3 &o_n)
+			{
+				o_n = spherePoint(u, v);
+				o_p = o_n;
+			});
+			return hi && lo;
+		}
+
+		if (name == "terrain" || name == "slivers")
+		{
+			// Terrain: square cells, 2 * n^2 triangles
+			// Slivers: 64:1 cells with scanner-like noise, 128 * n^2 triangles
+			const bool slivers = name == "slivers";
+			const size_t aspect = slivers ? 64 : 1;
+			const size_t rows = std::max<size_t>(1, (size_t)std::sqrt((double)triangleCount / (2.0 * aspect)));
+			const bool hi = writeGridObj(hiPath, rows, rows * aspect, false, false,
+				[slivers](float u, float v, size_t i, size_t j, Vector3 &o_p, Vector3 &)
+			{
+				const Vector3 p(u * 2.0f - 1.0f, 0.0f, 1.0f - v * 2.0f);
+				float h = 0.15f * fbm(p * 3.0f + Vector3(3.0f), slivers ? 3 : 8);
+				if (slivers) h += 0.002f * hashFloat((int32_t)i, (int32_t)j, 7);
+				o_p = Vector3(p.x, h, p.z);
+			});
+			const bool lo = writeGridObj(loPath, 64, 64, false, true,
+				[](float u, float v, size_t, size_t, Vector3 &o_p, Vector3 &o_n)
+			{
+				o_p = Vector3(u * 2.0f - 1.0f, 0.0f, 1.0f - v * 2.0f);
+				o_n = Vector3(0.0f, 1.0f, 0.0f);
+			});
+			return hi && lo;
+		}
+
+		logError("Bench", "Unknown benchmark mesh " + name);
+		return false;
+	}
+
+	//
+	// Results
+	//
+
+	struct StageResult
+	{
+		std::string mesh;
+		size_t triangles;
+		std::string stage;
+		double seconds;
+		size_t rays;
+		size_t startMemory; // Resident memory of the process when the stage starts and ends
+		size_t endMemory;
+		size_t processPeakMemory; // Peak resident memory of the process so far, not of the stage
+	};
+
+	size_t totalRayCount()
+	{
+		size_t rays = 0;
+		for (const auto &stage : gpuStatsCollect()) rays += stage.rayCount;
+		return rays;
+	}
+
+	class StageTimer
+	{
+	public:
+		StageTimer(std::vector<StageResult> &results, const std::string &mesh, size_t triangles, const char *stage)
+			: _results(results), _mesh(mesh), _triangles(triangles), _stage(stage), _rays(totalRayCount())
+			, _memory(profilerMemoryUsage())
+		{
+			_timing.begin();
+		}
+
+		~StageTimer()
+		{
+			glFinish(); // GPU stages are not done until the queue is empty
+			_timing.end();
+			StageResult r;
+			r.mesh = _mesh;
+			r.triangles = _triangles;
+			r.stage = _stage;
+			r.seconds = _timing.elapsedSeconds();
+			r.rays = totalRayCount() - _rays;
+			r.startMemory = _memory;
+			r.endMemory = profilerMemoryUsage();
+			r.processPeakMemory = profilerPeakMemoryUsage();
+			_results.push_back(r);
+
+			char line[256];
+			snprintf(line, sizeof(line), "%-8s %10zu %-22s %10.3f s", _mesh.c_str(), _triangles, _stage, r.seconds);
+			std::string str = line;
+			if (r.rays > 0 && r.seconds > 0.0)
+			{
+				snprintf(line, sizeof(line), " %10.2f MRays/s", (double)r.rays / r.seconds / 1000000.0);
+				str += line;
+			}
+			logDebug("Bench", str);
+		}
+
+	private:
+		std::vector<StageResult> &_results;
+		std::string _mesh;
+		size_t _triangles;
+		const char *_stage;
+		size_t _rays;
+		size_t _memory;
+		Timing _timing;
+	};
+
+	/// Solves a task to completion and exports its result, timing both separately
+	void benchmarkTask(std::vector<StageResult> &results, const std::string &mesh, size_t triangles, const char *stage, const char *exportStage, FornosTask *task)
+	{
+		{
+			StageTimer timer(results, mesh, triangles, stage);
+			while (!task->runStep()) {}
+			task->finish(); // Reads the results back
+		}
+		{
+			StageTimer timer(results, mesh, triangles, exportStage);
+			task->exportResults();
+		}
+		delete task;
+	}
+
+	bool benchmarkMesh(std::vector<StageResult> &results, const BenchmarkParameters &params, const std::string &name, size_t triangleCount)
+	{
+		const std::string prefix = params.workDir + "/bench_" + name + "_" + std::to_string(triangleCount);
+		const std::string hiPath = prefix + "_hi.obj";
+		const std::string loPath = prefix + "_lo.obj";
+
+		{
+			StageTimer timer(results, name, triangleCount, "generate");
+			if (!generateMeshes(name, triangleCount, hiPath, loPath))
+			{
+				logError("Bench", "Cannot write the benchmark meshes to " + params.workDir);
+				return false;
+			}
+		}
+
+		std::shared_ptr<Mesh> hiPolyMesh;
+		std::shared_ptr<Mesh> lowPolyMesh;
+		{
+			StageTimer timer(results, name, triangleCount, "load");
+			hiPolyMesh = std::shared_ptr<Mesh>(Mesh::loadFile(hiPath.c_str()));
+			lowPolyMesh = std::shared_ptr<Mesh>(Mesh::loadFile(loPath.c_str()));
+		}
+		std::remove(hiPath.c_str());
+		std::remove(loPath.c_str());
+		if (!hiPolyMesh || !lowPolyMesh)
+		{
+			logError("Bench", "Cannot load the benchmark meshes");
+			return false;
+		}
+		// Results are grouped by the requested size, the generators only get close to it
+		const size_t triangles = triangleCount;
+		logDebug("Bench", "Hi-poly mesh has " + std::to_string(hiPolyMesh->triangles.size()) + " triangles");
+
+		{
+			StageTimer timer(results, name, triangles, "normals/tangents");
+			hiPolyMesh->computeVertexNormals();
+			lowPolyMesh->computeTangentSpace();
+		}
+
+		std::shared_ptr<CompressedMapUV> compressedMap;
+		{
+			StageTimer timer(results, name, triangles, "rasterization");
+			compressedMap = std::shared_ptr<CompressedMapUV>(CompressedMapUV::fromMesh(lowPolyMesh.get(), params.texSize, params.texSize));
+			if (!compressedMap) return false;
+		}
+
+		std::shared_ptr<BVH> rootBVH;
+		{
+			StageTimer timer(results, name, triangles, "bvh");
+			const FornosParameters_Shared shared;
+			rootBVH = std::shared_ptr<BVH>(BVH::createBinary(hiPolyMesh.get(), shared.bvhTrisPerNode, 8192));
+		}
+
+		std::shared_ptr<MeshMapping> meshMapping(new MeshMapping());
+		{
+			StageTimer timer(results, name, triangles, "upload");
+			meshMapping->init(compressedMap, hiPolyMesh, rootBVH, true);
+		}
+		{
+			StageTimer timer(results, name, triangles, "mapping");
+			while (!meshMapping->runStep()) {}
+		}
+
+		const int dilation = FornosParameters_Shared().texDilation;
+
+		{
+			HeightSolver::Params solverParams;
+			solverParams.normalizeOutput = true;
+			solverParams.maxDistance = 0.0f;
+			std::unique_ptr<HeightSolver> solver(new HeightSolver(solverParams));
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "height", "height export",
+				new HeightTask(std::move(solver), (prefix + "_height.png").c_str(), dilation));
+		}
+
+		{
+			std::unique_ptr<PositionSolver> solver(new PositionSolver());
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "position", "position export",
+				new PositionTask(std::move(solver), (prefix + "_position.exr").c_str()));
+		}
+
+		{
+			NormalsSolver::Params solverParams;
+			solverParams.tangentSpace = true;
+			std::unique_ptr<NormalsSolver> solver(new NormalsSolver(solverParams));
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "normals", "normals export",
+				new NormalsTask(std::move(solver), (prefix + "_normals.png").c_str(), dilation));
+		}
+
+		{
+			const FornosParameters_SolverAO defaults;
+			AmbientOcclusionSolver::Params solverParams;
+			solverParams.sampleCount = params.sampleCount;
+			solverParams.minDistance = defaults.minDistance;
+			solverParams.maxDistance = defaults.maxDistance;
+			std::unique_ptr<AmbientOcclusionSolver> solver(new AmbientOcclusionSolver(solverParams));
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "ao", "ao export",
+				new AmbientOcclusionTask(std::move(solver), (prefix + "_ao.png").c_str(), dilation));
+		}
+
+		{
+			const FornosParameters_SolverBentNormals defaults;
+			BentNormalsSolver::Params solverParams;
+			solverParams.sampleCount = params.sampleCount;
+			solverParams.minDistance = defaults.minDistance;
+			solverParams.maxDistance = defaults.maxDistance;
+			solverParams.tangentSpace = true;
+			std::unique_ptr<BentNormalsSolver> solver(new BentNormalsSolver(solverParams));
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "bent normals", "bent normals export",
+				new BentNormalsTask(std::move(solver), (prefix + "_bentnormals.png").c_str(), dilation));
+		}
+
+		{
+			const FornosParameters_SolverThickness defaults;
+			ThicknessSolver::Params solverParams;
+			solverParams.sampleCount = params.sampleCount;
+			solverParams.minDistance = defaults.minDistance;
+			solverParams.maxDistance = defaults.maxDistance;
+			std::unique_ptr<ThicknessSolver> solver(new ThicknessSolver(solverParams));
+			solver->init(compressedMap, meshMapping);
+			benchmarkTask(results, name, triangles, "thickness", "thickness export",
+				new ThicknessTask(std::move(solver), (prefix + "_thickness.png").c_str(), dilation));
+		}
+
+		return true;
+	}
+
+	std::string resultsToJson(const BenchmarkParameters &params, const std::vector<StageResult> &results)
+	{
+		std::ostringstream ss;
+		ss << "{\n\t\"texture_size\": " << params.texSize
+			<< ",\n\t\"sample_count\": " << params.sampleCount
+			<< ",\n\t\"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const auto &r = results[i];
+			ss << "\t\t{ \"mesh\": " << jsonString(r.mesh)
+				<< ", \"triangles\": " << r.triangles
+				<< ", \"stage\": " << jsonString(r.stage)
+				<< ", \"seconds\": " << r.seconds
+				<< ", \"rays\": " << r.rays
+				<< ", \"rays_per_second\": " << (r.seconds > 0.0 ? (double)r.rays / r.seconds : 0.0)
+				<< ", \"rss_bytes\": " << r.endMemory
+				<< ", \"rss_delta_bytes\": " << ((int64_t)r.endMemory - (int64_t)r.startMemory)
+				<< ", \"process_peak_rss_bytes\": " << r.processPeakMemory
+				<< " }" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		ss << "\t]\n}\n";
+		return ss.str();
+	}
+}
+
+bool runBenchmark(const BenchmarkParameters &params)
+{
+	gpuStatsReset();
+
+	bool ok = true;
+	std::vector<StageResult> results;
+	for (const auto &name : params.meshes)
+	{
+		for (size_t triangleCount : params.triangleCounts)
+		{
+			logDebug("Bench", "Benchmarking " + name + " with " + std::to_string(triangleCount) + " triangles");
+			ok = benchmarkMesh(results, params, name, triangleCount) && ok;
+		}
+	}
+
+	const std::string json = resultsToJson(params, results);
+	if (params.outputPath.empty())
+	{
+		fputs(json.c_str(), stdout);
+	}
+	else
+	{
+		std::ofstream ofs(params.outputPath);
+		ofs << json;
+		if (!ofs)
+		{
+			logError("Bench", "Cannot write benchmark results to " + params.outputPath);
+			ok = false;
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct BenchmarkParameters
+{
+	std::vector<size_t> triangleCounts = { 1000000, 10000000, 50000000 };
+	std::vector<std::string> meshes = { "sphere", "terrain", "slivers" };
+	int texSize = 2048;
+	int sampleCount = 64;
+	std::string workDir = "."; // Generated meshes and baked images go here
+	std::string outputPath; // JSON results, stdout if empty
+};
+
+/// Bakes deterministic procedural hi/low-poly pairs and times every pipeline stage.
+/// Requires a current OpenGL context.
+/// @return False if any of the stages failed
+bool runBenchmark(const BenchmarkParameters &params);
@@ -21,8 +21,10 @@ SOFTWARE.
 */
 
 #include "bvh.h"
+#include "compactmesh.h"
 #include "logging.h"
 #include "mesh.h"
+#include "profiler.h"
 #include "timing.h"
 #include <cassert>
 
@@ -125,17 +127,73 @@ inline BucketSplit selectSplitFromBuckets(const uint32_t buckets[16], const Buck
 #endif
 }
 
-SplitResult findBestSplit(const Mesh *mesh, const BVH &parent)
+inline void trianglePositions(const Mesh *mesh, uint32_t tidx, Vector3 &p0, Vector3 &p1, Vector3 &p2)
+{
+	const Mesh::Triangle &tri = mesh->triangles[tidx];
+	p0 = mesh->positions[mesh->vertices[tri.vertexIndex0].positionIndex];
+	p1 = mesh->positions[mesh->vertices[tri.vertexIndex1].positionIndex];
+	p2 = mesh->positions[mesh->vertices[tri.vertexIndex2].positionIndex];
+}
+
+inline void trianglePositions(const CompactMesh *mesh, uint32_t tidx, Vector3 &p0, Vector3 &p1, Vector3 &p2)
+{
+	p0 = mesh->position(mesh->positionIndex(tidx, 0));
+	p1 = mesh->position(mesh->positionIndex(tidx, 1));
+	p2 = mesh->position(mesh->positionIndex(tidx, 2));
+}
+
+// Boxes are given as a degenerate triangle: both corners and the center, so the centroid is the center
+inline void trianglePositions(const std::vector<AABB> *boxes, uint32_t idx, Vector3 &p0, Vector3 &p1, Vector3 &p2)
+{
+	const AABB &box = (*boxes)[idx];
+	p0 = box.center - box.size;
+	p1 = box.center + box.size;
+	p2 = box.center;
+}
+
+inline size_t triangleCount(const Mesh *mesh) { return mesh->triangles.size(); }
+inline size_t triangleCount(const CompactMesh *mesh) { return mesh->triangleCount(); }
+inline size_t triangleCount(const std::vector<AABB> *boxes) { return boxes->size(); }
+
+inline void meshBounds(const Mesh *mesh, Vector3 &mins, Vector3 &maxs)
+{
+	for (size_t i = 0; i < mesh->positions.size(); ++i)
+	{
+		const Vector3 p = mesh->positions[i];
+		mins = min(mins, p);
+		maxs = max(maxs, p);
+	}
+}
+
+inline void meshBounds(const CompactMesh *mesh, Vector3 &mins, Vector3 &maxs)
+{
+	for (size_t i = 0; i < mesh->positions.size(); ++i)
+	{
+		const Vector3 p = mesh->position((uint32_t)i);
+		mins = min(mins, p);
+		maxs = max(maxs, p);
+	}
+}
+
+inline void meshBounds(const std::vector<AABB> *boxes, Vector3 &mins, Vector3 &maxs)
+{
+	for (const AABB &box : *boxes)
+	{
+		mins = min(mins, box.center - box.size);
+		maxs = max(maxs, box.center + box.size);
+	}
+}
+
+template <typename MeshT>
+SplitResult findBestSplit(const MeshT *mesh, const BVH &parent)
 {
 	SplitResult ret;
 
 	BucketAABB centroiddsAABB;
 	for (uint32_t tidx : parent.triangles)
 	{
-		const Mesh::Triangle &tri = mesh->triangles[tidx];
-		const Vector3 p0 = mesh->positions[mesh->vertices[tri.vertexIndex0].positionIndex];
-		const Vector3 p1 = mesh->positions[mesh->vertices[tri.vertexIndex1].positionIndex];
-		const Vector3 p2 = mesh->positions[mesh->vertices[tri.vertexIndex2].positionIndex];
+		Vector3 p0, p1, p2;
+		trianglePositions(mesh, tidx, p0, p1, p2);
 		const Vector3 centroid = (p0 + p1 + p2) / 3.0f;
 		centroiddsAABB.addPoint(centroid);
 	}
@@ -149,10 +207,8 @@ SplitResult findBestSplit(const Mesh *mesh, const BVH &parent)
 
 	for (uint32_t tidx : parent.triangles)
 	{
-		const Mesh::Triangle &tri = mesh->triangles[tidx];
-		const Vector3 p0 = mesh->positions[mesh->vertices[tri.vertexIndex0].positionIndex];
-		const Vector3 p1 = mesh->positions[mesh->vertices[tri.vertexIndex1].positionIndex];
-		const Vector3 p2 = mesh->positions[mesh->vertices[tri.vertexIndex2].positionIndex];
+		Vector3 p0, p1, p2;
+		trianglePositions(mesh, tidx, p0, p1, p2);
 		const Vector3 centroid = (p0 + p1 + p2) / 3.0f;
 
 		const Vector3 ijk = (centroid - centroiddsAABB.minv) / (centroiddsAABB.maxv - centroiddsAABB.minv) * 15.99f;
@@ -202,7 +258,8 @@ SplitResult findBestSplit(const Mesh *mesh, const BVH &parent)
 	return ret;
 }
 
-void binaryDivisionBVH(const Mesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth, BVH &parent, const size_t currentDepth)
+template <typename MeshT>
+void binaryDivisionBVH(const MeshT *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth, BVH &parent, const size_t currentDepth)
 {
 	if (parent.triangles.size() <= maxTriangleCount ||
 		currentDepth >= maxTreeDepth)
@@ -220,10 +277,8 @@ void binaryDivisionBVH(const Mesh *mesh, const size_t maxTriangleCount, const si
 
 	for (uint32_t tidx : parent.triangles)
 	{
-		const Mesh::Triangle &tri = mesh->triangles[tidx];
-		const Vector3 p0 = mesh->positions[mesh->vertices[tri.vertexIndex0].positionIndex];
-		const Vector3 p1 = mesh->positions[mesh->vertices[tri.vertexIndex1].positionIndex];
-		const Vector3 p2 = mesh->positions[mesh->vertices[tri.vertexIndex2].positionIndex];
+		Vector3 p0, p1, p2;
+		trianglePositions(mesh, tidx, p0, p1, p2);
 		const Vector3 c = (p0 + p1 + p2) * (1.0f / 3.0f);
 
 		const bool left =
@@ -280,30 +335,35 @@ void binaryDivisionBVH(const Mesh *mesh, const size_t maxTriangleCount, const si
 		parent.children[1].subtreeTriangleCount;
 }
 
-BVH* BVH::createBinary(const Mesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth)
+// The triangles are all the mesh triangles or a subset of them, never repeated
+template <typename MeshT>
+BVH* createBinaryBVH(const MeshT *mesh, std::vector<uint32_t> triangles, const size_t maxTriangleCount, const size_t maxTreeDepth)
 {
+	PROFILE_ZONE("BVH::createBinary");
 	Timing timing;
 	timing.begin();
 
 	Vector3 mins(FLT_MAX);
 	Vector3 maxs(-FLT_MAX);
-	for (size_t i = 0; i < mesh->positions.size(); ++i)
+	if (triangles.size() == triangleCount(mesh))
 	{
-		const Vector3 p = mesh->positions[i];
-		mins = min(mins, p);
-		maxs = max(maxs, p);
+		meshBounds(mesh, mins, maxs);
+	}
+	else
+	{
+		for (uint32_t tidx : triangles)
+		{
+			Vector3 p0, p1, p2;
+			trianglePositions(mesh, tidx, p0, p1, p2);
+			mins = min(mins, min(p0, min(p1, p2)));
+			maxs = max(maxs, max(p0, max(p1, p2)));
+		}
 	}
 
 	BVH *bvh = new BVH();
 	bvh->aabb.center = (maxs + mins) * 0.5f;
 	bvh->aabb.size = (maxs - mins) * 0.5f;
-
-	const size_t count = mesh->triangles.size();
-	bvh->triangles.resize(count);
-	for (size_t i = 0; i < count; ++i)
-	{
-		bvh->triangles[i] = (uint32_t)i;
-	}
+	bvh->triangles.swap(triangles);
 
 	binaryDivisionBVH(mesh, maxTriangleCount, maxTreeDepth, *bvh, 0);
 
@@ -311,4 +371,39 @@ BVH* BVH::createBinary(const Mesh *mesh, const size_t maxTriangleCount, const si
 	logDebug("BVH", "BHV Creation took " + std::to_string(timing.elapsedSeconds()) + " seconds.");
 
 	return bvh;
-}
\ No newline at end of file
+}
+
+inline std::vector<uint32_t> triangleRange(size_t firstTriangle, size_t count)
+{
+	std::vector<uint32_t> triangles(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		triangles[i] = (uint32_t)(firstTriangle + i);
+	}
+	return triangles;
+}
+
+BVH* BVH::createBinary(const Mesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth)
+{
+	return createBinaryBVH(mesh, triangleRange(0, mesh->triangles.size()), maxTriangleCount, maxTreeDepth);
+}
+
+BVH* BVH::createBinary(const CompactMesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth)
+{
+	return createBinaryBVH(mesh, triangleRange(0, mesh->triangleCount()), maxTriangleCount, maxTreeDepth);
+}
+
+BVH* BVH::createBinary(const Mesh *mesh, const size_t firstTriangle, const size_t triangleCount, const size_t maxTriangleCount, const size_t maxTreeDepth)
+{
+	return createBinaryBVH(mesh, triangleRange(firstTriangle, triangleCount), maxTriangleCount, maxTreeDepth);
+}
+
+BVH* BVH::createBinary(const Mesh *mesh, const std::vector<uint32_t> &triangles, const size_t maxTriangleCount, const size_t maxTreeDepth)
+{
+	return createBinaryBVH(mesh, triangles, maxTriangleCount, maxTreeDepth);
+}
+
+BVH* BVH::createBinary(const std::vector<AABB> &boxes, const size_t maxBoxCount, const size_t maxTreeDepth)
+{
+	return createBinaryBVH(&boxes, triangleRange(0, boxes.size()), maxBoxCount, maxTreeDepth);
+}
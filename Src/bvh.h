@@ -26,6 +26,7 @@ SOFTWARE.
 #include <vector>
 #include <cstdint>
 
+class CompactMesh;
 class Mesh;
 
 /// Bounding Volume Hierarchy node
@@ -44,4 +45,14 @@ public:
 	/// @param maxTriangleCount Maximum number of triangles in a leaf node
 	/// @param maxTreeDepth Maximum depth of the tree (useful for stack based algorithms)
 	static BVH* createBinary(const Mesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth);
+	static BVH* createBinary(const CompactMesh *mesh, const size_t maxTriangleCount, const size_t maxTreeDepth);
+
+	/// Builds a bounding volume hierarchy for a range of the mesh triangles
+	static BVH* createBinary(const Mesh *mesh, const size_t firstTriangle, const size_t triangleCount, const size_t maxTriangleCount, const size_t maxTreeDepth);
+
+	/// Builds a bounding volume hierarchy for a subset of the mesh triangles
+	static BVH* createBinary(const Mesh *mesh, const std::vector<uint32_t> &triangles, const size_t maxTriangleCount, const size_t maxTreeDepth);
+
+	/// Builds a bounding volume hierarchy of boxes, the nodes list box indices instead of triangles
+	static BVH* createBinary(const std::vector<AABB> &boxes, const size_t maxBoxCount, const size_t maxTreeDepth);
 };
\ No newline at end of file
@@ -0,0 +1,218 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "compactmesh.h"
+#include "logging.h"
+#include "mesh.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	uint64_t quantize(float value, float invScale, uint64_t maxValue)
+	{
+		const float q = std::floor(value * invScale + 0.5f);
+		if (!(q > 0.0f)) return 0;
+		return q >= (float)maxValue ? maxValue : (uint64_t)q;
+	}
+
+	uint32_t packSnorm16(float value)
+	{
+		const float v = std::fmaxf(-1.0f, std::fminf(1.0f, value));
+		return (uint32_t)(uint16_t)(int16_t)std::lround(v * 32767.0f);
+	}
+
+	// Octahedral encoding, the lower half of the octahedron is folded over the upper one.
+	// Zero length normals decode as (0, 0, 1).
+	uint32_t encodeNormal(const Vector3 &n)
+	{
+		const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (!(l1 > 0.0f)) return 0;
+		float x = n.x / l1;
+		float y = n.y / l1;
+		if (n.z < 0.0f)
+		{
+			const float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = fx;
+			y = fy;
+		}
+		return packSnorm16(x) | (packSnorm16(y) << 16);
+	}
+
+	// Gathers the geometry of a mesh, the positions stay as floats until the bounds are known.
+	// The corner indices are only stored once a corner doesn't have the position or the normal of its index.
+	class CompactMeshBuilder : public MeshGeometrySink
+	{
+	public:
+		void reserve(size_t positionCount, size_t normalCount, size_t triangleCount)
+		{
+			_positions.resize(positionCount);
+			_normals.resize(normalCount);
+			_cornerCountHint = triangleCount * 3;
+		}
+
+		// Positions and normals can be set from several threads
+		void position(size_t index, const Vector3 &position)
+		{
+			assert(index < _positions.size());
+			_positions[index] = position;
+		}
+
+		void normal(size_t index, const Vector3 &normal)
+		{
+			assert(index < _normals.size());
+			_normals[index] = encodeNormal(normal);
+		}
+
+		void triangle(const uint32_t positions[3], const uint32_t normals[3])
+		{
+			for (int c = 0; c < 3; ++c) addCorner(positions[c], normals[c]);
+		}
+
+		CompactMesh* build()
+		{
+			PROFILE_ZONE("CompactMesh::build");
+			if (_cornerCount == 0) _positions.clear(); // Nothing to trace
+			if (_ownPositions && _positions.size() != _cornerCount) storePositionIndices();
+
+			Vector3 mins(FLT_MAX);
+			Vector3 maxs(-FLT_MAX);
+			for (const auto &p : _positions)
+			{
+				mins = min(mins, p);
+				maxs = max(maxs, p);
+			}
+
+			const uint64_t maxValue = (uint64_t(1) << CompactMesh::k_positionBits) - 1;
+			CompactMesh *compact = new CompactMesh();
+			compact->origin = _positions.empty() ? Vector3() : mins;
+			compact->scale = _positions.empty() ? Vector3() : (maxs - mins) * (1.0f / (float)maxValue);
+			const Vector3 invScale(
+				compact->scale.x > 0.0f ? 1.0f / compact->scale.x : 0.0f,
+				compact->scale.y > 0.0f ? 1.0f / compact->scale.y : 0.0f,
+				compact->scale.z > 0.0f ? 1.0f / compact->scale.z : 0.0f);
+
+			const int positionCount = (int)_positions.size();
+			compact->positions.resize(positionCount);
+#pragma omp parallel for
+			for (int i = 0; i < positionCount; ++i)
+			{
+				const Vector3 p = _positions[i] - compact->origin;
+				compact->positions[i] =
+					quantize(p.x, invScale.x, maxValue) |
+					(quantize(p.y, invScale.y, maxValue) << CompactMesh::k_positionBits) |
+					(quantize(p.z, invScale.z, maxValue) << (2 * CompactMesh::k_positionBits));
+			}
+			_positions = std::vector<Vector3>();
+
+			// The corners without a normal share a zero length one
+			const uint32_t zeroNormal = (uint32_t)_normals.size();
+			bool missingNormals = false;
+			for (auto &n : _normalIndices)
+			{
+				if (n >= zeroNormal)
+				{
+					n = zeroNormal;
+					missingNormals = true;
+				}
+			}
+			if (missingNormals) _normals.push_back(0);
+
+			compact->normals.swap(_normals);
+			compact->indices.swap(_indices);
+			compact->normalIndices.swap(_normalIndices);
+			logDebug("CompactMesh", "Compact mesh takes " + std::to_string(compact->memorySize() / (1024 * 1024)) + " MB" +
+				(compact->indices.empty() ? " (triangle soup)" : ""));
+			return compact;
+		}
+
+	private:
+		void addCorner(uint32_t position, uint32_t normal)
+		{
+			if (_ownPositions && position != _cornerCount) storePositionIndices();
+			if (!_ownPositions) _indices.push_back(position);
+			if (_sharedNormals && normal != position) storeNormalIndices();
+			if (!_sharedNormals) _normalIndices.push_back(normal);
+			++_cornerCount;
+		}
+
+		// Every corner so far had the position of its index
+		void storePositionIndices()
+		{
+			_ownPositions = false;
+			_indices.reserve(std::max(_cornerCountHint, _cornerCount));
+			for (size_t i = 0; i < _cornerCount; ++i) _indices.push_back((uint32_t)i);
+		}
+
+		// Every corner so far had the normal of its position
+		void storeNormalIndices()
+		{
+			_sharedNormals = false;
+			_normalIndices.reserve(std::max(_cornerCountHint, _cornerCount));
+			for (size_t i = 0; i < _cornerCount; ++i) _normalIndices.push_back(_ownPositions ? (uint32_t)i : _indices[i]);
+		}
+
+		std::vector<Vector3> _positions;
+		std::vector<uint32_t> _normals;
+		std::vector<uint32_t> _indices;
+		std::vector<uint32_t> _normalIndices;
+		size_t _cornerCount = 0;
+		size_t _cornerCountHint = 0;
+		bool _ownPositions = true;
+		bool _sharedNormals = true;
+	};
+}
+
+CompactMesh* CompactMesh::create(const Mesh *mesh)
+{
+	PROFILE_ZONE("CompactMesh::create");
+
+	CompactMeshBuilder builder;
+	builder.reserve(mesh->positions.size(), mesh->normals.size(), mesh->triangles.size());
+	const int positionCount = (int)mesh->positions.size();
+#pragma omp parallel for
+	for (int i = 0; i < positionCount; ++i) builder.position(i, mesh->positions[i]);
+	const int normalCount = (int)mesh->normals.size();
+#pragma omp parallel for
+	for (int i = 0; i < normalCount; ++i) builder.normal(i, mesh->normals[i]);
+	for (const auto &tri : mesh->triangles)
+	{
+		const Mesh::Vertex *v[3] = { &mesh->vertices[tri.vertexIndex0], &mesh->vertices[tri.vertexIndex1], &mesh->vertices[tri.vertexIndex2] };
+		const uint32_t positions[3] = { v[0]->positionIndex, v[1]->positionIndex, v[2]->positionIndex };
+		const uint32_t normals[3] = { v[0]->normalIndex, v[1]->normalIndex, v[2]->normalIndex };
+		builder.triangle(positions, normals);
+	}
+	return builder.build();
+}
+
+CompactMesh* CompactMesh::loadFile(const char *path)
+{
+	PROFILE_ZONE("CompactMesh::loadFile");
+
+	CompactMeshBuilder builder;
+	if (!Mesh::readGeometry(path, builder)) return nullptr;
+	return builder.build();
+}
@@ -0,0 +1,82 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include "math.h"
+#include <cstdint>
+#include <vector>
+
+class Mesh;
+
+/// Positions and normals of a mesh, the only data needed to cast rays against it, in a compact form.
+/// Positions are quantized to 21 bits per axis in the mesh bounds and normals are octahedral encoded in
+/// 2x16 bits, each one once however many triangles share it. The triangle corners index them, the indices are
+/// left out when every corner has a position of its own, or when the normals are indexed like the positions.
+class CompactMesh
+{
+public:
+	static const uint32_t k_positionBits = 21;
+
+	Vector3 origin; // Minimum of the mesh bounds
+	Vector3 scale; // Size of a quantization step per axis
+	std::vector<uint64_t> positions; // x | y << 21 | z << 42
+	std::vector<uint32_t> normals; // Octahedral coordinates as two snorm16
+	std::vector<uint32_t> indices; // Position of every triangle corner, empty if the corners are the positions
+	std::vector<uint32_t> normalIndices; // Normal of every triangle corner, empty if it's the position index
+
+	/// Positions and normals of the mesh vertices, the texture coordinates are dropped
+	static CompactMesh* create(const Mesh *mesh);
+
+	/// Straight from a PLY or .fmesh file, without loading a Mesh (see Mesh::readGeometry)
+	/// @return nullptr if the file can't be read
+	static CompactMesh* loadFile(const char *path);
+
+	size_t triangleCount() const { return (indices.empty() ? positions.size() : indices.size()) / 3; }
+
+	uint32_t positionIndex(size_t triangle, size_t corner) const
+	{
+		const size_t i = triangle * 3 + corner;
+		return indices.empty() ? (uint32_t)i : indices[i];
+	}
+
+	uint32_t normalIndex(size_t triangle, size_t corner) const
+	{
+		return normalIndices.empty() ? positionIndex(triangle, corner) : normalIndices[triangle * 3 + corner];
+	}
+
+	Vector3 position(uint32_t index) const
+	{
+		const uint64_t q = positions[index];
+		const uint64_t mask = (uint64_t(1) << k_positionBits) - 1;
+		return origin + Vector3(
+			(float)(q & mask),
+			(float)((q >> k_positionBits) & mask),
+			(float)(q >> (2 * k_positionBits))) * scale;
+	}
+
+	size_t memorySize() const
+	{
+		return positions.size() * sizeof(uint64_t) + normals.size() * sizeof(uint32_t) +
+			indices.size() * sizeof(uint32_t) + normalIndices.size() * sizeof(uint32_t);
+	}
+};
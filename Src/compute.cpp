@@ -26,7 +26,13 @@ SOFTWARE.
 #include "logging.h"
 #include "math.h"
 #include "mesh.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <fstream>
+#include <vector>
+#include <emmintrin.h>
 
 #if DEBUG_EXPORT_DIRECTIONS_MAP
 #include "image.h"
@@ -72,31 +78,486 @@ inline GLuint CreateComputeProgramFromMemory(const char *src)
 
 namespace
 {
-	bool rasterTriangle
+	// Screen tiles rasterized in parallel, in pixels
+	const uint32_t k_rasterTileSize = 64;
+
+	// Inclusive pixel rectangle
+	struct PixelRect
+	{
+		uint32_t xMin;
+		uint32_t yMin;
+		uint32_t xMax;
+		uint32_t yMax;
+	};
+
+	// Map receiving the rasterized pixels, it may only hold the part of the texture starting at (x, y)
+	struct RasterTarget
+	{
+		MapUV *map;
+		uint32_t x;
+		uint32_t y;
+
+		size_t index(uint32_t px, uint32_t py) const
+		{
+			return size_t(py - y) * map->width + (px - x);
+		}
+	};
+
+	// Covered pixels of a tile in row major order
+	struct TileTexels
+	{
+		std::vector<uint32_t> indices; // Index in the full map
+		std::vector<Vector3> positions;
+		std::vector<Vector3> directions;
+		std::vector<Vector3> normals;
+		std::vector<Vector3> tangents;
+		std::vector<Vector3> bitangents;
+		std::vector<size_t> rowStarts; // First texel of each row in the tile, plus the total count
+		std::vector<size_t> rowOffsets; // First texel of each row in the compressed map
+	};
+
+	bool hasMappingAttributes(const Mesh *mesh, const Mesh::Triangle &tri)
+	{
+		const auto &v0 = mesh->vertices[tri.vertexIndex0];
+		const auto &v1 = mesh->vertices[tri.vertexIndex1];
+		const auto &v2 = mesh->vertices[tri.vertexIndex2];
+
+		return v0.texcoordIndex != UINT32_MAX &&
+			v1.texcoordIndex != UINT32_MAX &&
+			v2.texcoordIndex != UINT32_MAX &&
+			v0.normalIndex != UINT32_MAX &&
+			v1.normalIndex != UINT32_MAX &&
+			v2.normalIndex != UINT32_MAX;
+	}
+
+	uint32_t pixelCoord(float f, uint32_t size)
+	{
+		return (uint32_t)std::fminf(std::fmaxf(std::roundf(f), 0.0f), float(size - 1));
+	}
+
+	// Pixels of the map that can be covered by the triangle
+	PixelRect triangleRect
+	(
+		const Vector2 &u0,
+		const Vector2 &u1,
+		const Vector2 &u2,
+		const Vector2 &halfpix,
+		const Vector2 &scale,
+		uint32_t width,
+		uint32_t height
+	)
+	{
+		const Vector2 u01 = (u0 - halfpix) * scale;
+		const Vector2 u11 = (u1 - halfpix) * scale;
+		const Vector2 u21 = (u2 - halfpix) * scale;
+		PixelRect rect;
+		rect.xMin = pixelCoord(std::fminf(u01.x, std::fminf(u11.x, u21.x)), width);
+		rect.yMin = pixelCoord(std::fminf(u01.y, std::fminf(u11.y, u21.y)), height);
+		rect.xMax = pixelCoord(std::fmaxf(u01.x, std::fmaxf(u11.x, u21.x)), width);
+		rect.yMax = pixelCoord(std::fmaxf(u01.y, std::fmaxf(u11.y, u21.y)), height);
+		return rect;
+	}
+
+	/// Calls shade(x, y, barycentrics) for the pixels inside clip covered by the triangle.
+	/// The barycentrics are edge functions of the pixel position, stepped incrementally in double
+	/// precision for 4 pixels at a time along the rows. Every row starts from the first pixel of its
+	/// raster tile, so the values of a pixel do not depend on the clip rectangle or the rasterization order.
+	template <typename ShadeFunction>
+	void rasterCoverage
+	(
+		const Vector2 &u0,
+		const Vector2 &u1,
+		const Vector2 &u2,
+		const Vector2 &pixsize,
+		const Vector2 &halfpix,
+		const Vector2 &scale,
+		const PixelRect &clip,
+		ShadeFunction shade
+	)
+	{
+		const uint32_t width = uint32_t(scale.x);
+		const uint32_t height = uint32_t(scale.y);
+		const PixelRect rect = triangleRect(u0, u1, u2, halfpix, scale, width, height);
+		const uint32_t xMin = std::max(rect.xMin, clip.xMin);
+		const uint32_t yMin = std::max(rect.yMin, clip.yMin);
+		const uint32_t xMax = std::min(rect.xMax, clip.xMax);
+		const uint32_t yMax = std::min(rect.yMax, clip.yMax);
+		if (xMin > xMax || yMin > yMax) return;
+
+		// Degenerated in UV space
+		const Vector2 e0 = u1 - u0;
+		const Vector2 e1 = u2 - u0;
+		if (!std::isfinite(1.0f / (e0.x * e1.y - e1.x * e0.y))) return;
+
+		// Barycentrics (k, i, j) as linear functions of the pixel offset from the rectangle origin
+		const double s = 1.0 / (double(e0.x) * e1.y - double(e1.x) * e0.y);
+		const double ox = double(rect.xMin) * pixsize.x + halfpix.x - u0.x;
+		const double oy = double(rect.yMin) * pixsize.y + halfpix.y - u0.y;
+		const double i0 = (ox * e1.y - e1.x * oy) * s;
+		const double idx = pixsize.x * e1.y * s;
+		const double idy = -pixsize.y * e1.x * s;
+		const double j0 = (e0.x * oy - ox * e0.y) * s;
+		const double jdx = -pixsize.x * e0.y * s;
+		const double jdy = pixsize.y * e0.x * s;
+
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d low = _mm_set1_pd(-0.001);
+		const __m128d iStep = _mm_set1_pd(4.0 * idx);
+		const __m128d jStep = _mm_set1_pd(4.0 * jdx);
+		const uint32_t xStart = std::max(rect.xMin, xMin / k_rasterTileSize * k_rasterTileSize);
+		const double dx = double(xStart - rect.xMin);
+
+		for (uint32_t y = yMin; y <= yMax; ++y)
+		{
+			const double dy = double(y - rect.yMin);
+			const double iRow = i0 + dy * idy;
+			const double jRow = j0 + dy * jdy;
+			__m128d bi01 = _mm_setr_pd(iRow + dx * idx, iRow + (dx + 1.0) * idx);
+			__m128d bi23 = _mm_setr_pd(iRow + (dx + 2.0) * idx, iRow + (dx + 3.0) * idx);
+			__m128d bj01 = _mm_setr_pd(jRow + dx * jdx, jRow + (dx + 1.0) * jdx);
+			__m128d bj23 = _mm_setr_pd(jRow + (dx + 2.0) * jdx, jRow + (dx + 3.0) * jdx);
+
+			for (uint32_t x = xStart; x <= xMax; x += 4)
+			{
+				const __m128d bk01 = _mm_sub_pd(_mm_sub_pd(one, bi01), bj01);
+				const __m128d bk23 = _mm_sub_pd(_mm_sub_pd(one, bi23), bj23);
+				__m128d inside01 = _mm_and_pd(_mm_cmpge_pd(bi01, low), _mm_cmple_pd(bi01, one));
+				inside01 = _mm_and_pd(inside01, _mm_and_pd(_mm_cmpge_pd(bj01, low), _mm_cmple_pd(bj01, one)));
+				inside01 = _mm_and_pd(inside01, _mm_and_pd(_mm_cmpge_pd(bk01, low), _mm_cmple_pd(bk01, one)));
+				__m128d inside23 = _mm_and_pd(_mm_cmpge_pd(bi23, low), _mm_cmple_pd(bi23, one));
+				inside23 = _mm_and_pd(inside23, _mm_and_pd(_mm_cmpge_pd(bj23, low), _mm_cmple_pd(bj23, one)));
+				inside23 = _mm_and_pd(inside23, _mm_and_pd(_mm_cmpge_pd(bk23, low), _mm_cmple_pd(bk23, one)));
+				int mask = _mm_movemask_pd(inside01) | (_mm_movemask_pd(inside23) << 2);
+				if (x < xMin) mask &= 0xF << std::min(xMin - x, 4u);
+				if (xMax - x < 3) mask &= (1 << (xMax - x + 1)) - 1;
+
+				if (mask != 0)
+				{
+					double bi[4], bj[4], bk[4];
+					_mm_storeu_pd(bi, bi01);
+					_mm_storeu_pd(bi + 2, bi23);
+					_mm_storeu_pd(bj, bj01);
+					_mm_storeu_pd(bj + 2, bj23);
+					_mm_storeu_pd(bk, bk01);
+					_mm_storeu_pd(bk + 2, bk23);
+					for (uint32_t lane = 0; lane < 4; ++lane)
+					{
+						if ((mask & (1 << lane)) == 0) continue;
+						shade(x + lane, y, Vector3(float(bk[lane]), float(bi[lane]), float(bj[lane])));
+					}
+				}
+
+				bi01 = _mm_add_pd(bi01, iStep);
+				bi23 = _mm_add_pd(bi23, iStep);
+				bj01 = _mm_add_pd(bj01, jStep);
+				bj23 = _mm_add_pd(bj23, jStep);
+			}
+		}
+	}
+
+	// Triangles of each block of the parallel binning passes
+	const size_t k_binChunkTriangles = 64 * 1024;
+
+	/// Bins the triangles in screen tiles, each tile keeps the mesh order of its triangles
+	/// so overlapping triangles resolve like in a serial raster.
+	/// @return False if any triangle lacks texture coordinates or normals
+	bool binTriangles
+	(
+		const Mesh *mesh,
+		const Vector2 &halfpix,
+		const Vector2 &scale,
+		uint32_t width,
+		uint32_t height,
+		const PixelRect &region,
+		std::vector<std::vector<uint32_t> > &o_tiles
+	)
+	{
+		PROFILE_ZONE("Bin triangles");
+		const uint32_t tilesX = (width + k_rasterTileSize - 1) / k_rasterTileSize;
+		const uint32_t tilesY = (height + k_rasterTileSize - 1) / k_rasterTileSize;
+		const size_t tileCount = size_t(tilesX) * tilesY;
+		const size_t triangleCount = mesh->triangles.size();
+		const int chunkCount = int((triangleCount + k_binChunkTriangles - 1) / k_binChunkTriangles);
+
+		// Tiles overlapped by the pixels of the triangle in the region, false if there are none
+		auto triangleTiles = [&](size_t triIndex, PixelRect &o_rect)
+		{
+			const auto &tri = mesh->triangles[triIndex];
+			const Vector2 u0 = mesh->texcoords[mesh->vertices[tri.vertexIndex0].texcoordIndex];
+			const Vector2 u1 = mesh->texcoords[mesh->vertices[tri.vertexIndex1].texcoordIndex];
+			const Vector2 u2 = mesh->texcoords[mesh->vertices[tri.vertexIndex2].texcoordIndex];
+			const PixelRect rect = triangleRect(u0, u1, u2, halfpix, scale, width, height);
+			o_rect.xMin = std::max(rect.xMin, region.xMin);
+			o_rect.yMin = std::max(rect.yMin, region.yMin);
+			o_rect.xMax = std::min(rect.xMax, region.xMax);
+			o_rect.yMax = std::min(rect.yMax, region.yMax);
+			if (o_rect.xMin > o_rect.xMax || o_rect.yMin > o_rect.yMax) return false;
+			o_rect.xMin /= k_rasterTileSize;
+			o_rect.yMin /= k_rasterTileSize;
+			o_rect.xMax /= k_rasterTileSize;
+			o_rect.yMax /= k_rasterTileSize;
+			return true;
+		};
+
+		// Counting sort of the triangles by tile, chunks are the blocks of the parallel passes
+		std::vector<uint32_t> offsets(size_t(chunkCount) * tileCount, 0);
+		std::vector<char> chunkValid(chunkCount, 1);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
+		{
+			uint32_t *counts = offsets.data() + size_t(c) * tileCount;
+			const size_t end = std::min(size_t(c + 1) * k_binChunkTriangles, triangleCount);
+			for (size_t triIndex = size_t(c) * k_binChunkTriangles; triIndex < end; ++triIndex)
+			{
+				if (!hasMappingAttributes(mesh, mesh->triangles[triIndex]))
+				{
+					chunkValid[c] = 0;
+					break;
+				}
+				PixelRect tiles;
+				if (!triangleTiles(triIndex, tiles)) continue;
+				for (uint32_t ty = tiles.yMin; ty <= tiles.yMax; ++ty)
+				{
+					for (uint32_t tx = tiles.xMin; tx <= tiles.xMax; ++tx) ++counts[size_t(ty) * tilesX + tx];
+				}
+			}
+		}
+		if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end()) return false;
+
+		o_tiles.clear();
+		o_tiles.resize(tileCount);
+#pragma omp parallel for
+		for (int tileIndex = 0; tileIndex < int(tileCount); ++tileIndex)
+		{
+			uint32_t sum = 0;
+			for (int c = 0; c < chunkCount; ++c)
+			{
+				uint32_t &offset = offsets[size_t(c) * tileCount + tileIndex];
+				const uint32_t count = offset;
+				offset = sum;
+				sum += count;
+			}
+			o_tiles[tileIndex].resize(sum);
+		}
+
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
+		{
+			uint32_t *next = offsets.data() + size_t(c) * tileCount;
+			const size_t end = std::min(size_t(c + 1) * k_binChunkTriangles, triangleCount);
+			for (size_t triIndex = size_t(c) * k_binChunkTriangles; triIndex < end; ++triIndex)
+			{
+				PixelRect tiles;
+				if (!triangleTiles(triIndex, tiles)) continue;
+				for (uint32_t ty = tiles.yMin; ty <= tiles.yMax; ++ty)
+				{
+					for (uint32_t tx = tiles.xMin; tx <= tiles.xMax; ++tx)
+					{
+						const size_t tileIndex = size_t(ty) * tilesX + tx;
+						o_tiles[tileIndex][next[tileIndex]++] = (uint32_t)triIndex;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	PixelRect tileRect(size_t tileIndex, uint32_t width, uint32_t height)
+	{
+		const uint32_t tilesX = (width + k_rasterTileSize - 1) / k_rasterTileSize;
+		PixelRect rect;
+		rect.xMin = uint32_t(tileIndex % tilesX) * k_rasterTileSize;
+		rect.yMin = uint32_t(tileIndex / tilesX) * k_rasterTileSize;
+		rect.xMax = std::min(rect.xMin + k_rasterTileSize, width) - 1;
+		rect.yMax = std::min(rect.yMin + k_rasterTileSize, height) - 1;
+		return rect;
+	}
+
+	/// Rasterizes the tiles in parallel into a dense map
+	/// @param rasterTriangle Function(triangle, clip, target) rasterizing a triangle inside the clip rectangle
+	template <typename RasterFunction>
+	MapUV* rasterMap(const Mesh *mesh, uint32_t width, uint32_t height, RasterFunction rasterTriangle)
+	{
+		const Vector2 scale((float)width, (float)height);
+		const Vector2 pixsize = Vector2(1.0f) / scale;
+		const Vector2 halfpix = pixsize * 0.5f;
+
+		PixelRect region;
+		region.xMin = 0;
+		region.yMin = 0;
+		region.xMax = width - 1;
+		region.yMax = height - 1;
+
+		std::vector<std::vector<uint32_t> > tiles;
+		if (!binTriangles(mesh, halfpix, scale, width, height, region, tiles)) return nullptr;
+
+		MapUV *map = new MapUV(width, height);
+
+		//if (computeTangentSpace)
+		{
+			const size_t size = map->normals.size();
+			map->tangents.resize(size);
+			map->bitangents.resize(size);
+		}
+
+		RasterTarget target;
+		target.map = map;
+		target.x = 0;
+		target.y = 0;
+
+#pragma omp parallel for schedule(dynamic)
+		for (int tileIndex = 0; tileIndex < int(tiles.size()); ++tileIndex)
+		{
+			const PixelRect clip = tileRect(tileIndex, width, height);
+			for (const uint32_t triIndex : tiles[tileIndex])
+			{
+				rasterTriangle(mesh->triangles[triIndex], clip, target);
+			}
+		}
+
+		return map;
+	}
+
+	/// Rasterizes the tiles in parallel and only keeps the covered pixels.
+	/// Every tile goes through a small dense map, the result matches CompressedMapUV(dense map)
+	/// without ever allocating the whole texture.
+	/// @param region Optional part of the map to rasterize, the indices still refer to the whole map
+	template <typename RasterFunction>
+	CompressedMapUV* rasterCompressedMap
+	(
+		const Mesh *mesh,
+		uint32_t width,
+		uint32_t height,
+		const MapRegion *region,
+		RasterFunction rasterTriangle
+	)
+	{
+		const Vector2 scale((float)width, (float)height);
+		const Vector2 pixsize = Vector2(1.0f) / scale;
+		const Vector2 halfpix = pixsize * 0.5f;
+
+		PixelRect rasterRegion;
+		rasterRegion.xMin = region ? std::min(region->x, width) : 0;
+		rasterRegion.yMin = region ? std::min(region->y, height) : 0;
+		rasterRegion.xMax = region ? std::min(region->x + region->width, width) - 1 : width - 1;
+		rasterRegion.yMax = region ? std::min(region->y + region->height, height) - 1 : height - 1;
+
+		std::vector<std::vector<uint32_t> > tiles;
+		if (!binTriangles(mesh, halfpix, scale, width, height, rasterRegion, tiles)) return nullptr;
+
+		std::vector<TileTexels> tileTexels(tiles.size());
+
+#pragma omp parallel for schedule(dynamic)
+		for (int tileIndex = 0; tileIndex < int(tiles.size()); ++tileIndex)
+		{
+			if (tiles[tileIndex].empty()) continue;
+
+			PixelRect clip = tileRect(tileIndex, width, height);
+			clip.xMin = std::max(clip.xMin, rasterRegion.xMin);
+			clip.yMin = std::max(clip.yMin, rasterRegion.yMin);
+			clip.xMax = std::min(clip.xMax, rasterRegion.xMax);
+			clip.yMax = std::min(clip.yMax, rasterRegion.yMax);
+			MapUV tile(clip.xMax - clip.xMin + 1, clip.yMax - clip.yMin + 1);
+			tile.tangents.resize(tile.normals.size());
+			tile.bitangents.resize(tile.normals.size());
+
+			RasterTarget target;
+			target.map = &tile;
+			target.x = clip.xMin;
+			target.y = clip.yMin;
+			for (const uint32_t triIndex : tiles[tileIndex])
+			{
+				rasterTriangle(mesh->triangles[triIndex], clip, target);
+			}
+			tiles[tileIndex] = std::vector<uint32_t>();
+
+			TileTexels &texels = tileTexels[tileIndex];
+			texels.rowStarts.reserve(tile.height + 1);
+			for (uint32_t y = clip.yMin; y <= clip.yMax; ++y)
+			{
+				texels.rowStarts.push_back(texels.indices.size());
+				for (uint32_t x = clip.xMin; x <= clip.xMax; ++x)
+				{
+					const size_t i = target.index(x, y);
+					const Vector3 n = tile.directions[i];
+					if (dot(n, n) > 0.5f) // With normal data
+					{
+						texels.indices.push_back(y * width + x);
+						texels.positions.push_back(tile.positions[i]);
+						texels.directions.push_back(tile.directions[i]);
+						texels.normals.push_back(tile.normals[i]);
+						texels.tangents.push_back(tile.tangents[i]);
+						texels.bitangents.push_back(tile.bitangents[i]);
+					}
+				}
+			}
+			texels.rowStarts.push_back(texels.indices.size());
+		}
+
+		// Same row major order as a dense map
+		const uint32_t tilesX = (width + k_rasterTileSize - 1) / k_rasterTileSize;
+		size_t count = 0;
+		for (size_t bandStart = 0; bandStart < tileTexels.size(); bandStart += tilesX)
+		{
+			for (uint32_t row = 0; row < k_rasterTileSize; ++row)
+			{
+				for (size_t tileIndex = bandStart; tileIndex < bandStart + tilesX; ++tileIndex)
+				{
+					TileTexels &texels = tileTexels[tileIndex];
+					if (row + 1 >= texels.rowStarts.size()) continue;
+					texels.rowOffsets.push_back(count);
+					count += texels.rowStarts[row + 1] - texels.rowStarts[row];
+				}
+			}
+		}
+
+		CompressedMapUV *map = new CompressedMapUV(width, height);
+		map->indices.resize(count);
+		map->positions.resize(count);
+		map->directions.resize(count);
+		map->normals.resize(count);
+		map->tangents.resize(count);
+		map->bitangents.resize(count);
+
+#pragma omp parallel for
+		for (int tileIndex = 0; tileIndex < int(tileTexels.size()); ++tileIndex)
+		{
+			TileTexels &texels = tileTexels[tileIndex];
+			for (size_t row = 0; row < texels.rowOffsets.size(); ++row)
+			{
+				const size_t begin = texels.rowStarts[row];
+				const size_t end = texels.rowStarts[row + 1];
+				const size_t offset = texels.rowOffsets[row];
+				std::copy(texels.indices.begin() + begin, texels.indices.begin() + end, map->indices.begin() + offset);
+				std::copy(texels.positions.begin() + begin, texels.positions.begin() + end, map->positions.begin() + offset);
+				std::copy(texels.directions.begin() + begin, texels.directions.begin() + end, map->directions.begin() + offset);
+				std::copy(texels.normals.begin() + begin, texels.normals.begin() + end, map->normals.begin() + offset);
+				std::copy(texels.tangents.begin() + begin, texels.tangents.begin() + end, map->tangents.begin() + offset);
+				std::copy(texels.bitangents.begin() + begin, texels.bitangents.begin() + end, map->bitangents.begin() + offset);
+			}
+			texels = TileTexels();
+		}
+
+		return map;
+	}
+
+	void rasterTriangle
 	(
 		const Mesh *mesh,
 		const Mesh *meshForMapping,
-		const Mesh::Triangle &tri, 
-		const Vector2 &pixsize, 
-		const Vector2 &halfpix, 
-		const Vector2 &scale, 
-		MapUV *map
+		const Mesh::Triangle &tri,
+		const Vector2 &pixsize,
+		const Vector2 &halfpix,
+		const Vector2 &scale,
+		const PixelRect &clip,
+		const RasterTarget &target
 	)
 	{
 		const auto &v0 = mesh->vertices[tri.vertexIndex0];
 		const auto &v1 = mesh->vertices[tri.vertexIndex1];
 		const auto &v2 = mesh->vertices[tri.vertexIndex2];
 
-		if (v0.texcoordIndex == UINT32_MAX ||
-			v1.texcoordIndex == UINT32_MAX ||
-			v2.texcoordIndex == UINT32_MAX ||
-			v0.normalIndex == UINT32_MAX ||
-			v1.normalIndex == UINT32_MAX ||
-			v2.normalIndex == UINT32_MAX)
-		{
-			return false;
-		}
-
 		const Vector3 p0 = mesh->positions[v0.positionIndex];
 		const Vector3 p1 = mesh->positions[v1.positionIndex];
 		const Vector3 p2 = mesh->positions[v2.positionIndex];
@@ -129,67 +590,47 @@ namespace
 		const Vector3 b1 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[tri.vertexIndex1];
 		const Vector3 b2 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[tri.vertexIndex2];
 
-		// Note: Surely not the fastest algorithm
-		const Vector2 u01 = (u0 - halfpix) * scale;
-		const Vector2 u11 = (u1 - halfpix) * scale;
-		const Vector2 u21 = (u2 - halfpix) * scale;
-		const uint32_t xMin = std::min(uint32_t(std::roundf(std::fminf(u01.x, std::fminf(u11.x, u21.x)))), map->width);
-		const uint32_t yMin = std::min(uint32_t(std::roundf(std::fminf(u01.y, std::fminf(u11.y, u21.y)))), map->height);
-		const uint32_t xMax = std::min(uint32_t(std::roundf(std::fmaxf(u01.x, std::fmaxf(u11.x, u21.x)))), map->width);
-		const uint32_t yMax = std::min(uint32_t(std::roundf(std::fmaxf(u01.y, std::fmaxf(u11.y, u21.y)))), map->height);
-
-		for (uint32_t y = yMin; y <= yMax; ++y)
+		MapUV *map = target.map;
+		rasterCoverage(u0, u1, u2, pixsize, halfpix, scale, clip,
+			[&](uint32_t x, uint32_t y, const Vector3 &b)
 		{
-			for (uint32_t x = xMin; x <= xMax; ++x)
-			{
-				const Vector2 xy((float)x, (float)y);
-				const Vector2 uv = xy * pixsize + halfpix;
-				const Vector3 b = Barycentric(uv, u0, u1, u2);
-				if (b.x >= -0.001f && b.x <= 1 && 
-					b.y >= -0.001f && b.y <= 1 && 
-					b.z >= -0.001f && b.z <= 1)
-				{
-					int i = y * map->width + x;
-					map->positions[i] = p0 * b.x + p1 * b.y + p2 * b.z;
-					map->directions[i] = normalize(d0 * b.x + d1 * b.y + d2 * b.z);
-					map->normals[i] = normalize(n0 * b.x + n1 * b.y + n2 * b.z);
-					map->tangents[i] = normalize(t0 * b.x + t1 * b.y + t2 * b.z);
-					map->bitangents[i] = normalize(b0 * b.x + b1 * b.y + b2 * b.z);
-				}
-			}
-		}
-
-		return true;
+			const size_t i = target.index(x, y);
+			map->positions[i] = p0 * b.x + p1 * b.y + p2 * b.z;
+			map->directions[i] = normalize(d0 * b.x + d1 * b.y + d2 * b.z);
+			map->normals[i] = normalize(n0 * b.x + n1 * b.y + n2 * b.z);
+			map->tangents[i] = normalize(t0 * b.x + t1 * b.y + t2 * b.z);
+			map->bitangents[i] = normalize(b0 * b.x + b1 * b.y + b2 * b.z);
+		});
 	}
 
 	MapUV* createMapUV(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height)
 	{
 		assert(mesh);
 
-		MapUV *map = new MapUV(width, height);
-
 		const Vector2 scale((float)width, (float)height);
 		const Vector2 pixsize = Vector2(1.0f) / scale;
 		const Vector2 halfpix = pixsize * 0.5f;
 
-		//if (computeTangentSpace)
+		return rasterMap(mesh, width, height,
+			[&](const Mesh::Triangle &tri, const PixelRect &clip, const RasterTarget &target)
 		{
-			const size_t size = map->normals.size();
-			map->tangents.resize(size);
-			map->bitangents.resize(size);
-		}
+			rasterTriangle(mesh, meshDirs, tri, pixsize, halfpix, scale, clip, target);
+		});
+	}
 
-		//for (int vindex = 0; vindex < mesh->positions.size(); vindex += 3)
-		for (const auto &tri : mesh->triangles)
-		{
-			if (!rasterTriangle(mesh, meshDirs, tri, pixsize, halfpix, scale, map))
-			{
-				delete map;
-				return nullptr;
-			}
-		}
+	CompressedMapUV* createCompressedMapUV(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, const MapRegion *region)
+	{
+		assert(mesh);
 
-		return map;
+		const Vector2 scale((float)width, (float)height);
+		const Vector2 pixsize = Vector2(1.0f) / scale;
+		const Vector2 halfpix = pixsize * 0.5f;
+
+		return rasterCompressedMap(mesh, width, height, region,
+			[&](const Mesh::Triangle &tri, const PixelRect &clip, const RasterTarget &target)
+		{
+			rasterTriangle(mesh, meshDirs, tri, pixsize, halfpix, scale, clip, target);
+		});
 	}
 
 	float edgeDistance(const Vector3 &e0, const Vector3 &e1, const Vector3 &p)
@@ -209,8 +650,7 @@ namespace
 		return std::fminf(d0, std::fminf(d1, d2));
 	}
 
-#pragma optimize( "", off )
-	bool rasterTriangleEdge
+	void rasterTriangleEdge
 	(
 		const Mesh *mesh,
 		const Mesh *meshForMapping,
@@ -219,23 +659,14 @@ namespace
 		const Vector2 &halfpix,
 		const Vector2 &scale,
 		const float edge,
-		MapUV *map
+		const PixelRect &clip,
+		const RasterTarget &target
 	)
 	{
 		const auto &v0 = mesh->vertices[tri.vertexIndex0];
 		const auto &v1 = mesh->vertices[tri.vertexIndex1];
 		const auto &v2 = mesh->vertices[tri.vertexIndex2];
 
-		if (v0.texcoordIndex == UINT32_MAX ||
-			v1.texcoordIndex == UINT32_MAX ||
-			v2.texcoordIndex == UINT32_MAX ||
-			v0.normalIndex == UINT32_MAX ||
-			v1.normalIndex == UINT32_MAX ||
-			v2.normalIndex == UINT32_MAX)
-		{
-			return false;
-		}
-
 		const Vector3 p0 = mesh->positions[v0.positionIndex];
 		const Vector3 p1 = mesh->positions[v1.positionIndex];
 		const Vector3 p2 = mesh->positions[v2.positionIndex];
@@ -261,102 +692,84 @@ namespace
 			d2 = meshForMapping->normals[mv2.normalIndex];
 		}
 
-		const Vector3 t0 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[v0.normalIndex];
-		const Vector3 t1 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[v1.normalIndex];
-		const Vector3 t2 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[v2.normalIndex];
-		const Vector3 b0 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[v0.normalIndex];
-		const Vector3 b1 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[v1.normalIndex];
-		const Vector3 b2 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[v2.normalIndex];
-
-		// Note: Surely not the fastest algorithm
-		const Vector2 u01 = (u0 - halfpix) * scale;
-		const Vector2 u11 = (u1 - halfpix) * scale;
-		const Vector2 u21 = (u2 - halfpix) * scale;
-		const uint32_t xMin = (uint32_t)std::fmaxf(std::roundf(std::fminf(u01.x, std::fminf(u11.x, u21.x))), 0.0f);
-		const uint32_t yMin = (uint32_t)std::fmaxf(std::roundf(std::fminf(u01.y, std::fminf(u11.y, u21.y))), 0.0f);
-		const uint32_t xMax = (uint32_t)std::fmaxf(std::roundf(std::fmaxf(u01.x, std::fmaxf(u11.x, u21.x))), 0.0f);
-		const uint32_t yMax = (uint32_t)std::fmaxf(std::roundf(std::fmaxf(u01.y, std::fmaxf(u11.y, u21.y))), 0.0f);
+		const Vector3 t0 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[tri.vertexIndex0];
+		const Vector3 t1 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[tri.vertexIndex1];
+		const Vector3 t2 = mesh->tangents.empty() ? Vector3(0) : mesh->tangents[tri.vertexIndex2];
+		const Vector3 b0 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[tri.vertexIndex0];
+		const Vector3 b1 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[tri.vertexIndex1];
+		const Vector3 b2 = mesh->tangents.empty() ? Vector3(0) : mesh->bitangents[tri.vertexIndex2];
 
-		for (uint32_t y = yMin; y <= yMax; ++y)
+		MapUV *map = target.map;
+		rasterCoverage(u0, u1, u2, pixsize, halfpix, scale, clip,
+			[&](uint32_t x, uint32_t y, const Vector3 &b)
 		{
-			for (uint32_t x = xMin; x <= xMax; ++x)
-			{
-				const Vector2 xy((float)x, (float)y);
-				const Vector2 uv = xy * pixsize + halfpix;
-				const Vector3 b = Barycentric(uv, u0, u1, u2);
-				if (b.x >= -0.001f && b.x <= 1 &&
-					b.y >= -0.001f && b.y <= 1 &&
-					b.z >= -0.001f && b.z <= 1)
-				{
-					const int i = y * map->width + x;
-					const Vector3 p = p0 * b.x + p1 * b.y + p2 * b.z;
-					const Vector3 n = normalize(n0 * b.x + n1 * b.y + n2 * b.z);
-
-					/*const float e0 = std::fminf(edgeDistance(p0, p1, p) / edge, 1.0f);
-					const float e1 = std::fminf(edgeDistance(p1, p2, p) / edge, 1.0f);
-					const float e2 = std::fminf(edgeDistance(p2, p0, p) / edge, 1.0f);
-					const float ev0 = std::fminf(e0, e2);
-					const float ev1 = std::fminf(e0, e1);
-					const float ev2 = std::fminf(e1, e2);
-					const Vector3 d0h = normalize(d0 * ev0 + n0 * (1.0f - ev0));
-					const Vector3 d1h = normalize(d1 * ev1 + n1 * (1.0f - ev1));
-					const Vector3 d2h = normalize(d2 * ev2 + n2 * (1.0f - ev2));
-					const Vector3 d = normalize(d0h * b.x + d1h * b.y + d2h * b.z);*/
-					const float t = std::fminf(triangleDistance(p0, p1, p2, p) / edge, 1.0f);
-					const Vector3 dsmooth = normalize(d0 * b.x + d1 * b.y + d2 * b.z);
-					const Vector3 d = normalize(dsmooth * (1.0f - t) + n * t);
-					
-					map->positions[i] = p;
-					map->directions[i] = d;
-					map->normals[i] = n;
-					map->tangents[i] = normalize(t0 * b.x + t1 * b.y + t2 * b.z);
-					map->bitangents[i] = normalize(b0 * b.x + b1 * b.y + b2 * b.z);
-				}
-			}
-		}
-
-		return true;
+			const size_t i = target.index(x, y);
+			const Vector3 p = p0 * b.x + p1 * b.y + p2 * b.z;
+			const Vector3 n = normalize(n0 * b.x + n1 * b.y + n2 * b.z);
+
+			/*const float e0 = std::fminf(edgeDistance(p0, p1, p) / edge, 1.0f);
+			const float e1 = std::fminf(edgeDistance(p1, p2, p) / edge, 1.0f);
+			const float e2 = std::fminf(edgeDistance(p2, p0, p) / edge, 1.0f);
+			const float ev0 = std::fminf(e0, e2);
+			const float ev1 = std::fminf(e0, e1);
+			const float ev2 = std::fminf(e1, e2);
+			const Vector3 d0h = normalize(d0 * ev0 + n0 * (1.0f - ev0));
+			const Vector3 d1h = normalize(d1 * ev1 + n1 * (1.0f - ev1));
+			const Vector3 d2h = normalize(d2 * ev2 + n2 * (1.0f - ev2));
+			const Vector3 d = normalize(d0h * b.x + d1h * b.y + d2h * b.z);*/
+			const float t = std::fminf(triangleDistance(p0, p1, p2, p) / edge, 1.0f);
+			const Vector3 dsmooth = normalize(d0 * b.x + d1 * b.y + d2 * b.z);
+			const Vector3 d = normalize(dsmooth * (1.0f - t) + n * t);
+
+			map->positions[i] = p;
+			map->directions[i] = d;
+			map->normals[i] = n;
+			map->tangents[i] = normalize(t0 * b.x + t1 * b.y + t2 * b.z);
+			map->bitangents[i] = normalize(b0 * b.x + b1 * b.y + b2 * b.z);
+		});
 	}
-#pragma optimize( "", on ) 
 
 	MapUV* createMapUVEdge(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge)
 	{
 		assert(mesh);
 
-		MapUV *map = new MapUV(width, height);
-
 		const Vector2 scale((float)width, (float)height);
 		const Vector2 pixsize = Vector2(1.0f) / scale;
 		const Vector2 halfpix = pixsize * 0.5f;
 
-		//if (computeTangentSpace)
+		return rasterMap(mesh, width, height,
+			[&](const Mesh::Triangle &tri, const PixelRect &clip, const RasterTarget &target)
 		{
-			const size_t size = map->normals.size();
-			map->tangents.resize(size);
-			map->bitangents.resize(size);
-		}
+			rasterTriangleEdge(mesh, meshDirs, tri, pixsize, halfpix, scale, edge, clip, target);
+		});
+	}
 
-		for (const auto &tri : mesh->triangles)
-		{
-			if (!rasterTriangleEdge(mesh, meshDirs, tri, pixsize, halfpix, scale, edge, map))
-			{
-				delete map;
-				return nullptr;
-			}
-		}
+	CompressedMapUV* createCompressedMapUVEdge(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge, const MapRegion *region)
+	{
+		assert(mesh);
 
-		return map;
+		const Vector2 scale((float)width, (float)height);
+		const Vector2 pixsize = Vector2(1.0f) / scale;
+		const Vector2 halfpix = pixsize * 0.5f;
+
+		return rasterCompressedMap(mesh, width, height, region,
+			[&](const Mesh::Triangle &tri, const PixelRect &clip, const RasterTarget &target)
+		{
+			rasterTriangleEdge(mesh, meshDirs, tri, pixsize, halfpix, scale, edge, clip, target);
+		});
 	}
 }
 
 MapUV* MapUV::fromMesh(const Mesh *mesh, uint32_t width, uint32_t height)
 {
+	PROFILE_ZONE("MapUV::fromMesh");
 	assert(mesh);
 	return createMapUV(mesh, nullptr, width, height);
 }
 
 MapUV* MapUV::fromMeshes(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height)
 {
+	PROFILE_ZONE("MapUV::fromMeshes");
 	assert(mesh);
 	assert(meshDirs);
 	return createMapUV(mesh, meshDirs, width, height);
@@ -364,15 +777,23 @@ MapUV* MapUV::fromMeshes(const Mesh *mesh, const Mesh *meshDirs, uint32_t width,
 
 MapUV* MapUV::fromMeshes_Hybrid(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge)
 {
+	PROFILE_ZONE("MapUV::fromMeshes_Hybrid");
 	assert(mesh);
 	assert(meshDirs);
 	return createMapUVEdge(mesh, meshDirs, width, height, edge);
 }
 
+CompressedMapUV::CompressedMapUV(uint32_t width, uint32_t height)
+	: width(width)
+	, height(height)
+{
+}
+
 CompressedMapUV::CompressedMapUV(const MapUV *map)
 	: width(map->width)
 	, height(map->height)
 {
+	PROFILE_ZONE("CompressedMapUV");
 	assert(map);
 	assert(map->normals.size() > 0);
 
@@ -414,3 +835,121 @@ CompressedMapUV::CompressedMapUV(const MapUV *map)
 	exportNormalImage(&directions[0], this, "D:\\asdf.png");
 #endif
 }
+
+CompressedMapUV* CompressedMapUV::fromMesh(const Mesh *mesh, uint32_t width, uint32_t height, const MapRegion *region)
+{
+	PROFILE_ZONE("CompressedMapUV::fromMesh");
+	assert(mesh);
+	return createCompressedMapUV(mesh, nullptr, width, height, region);
+}
+
+CompressedMapUV* CompressedMapUV::fromMeshes(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, const MapRegion *region)
+{
+	PROFILE_ZONE("CompressedMapUV::fromMeshes");
+	assert(mesh);
+	assert(meshDirs);
+	return createCompressedMapUV(mesh, meshDirs, width, height, region);
+}
+
+CompressedMapUV* CompressedMapUV::fromMeshes_Hybrid(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge, const MapRegion *region)
+{
+	PROFILE_ZONE("CompressedMapUV::fromMeshes_Hybrid");
+	assert(mesh);
+	assert(meshDirs);
+	return createCompressedMapUVEdge(mesh, meshDirs, width, height, edge, region);
+}
+
+namespace
+{
+	// Standard deviation of the gaussian resolve filter in texels
+	static const float k_gaussianSigma = 0.35f;
+
+	template <typename T>
+	void reorder(std::vector<T> &values, const std::vector<uint32_t> &order)
+	{
+		if (values.empty()) return;
+		std::vector<T> sorted(order.size());
+		for (size_t i = 0; i < order.size(); ++i) sorted[i] = values[order[i]];
+		values.swap(sorted);
+	}
+
+	template <typename T>
+	void resolveSamples(const CompressedMapUV &map, const T *samples, std::vector<T> &o_texels, std::vector<uint32_t> &o_indices)
+	{
+		o_texels.clear();
+		o_indices.clear();
+		const size_t count = map.indices.size();
+		for (size_t begin = 0, end = 0; begin < count; begin = end)
+		{
+			T sum = samples[begin] * map.weights[begin];
+			float weight = map.weights[begin];
+			for (end = begin + 1; end < count && map.indices[end] == map.indices[begin]; ++end)
+			{
+				sum = sum + samples[end] * map.weights[end];
+				weight += map.weights[end];
+			}
+			o_texels.push_back(sum * (1.0f / weight));
+			o_indices.push_back(map.indices[begin]);
+		}
+	}
+}
+
+CompressedMapUV* CompressedMapUV::fromSamples(CompressedMapUV &sampleMap, uint32_t samplesPerAxis, bool gaussian)
+{
+	PROFILE_ZONE("CompressedMapUV::fromSamples");
+	assert(samplesPerAxis > 0);
+	assert(sampleMap.width % samplesPerAxis == 0 && sampleMap.height % samplesPerAxis == 0);
+
+	const uint32_t width = sampleMap.width / samplesPerAxis;
+	const uint32_t height = sampleMap.height / samplesPerAxis;
+	const size_t count = sampleMap.indices.size();
+	CompressedMapUV *map = new CompressedMapUV(width, height);
+
+	std::vector<uint32_t> texels(count);
+	std::vector<float> weights(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint32_t x = sampleMap.indices[i] % sampleMap.width;
+		const uint32_t y = sampleMap.indices[i] / sampleMap.width;
+		texels[i] = (y / samplesPerAxis) * width + x / samplesPerAxis;
+
+		// Offset from the texel center in texels
+		const Vector2 d(
+			((float)(x % samplesPerAxis) + 0.5f) / (float)samplesPerAxis - 0.5f,
+			((float)(y % samplesPerAxis) + 0.5f) / (float)samplesPerAxis - 0.5f);
+		weights[i] = gaussian ? std::exp(-dot(d, d) / (2.0f * k_gaussianSigma * k_gaussianSigma)) : 1.0f;
+	}
+
+	// Samples are rasterized in rows of the supersampled map, group them by texel
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < count; ++i) order[i] = (uint32_t)i;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return texels[a] < texels[b]; });
+
+	map->positions.swap(sampleMap.positions);
+	map->directions.swap(sampleMap.directions);
+	map->normals.swap(sampleMap.normals);
+	map->tangents.swap(sampleMap.tangents);
+	map->bitangents.swap(sampleMap.bitangents);
+	map->indices.swap(texels);
+	map->weights.swap(weights);
+	sampleMap.indices.clear();
+
+	reorder(map->positions, order);
+	reorder(map->directions, order);
+	reorder(map->normals, order);
+	reorder(map->tangents, order);
+	reorder(map->bitangents, order);
+	reorder(map->indices, order);
+	reorder(map->weights, order);
+	return map;
+}
+
+void CompressedMapUV::resolve(const float *samples, std::vector<float> &o_texels, std::vector<uint32_t> &o_indices) const
+{
+	resolveSamples(*this, samples, o_texels, o_indices);
+}
+
+void CompressedMapUV::resolve(const Vector3 *samples, std::vector<Vector3> &o_texels, std::vector<uint32_t> &o_indices) const
+{
+	resolveSamples(*this, samples, o_texels, o_indices);
+}
@@ -240,6 +240,15 @@ struct MapUV
 	static MapUV* fromMeshes_Hybrid(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge);
 };
 
+/// Rectangle of a map in pixels
+struct MapRegion
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
 /// MapUV without any pixels with no data
 /// This is for a more efficient processing in the GPU
 struct CompressedMapUV
@@ -250,10 +259,34 @@ struct CompressedMapUV
 	std::vector<Vector3> tangents;
 	std::vector<Vector3> bitangents;
 	std::vector<uint32_t> indices; // Actual index in the MapUV
+	std::vector<float> weights; // Resolve weight of every sample, empty with a single sample per texel
 
 	const uint32_t width;
 	const uint32_t height;
 
+	/// Creates an empty map
+	CompressedMapUV(uint32_t width, uint32_t height);
+
 	/// Creates a compressed map from a raw map
 	CompressedMapUV(const MapUV *map);
+
+	/// Same as the MapUV builders followed by the compression but rasterizing straight into the compressed
+	/// layout. Memory grows with the covered pixels instead of the texture size.
+	/// @param region Only rasterize this part of the map (the whole map if null)
+	/// @return nullptr if the mesh is missing texture coordinates or normals
+	static CompressedMapUV* fromMesh(const Mesh *mesh, uint32_t width, uint32_t height, const MapRegion *region = nullptr);
+	static CompressedMapUV* fromMeshes(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, const MapRegion *region = nullptr);
+	static CompressedMapUV* fromMeshes_Hybrid(const Mesh *mesh, const Mesh *meshDirs, uint32_t width, uint32_t height, float edge, const MapRegion *region = nullptr);
+
+	/// Supersampled map from a map rasterized at samplesPerAxis times this resolution.
+	/// Every covered sample is kept with the index of its texel, the samples of a texel are consecutive.
+	/// @param gaussian Weight the samples by their distance to the texel center instead of a box filter
+	static CompressedMapUV* fromSamples(CompressedMapUV &sampleMap, uint32_t samplesPerAxis, bool gaussian);
+
+	bool supersampled() const { return !weights.empty(); }
+
+	/// Weighted average of the samples of every texel
+	/// @param o_indices Index in the MapUV of every resolved texel
+	void resolve(const float *samples, std::vector<float> &o_texels, std::vector<uint32_t> &o_indices) const;
+	void resolve(const Vector3 *samples, std::vector<Vector3> &o_texels, std::vector<uint32_t> &o_indices) const;
 };
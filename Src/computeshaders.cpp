@@ -23,140 +23,166 @@ SOFTWARE.
 #include "computeshaders.h"
 #include "computeshaders_content.h"
 #include "compute.h"
+#include "math.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
 
 #define COMPUTE_SHADER_FROM_FILES 0
 
-GLuint LoadComputeShader_MeshMapping()
-{
 #if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\meshmapping.comp");
+#define COMPUTE_SHADER_SOURCE(file, content) loadFile("D:\\Code\\Fornos\\Shaders\\" file)
 #else
-	return CreateComputeProgramFromMemory(meshmapping_comp);
+#define COMPUTE_SHADER_SOURCE(file, content) std::string(content)
 #endif
+
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name)
+{
+	return define(name, std::string());
 }
 
-GLuint LoadComputeShader_MeshMappingCullBackfaces()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, bool value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\meshmapping_nobackfaces.comp");
-#else
-	return CreateComputeProgramFromMemory(meshmapping_nobackfaces_comp);
-#endif
+	return define(name, std::string(value ? "1" : "0"));
 }
 
-GLuint LoadComputeShader_AO_GenData()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, int32_t value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\ao_step0.comp");
-#else
-	return CreateComputeProgramFromMemory(ao_step0_comp);
-#endif
+	return define(name, std::to_string(value));
 }
 
-GLuint LoadComputeShader_AO_Sampling()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, uint32_t value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\ao_step1.comp");
-#else
-	return CreateComputeProgramFromMemory(ao_step1_comp);
-#endif
+	return define(name, std::to_string(value) + "u");
 }
 
-GLuint LoadComputeShader_AO_Aggregate()
+namespace
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\ao_step2.comp");
-#else
-	return CreateComputeProgramFromMemory(ao_step2_comp);
-#endif
+	std::string floatLiteral(float value)
+	{
+		char buff[32];
+		snprintf(buff, sizeof(buff), "%.9g", value);
+		std::string str(buff);
+		// Make sure GLSL parses it as a float literal
+		if (str.find_first_of(".e") == std::string::npos) str += ".0";
+		return str;
+	}
 }
 
-GLuint LoadComputeShader_BN_GenData()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, float value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\ao_step0.comp");
-#else
-	return CreateComputeProgramFromMemory(ao_step0_comp);
-#endif
+	return define(name, floatLiteral(value));
 }
 
-GLuint LoadComputeShader_BN_Sampling()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, const Vector3 &value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\bentnormals_step1.comp");
-#else
-	return CreateComputeProgramFromMemory(bentnormals_step1_comp);
-#endif
+	return define(name, "vec3(" + floatLiteral(value.x) + ", " + floatLiteral(value.y) + ", " + floatLiteral(value.z) + ")");
 }
 
-GLuint LoadComputeShader_BN_Aggregate()
+ComputeShaderDefines& ComputeShaderDefines::define(const char *name, const std::string &value)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\bentnormals_step2.comp");
-#else
-	return CreateComputeProgramFromMemory(bentnormals_step2_comp);
-#endif
+	_str += "#define ";
+	_str += name;
+	if (!value.empty())
+	{
+		_str += " ";
+		_str += value;
+	}
+	_str += "\n";
+	return *this;
 }
 
-GLuint LoadComputeShader_Thick_GenData()
+namespace
 {
 #if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\ao_step0.comp");
-#else
-	return CreateComputeProgramFromMemory(ao_step0_comp);
+	std::string loadFile(const char *path)
+	{
+		std::ifstream ifs(path);
+		return std::string((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+	}
 #endif
+
+	/// Compiles a shader variant, or returns the cached one if it was built before.
+	/// Definitions go right after the #version line, which must stay first.
+	GLuint loadComputeShader(const char *name, const std::string &src, const ComputeShaderDefines &defines)
+	{
+		static std::map<std::string, GLuint> s_programs;
+
+		const std::string key = std::string(name) + "\n" + defines.str();
+		auto it = s_programs.find(key);
+		if (it != s_programs.end()) return it->second;
+
+		std::string source = src;
+		const size_t versionEnd = source.find('\n', source.find("#version"));
+		source.insert(versionEnd == std::string::npos ? source.size() : versionEnd + 1, defines.str());
+
+		const GLuint program = CreateComputeProgramFromMemory(source.c_str());
+		s_programs[key] = program;
+		return program;
+	}
 }
 
-GLuint LoadComputeShader_Thick_Sampling()
+GLuint LoadComputeShader_MeshMapping(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\thick_step1.comp");
-#else
-	return CreateComputeProgramFromMemory(thick_step1_comp);
-#endif
+	return loadComputeShader("meshmapping.comp", COMPUTE_SHADER_SOURCE("meshmapping.comp", meshmapping_comp), defines);
 }
 
-GLuint LoadComputeShader_Thick_Aggregate()
+GLuint LoadComputeShader_AO_GenData(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\thick_step2.comp");
-#else
-	return CreateComputeProgramFromMemory(thick_step2_comp);
-#endif
+	return loadComputeShader("ao_step0.comp", COMPUTE_SHADER_SOURCE("ao_step0.comp", ao_step0_comp), defines);
 }
 
-GLuint LoadComputeShader_Height()
+GLuint LoadComputeShader_AO_Sampling(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\heights.comp");
-#else
-	return CreateComputeProgramFromMemory(heights_comp);
-#endif
+	return loadComputeShader("ao_step1.comp", COMPUTE_SHADER_SOURCE("ao_step1.comp", ao_step1_comp), defines);
 }
 
-GLuint LoadComputeShader_Position()
+GLuint LoadComputeShader_AO_Aggregate(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\positions.comp");
-#else
-	return CreateComputeProgramFromMemory(positions_comp);
-#endif
+	return loadComputeShader("ao_step2.comp", COMPUTE_SHADER_SOURCE("ao_step2.comp", ao_step2_comp), defines);
 }
 
-GLuint LoadComputeShader_Normal()
+GLuint LoadComputeShader_BN_GenData(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\normals.comp");
-#else
-	return CreateComputeProgramFromMemory(normals_comp);
-#endif
+	return loadComputeShader("ao_step0.comp", COMPUTE_SHADER_SOURCE("ao_step0.comp", ao_step0_comp), defines);
 }
 
-GLuint LoadComputeShader_ToTangentSpace()
+GLuint LoadComputeShader_BN_Sampling(const ComputeShaderDefines &defines)
 {
-#if COMPUTE_SHADER_FROM_FILES
-	return CreateComputeProgram("D:\\Code\\Fornos\\Shaders\\tangentspace.comp");
-#else
-	return CreateComputeProgramFromMemory(tangentspace_comp);
-#endif
+	return loadComputeShader("bentnormals_step1.comp", COMPUTE_SHADER_SOURCE("bentnormals_step1.comp", bentnormals_step1_comp), defines);
 }
+
+GLuint LoadComputeShader_BN_Aggregate(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("bentnormals_step2.comp", COMPUTE_SHADER_SOURCE("bentnormals_step2.comp", bentnormals_step2_comp), defines);
+}
+
+GLuint LoadComputeShader_Thick_GenData(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("ao_step0.comp", COMPUTE_SHADER_SOURCE("ao_step0.comp", ao_step0_comp), defines);
+}
+
+GLuint LoadComputeShader_Thick_Sampling(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("thick_step1.comp", COMPUTE_SHADER_SOURCE("thick_step1.comp", thick_step1_comp), defines);
+}
+
+GLuint LoadComputeShader_Thick_Aggregate(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("thick_step2.comp", COMPUTE_SHADER_SOURCE("thick_step2.comp", thick_step2_comp), defines);
+}
+
+GLuint LoadComputeShader_Height(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("heights.comp", COMPUTE_SHADER_SOURCE("heights.comp", heights_comp), defines);
+}
+
+GLuint LoadComputeShader_Position(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("positions.comp", COMPUTE_SHADER_SOURCE("positions.comp", positions_comp), defines);
+}
+
+GLuint LoadComputeShader_Normal(const ComputeShaderDefines &defines)
+{
+	return loadComputeShader("normals.comp", COMPUTE_SHADER_SOURCE("normals.comp", normals_comp), defines);
+}
\ No newline at end of file
@@ -24,24 +24,47 @@ SOFTWARE.
 #pragma once
 
 #include <glad/glad.h>
+#include <cstdint>
+#include <string>
 
-GLuint LoadComputeShader_MeshMapping();
-GLuint LoadComputeShader_MeshMappingCullBackfaces();
+struct Vector3;
 
-GLuint LoadComputeShader_AO_GenData();
-GLuint LoadComputeShader_AO_Sampling();
-GLuint LoadComputeShader_AO_Aggregate();
+/// Preprocessor definitions injected into a compute shader before compiling it.
+/// Each distinct set of definitions produces (and caches) its own program variant,
+/// so bake constants can be folded by the driver instead of read from buffers.
+class ComputeShaderDefines
+{
+public:
+	ComputeShaderDefines &define(const char *name);
+	ComputeShaderDefines &define(const char *name, bool value);
+	ComputeShaderDefines &define(const char *name, int32_t value);
+	ComputeShaderDefines &define(const char *name, uint32_t value);
+	ComputeShaderDefines &define(const char *name, float value);
+	ComputeShaderDefines &define(const char *name, const Vector3 &value);
 
-GLuint LoadComputeShader_BN_GenData();
-GLuint LoadComputeShader_BN_Sampling();
-GLuint LoadComputeShader_BN_Aggregate();
+	/// GLSL source lines with all the definitions, also used as cache key
+	inline const std::string& str() const { return _str; }
 
-GLuint LoadComputeShader_Thick_GenData();
-GLuint LoadComputeShader_Thick_Sampling();
-GLuint LoadComputeShader_Thick_Aggregate();
+private:
+	ComputeShaderDefines &define(const char *name, const std::string &value);
 
-GLuint LoadComputeShader_Height();
-GLuint LoadComputeShader_Position();
-GLuint LoadComputeShader_Normal();
+	std::string _str;
+};
 
-GLuint LoadComputeShader_ToTangentSpace();
\ No newline at end of file
+GLuint LoadComputeShader_MeshMapping(const ComputeShaderDefines &defines = ComputeShaderDefines());
+
+GLuint LoadComputeShader_AO_GenData(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_AO_Sampling(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_AO_Aggregate(const ComputeShaderDefines &defines = ComputeShaderDefines());
+
+GLuint LoadComputeShader_BN_GenData(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_BN_Sampling(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_BN_Aggregate(const ComputeShaderDefines &defines = ComputeShaderDefines());
+
+GLuint LoadComputeShader_Thick_GenData(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_Thick_Sampling(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_Thick_Aggregate(const ComputeShaderDefines &defines = ComputeShaderDefines());
+
+GLuint LoadComputeShader_Height(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_Position(const ComputeShaderDefines &defines = ComputeShaderDefines());
+GLuint LoadComputeShader_Normal(const ComputeShaderDefines &defines = ComputeShaderDefines());
\ No newline at end of file
@@ -21,17 +21,35 @@ SOFTWARE.
 */
 
 #include <stdio.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "fornos.h"
 #include "fornosui.h"
+#include "bakeserver.h"
+#include "benchmark.h"
 #include "bvh.h"
+#include "compactmesh.h"
 #include "compute.h"
+#include "gpustats.h"
+#include "image.h"
+#include "instancedmesh.h"
+#include "logging.h"
+#include "mappedfile.h"
 #include "mesh.h"
+#include "profiler.h"
+#include "taskgraph.h"
 #include "timing.h"
+#include "worksize.h"
 #include "meshmapping.h"
 
 #include "solver_ao.h"
@@ -41,212 +59,1634 @@ SOFTWARE.
 #include "solver_normals.h"
 #include "solver_thickness.h"
 
+#include <cxxopts.hpp>
+
 static int windowWidth = 640;
 static int windowHeight = 480;
 
 
-static void error_callback(int error, const char* description)
+static void profileMemory()
+{
+	profilerCounter("Memory (MB)", (double)profilerMemoryUsage() / (1024.0 * 1024.0));
+}
+
+static std::vector<std::string> splitList(const std::string &str)
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	while (start <= str.size())
+	{
+		const size_t end = std::min(str.find(',', start), str.size());
+		if (end > start) items.push_back(str.substr(start, end - start));
+		start = end + 1;
+	}
+	return items;
+}
+
+/// Loads any supported mesh and writes it in the native binary format.
+/// With tangents the tangent space is stored too, so the bakes don't need to compute it again.
+static bool convertMesh(const std::string &inputPath, std::string outputPath, bool tangents)
+{
+	if (outputPath.empty())
+	{
+		const size_t dot = inputPath.find_last_of('.');
+		const size_t slash = inputPath.find_last_of("/\\");
+		const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+		outputPath = (hasExtension ? inputPath.substr(0, dot) : inputPath) + ".fmesh";
+	}
+
+	std::unique_ptr<Mesh> mesh(Mesh::loadFile(inputPath.c_str()));
+	if (!mesh)
+	{
+		fprintf(stderr, "Failed to load %s\n", inputPath.c_str());
+		return false;
+	}
+	if (tangents) mesh->computeTangentSpace();
+	if (!mesh->saveFmesh(outputPath.c_str()))
+	{
+		fprintf(stderr, "Failed to write %s\n", outputPath.c_str());
+		return false;
+	}
+	printf("%s: %zu triangles, %zu vertices\n", outputPath.c_str(), mesh->triangles.size(), mesh->vertices.size());
+	return true;
+}
+
+static CompressedMapUV* rasterizeCompressedMap
+(
+	const FornosParameters_Shared &params,
+	const Mesh *lowPolyMesh,
+	const Mesh *lowPolyMeshForMapping,
+	uint32_t width,
+	uint32_t height,
+	const MapRegion *region
+)
+{
+	switch (params.mapping)
+	{
+	case MeshMappingMethod::Smooth:
+		return CompressedMapUV::fromMeshes(lowPolyMesh, lowPolyMeshForMapping, width, height, region);
+	case MeshMappingMethod::LowPolyNormals:
+		return CompressedMapUV::fromMesh(lowPolyMesh, width, height, region);
+	case MeshMappingMethod::Hybrid:
+		return CompressedMapUV::fromMeshes_Hybrid(lowPolyMesh, lowPolyMeshForMapping, width, height, params.mappingEdge, region);
+	}
+	return nullptr;
+}
+
+static uint32_t samplesPerAxis(const FornosParameters_Shared &params)
+{
+	return (uint32_t)std::min(std::max(params.supersampling, 1), k_maxSupersampling);
+}
+
+static CompressedMapUV* createCompressedMap
+(
+	const FornosParameters_Shared &params,
+	const Mesh *lowPolyMesh,
+	const Mesh *lowPolyMeshForMapping,
+	const MapRegion *region
+)
+{
+	const uint32_t width = (uint32_t)params.texWidth;
+	const uint32_t height = (uint32_t)params.texHeight;
+	const uint32_t samples = samplesPerAxis(params);
+	if (samples == 1)
+	{
+		return rasterizeCompressedMap(params, lowPolyMesh, lowPolyMeshForMapping, width, height, region);
+	}
+
+	// Stratified samples: the map is rasterized at a multiple of the resolution and resolved on export
+	MapRegion sampleRegion;
+	if (region)
+	{
+		sampleRegion.x = region->x * samples;
+		sampleRegion.y = region->y * samples;
+		sampleRegion.width = region->width * samples;
+		sampleRegion.height = region->height * samples;
+	}
+	std::unique_ptr<CompressedMapUV> sampleMap(rasterizeCompressedMap(params, lowPolyMesh, lowPolyMeshForMapping,
+		width * samples, height * samples, region ? &sampleRegion : nullptr));
+	if (!sampleMap) return nullptr;
+	return CompressedMapUV::fromSamples(*sampleMap, samples, params.sampleFilter == SampleFilter::Gaussian);
+}
+
+// Solvers of the enabled bakers
+struct BakeSolvers
+{
+	std::unique_ptr<HeightSolver> height;
+	std::unique_ptr<PositionSolver> positions;
+	std::unique_ptr<NormalsSolver> normals;
+	std::unique_ptr<AmbientOcclusionSolver> ao;
+	std::unique_ptr<BentNormalsSolver> bentNormals;
+	std::unique_ptr<ThicknessSolver> thickness;
+};
+
+static void createSolvers
+(
+	const FornosParameters &params,
+	std::shared_ptr<const CompressedMapUV> map,
+	std::shared_ptr<MeshMapping> meshMapping,
+	BakeSolvers &o_solvers
+)
+{
+	if (params.thickness.enabled)
+	{
+		ThicknessSolver::Params solverParams;
+		solverParams.sampleCount = (uint32_t)params.thickness.sampleCount;
+		solverParams.minDistance = params.thickness.minDistance;
+		solverParams.maxDistance = params.thickness.maxDistance;
+		o_solvers.thickness = std::unique_ptr<ThicknessSolver>(new ThicknessSolver(solverParams));
+		o_solvers.thickness->init(map, meshMapping);
+	}
+
+	if (params.bentNormals.enabled)
+	{
+		BentNormalsSolver::Params solverParams;
+		solverParams.sampleCount = (uint32_t)params.bentNormals.sampleCount;
+		solverParams.minDistance = params.bentNormals.minDistance;
+		solverParams.maxDistance = params.bentNormals.maxDistance;
+		solverParams.tangentSpace = params.bentNormals.tangentSpace;
+		o_solvers.bentNormals = std::unique_ptr<BentNormalsSolver>(new BentNormalsSolver(solverParams));
+		o_solvers.bentNormals->init(map, meshMapping);
+	}
+
+	if (params.ao.enabled)
+	{
+		AmbientOcclusionSolver::Params solverParams;
+		solverParams.sampleCount = (uint32_t)params.ao.sampleCount;
+		solverParams.minDistance = params.ao.minDistance;
+		solverParams.maxDistance = params.ao.maxDistance;
+		o_solvers.ao = std::unique_ptr<AmbientOcclusionSolver>(new AmbientOcclusionSolver(solverParams));
+		o_solvers.ao->init(map, meshMapping);
+	}
+
+	if (params.normals.enabled)
+	{
+		NormalsSolver::Params solverParams;
+		solverParams.tangentSpace = params.normals.tangentSpace;
+		o_solvers.normals = std::unique_ptr<NormalsSolver>(new NormalsSolver(solverParams));
+		o_solvers.normals->init(map, meshMapping);
+	}
+
+	if (params.positions.enabled)
+	{
+		o_solvers.positions = std::unique_ptr<PositionSolver>(new PositionSolver());
+		o_solvers.positions->init(map, meshMapping);
+	}
+
+	if (params.height.enabled)
+	{
+		HeightSolver::Params solverParams;
+		solverParams.maxDistance = params.height.maxDistance;
+		solverParams.normalizeOutput = params.height.normalizeOutput;
+		o_solvers.height = std::unique_ptr<HeightSolver>(new HeightSolver(solverParams));
+		o_solvers.height->init(map, meshMapping);
+	}
+}
+
+// Adds the tasks that run and export the solvers, once the mesh mapping is done
+// @return The nodes of the added tasks
+static std::vector<TaskGraph::Node> addSolverTasks(const FornosParameters &params, BakeSolvers &solvers, TaskGraph &graph, TaskGraph::Node mapping)
+{
+	std::vector<TaskGraph::Node> nodes;
+	if (solvers.height)
+	{
+		nodes.push_back(graph.addContextTask(
+			new HeightTask(std::move(solvers.height), params.height.outputPath.c_str(), params.shared.texDilation), { mapping }
+		));
+	}
+
+	if (solvers.positions)
+	{
+		nodes.push_back(graph.addContextTask(
+			new PositionTask(std::move(solvers.positions), params.positions.outputPath.c_str()), { mapping }
+		));
+	}
+
+	if (solvers.normals)
+	{
+		nodes.push_back(graph.addContextTask(
+			new NormalsTask(std::move(solvers.normals), params.normals.outputPath.c_str(), params.shared.texDilation), { mapping }
+		));
+	}
+
+	if (solvers.ao)
+	{
+		nodes.push_back(graph.addContextTask(
+			new AmbientOcclusionTask(std::move(solvers.ao), params.ao.outputPath.c_str(), params.shared.texDilation), { mapping }
+		));
+	}
+
+	if (solvers.bentNormals)
+	{
+		nodes.push_back(graph.addContextTask(
+			new BentNormalsTask(std::move(solvers.bentNormals), params.bentNormals.outputPath.c_str(), params.shared.texDilation), { mapping }
+		));
+	}
+
+	if (solvers.thickness)
+	{
+		nodes.push_back(graph.addContextTask(
+			new ThicknessTask(std::move(solvers.thickness), params.thickness.outputPath.c_str(), params.shared.texDilation), { mapping }
+		));
+	}
+	return nodes;
+}
+
+/// High poly mesh ready to upload, with its BVH built
+struct HiPolyBuild
+{
+	std::shared_ptr<const Mesh> mesh;
+	std::unique_ptr<InstancedMesh> instancedMesh; // Uploaded instead of the mesh when given
+	std::unique_ptr<CompactMesh> compactMesh; // Replaces the mesh for very big meshes
+	std::unique_ptr<BVH> bvh;
+};
+
+/// Builds the BVH of the high poly mesh, without any OpenGL calls.
+/// The compact mesh replaces the high poly mesh as soon as it is built, the mesh is released if nothing else holds it.
+/// Instanced meshes build the BVH of their parts and instances.
+static void buildHiPolyBVH(const FornosParameters_Shared &params, HiPolyBuild &build)
+{
+	if (build.instancedMesh)
+	{
+		if (params.compactHiPolyMesh)
+		{
+			logWarning("Instances", "Instanced meshes are not compacted");
+		}
+		build.instancedMesh->buildBVH(params.bvhTrisPerNode);
+		logDebug("Instances",
+			std::to_string(build.instancedMesh->mesh.triangles.size()) + " part triangles instead of " +
+			std::to_string(build.instancedMesh->instancedTriangleCount()));
+	}
+	else if (params.compactHiPolyMesh)
+	{
+		if (!build.compactMesh) build.compactMesh.reset(CompactMesh::create(build.mesh.get()));
+		build.mesh.reset();
+		profileMemory();
+		build.bvh.reset(BVH::createBinary(build.compactMesh.get(), params.bvhTrisPerNode, 8192));
+	}
+	else
+	{
+		build.bvh.reset(BVH::createBinary(build.mesh.get(), params.bvhTrisPerNode, 8192));
+	}
+	profileMemory();
+}
+
+/// Uploads the high poly mesh in the BVH order, without any texels to map yet, and releases the build
+static std::shared_ptr<MeshMapping> uploadHiPolyMesh(const FornosParameters_Shared &params, HiPolyBuild &build)
+{
+	std::shared_ptr<MeshMapping> meshMapping(new MeshMapping());
+	if (build.instancedMesh) meshMapping->initMesh(build.instancedMesh.get(), params.ignoreBackfaces);
+	else if (build.compactMesh) meshMapping->initMesh(build.compactMesh.get(), *build.bvh, params.ignoreBackfaces);
+	else meshMapping->initMesh(build.mesh.get(), *build.bvh, params.ignoreBackfaces);
+	build = HiPolyBuild();
+	profileMemory();
+	return meshMapping;
+}
+
+// Square tiles of the texture, none if it's baked at once
+static std::vector<MapRegion> splitTiles(const FornosParameters_Shared &params)
+{
+	std::vector<MapRegion> tiles;
+	if (params.tileSize > 0 &&
+		(params.tileSize < params.texWidth || params.tileSize < params.texHeight))
+	{
+		const uint32_t tileSize = (uint32_t)params.tileSize;
+		for (uint32_t y = 0; y < (uint32_t)params.texHeight; y += tileSize)
+		{
+			for (uint32_t x = 0; x < (uint32_t)params.texWidth; x += tileSize)
+			{
+				MapRegion tile;
+				tile.x = x;
+				tile.y = y;
+				tile.width = std::min(tileSize, (uint32_t)params.texWidth - x);
+				tile.height = std::min(tileSize, (uint32_t)params.texHeight - y);
+				tiles.push_back(tile);
+			}
+		}
+	}
+	return tiles;
+}
+
+static const uint64_t k_hashSeed = 14695981039346656037ull;
+
+// Murmur3 finalizer, every bit of the input flips about half of the bits of the output
+static uint64_t mixHash(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Both the word and the hash are mixed, so changes in different words never cancel each other
+static uint64_t hashWord(uint64_t hash, uint64_t word)
+{
+	return mixHash(hash ^ mixHash(word));
+}
+
+// Hashes the whole file a word at a time, false if it can't be read
+static bool hashFile(const std::string &path, uint64_t &io_hash)
+{
+	MappedFile file(path.c_str());
+	if (!file.valid()) return false;
+	const char *data = file.data();
+	const size_t size = file.size();
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		io_hash = hashWord(io_hash, word);
+	}
+	if (i < size)
+	{
+		uint64_t word = 0;
+		memcpy(&word, data + i, size - i);
+		io_hash = hashWord(io_hash, word);
+	}
+	io_hash = hashWord(io_hash, (uint64_t)size);
+	return true;
+}
+
+/// Content hashes of the mesh files of the previous bakes, with the sizes and modification times the files had
+/// when they were hashed. A file is only read and hashed again once its size or modification time changes.
+/// Only used by the hashes stage of the pending bake.
+struct FileHashes
+{
+	struct Entry
+	{
+		uint64_t size;
+		int64_t modified;
+		uint64_t hash;
+	};
+	std::map<std::string, Entry> entries;
+};
+
+// Content hash of a file, reused from a previous bake if the file has the same size and modification time
+static bool hashFile(FileHashes &hashes, const std::string &path, uint64_t size, int64_t modified, uint64_t &o_hash)
+{
+	const auto it = hashes.entries.find(path);
+	if (it != hashes.entries.end() && modified != 0 && it->second.size == size && it->second.modified == modified)
+	{
+		o_hash = it->second.hash;
+		return true;
+	}
+	o_hash = k_hashSeed;
+	if (!hashFile(path, o_hash))
+	{
+		hashes.entries.erase(path);
+		return false;
+	}
+	hashes.entries[path] = FileHashes::Entry{ size, modified, o_hash };
+	return true;
+}
+
+static uint64_t hashValues(uint64_t hash, std::initializer_list<uint64_t> values)
+{
+	for (uint64_t value : values) hash = hashWord(hash, value);
+	return hash != 0 ? hash : 1;
+}
+
+/// Keys of the stages of a bake: the contents of the files and every parameter each stage depends on.
+/// Stages with the same key as in a previous bake produce the same data. Zero if a file can't be read.
+struct BakeKeys
+{
+	uint64_t lowPoly = 0; // Low poly mesh with its normals, tangent space and mapping directions
+	uint64_t hiPoly = 0; // High poly mesh uploaded with its BVH, zero for instance descriptions (the parts aren't hashed)
+	uint64_t map = 0; // Texels of the whole texture rasterized from the low poly mesh
+
+	/// The mapping of the map texels to the high poly mesh, also the name of its cache file
+	uint64_t mapping() const { return map != 0 && hiPoly != 0 ? hashValues(map, { hiPoly }) : 0; }
+};
+
+// Mesh files of the mapping cache, read before hashing them so a file written meanwhile won't match its cache
+static MeshMappingSources mappingSources(const FornosParameters_Shared &params)
+{
+	MeshMappingSources sources;
+	const std::string *paths[] = { &params.loPolyMeshPath, &params.hiPolyMeshPath };
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!paths[i]->empty()) fileStamp(paths[i]->c_str(), sources.sizes[i], sources.modified[i]);
+	}
+	return sources;
+}
+
+// The files are hashed with the stamps of the sources, taken before reading them
+static BakeKeys bakeKeys(const FornosParameters &params, const MeshMappingSources &sources, FileHashes &hashes)
+{
+	const FornosParameters_Shared &shared = params.shared;
+	BakeKeys keys;
+
+	uint64_t lowPolyHash;
+	if (!hashFile(hashes, shared.loPolyMeshPath, sources.sizes[0], sources.modified[0], lowPolyHash)) return keys;
+	// The tangent space is only computed for the bakers that need it
+	const bool tangentSpace =
+		(params.normals.enabled && params.normals.tangentSpace) ||
+		(params.bentNormals.enabled && params.bentNormals.tangentSpace);
+	keys.lowPoly = hashValues(lowPolyHash, {
+		(uint64_t)shared.loPolyMeshNormal,
+		shared.weldObjVertices,
+		tangentSpace,
+		shared.mapping != MeshMappingMethod::LowPolyNormals,
+	});
+
+	uint32_t mappingEdge;
+	memcpy(&mappingEdge, &shared.mappingEdge, sizeof(mappingEdge));
+	keys.map = hashValues(keys.lowPoly, {
+		(uint64_t)shared.texWidth,
+		(uint64_t)shared.texHeight,
+		(uint64_t)samplesPerAxis(shared),
+		(uint64_t)shared.sampleFilter,
+		(uint64_t)shared.mapping,
+		mappingEdge,
+	});
+
+	// Without a high poly mesh the low poly mesh is baked as it is
+	uint64_t hiPolyHash = keys.lowPoly;
+	if (InstancedMesh::isDescription(shared.hiPolyMeshPath.c_str())) return keys;
+	if (!shared.hiPolyMeshPath.empty())
+	{
+		if (!hashFile(hashes, shared.hiPolyMeshPath, sources.sizes[1], sources.modified[1], hiPolyHash)) return keys;
+	}
+	keys.hiPoly = hashValues(hiPolyHash, {
+		shared.hiPolyMeshPath.empty(),
+		(uint64_t)shared.hiPolyMeshNormal,
+		shared.weldObjVertices,
+		shared.compactHiPolyMesh,
+		shared.instanceRepeatedGroups,
+		(uint64_t)shared.bvhTrisPerNode,
+		shared.ignoreBackfaces,
+	});
+	return keys;
+}
+
+/// What the previous bakes loaded and built, kept by the runner between bakes.
+/// A bake reuses every stage with the same key and only redoes the stages whose files or parameters changed.
+struct BakeSession
+{
+	BakeKeys keys;
+	std::shared_ptr<Mesh> lowPolyMesh;
+	std::shared_ptr<Mesh> lowPolyMeshForMapping;
+	std::shared_ptr<MeshMapping> hiPolyMapping; // Without any texels, or with the mapped texels of the whole texture
+	std::shared_ptr<CompressedMapUV> map;
+	std::shared_ptr<const CompressedMapUV> mappedMap; // The map hiPolyMapping has the mapping of, once it's done
+};
+
+static std::string mappingCachePath(const std::string &dir, uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.fmap", (unsigned long long)key);
+	const bool separator = !dir.empty() && dir.back() != '/' && dir.back() != '\\';
+	return dir + (separator ? "/" : "") + name;
+}
+
+// Output path of a UDIM tile, replaces the <UDIM> tag or appends the tile number before the extension
+static std::string udimOutputPath(const std::string &path, int udim)
+{
+	const std::string tag = "<UDIM>";
+	const std::string number = std::to_string(udim);
+	const size_t tagPos = path.find(tag);
+	if (tagPos != std::string::npos)
+	{
+		return path.substr(0, tagPos) + number + path.substr(tagPos + tag.size());
+	}
+	const size_t extPos = path.find_last_of('.');
+	const size_t sepPos = path.find_last_of("/\\");
+	if (extPos == std::string::npos || (sepPos != std::string::npos && extPos < sepPos))
+	{
+		return path + "." + number;
+	}
+	return path.substr(0, extPos) + "." + number + path.substr(extPos);
+}
+
+static FornosParameters udimParameters(const FornosParameters &params, int udim)
+{
+	FornosParameters tileParams = params;
+	tileParams.height.outputPath = udimOutputPath(params.height.outputPath, udim);
+	tileParams.positions.outputPath = udimOutputPath(params.positions.outputPath, udim);
+	tileParams.normals.outputPath = udimOutputPath(params.normals.outputPath, udim);
+	tileParams.ao.outputPath = udimOutputPath(params.ao.outputPath, udim);
+	tileParams.bentNormals.outputPath = udimOutputPath(params.bentNormals.outputPath, udim);
+	tileParams.thickness.outputPath = udimOutputPath(params.thickness.outputPath, udim);
+	return tileParams;
+}
+
+// Groups the triangles by the UDIM tile (1001 + u + 10 * v) that contains their texture coordinates centroid
+static std::map<int, std::vector<Mesh::Triangle> > splitUdimTiles(const Mesh *mesh)
+{
+	std::map<int, std::vector<Mesh::Triangle> > tiles;
+	size_t outside = 0;
+	for (const auto &tri : mesh->triangles)
+	{
+		const auto &v0 = mesh->vertices[tri.vertexIndex0];
+		const auto &v1 = mesh->vertices[tri.vertexIndex1];
+		const auto &v2 = mesh->vertices[tri.vertexIndex2];
+		if (v0.texcoordIndex == UINT32_MAX || v1.texcoordIndex == UINT32_MAX || v2.texcoordIndex == UINT32_MAX)
+		{
+			// Left in the first tile so the rasterization reports the missing attributes
+			tiles[1001].push_back(tri);
+			continue;
+		}
+
+		const Vector2 centroid = (mesh->texcoords[v0.texcoordIndex] +
+			mesh->texcoords[v1.texcoordIndex] + mesh->texcoords[v2.texcoordIndex]) * (1.0f / 3.0f);
+		const int u = (int)std::floor(centroid.x);
+		const int v = (int)std::floor(centroid.y);
+		if (u < 0 || u > 9 || v < 0)
+		{
+			++outside;
+			continue;
+		}
+		tiles[1001 + u + 10 * v].push_back(tri);
+	}
+	if (outside > 0)
+	{
+		logWarning("UDIM", std::to_string(outside) + " triangles outside of the UDIM range are not baked");
+	}
+	return tiles;
+}
+
+// Copy of the mesh with only some of its triangles.
+// Vertex indices are kept, so the mesh for the mapping directions is still valid for it.
+static Mesh* createSubMesh(const Mesh *mesh, const std::vector<Mesh::Triangle> &triangles)
+{
+	Mesh *subMesh = new Mesh();
+	subMesh->positions = mesh->positions;
+	subMesh->texcoords = mesh->texcoords;
+	subMesh->normals = mesh->normals;
+	subMesh->tangents = mesh->tangents;
+	subMesh->bitangents = mesh->bitangents;
+	subMesh->vertices = mesh->vertices;
+	subMesh->triangles = triangles;
+	return subMesh;
+}
+
+// Copy of the mesh with only the tile triangles and the texture coordinates moved to the 0-1 range
+static Mesh* createUdimTileMesh(const Mesh *mesh, int udim, const std::vector<Mesh::Triangle> &triangles)
+{
+	const Vector2 offset((float)((udim - 1001) % 10), (float)((udim - 1001) / 10));
+	Mesh *tileMesh = createSubMesh(mesh, triangles);
+	for (auto &uv : tileMesh->texcoords) uv = uv - offset;
+	return tileMesh;
+}
+
+/// Low poly triangles baked only against some of the high poly triangles
+struct BakeGroup
+{
+	std::string name;
+	std::vector<Mesh::Triangle> lowPolyTriangles;
+	std::vector<uint32_t> hiPolyTriangles;
+};
+
+// Name shared by the low and high poly versions of a group: any case and without a _low, _lo, _high or _hi suffix
+static std::string bakeGroupName(const std::string &name)
+{
+	std::string lower(name);
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	for (const std::string suffix : { "_low", "_lo", "_high", "_hi" })
+	{
+		if (lower.size() > suffix.size() && lower.compare(lower.size() - suffix.size(), suffix.size(), suffix) == 0)
+		{
+			return lower.substr(0, lower.size() - suffix.size());
+		}
+	}
+	return lower;
+}
+
+// Matches the low poly groups with the high poly groups of the same name. The low poly groups without a match
+// are baked together against the high poly groups without a match. Empty if any of the meshes has no groups.
+static std::vector<BakeGroup> matchBakeGroups(const Mesh *lowPolyMesh, const Mesh *hiPolyMesh)
+{
+	std::vector<BakeGroup> groups;
+	if (lowPolyMesh->groups.empty() || hiPolyMesh->groups.empty()) return groups;
+
+	std::map<std::string, size_t> groupIndices;
+	for (const auto &group : lowPolyMesh->groups)
+	{
+		const std::string name = bakeGroupName(group.name);
+		auto it = groupIndices.find(name);
+		if (it == groupIndices.end())
+		{
+			it = groupIndices.emplace(name, groups.size()).first;
+			groups.emplace_back();
+			groups.back().name = name;
+		}
+		auto &triangles = groups[it->second].lowPolyTriangles;
+		triangles.insert(triangles.end(),
+			lowPolyMesh->triangles.begin() + group.firstTriangle,
+			lowPolyMesh->triangles.begin() + group.firstTriangle + group.triangleCount);
+	}
+
+	BakeGroup unmatched;
+	unmatched.name = "unmatched";
+	for (const auto &group : hiPolyMesh->groups)
+	{
+		auto it = groupIndices.find(bakeGroupName(group.name));
+		auto &triangles = it != groupIndices.end() ? groups[it->second].hiPolyTriangles : unmatched.hiPolyTriangles;
+		for (uint32_t i = 0; i < group.triangleCount; ++i) triangles.push_back(group.firstTriangle + i);
+	}
+
+	std::vector<BakeGroup> matched;
+	for (auto &group : groups)
+	{
+		if (!group.hiPolyTriangles.empty())
+		{
+			matched.push_back(std::move(group));
+			continue;
+		}
+		logDebug("Groups", "No high poly group matches " + group.name);
+		unmatched.lowPolyTriangles.insert(unmatched.lowPolyTriangles.end(),
+			group.lowPolyTriangles.begin(), group.lowPolyTriangles.end());
+	}
+	if (!unmatched.lowPolyTriangles.empty())
+	{
+		if (unmatched.hiPolyTriangles.empty())
+		{
+			logWarning("Groups", std::to_string(unmatched.lowPolyTriangles.size()) +
+				" low poly triangles without a matching high poly group are not baked");
+		}
+		else
+		{
+			matched.push_back(std::move(unmatched));
+		}
+	}
+	logDebug("Groups", std::to_string(matched.size()) + " groups matched by name");
+	return matched;
+}
+
+/// Tiles of a tiled bake, or of the groups matched by name (every tile of a group, when tiled), baked one after
+/// another. Every tile gets its own compressed map and solvers, so the GPU buffers and the per-texel pipeline
+/// data are bounded by the tile size. The results of a baked tile are written into the output images on the
+/// workers and released, only the images are kept until they are saved.
+/// The tiles are rasterized and the BVH of every group is built on the workers, one tile ahead of the bake.
+struct TiledBake
+{
+	/// What the rasterization of a tile leaves for its bake, and the bake for the output of the tile
+	struct Work
+	{
+		std::shared_ptr<CompressedMapUV> map;
+		std::unique_ptr<BVH> groupBVH; // Only for the first tile of a group
+
+		std::unique_ptr<float[]> height;
+		std::unique_ptr<Vector3[]> positions;
+		std::unique_ptr<Vector3[]> normals;
+		std::unique_ptr<float[]> ao;
+		std::unique_ptr<Vector3[]> bentNormals;
+		std::unique_ptr<float[]> thickness;
+	};
+
+	FornosParameters params;
+	std::shared_ptr<const Mesh> lowPolyMesh;
+	std::shared_ptr<const Mesh> lowPolyMeshForMapping;
+	std::shared_ptr<const Mesh> hiPolyMesh; // Only for groups, each one is mapped to a BVH of its own triangles
+	std::vector<BakeGroup> groups;
+	std::vector<MapRegion> tiles;
+	std::vector<Work> work; // One per tile, written by its rasterization, its bake and released by its output
+
+	// Only used by the rasterizations, which run one after another
+	std::shared_ptr<const Mesh> groupMesh;
+	size_t groupMeshIndex = 0;
+
+	// Only used by the bakes on the context thread
+	std::shared_ptr<MeshMapping> meshMapping; // Of the high poly mesh, or of the group being baked
+
+	// Only used by the outputs, which run one after another
+	std::unique_ptr<ImageWriter> heightImage;
+	std::unique_ptr<ImageWriter> positionsImage;
+	std::unique_ptr<ImageWriter> normalsImage;
+	std::unique_ptr<ImageWriter> aoImage;
+	std::unique_ptr<ImageWriter> bentNormalsImage;
+	std::unique_ptr<ImageWriter> thicknessImage;
+	bool covered = false;
+
+	// Every tile of every group, the whole texture is a single tile if the bake isn't tiled
+	size_t tileCount() const { return std::max<size_t>(tiles.size(), 1); }
+	size_t workCount() const { return tileCount() * std::max<size_t>(groups.size(), 1); }
+	size_t groupIndex(size_t index) const { return index / tileCount(); }
+	const MapRegion* tileRegion(size_t index) const { return tiles.empty() ? nullptr : &tiles[index % tileCount()]; }
+
+	// Rasterizes a tile, and builds the BVH of its group if it is the first tile of the group
+	void rasterize(size_t index)
+	{
+		Work &tile = work[index];
+		if (!groups.empty() && index % tileCount() == 0)
+		{
+			PROFILE_ZONE("Group BVH");
+			tile.groupBVH.reset(BVH::createBinary(hiPolyMesh.get(), groups[groupIndex(index)].hiPolyTriangles,
+				params.shared.bvhTrisPerNode, 8192));
+		}
+		if (!tile.map) // The runner already rasterized the first tile
+		{
+			PROFILE_ZONE("Tile rasterization");
+			const Mesh *mesh = lowPolyMesh.get();
+			if (!groups.empty())
+			{
+				if (!groupMesh || groupMeshIndex != groupIndex(index))
+				{
+					groupMesh.reset(createSubMesh(lowPolyMesh.get(), groups[groupIndex(index)].lowPolyTriangles));
+					groupMeshIndex = groupIndex(index);
+				}
+				mesh = groupMesh.get();
+			}
+			tile.map = std::shared_ptr<CompressedMapUV>(createCompressedMap(
+				params.shared, mesh, lowPolyMeshForMapping.get(), tileRegion(index)));
+		}
+		if (index + 1 == work.size()) groupMesh.reset();
+		profileMemory();
+	}
+
+	// Writes the results of a baked tile into the images and releases the tile
+	void writeTile(size_t index)
+	{
+		PROFILE_ZONE("Tile output");
+		if (index == 0) createImages();
+		Work &tile = work[index];
+		const CompressedMapUV *map = tile.map.get();
+		if (map && !map->indices.empty())
+		{
+			covered = true;
+			if (tile.height) heightImage->write(tile.height.get(), map);
+			if (tile.positions) positionsImage->write(tile.positions.get(), map);
+			if (tile.normals) normalsImage->write(tile.normals.get(), map);
+			if (tile.ao) aoImage->write(tile.ao.get(), map);
+			if (tile.bentNormals) bentNormalsImage->write(tile.bentNormals.get(), map);
+			if (tile.thickness) thicknessImage->write(tile.thickness.get(), map);
+		}
+		tile = Work();
+		profileMemory();
+	}
+
+	void saveImages()
+	{
+		if (!covered)
+		{
+			logWarning("Tiles", "No texels covered by the low poly mesh");
+			return;
+		}
+
+		if (heightImage)
+		{
+			Vector2 minmax;
+			heightImage->save(&minmax);
+			logDebug("Height", "Height map range: " + std::to_string(minmax.x) + " to " + std::to_string(minmax.y));
+		}
+		if (positionsImage) positionsImage->save();
+		if (normalsImage) normalsImage->save();
+		if (aoImage) aoImage->save();
+		if (bentNormalsImage) bentNormalsImage->save();
+		if (thicknessImage)
+		{
+			Vector2 minmax;
+			thicknessImage->save(&minmax);
+			logDebug("Thickness", "Thickness map range: " + std::to_string(minmax.x) + " to " + std::to_string(minmax.y));
+		}
+	}
+
+	void createImages()
+	{
+		const uint32_t w = (uint32_t)params.shared.texWidth;
+		const uint32_t h = (uint32_t)params.shared.texHeight;
+		const int dilation = params.shared.texDilation;
+		if (params.height.enabled)
+		{
+			heightImage.reset(new ImageWriter(ImageWriter::Type::Float, params.height.outputPath.c_str(), w, h,
+				dilation, Vector2(0, params.height.maxDistance), params.height.normalizeOutput));
+		}
+		if (params.positions.enabled)
+		{
+			positionsImage.reset(new ImageWriter(ImageWriter::Type::Vector, params.positions.outputPath.c_str(), w, h));
+		}
+		if (params.normals.enabled)
+		{
+			normalsImage.reset(new ImageWriter(ImageWriter::Type::Normal, params.normals.outputPath.c_str(), w, h, dilation));
+		}
+		if (params.ao.enabled)
+		{
+			aoImage.reset(new ImageWriter(ImageWriter::Type::Float, params.ao.outputPath.c_str(), w, h,
+				dilation, Vector2(0, 0), true));
+		}
+		if (params.bentNormals.enabled)
+		{
+			bentNormalsImage.reset(new ImageWriter(ImageWriter::Type::Normal, params.bentNormals.outputPath.c_str(), w, h, dilation));
+		}
+		if (params.thickness.enabled)
+		{
+			thicknessImage.reset(new ImageWriter(ImageWriter::Type::Float, params.thickness.outputPath.c_str(), w, h,
+				dilation, Vector2(0, 0), true));
+		}
+	}
+};
+
+/// Bakes a tile of a tiled bake once it is rasterized: uploads the BVH of its group if it starts one, maps the
+/// tile and runs every solver, reading their results back as they finish
+class TileBakeTask : public FornosTask
+{
+public:
+	TileBakeTask(std::shared_ptr<TiledBake> tiled, size_t index)
+		: _tiled(tiled)
+		, _index(index)
+		, _step(Step::Start)
+	{
+	}
+
+	bool runStep()
+	{
+		if (_step == Step::Start && !startTile()) return true;
+
+		TiledBake &tiled = *_tiled;
+		TiledBake::Work &work = tiled.work[_index];
+		bool done = false;
+		switch (_step)
+		{
+		case Step::Mapping:
+			done = tiled.meshMapping->runStep();
+			if (done) glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			break;
+		case Step::Height:
+			done = _solvers.height->runStep();
+			if (done) work.height.reset(_solvers.height->getResults());
+			break;
+		case Step::Positions:
+			done = _solvers.positions->runStep();
+			if (done) work.positions.reset(_solvers.positions->getResults());
+			break;
+		case Step::Normals:
+			done = _solvers.normals->runStep();
+			if (done) work.normals.reset(_solvers.normals->getResults());
+			break;
+		case Step::AmbientOcclusion:
+			done = _solvers.ao->runStep();
+			if (done) work.ao.reset(_solvers.ao->getResults());
+			break;
+		case Step::BentNormals:
+			done = _solvers.bentNormals->runStep();
+			if (done) work.bentNormals.reset(_solvers.bentNormals->getResults());
+			break;
+		case Step::Thickness:
+			done = _solvers.thickness->runStep();
+			if (done) work.thickness.reset(_solvers.thickness->getResults());
+			break;
+		default:
+			break;
+		}
+
+		if (done) nextStep();
+		if (_step != Step::Done) return false;
+
+		_solvers = BakeSolvers();
+		_map.reset();
+		profileMemory();
+		return true;
+	}
+
+	void finish()
+	{
+		if (_index + 1 == _tiled->work.size()) _tiled->meshMapping.reset(); // The last group mapping isn't needed
+	}
+
+	float progress() const
+	{
+		return (float)(int)_step / (float)(int)Step::Done;
+	}
+
+	const char* name() const { return _tiled->groups.empty() ? "Tile bake" : "Group bake"; }
+
+private:
+	enum class Step { Start, Mapping, Height, Positions, Normals, AmbientOcclusion, BentNormals, Thickness, Done };
+
+	// Uploads the group and sets the tile map, false if the tile has no texels
+	bool startTile()
+	{
+		TiledBake &tiled = *_tiled;
+		TiledBake::Work &work = tiled.work[_index];
+		_map = work.map; // Kept for the output of the tile
+		if (work.groupBVH)
+		{
+			tiled.meshMapping.reset(); // Release the previous group before uploading the next one
+			tiled.meshMapping.reset(new MeshMapping());
+			tiled.meshMapping->initMesh(tiled.hiPolyMesh.get(), *work.groupBVH, tiled.params.shared.ignoreBackfaces);
+			work.groupBVH.reset();
+			profileMemory();
+		}
+		if (!_map || _map->indices.empty())
+		{
+			_map.reset();
+			_step = Step::Done;
+			return false;
+		}
+
+		if (tiled.groups.empty())
+		{
+			logDebug("Tiles", "Tile " + std::to_string(_index + 1) + "/" + std::to_string(tiled.workCount()) +
+				" with " + std::to_string(_map->indices.size()) + " texels");
+		}
+		else
+		{
+			const BakeGroup &group = tiled.groups[tiled.groupIndex(_index)];
+			logDebug("Groups", "Group " + group.name + " (" + std::to_string(tiled.groupIndex(_index) + 1) + "/" +
+				std::to_string(tiled.groups.size()) + ") with " + std::to_string(_map->indices.size()) + " texels and " +
+				std::to_string(group.hiPolyTriangles.size()) + " high poly triangles");
+		}
+
+		tiled.meshMapping->setMap(_map);
+		createSolvers(tiled.params, _map, tiled.meshMapping, _solvers);
+		_step = Step::Mapping;
+		return true;
+	}
+
+	bool hasSolver(Step step) const
+	{
+		switch (step)
+		{
+		case Step::Height: return _solvers.height != nullptr;
+		case Step::Positions: return _solvers.positions != nullptr;
+		case Step::Normals: return _solvers.normals != nullptr;
+		case Step::AmbientOcclusion: return _solvers.ao != nullptr;
+		case Step::BentNormals: return _solvers.bentNormals != nullptr;
+		case Step::Thickness: return _solvers.thickness != nullptr;
+		default: return true;
+		}
+	}
+
+	void nextStep()
+	{
+		do
+		{
+			_step = Step((int)_step + 1);
+		} while (!hasSolver(_step));
+	}
+
+	std::shared_ptr<TiledBake> _tiled;
+	const size_t _index;
+	std::shared_ptr<CompressedMapUV> _map;
+	BakeSolvers _solvers;
+	Step _step;
+};
+
+// Adds the rasterization, the bake and the output of every tile, and the export once all of them are written.
+// A tile is rasterized while the previous one bakes, baked once the previous one is done and written into the
+// images while the next one bakes.
+static void addTiledBake(TaskGraph &graph, std::shared_ptr<TiledBake> tiled)
 {
-	fprintf(stderr, "Error %d: %s\n", error, description);
+	TaskGraph::Node raster = TaskGraph::k_noNode;
+	TaskGraph::Node bake = TaskGraph::k_noNode;
+	TaskGraph::Node previousBake = TaskGraph::k_noNode;
+	TaskGraph::Node output = TaskGraph::k_noNode;
+	for (size_t i = 0; i < tiled->work.size(); ++i)
+	{
+		raster = graph.addWorkerJob("Tile rasterization", [tiled, i](FunctionTask&) { tiled->rasterize(i); }, { raster, previousBake });
+		previousBake = bake;
+		bake = graph.addContextTask(new TileBakeTask(tiled, i), { raster, bake });
+		output = graph.addWorkerJob("Tile output", [tiled, i](FunctionTask&) { tiled->writeTile(i); }, { bake, output });
+	}
+	graph.addWorkerJob("Tiled export", [tiled](FunctionTask&) { tiled->saveImages(); }, { output });
 }
 
-bool FornosRunner::start(const FornosParameters &params, std::string &errors)
+/// What the stages of a bake pass to each other. The stages run on different threads: every member is written
+/// by a single stage and only read by the stages that depend on it, or before any stage runs.
+struct BakeStages
 {
-	// TODO: Several of this steps can take long and they will freeze the UI
+	FornosParameters params;
+	BakeKeys keys;
+	MeshMappingSources sources;
+	std::vector<MapRegion> tiles;
+	bool matchGroups = false;
+
+	std::shared_ptr<Mesh> lowPolyMesh;
+	std::shared_ptr<Mesh> lowPolyMeshForMapping;
+	std::shared_ptr<Mesh> hiPolyMesh; // Kept on the CPU only for the groups
+	HiPolyBuild hiPolyBuild;
+	std::vector<BakeGroup> groups;
+	std::shared_ptr<MeshMapping> meshMapping;
+	std::shared_ptr<CompressedMapUV> compressedMap;
+	std::unique_ptr<MeshMappingCacheData> cacheData; // Read from the mapping cache, uploaded by the plan
 
-	std::shared_ptr<Mesh> lowPolyMesh(Mesh::loadFile(params.shared.loPolyMeshPath.c_str()));
-	if (lowPolyMesh)
+	// UDIM tiles with their triangles, baked one after another
+	std::vector<std::pair<int, std::vector<Mesh::Triangle> > > udimTiles;
+	std::vector<std::shared_ptr<CompressedMapUV> > udimMaps; // Rasterized while the previous tile bakes
+	size_t udimBakedTiles = 0;
+
+	/// The first error is reported, the stages after it do nothing
+	void fail(const std::string &error)
 	{
-		switch (params.shared.loPolyMeshNormal)
-		{
-		case NormalImport::Import: break;
-		case NormalImport::ComputePerFace: lowPolyMesh->computeFaceNormals(); break;
-		case NormalImport::ComputePerVertex: lowPolyMesh->computeVertexNormals(); break;
-		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_errors.empty()) _errors = error;
 	}
-	else
+
+	bool failed()
 	{
-		errors = "Missing low poly mesh";
-		return false;
+		std::lock_guard<std::mutex> lock(_mutex);
+		return !_errors.empty();
 	}
 
-	std::shared_ptr<Mesh> hiPolyMesh = 
-		params.shared.hiPolyMeshPath.empty() ?
-		lowPolyMesh : 
-		std::shared_ptr<Mesh>(Mesh::loadFile(params.shared.hiPolyMeshPath.c_str()));
-	if (hiPolyMesh && hiPolyMesh != lowPolyMesh)
+	std::string errors()
 	{
-		switch (params.shared.hiPolyMeshNormal)
-		{
-		case NormalImport::Import: break;
-		case NormalImport::ComputePerFace: hiPolyMesh->computeFaceNormals(); break;
-		case NormalImport::ComputePerVertex: hiPolyMesh->computeVertexNormals(); break;
-		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _errors;
 	}
 
-	const bool needsTangentSpace = 
+private:
+	std::mutex _mutex;
+	std::string _errors;
+};
+
+// Loads the low poly mesh with the normals and tangent space the bakers need, and the mesh for the mapping directions
+static void loadLowPolyMesh(BakeStages &bake, FunctionTask &task)
+{
+	const FornosParameters &params = bake.params;
+	std::shared_ptr<Mesh> lowPolyMesh(Mesh::loadFile(params.shared.loPolyMeshPath.c_str(), params.shared.weldObjVertices));
+	if (!lowPolyMesh)
+	{
+		bake.fail("Missing low poly mesh");
+		return;
+	}
+	task.setProgress(0.5f);
+	switch (params.shared.loPolyMeshNormal)
+	{
+	case NormalImport::Import: break;
+	case NormalImport::ComputePerFace: lowPolyMesh->computeFaceNormals(); break;
+	case NormalImport::ComputePerVertex: lowPolyMesh->computeVertexNormals(); break;
+	}
+	task.setProgress(0.6f);
+
+	const bool needsTangentSpace =
 		(params.normals.enabled && params.normals.tangentSpace) ||
 		(params.bentNormals.enabled && params.bentNormals.tangentSpace);
 
-	if (needsTangentSpace)
+	// Converted meshes can store the tangent space, unless the normals were just computed
+	const bool hasTangentSpace = !lowPolyMesh->tangents.empty() && params.shared.loPolyMeshNormal == NormalImport::Import;
+	if (needsTangentSpace && !hasTangentSpace)
 	{
 		lowPolyMesh->computeTangentSpace();
 	}
+	task.setProgress(0.8f);
 
-	std::shared_ptr<MapUV> map;
-	
-	switch (params.shared.mapping)
+	std::shared_ptr<Mesh> lowPolyMeshForMapping = lowPolyMesh;
+	if (params.shared.mapping != MeshMappingMethod::LowPolyNormals &&
+		params.shared.loPolyMeshNormal != NormalImport::ComputePerVertex)
 	{
-	case MeshMappingMethod::Smooth:
+		lowPolyMeshForMapping = std::shared_ptr<Mesh>(Mesh::createCopy(lowPolyMesh.get()));
+		lowPolyMeshForMapping->computeVertexNormalsAggressive();
+	}
+
+	bake.lowPolyMesh = lowPolyMesh;
+	bake.lowPolyMeshForMapping = lowPolyMeshForMapping;
+	profileMemory();
+}
+
+// Loads the high poly mesh, or the instances of its parts, with the normals of the parameters.
+// A compact mesh with the imported normals is read straight from the file when the format allows it.
+static void loadHiPolyMesh(BakeStages &bake, FunctionTask &task)
+{
+	const FornosParameters &params = bake.params;
+	const char *path = params.shared.hiPolyMeshPath.c_str();
+	if (params.shared.compactHiPolyMesh && params.shared.hiPolyMeshNormal == NormalImport::Import &&
+		!params.shared.instanceRepeatedGroups && !bake.matchGroups && Mesh::readsGeometry(path))
+	{
+		bake.hiPolyBuild.compactMesh.reset(CompactMesh::loadFile(path));
+		if (!bake.hiPolyBuild.compactMesh) bake.fail("Missing high poly mesh");
+		profileMemory();
+		return;
+	}
+
+	std::shared_ptr<Mesh> hiPolyMesh;
+	std::unique_ptr<InstancedMesh> instancedMesh;
+	if (InstancedMesh::isDescription(path))
+	{
+		instancedMesh.reset(InstancedMesh::loadDescription(path));
+	}
+	else
+	{
+		hiPolyMesh.reset(Mesh::loadFile(path, params.shared.weldObjVertices));
+		if (hiPolyMesh && params.shared.instanceRepeatedGroups)
+		{
+			instancedMesh.reset(InstancedMesh::createFromRepeatedGroups(hiPolyMesh.get()));
+			if (instancedMesh) hiPolyMesh.reset();
+		}
+	}
+
+	// Instances share the normals of their part
+	Mesh *hiPolyNormalsMesh = instancedMesh ? &instancedMesh->mesh : hiPolyMesh.get();
+	if (!hiPolyNormalsMesh)
+	{
+		bake.fail("Missing high poly mesh");
+		return;
+	}
+	task.setProgress(0.8f);
+	switch (params.shared.hiPolyMeshNormal)
+	{
+	case NormalImport::Import: break;
+	case NormalImport::ComputePerFace: hiPolyNormalsMesh->computeFaceNormals(); break;
+	case NormalImport::ComputePerVertex: hiPolyNormalsMesh->computeVertexNormals(); break;
+	}
+
+	bake.hiPolyMesh = hiPolyMesh;
+	bake.hiPolyBuild.instancedMesh = std::move(instancedMesh);
+	profileMemory();
+}
+
+// Matches the groups by name, and builds the BVH of the whole high poly mesh when there are no groups to bake.
+// Without a high poly mesh the low poly mesh is baked as it is.
+static void buildHiPolyStage(BakeStages &bake, FunctionTask &task)
+{
+	if (bake.failed()) return;
+	const FornosParameters &params = bake.params;
+	if (params.shared.hiPolyMeshPath.empty()) bake.hiPolyMesh = bake.lowPolyMesh;
+
+	if (bake.matchGroups)
 	{
-		std::shared_ptr<Mesh> lowPolyMeshForMapping;
-		if (params.shared.loPolyMeshNormal != NormalImport::ComputePerVertex)
+		if (!bake.hiPolyMesh)
 		{
-			lowPolyMeshForMapping = std::shared_ptr<Mesh>(Mesh::createCopy(lowPolyMesh.get()));
-			lowPolyMeshForMapping->computeVertexNormalsAggressive();
+			logWarning("Groups", "Groups are not matched by name with instanced high poly meshes");
 		}
 		else
 		{
-			lowPolyMeshForMapping = lowPolyMesh;
+			bake.groups = matchBakeGroups(bake.lowPolyMesh.get(), bake.hiPolyMesh.get());
+			if (bake.groups.empty()) logWarning("Groups", "No groups matched by name, baking the whole meshes");
 		}
+		task.setProgress(0.1f);
+	}
 
-		map = std::shared_ptr<MapUV>(MapUV::fromMeshes(
-			lowPolyMesh.get(),
-			lowPolyMeshForMapping.get(),
-			params.shared.texWidth,
-			params.shared.texHeight));
-	} break;
+	// Matched groups upload their own mappings when they are baked
+	if (!bake.groups.empty())
+	{
+		if (params.shared.compactHiPolyMesh)
+		{
+			logWarning("Groups", "Compact high poly mesh is ignored when matching groups by name");
+		}
+		return;
+	}
+	bake.hiPolyBuild.mesh = std::move(bake.hiPolyMesh);
+	buildHiPolyBVH(params.shared, bake.hiPolyBuild);
+}
 
-	case MeshMappingMethod::LowPolyNormals:
+// Rasterizes the texels of the whole texture, or of the first tile or group
+static void rasterizeStage(BakeStages &bake, FunctionTask&)
+{
+	if (bake.failed()) return;
+	std::unique_ptr<Mesh> groupMesh(bake.groups.empty() ? nullptr : createSubMesh(bake.lowPolyMesh.get(), bake.groups[0].lowPolyTriangles));
+	bake.compressedMap = std::shared_ptr<CompressedMapUV>(createCompressedMap(bake.params.shared,
+		groupMesh ? groupMesh.get() : bake.lowPolyMesh.get(), bake.lowPolyMeshForMapping.get(),
+		bake.tiles.empty() ? nullptr : &bake.tiles[0]));
+	if (!bake.compressedMap)
 	{
-		map = std::shared_ptr<MapUV>(MapUV::fromMesh(
-			lowPolyMesh.get(),
-			params.shared.texWidth,
-			params.shared.texHeight));
-	} break;
+		bake.fail("Low poly mesh is missing texture coordinates or normals information");
+		return;
+	}
+	profileMemory();
+}
 
-	case MeshMappingMethod::Hybrid:
+static void error_callback(int error, const char* description)
+{
+	fprintf(stderr, "Error %d: %s\n", error, description);
+}
+
+FornosRunner::FornosRunner()
+	: _graph(new TaskGraph())
+	, _fileHashes(new FileHashes())
+{
+}
+
+FornosRunner::~FornosRunner()
+{
+}
+
+void FornosRunner::releaseSessions()
+{
+	_sessions.clear();
+}
+
+// Moves the session sharing the most expensive stages with the keys to the front, or a new one if none shares any.
+// The least recently used sessions beyond the count are released before the bake loads anything.
+static BakeSession& frontSession(std::vector<std::unique_ptr<BakeSession> > &sessions, const BakeKeys &keys, size_t count)
+{
+	size_t best = sessions.size();
+	int bestScore = 0;
+	for (size_t i = 0; i < sessions.size(); ++i)
 	{
-		std::shared_ptr<Mesh> lowPolyMeshForMapping;
-		if (params.shared.loPolyMeshNormal != NormalImport::ComputePerVertex)
-		{
-			lowPolyMeshForMapping = std::shared_ptr<Mesh>(Mesh::createCopy(lowPolyMesh.get()));
-			lowPolyMeshForMapping->computeVertexNormalsAggressive();
-		}
-		else
+		const BakeKeys &sessionKeys = sessions[i]->keys;
+		const int score =
+			(keys.hiPoly != 0 && keys.hiPoly == sessionKeys.hiPoly ? 2 : 0) +
+			(keys.lowPoly != 0 && keys.lowPoly == sessionKeys.lowPoly ? 1 : 0);
+		if (score > bestScore)
 		{
-			lowPolyMeshForMapping = lowPolyMesh;
+			best = i;
+			bestScore = score;
 		}
+	}
+
+	std::unique_ptr<BakeSession> session;
+	if (best < sessions.size())
+	{
+		session = std::move(sessions[best]);
+		sessions.erase(sessions.begin() + best);
+	}
+	else
+	{
+		session.reset(new BakeSession());
+	}
+	sessions.insert(sessions.begin(), std::move(session));
+	if (sessions.size() > std::max<size_t>(count, 1)) sessions.resize(std::max<size_t>(count, 1));
+	return *sessions.front();
+}
 
-		map = std::shared_ptr<MapUV>(MapUV::fromMeshes_Hybrid(
-			lowPolyMesh.get(),
-			lowPolyMeshForMapping.get(),
-			params.shared.texWidth,
-			params.shared.texHeight,
-			params.shared.mappingEdge));
-	} break;
+bool FornosRunner::start(const FornosParameters &params, std::string &errors)
+{
+	if (pending())
+	{
+		errors = "Another bake is pending";
+		return false;
 	}
-	
-	if (!map)
+
+	// The texels and samples of the rasterized map are indexed with 32 bits
+	const uint64_t samples = samplesPerAxis(params.shared);
+	if ((uint64_t)params.shared.texWidth * samples * (uint64_t)params.shared.texHeight * samples > (uint64_t)UINT32_MAX)
 	{
-		errors = "Low poly mesh is missing texture coordinates or normals information";
+		errors = "Texture too big for its supersampling, it needs fewer than 2^32 samples";
 		return false;
 	}
-	std::shared_ptr<CompressedMapUV> compressedMap(new CompressedMapUV(map.get()));
+	if (params.shared.supersampling > k_maxSupersampling)
+	{
+		logWarning("Supersampling", "Supersampling clamped to " + std::to_string(k_maxSupersampling));
+	}
 
-	std::shared_ptr<BVH> rootBVH(BVH::createBinary(hiPolyMesh.get(), params.shared.bvhTrisPerNode, 8192));
+	gpuStatsReset();
+	profilerEnable(!_traceOutputPath.empty());
+	profilerReset();
+	_graph->resetTimings();
+	_errors.clear();
+	profileMemory();
 
-	std::shared_ptr<MeshMapping> meshMapping(new MeshMapping());
-	meshMapping->init(compressedMap, hiPolyMesh, rootBVH, params.shared.ignoreBackfaces);
+	// Nothing is loaded here: the meshes are hashed on a worker, and the plan picks what the previous bakes share
+	_bake.reset(new BakeStages());
+	_bake->params = params;
+	_bake->tiles = splitTiles(params.shared);
+	_bake->matchGroups = params.shared.matchGroupsByName && !params.shared.udim;
+	std::shared_ptr<BakeStages> bake = _bake;
+	std::shared_ptr<FileHashes> fileHashes = _fileHashes;
+	const TaskGraph::Node keysNode = _graph->addWorkerJob("Mesh hashes", [bake, fileHashes](FunctionTask&)
+	{
+		bake->sources = mappingSources(bake->params.shared);
+		bake->keys = bakeKeys(bake->params, bake->sources, *fileHashes);
+	});
+	_graph->addContextJob("Bake plan", [this, bake](FunctionTask&) { planBake(bake); }, { keysNode });
+	_baking = true;
+	return true;
+}
 
-	if (params.thickness.enabled)
+// Adds the stages of the bake, reusing the meshes, the BVH and the mapping of the previous bakes or of the cache
+void FornosRunner::planBake(std::shared_ptr<BakeStages> bake)
+{
+	const FornosParameters &params = bake->params;
+	const BakeKeys keys = bake->keys;
+	const bool wholeTexture = bake->tiles.empty() && !params.shared.udim;
+	const bool matchGroups = bake->matchGroups;
+
+	if (keys.lowPoly == 0)
 	{
-		ThicknessSolver::Params solverParams;
-		solverParams.sampleCount = (uint32_t)params.thickness.sampleCount;
-		solverParams.minDistance = params.thickness.minDistance;
-		solverParams.maxDistance = params.thickness.maxDistance;
-		std::unique_ptr<ThicknessSolver> solver(new ThicknessSolver(solverParams));
-		solver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new ThicknessTask(std::move(solver), params.thickness.outputPath.c_str(), params.shared.texDilation)
-		);
+		// Before picking a session, a failed bake doesn't release the kept ones
+		bake->fail("Missing low poly mesh");
+		return;
 	}
+	BakeSession &session = frontSession(_sessions, keys, _sessionCount);
 
-	if (params.bentNormals.enabled)
+	// The mapping of a whole texture bake is reused if nothing it depends on changed since the previous bake
+	if (wholeTexture && !matchGroups && keys.mapping() != 0 && keys.mapping() == session.keys.mapping() &&
+		session.mappedMap && session.mappedMap == session.map && session.hiPolyMapping->done())
 	{
-		BentNormalsSolver::Params solverParams;
-		solverParams.sampleCount = (uint32_t)params.bentNormals.sampleCount;
-		solverParams.minDistance = params.bentNormals.minDistance;
-		solverParams.maxDistance = params.bentNormals.maxDistance;
-		solverParams.tangentSpace = params.bentNormals.tangentSpace;
-		std::unique_ptr<BentNormalsSolver> solver(new BentNormalsSolver(solverParams));
-		solver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new BentNormalsTask(std::move(solver), params.bentNormals.outputPath.c_str(), params.shared.texDilation)
-		);
+		logDebug("Session", "Mesh mapping of the previous bake reused");
+		BakeSolvers solvers;
+		createSolvers(params, session.map, session.hiPolyMapping, solvers);
+		addSolverTasks(params, solvers, *_graph, TaskGraph::k_noNode);
+		return;
 	}
 
-	if (params.ao.enabled)
+	// Or it can come from the cache, the meshes aren't even loaded then
+	uint64_t cacheKey = 0;
+	if (!_mappingCacheDir.empty())
 	{
-		AmbientOcclusionSolver::Params solverParams;
-		solverParams.sampleCount = (uint32_t)params.ao.sampleCount;
-		solverParams.minDistance = params.ao.minDistance;
-		solverParams.maxDistance = params.ao.maxDistance;
-		std::unique_ptr<AmbientOcclusionSolver> solver(new AmbientOcclusionSolver(solverParams));
-		solver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new AmbientOcclusionTask(std::move(solver), params.ao.outputPath.c_str(), params.shared.texDilation)
-		);
+		if (!wholeTexture || params.shared.matchGroupsByName)
+		{
+			logDebug("Cache", "Tiled, UDIM and group bakes don't use the mapping cache");
+		}
+		else if (keys.hiPoly == 0 && InstancedMesh::isDescription(params.shared.hiPolyMeshPath.c_str()))
+		{
+			logDebug("Cache", "Instance descriptions don't use the mapping cache");
+		}
+		else
+		{
+			cacheKey = keys.mapping();
+		}
+	}
+	if (cacheKey == 0)
+	{
+		planStages(bake, &session, std::string(), 0);
+		return;
 	}
 
-	if (params.normals.enabled)
+	// The file is read and checked on a worker, only its buffers are uploaded with the context
+	const std::string cachePath = mappingCachePath(_mappingCacheDir, cacheKey);
+	BakeSession *bakeSession = &session;
+	const TaskGraph::Node readNode = _graph->addWorkerJob("Mapping cache read", [bake, cachePath, cacheKey](FunctionTask&)
 	{
-		NormalsSolver::Params solverParams;
-		solverParams.tangentSpace = params.normals.tangentSpace;
-		std::unique_ptr<NormalsSolver> normalsSolver(new NormalsSolver(solverParams));
-		normalsSolver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new NormalsTask(std::move(normalsSolver), params.normals.outputPath.c_str(), params.shared.texDilation)
-		);
+		bake->cacheData.reset(MeshMapping::readCache(cachePath.c_str(), cacheKey, bake->sources, bake->compressedMap));
+		if (bake->cacheData) profileMemory();
+	});
+	_graph->addContextJob("Mapping cache upload", [this, bake, bakeSession, cachePath, cacheKey](FunctionTask&)
+	{
+		if (!bake->cacheData)
+		{
+			planStages(bake, bakeSession, cachePath, cacheKey);
+			return;
+		}
+
+		const FornosParameters &params = bake->params;
+		std::shared_ptr<MeshMapping> meshMapping(MeshMapping::createFromCache(*bake->cacheData, params.shared.ignoreBackfaces));
+		bake->cacheData.reset();
+		logDebug("Cache", "Mesh mapping loaded from " + cachePath);
+		profileMemory();
+
+		BakeSession &session = *bakeSession;
+		session.keys.hiPoly = bake->keys.hiPoly;
+		session.keys.map = bake->keys.map;
+		session.hiPolyMapping = meshMapping;
+		session.map = bake->compressedMap;
+		session.mappedMap = bake->compressedMap;
+
+		BakeSolvers solvers;
+		createSolvers(params, bake->compressedMap, meshMapping, solvers);
+		addSolverTasks(params, solvers, *_graph, TaskGraph::k_noNode);
+	}, { readNode });
+}
+
+// The stages of a bake that loads or builds what the previous bakes and the cache didn't have. They run as tasks:
+// both meshes load at the same time, and the BVH is built while the texels are rasterized. Only the uploads and
+// the setup of the bakers use the context.
+void FornosRunner::planStages(std::shared_ptr<BakeStages> bake, BakeSession *bakeSession, const std::string &cachePath, uint64_t cacheKey)
+{
+	const FornosParameters &params = bake->params;
+	const BakeKeys keys = bake->keys;
+	const bool wholeTexture = bake->tiles.empty() && !params.shared.udim;
+	const bool matchGroups = bake->matchGroups;
+	BakeSession &session = *bakeSession;
+
+	TaskGraph::Node lowPolyNode = TaskGraph::k_noNode;
+	if (keys.lowPoly != session.keys.lowPoly)
+	{
+		// Release the previous meshes and everything built from them before loading
+		session.keys.lowPoly = 0;
+		session.keys.map = 0;
+		session.lowPolyMesh.reset();
+		session.lowPolyMeshForMapping.reset();
+		session.map.reset();
+		session.mappedMap.reset();
+		if (params.shared.hiPolyMeshPath.empty()) session.hiPolyMapping.reset();
+
+		lowPolyNode = _graph->addWorkerJob("Low poly mesh", [bake](FunctionTask &task) { loadLowPolyMesh(*bake, task); });
+	}
+	else
+	{
+		logDebug("Session", "Low poly mesh of the previous bake reused");
+		bake->lowPolyMesh = session.lowPolyMesh;
+		bake->lowPolyMeshForMapping = session.lowPolyMeshForMapping;
 	}
 
-	if (params.positions.enabled)
+	// Groups need the high poly mesh on the CPU, the mapping of the session is only kept without them
+	TaskGraph::Node hiPolyNode = TaskGraph::k_noNode;
+	TaskGraph::Node groupsNode = TaskGraph::k_noNode;
+	if (!matchGroups && keys.hiPoly != 0 && keys.hiPoly == session.keys.hiPoly)
+	{
+		logDebug("Session", "High poly mesh and BVH of the previous bake reused");
+		bake->meshMapping = session.hiPolyMapping;
+	}
+	else
+	{
+		session.keys.hiPoly = 0;
+		session.hiPolyMapping.reset();
+		session.mappedMap.reset();
+
+		const TaskGraph::Node loadNode = params.shared.hiPolyMeshPath.empty() ? lowPolyNode :
+			_graph->addWorkerJob("High poly mesh", [bake](FunctionTask &task) { loadHiPolyMesh(*bake, task); });
+		groupsNode = _graph->addWorkerJob("BVH", [bake](FunctionTask &task) { buildHiPolyStage(*bake, task); },
+			{ loadNode, matchGroups ? lowPolyNode : TaskGraph::k_noNode });
+		const uint64_t hiPolyKey = keys.hiPoly;
+		hiPolyNode = _graph->addContextJob("High poly upload", [bake, bakeSession, hiPolyKey](FunctionTask&)
+		{
+			if (bake->failed() || !bake->groups.empty()) return;
+			bake->meshMapping = uploadHiPolyMesh(bake->params.shared, bake->hiPolyBuild);
+			bakeSession->hiPolyMapping = bake->meshMapping;
+			bakeSession->keys.hiPoly = hiPolyKey;
+		}, { groupsNode });
+	}
+	if (params.shared.matchGroupsByName && params.shared.udim)
 	{
-		std::unique_ptr<PositionSolver> solver(new PositionSolver());
-		solver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new PositionTask(std::move(solver), params.positions.outputPath.c_str())
-		);
+		logWarning("Groups", "Groups are not matched by name when baking UDIM tiles");
 	}
 
-	if (params.height.enabled)
+	// UDIM tiles rasterize their own texels
+	TaskGraph::Node rasterNode = TaskGraph::k_noNode;
+	if (wholeTexture && !matchGroups && keys.map != 0 && keys.map == session.keys.map)
 	{
-		HeightSolver::Params solverParams;
-		solverParams.maxDistance = params.height.maxDistance;
-		solverParams.normalizeOutput = params.height.normalizeOutput;
-		std::unique_ptr<HeightSolver> solver(new HeightSolver(solverParams));
-		solver->init(compressedMap, meshMapping);
-		_tasks.emplace_back(
-			new HeightTask(std::move(solver), params.height.outputPath.c_str(), params.shared.texDilation)
-		);
+		logDebug("Session", "Texels of the previous bake reused");
+		bake->compressedMap = session.map;
+	}
+	else if (!params.shared.udim)
+	{
+		rasterNode = _graph->addWorkerJob("Rasterization", [bake](FunctionTask &task) { rasterizeStage(*bake, task); },
+			{ lowPolyNode, matchGroups ? groupsNode : TaskGraph::k_noNode });
 	}
 
-	_tasks.emplace_back(new MeshMappingTask(meshMapping));
+	// Adds the tasks of the bakers once the meshes, the BVH and the texels are ready
+	const bool lowPolyLoaded = lowPolyNode != TaskGraph::k_noNode;
+	_graph->addContextJob("Bakers setup",
+		[this, bake, bakeSession, keys, lowPolyLoaded, cachePath, cacheKey](FunctionTask&)
+	{
+		BakeSession &session = *bakeSession;
+		if (lowPolyLoaded && bake->lowPolyMesh)
+		{
+			session.lowPolyMesh = bake->lowPolyMesh;
+			session.lowPolyMeshForMapping = bake->lowPolyMeshForMapping;
+			session.keys.lowPoly = keys.lowPoly;
+		}
+		if (bake->failed()) return;
 
-	return true;
+		const FornosParameters &params = bake->params;
+		if (params.shared.udim)
+		{
+			startUdim(bake);
+			return;
+		}
+
+		if (!bake->groups.empty() || !bake->tiles.empty())
+		{
+			std::shared_ptr<TiledBake> tiled(new TiledBake());
+			tiled->params = params;
+			tiled->lowPolyMesh = bake->lowPolyMesh;
+			tiled->lowPolyMeshForMapping = bake->lowPolyMeshForMapping;
+			tiled->groups = bake->groups;
+			tiled->tiles = bake->tiles;
+			if (tiled->groups.empty())
+			{
+				session.mappedMap.reset(); // Every tile replaces the texels of the mapping
+				tiled->meshMapping = bake->meshMapping;
+			}
+			else
+			{
+				tiled->hiPolyMesh = bake->hiPolyMesh;
+			}
+			tiled->work.resize(tiled->workCount());
+			tiled->work[0].map = bake->compressedMap;
+			addTiledBake(*_graph, tiled);
+			return;
+		}
+
+		std::shared_ptr<CompressedMapUV> compressedMap = bake->compressedMap;
+		std::shared_ptr<MeshMapping> meshMapping = bake->meshMapping;
+		session.map = compressedMap;
+		session.keys.map = keys.map;
+		session.mappedMap = compressedMap;
+		meshMapping->setMap(compressedMap);
+		profileMemory();
+
+		BakeSolvers solvers;
+		createSolvers(params, compressedMap, meshMapping, solvers);
+		const TaskGraph::Node mappingNode = _graph->addContextTask(cachePath.empty() ?
+			new MeshMappingTask(meshMapping) : new MeshMappingTask(meshMapping, compressedMap, cachePath, cacheKey, bake->sources));
+		addSolverTasks(params, solvers, *_graph, mappingNode);
+	}, { lowPolyNode, hiPolyNode, rasterNode });
 }
 
-void FornosRunner::run()
+// Rasterizes a UDIM tile on a worker while the previous tile bakes, its mapping and bakers are set up once the
+// previous tile is done. Only one tile holds the GPU buffers of its mapping and bakers at a time.
+// The high poly mesh and BVH are uploaded once and shared by the mappings of all the tiles.
+static void addUdimTile(TaskGraph *graph, std::shared_ptr<BakeStages> bake, size_t index, const std::vector<TaskGraph::Node> &previousTile)
 {
-	if (!_tasks.empty())
+	const TaskGraph::Node rasterNode = graph->addWorkerJob("UDIM tile rasterization", [bake, index](FunctionTask&)
 	{
-		auto task = _tasks.back();
-		if (task->runStep())
+		if (bake->failed()) return;
+		const auto &tile = bake->udimTiles[index];
+		std::unique_ptr<Mesh> tileMesh(createUdimTileMesh(bake->lowPolyMesh.get(), tile.first, tile.second));
+		bake->udimMaps[index] = std::shared_ptr<CompressedMapUV>(createCompressedMap(
+			bake->params.shared, tileMesh.get(), bake->lowPolyMeshForMapping.get(), nullptr));
+		if (!bake->udimMaps[index])
+		{
+			bake->fail("Low poly mesh is missing texture coordinates or normals information");
+			return;
+		}
+		profileMemory();
+	});
+
+	std::vector<TaskGraph::Node> dependencies = previousTile;
+	dependencies.push_back(rasterNode);
+	graph->addContextJob("UDIM bakers setup", [graph, bake, index](FunctionTask&)
+	{
+		if (bake->failed()) return;
+		std::shared_ptr<CompressedMapUV> compressedMap = std::move(bake->udimMaps[index]);
+		const int udim = bake->udimTiles[index].first;
+
+		std::vector<TaskGraph::Node> tileNodes;
+		if (!compressedMap->indices.empty())
+		{
+			logDebug("UDIM", "Tile " + std::to_string(udim) + " with " + std::to_string(compressedMap->indices.size()) + " texels");
+
+			std::shared_ptr<MeshMapping> meshMapping(new MeshMapping());
+			meshMapping->init(compressedMap, *bake->meshMapping);
+
+			const FornosParameters tileParams = udimParameters(bake->params, udim);
+			BakeSolvers solvers;
+			createSolvers(tileParams, compressedMap, meshMapping, solvers);
+			const TaskGraph::Node mappingNode = graph->addContextTask(new MeshMappingTask(meshMapping));
+			tileNodes = addSolverTasks(tileParams, solvers, *graph, mappingNode);
+			tileNodes.push_back(mappingNode);
+			++bake->udimBakedTiles;
+		}
+
+		if (index + 1 < bake->udimTiles.size())
+		{
+			addUdimTile(graph, bake, index + 1, tileNodes);
+		}
+		else if (bake->udimBakedTiles == 0)
 		{
-			task->finish(); // Exports map or any other after-compute work
-			delete task;
-			_tasks.pop_back();
+			bake->fail("No UDIM tile is covered by the low poly mesh");
 		}
+	}, dependencies);
+}
+
+// Bakes the UDIM tiles one after another, every one an independent bake with its own map, mesh mapping and solvers
+void FornosRunner::startUdim(std::shared_ptr<BakeStages> bake)
+{
+	const FornosParameters &params = bake->params;
+	if (params.shared.tileSize > 0)
+	{
+		logWarning("UDIM", "Tile size is ignored when baking UDIM tiles");
+	}
+
+	const auto udimTiles = splitUdimTiles(bake->lowPolyMesh.get());
+	bake->udimTiles.assign(udimTiles.begin(), udimTiles.end());
+	bake->udimMaps.resize(bake->udimTiles.size());
+	if (bake->udimTiles.empty())
+	{
+		bake->fail("No UDIM tile is covered by the low poly mesh");
+		return;
+	}
+	addUdimTile(_graph.get(), bake, 0, {});
+}
+
+bool FornosRunner::pending() const
+{
+	return _graph->pending();
+}
+
+const FornosTask* FornosRunner::currentTask() const
+{
+	return _graph->currentTask();
+}
+
+size_t FornosRunner::taskCount() const
+{
+	return _graph->taskCount();
+}
+
+const std::vector<TaskTiming>& FornosRunner::taskTimings() const
+{
+	return _graph->timings();
+}
+
+void FornosRunner::run()
+{
+	const size_t taskCount = _graph->taskCount();
+	_graph->run();
+	if (_graph->taskCount() < taskCount) profileMemory();
+	if (_baking && !_graph->pending())
+	{
+		_baking = false;
+		_errors = _bake->errors();
+		_bake.reset();
+		finishBake();
+	}
+}
+
+void FornosRunner::cancel()
+{
+	_graph->clear();
+	_baking = false;
+	_bake.reset();
+}
+
+void FornosRunner::finishBake()
+{
+	logDebug("Stats", "GPU stats for the bake:\n" + gpuStatsReport());
+	if (!_statsOutputPath.empty() && !gpuStatsExportJson(_statsOutputPath.c_str()))
+	{
+		logError("Stats", "Cannot write GPU stats to " + _statsOutputPath);
+	}
+	if (!_traceOutputPath.empty())
+	{
+		if (profilerExportTrace(_traceOutputPath.c_str())) logDebug("Trace", "Bake trace written to " + _traceOutputPath);
+		else logError("Trace", "Cannot write the trace to " + _traceOutputPath);
+		profilerReset();
 	}
 }
 
@@ -278,6 +1718,89 @@ int CALLBACK WinMain
 int main(int argc, char *argv[])
 #endif
 {
+#if defined(_WIN32) && !defined(_CONSOLE)
+	int argc = __argc;
+	char **argv = __argv;
+#endif
+
+	cxxopts::Options options("Fornos", "GPU texture baking");
+	options.add_options()
+		("gpu-stats", "Write per-stage GPU stats of every bake as JSON", cxxopts::value<std::string>(), "FILE")
+		("trace", "Write a Chrome trace (chrome://tracing, Perfetto) of every bake", cxxopts::value<std::string>(), "FILE")
+		("benchmark", "Run the benchmark suite and exit")
+		("bench-meshes", "Benchmark meshes (sphere, terrain, slivers)", cxxopts::value<std::string>(), "LIST")
+		("bench-triangles", "Benchmark hi-poly triangle counts", cxxopts::value<std::string>(), "LIST")
+		("bench-size", "Benchmark texture size", cxxopts::value<int>(), "N")
+		("bench-samples", "Benchmark ray samples per texel", cxxopts::value<int>(), "N")
+		("bench-dir", "Benchmark working directory", cxxopts::value<std::string>(), "DIR")
+		("bench-output", "Benchmark JSON results (stdout if not set)", cxxopts::value<std::string>(), "FILE")
+		("convert", "Convert a mesh to the fornos binary format (.fmesh) and exit", cxxopts::value<std::string>(), "FILE")
+		("convert-output", "Converted mesh path (input path with .fmesh extension if not set)", cxxopts::value<std::string>(), "FILE")
+		("convert-tangents", "Compute and store the tangent space of the converted mesh")
+		("mapping-cache", "Save the mesh mappings to this directory and reuse them in the next bakes", cxxopts::value<std::string>(), "DIR")
+		("serve", "Run the bake jobs sent to this local socket until a shutdown job", cxxopts::value<std::string>(), "SOCKET")
+		("serve-sessions", "Bakes whose meshes, BVH and mapping the server keeps for the next jobs", cxxopts::value<int>(), "N")
+		("submit", "Send the bake jobs of a file (a JSON object per line) to a server and exit", cxxopts::value<std::string>(), "FILE")
+		("server", "Socket of the server the jobs are sent to", cxxopts::value<std::string>(), "SOCKET")
+		("h,help", "Print help");
+	std::string statsPath;
+	std::string tracePath;
+	std::string mappingCacheDir;
+	bool benchmark = false;
+	BenchmarkParameters benchParams;
+	bool serve = false;
+	BakeServerParameters serverParams;
+	try
+	{
+		auto args = options.parse(argc, argv);
+		if (args.count("help"))
+		{
+			printf("%s\n", options.help().c_str());
+			return 0;
+		}
+		if (args.count("gpu-stats")) statsPath = args["gpu-stats"].as<std::string>();
+		if (args.count("trace")) tracePath = args["trace"].as<std::string>();
+		if (args.count("mapping-cache")) mappingCacheDir = args["mapping-cache"].as<std::string>();
+		benchmark = args.count("benchmark") > 0;
+		if (args.count("bench-meshes")) benchParams.meshes = splitList(args["bench-meshes"].as<std::string>());
+		if (args.count("bench-triangles"))
+		{
+			benchParams.triangleCounts.clear();
+			for (const auto &count : splitList(args["bench-triangles"].as<std::string>()))
+			{
+				benchParams.triangleCounts.push_back((size_t)std::stoull(count));
+			}
+		}
+		if (args.count("bench-size")) benchParams.texSize = args["bench-size"].as<int>();
+		if (args.count("bench-samples")) benchParams.sampleCount = args["bench-samples"].as<int>();
+		if (args.count("bench-dir")) benchParams.workDir = args["bench-dir"].as<std::string>();
+		if (args.count("bench-output")) benchParams.outputPath = args["bench-output"].as<std::string>();
+		if (args.count("serve"))
+		{
+			serve = true;
+			serverParams.socketPath = args["serve"].as<std::string>();
+			serverParams.statsOutputPath = statsPath;
+			serverParams.traceOutputPath = tracePath;
+			serverParams.mappingCacheDir = mappingCacheDir;
+		}
+		if (args.count("serve-sessions")) serverParams.sessionCount = (size_t)std::max(args["serve-sessions"].as<int>(), 1);
+		if (args.count("submit"))
+		{
+			if (!args.count("server")) throw std::runtime_error("--submit needs the --server socket");
+			return submitBakeJobs(args["server"].as<std::string>(), args["submit"].as<std::string>()) ? 0 : 1;
+		}
+		if (args.count("convert"))
+		{
+			const std::string outputPath = args.count("convert-output") ? args["convert-output"].as<std::string>() : std::string();
+			return convertMesh(args["convert"].as<std::string>(), outputPath, args.count("convert-tangents") > 0) ? 0 : 1;
+		}
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "%s\n%s\n", e.what(), options.help().c_str());
+		return 1;
+	}
+
 	// Setup window
 	glfwSetErrorCallback(error_callback);
 	if (!glfwInit()) return 1;
@@ -287,6 +1810,10 @@ int main(int argc, char *argv[])
 #if __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+	if (benchmark || serve) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	// Without the UI no frame waits for the steps, longer steps spend less time in their overhead
+	if (benchmark || serve) setStepTargetMilliseconds(k_headlessStepMilliseconds);
 	GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "Fornos: Texture Baking", NULL, NULL);
 	glfwMakeContextCurrent(window);
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
@@ -299,7 +1826,24 @@ int main(int argc, char *argv[])
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, true);
 #endif
 
+	if (benchmark)
+	{
+		const bool ok = runBenchmark(benchParams);
+		glfwTerminate();
+		return ok ? 0 : 1;
+	}
+
+	if (serve)
+	{
+		const bool ok = runBakeServer(serverParams);
+		glfwTerminate();
+		return ok ? 0 : 1;
+	}
+
 	FornosRunner runner;
+	runner.setStatsOutputPath(statsPath);
+	runner.setTraceOutputPath(tracePath);
+	runner.setMappingCacheDir(mappingCacheDir);
 	FornosUI ui;
 	ui.init(&runner, window);
 
@@ -332,6 +1876,8 @@ int main(int argc, char *argv[])
 	}
 
 	// Cleanup
+	runner.cancel(); // Their GPU buffers need the context
+	runner.releaseSessions();
 	ui.shutdown();
 	glfwTerminate();
 
@@ -23,10 +23,18 @@ SOFTWARE.
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
+struct BakeSession;
+struct BakeStages;
+struct FileHashes;
 class FornosTask;
+class Mesh;
+class MeshMapping;
+class TaskGraph;
+struct TaskTiming;
 
 //
 // Application parameters
@@ -34,6 +42,9 @@ class FornosTask;
 
 enum NormalImport { Import = 0, ComputePerFace = 1, ComputePerVertex = 2 };
 enum MeshMappingMethod { Smooth = 0, LowPolyNormals = 1, Hybrid = 2 };
+enum SampleFilter { Box = 0, Gaussian = 1 };
+
+static const int k_maxSupersampling = 8;
 
 struct FornosParameters_Shared
 {
@@ -41,10 +52,18 @@ struct FornosParameters_Shared
 	std::string hiPolyMeshPath;
 	NormalImport loPolyMeshNormal = NormalImport::Import;
 	NormalImport hiPolyMeshNormal = NormalImport::Import;
+	bool weldObjVertices = true; // Face vertices of OBJ meshes with the same position, texture coordinate and normal are shared
+	bool compactHiPolyMesh = false; // Quantized positions and normals for the BVH and the GPU, for very big meshes
+	bool instanceRepeatedGroups = false; // Groups of the high poly mesh that repeat another one become its instances
 	int bvhTrisPerNode = 8;
 	int texWidth = 2048;
 	int texHeight = 2048;
 	int texDilation = 16;
+	int tileSize = 0; // Bakes in square tiles of this size to bound the memory, 0 bakes the whole texture at once
+	int supersampling = 1; // Samples per texel axis (1 to k_maxSupersampling), the mapping and the bakers run for every sample
+	SampleFilter sampleFilter = SampleFilter::Box; // How the samples of a texel are resolved
+	bool udim = false; // Bakes a texture per UDIM tile (1001 + u + 10 * v) of the low poly texture coordinates
+	bool matchGroupsByName = false; // Every low poly group is baked only against the high poly groups with its name
 	bool ignoreBackfaces = true;
 	MeshMappingMethod mapping = MeshMappingMethod::Smooth;
 	float mappingEdge = 0.05f;
@@ -134,16 +153,70 @@ public:
 	virtual void finish() = 0;
 	virtual float progress() const = 0;
 	virtual const char* name() const = 0;
+
+	/// Work after finish() without OpenGL calls, like exporting the images.
+	/// Runs on a worker thread while the next tasks go on.
+	virtual void exportResults() {}
 };
 
+/// Runs the bakes one after another. The meshes, the BVH and the mapping of a bake are kept for the next ones,
+/// which only load or build again what changed. The stages of a bake run as a task graph: the loading, BVH
+/// and rasterization stages and the exports on worker threads, the GPU work on the thread calling run().
 class FornosRunner
 {
 public:
+	FornosRunner();
+	~FornosRunner();
+
+	/// Adds the stages of a bake to run() without loading anything, so it returns right away.
+	/// It only fails if a bake is pending or the texture is too big, the errors of the stages are in errors() once it is done.
 	bool start(const FornosParameters &params, std::string &errors);
-	bool pending() const { return !_tasks.empty(); }
+	bool pending() const;
 	void run();
-	const FornosTask* currentTask() const { return _tasks.empty() ? nullptr : _tasks.back(); }
+	const FornosTask* currentTask() const;
+
+	/// Errors of the last bake, empty while it is pending or if it succeeded
+	const std::string& errors() const { return _errors; }
+
+	/// Drops the tasks of the current bake, after the ones running on the workers finish
+	void cancel();
+
+	/// Number of bakes whose meshes, BVH and mapping are kept for the next bakes, the least recently used are released
+	void setSessionCount(size_t count) { _sessionCount = count; }
+
+	/// Releases the meshes, the BVHs and the mappings kept for the next bakes
+	void releaseSessions();
+
+	/// Tasks left of the current bake
+	size_t taskCount() const;
+
+	/// Timings of the tasks of the current bake done so far
+	const std::vector<TaskTiming>& taskTimings() const;
+
+	/// GPU stats of every bake are written as JSON to this path (disabled if empty)
+	void setStatsOutputPath(const std::string &path) { _statsOutputPath = path; }
+
+	/// Every bake is profiled and written as a Chrome trace to this path (disabled if empty)
+	void setTraceOutputPath(const std::string &path) { _traceOutputPath = path; }
+
+	/// Mesh mappings are saved to this directory and loaded by the next bakes of the same meshes and
+	/// mapping parameters, which skip the mesh loading, the BVH and the mapping (disabled if empty)
+	void setMappingCacheDir(const std::string &dir) { _mappingCacheDir = dir; }
 
 private:
-	std::vector<FornosTask*> _tasks;
+	void planBake(std::shared_ptr<BakeStages> bake);
+	void planStages(std::shared_ptr<BakeStages> bake, BakeSession *session, const std::string &cachePath, uint64_t cacheKey);
+	void startUdim(std::shared_ptr<BakeStages> bake);
+	void finishBake();
+
+	std::unique_ptr<TaskGraph> _graph;
+	bool _baking = false; // The graph has the tasks of a bake, finishBake is called when they are done
+	std::shared_ptr<BakeStages> _bake; // Stages of the pending bake
+	std::string _errors;
+	std::vector<std::unique_ptr<BakeSession> > _sessions; // Most recently used first
+	std::shared_ptr<FileHashes> _fileHashes; // Of the mesh files, kept while the files don't change
+	size_t _sessionCount = 1;
+	std::string _statsOutputPath;
+	std::string _traceOutputPath;
+	std::string _mappingCacheDir;
 };
\ No newline at end of file
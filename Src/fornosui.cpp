@@ -33,6 +33,7 @@ SOFTWARE.
 
 static const char* normalImportNames[3] = { "Import", "Compute per face", "Compute per vertex" };
 static const char* meshMappingMethodNames[3] = { "Smooth", "Low-poly normals", "Hybrid" };
+static const char* sampleFilterNames[2] = { "Box", "Gaussian" };
 
 inline void SetupImGuiStyle(bool bStyleDark_, float alpha_)
 {
@@ -158,6 +159,14 @@ static void parameter(const char *name, int *value, const char *id, const char *
 	ImGui::NextColumn();
 }
 
+static void parameter(const char *name, int *value, int minValue, int maxValue, const char *id, const char *help)
+{
+	parameter_common(name, help);
+	ImGui::InputInt(id, value);
+	*value = *value < minValue ? minValue : (*value > maxValue ? maxValue : *value);
+	ImGui::NextColumn();
+}
+
 static void parameter(const char *name, float *value, const char *id, const char *help)
 {
 	parameter_common(name, help);
@@ -336,8 +345,8 @@ void FornosParameters_Shared_View::render(int windowWidth, int windowHeight)
 
 	parameter_openFile("Low Mesh", &loPolyPath, "##lo",
 		"Low resolution mesh file.\n"
-		"Wavefront OBJ files supported.",
-		"Select Low-Poly Mesh", ".obj",
+		"Wavefront OBJ, PLY, glTF (.gltf and .glb) and native binary (.fmesh) files supported.",
+		"Select Low-Poly Mesh", ".obj;.ply;.fmesh;.gltf;.glb",
 		windowWidth, windowHeight);
 
 	parameter<NormalImport>("Normals", &data->loPolyMeshNormal, normalImportNames, 3, "#lowPolyNormal",
@@ -346,13 +355,31 @@ void FornosParameters_Shared_View::render(int windowWidth, int windowHeight)
 	parameter_openFile("High Mesh", &hiPolyPath, "##hi",
 		"Optional high resolution mesh file.\n"
 		"If not setup it will bake the low resolution mesh.\n"
-		"Wavefront OBJ files supported.",
-		"Select Hiigh-Poly Mesh", ".obj",
+		"Wavefront OBJ, PLY, glTF (.gltf and .glb) and native binary (.fmesh) files supported,\n"
+		"or an instance description (.instances).",
+		"Select Hiigh-Poly Mesh", ".obj;.ply;.fmesh;.gltf;.glb;.instances",
 		windowWidth, windowHeight);
 
 	parameter<NormalImport>("Normals", &data->hiPolyMeshNormal, normalImportNames, 3, "#hiPolyNormal",
 		"How the model normals are imported or computed.");
 
+	parameter("Weld OBJ vertices", &data->weldObjVertices, "##weldObjVertices",
+		"Shares the face vertices of Wavefront OBJ meshes (low and high) with the same position, texture coordinate and normal.\n"
+		"Unchecked every face corner keeps a vertex of its own: the mesh loads faster but takes more memory.");
+
+	parameter("Compact mesh", &data->compactHiPolyMesh, "##compactHiPoly",
+		"Keeps the high resolution mesh with quantized positions and normals once it is loaded.\n"
+		"Uses about a third of the memory on the CPU and the GPU, for very big meshes.");
+
+	parameter("Instance groups", &data->instanceRepeatedGroups, "##instanceGroups",
+		"Groups of the high resolution mesh that repeat another group (bolts, rivets, panels...)\n"
+		"are stored and raycast once, as instances with their own transform.");
+
+	parameter("Match by name", &data->matchGroupsByName, "##matchGroups",
+		"Bakes every group of the low resolution mesh only against the groups of the high resolution\n"
+		"mesh with the same name (ignoring case and _low, _lo, _high, _hi suffixes), one after another.\n"
+		"No need to explode the meshes so the parts don't project on each other.");
+
 	parameter_texSize("Tex Size", &data->texWidth, &data->texHeight, "#texSize",
 		"Texture output size (width x height).\n"
 		"Control+click to edit the number.");
@@ -362,6 +389,27 @@ void FornosParameters_Shared_View::render(int windowWidth, int windowHeight)
 		"This value is the distance (in pixels) for searching a pixel with data to use.\n"
 		"A value of zero will produce no dilation.");
 
+	parameter("Tile Size", &data->tileSize, "##tileSize",
+		"Bakes the texture in square tiles of this size (in pixels) to reduce memory usage.\n"
+		"Only the GPU memory is bounded by the tile size, the baked values of the whole texture are kept until it is written.\n"
+		"Useful for very big textures. A value of zero bakes the whole texture at once.");
+
+	parameter("Supersampling", &data->supersampling, 1, k_maxSupersampling, "##supersampling",
+		"Number of samples per texel axis (1 to 8), every texel is baked with supersampling x supersampling samples.\n"
+		"Smooths the edges of small details, the baking time grows with the number of samples.");
+
+	if (data->supersampling > 1)
+	{
+		parameter<SampleFilter>("Sample filter", &data->sampleFilter, sampleFilterNames, 2, "#sampleFilter",
+			"How the samples of a texel are averaged.\n"
+			"Box weights all the samples the same, Gaussian favours the samples near the texel center.");
+	}
+
+	parameter("UDIM", &data->udim, "##udim",
+		"Bakes a texture for every UDIM tile used by the low-poly texture coordinates.\n"
+		"The tile number replaces <UDIM> in the output paths or is added before the extension.\n"
+		"Tile size is ignored for UDIM bakes.");
+
 	parameter<MeshMappingMethod>("Mapping method", &data->mapping, meshMappingMethodNames, 3, "#meshMapping",
 		"How rays are generated to map the low-poly mesh to the high-poly mesh.\n"
 		"Smooth creates continuous direction for the rays.\n"
@@ -739,6 +787,8 @@ private:
 
 	bool _showLog = false;
 	bool _showAbout = false;
+	bool _showErrors = false;
+	bool _baking = false;
 	float _mainMenuHeight = 0;
 };
 
@@ -834,10 +884,7 @@ void FornosUI_Impl::renderParameters(int windowWidth, int windowHeight)
 	{
 		_bakeErrors.clear();
 		startBaking();
-		if (!_bakeErrors.empty())
-		{
-			ImGui::OpenPopup("ErrorsPopup");
-		}
+		_showErrors = !_bakeErrors.empty();
 	}
 
 	if (!readyToBake)
@@ -851,6 +898,14 @@ void FornosUI_Impl::renderParameters(int windowWidth, int windowHeight)
 
 void FornosUI_Impl::renderWorkInProgress()
 {
+	// The meshes are loaded after start, their errors are known once the bake is done
+	if (_baking && !_runner->pending())
+	{
+		_bakeErrors = _runner->errors();
+		_showErrors = !_bakeErrors.empty();
+	}
+	_baking = _runner->pending();
+
 	if (_runner->pending())
 	{
 		if (!ImGui::IsPopupOpen("TaskPopup"))
@@ -871,8 +926,11 @@ void FornosUI_Impl::renderWorkInProgress()
 			ImGui::Text("Baking");
 			ImGui::SameLine();
 			auto task = _runner->currentTask();
-			ImGui::Text(task->name());
-			ImGui::ProgressBar(task->progress());
+			if (task)
+			{
+				ImGui::Text(task->name());
+				ImGui::ProgressBar(task->progress());
+			}
 		}
 		ImGui::EndPopup();
 	}
@@ -880,6 +938,12 @@ void FornosUI_Impl::renderWorkInProgress()
 
 void FornosUI_Impl::renderErrors()
 {
+	if (_showErrors && !ImGui::IsPopupOpen("ErrorsPopup"))
+	{
+		ImGui::OpenPopup("ErrorsPopup");
+		_showErrors = false;
+	}
+
 	if (ImGui::BeginPopupModal("ErrorsPopup", NULL, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoTitleBar))
 	{
 		ImGui::Text("Baking errors:");
@@ -926,7 +990,7 @@ void FornosUI_Impl::renderAboutPopup()
 
 void FornosUI_Impl::startBaking()
 {
-	_runner->start(_params, _bakeErrors);
+	_baking = _runner->start(_params, _bakeErrors);
 }
 
 FornosUI::FornosUI()
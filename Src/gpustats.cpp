@@ -0,0 +1,177 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "gpustats.h"
+#include "json.h"
+#include "profiler.h"
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+
+namespace
+{
+	struct PendingQuery
+	{
+		GLuint query;
+		size_t stage;
+	};
+
+	std::vector<GPUStageStats> stages;
+	std::deque<PendingQuery> pendingQueries;
+	std::vector<GLuint> freeQueries;
+	size_t totalRayCount = 0;
+
+	size_t stageIndex(const char *name)
+	{
+		for (size_t i = 0; i < stages.size(); ++i)
+		{
+			if (strcmp(stages[i].name.c_str(), name) == 0) return i;
+		}
+		stages.emplace_back();
+		stages.back().name = name;
+		return stages.size() - 1;
+	}
+
+	GLuint allocQuery()
+	{
+		if (freeQueries.empty())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			return query;
+		}
+		const GLuint query = freeQueries.back();
+		freeQueries.pop_back();
+		return query;
+	}
+
+	// Queries finish in submission order, stop at the first one not available yet
+	void collectQueries(bool wait)
+	{
+		while (!pendingQueries.empty())
+		{
+			const PendingQuery &pending = pendingQueries.front();
+			if (!wait)
+			{
+				GLint available = 0;
+				glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available) break;
+			}
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &elapsed);
+			stages[pending.stage].gpuMilliseconds += (double)elapsed / 1000000.0;
+			freeQueries.push_back(pending.query);
+			pendingQueries.pop_front();
+		}
+	}
+}
+
+void gpuDispatchCompute(const char *stage, GLuint groupsX, size_t rayCount)
+{
+	collectQueries(false);
+
+	PendingQuery pending;
+	pending.query = allocQuery();
+	pending.stage = stageIndex(stage);
+
+	glBeginQuery(GL_TIME_ELAPSED, pending.query);
+	glDispatchCompute(groupsX, 1, 1);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	pendingQueries.push_back(pending);
+	auto &stats = stages[pending.stage];
+	stats.dispatchCount += 1;
+	stats.rayCount += rayCount;
+
+	if (rayCount > 0)
+	{
+		totalRayCount += rayCount;
+		profilerCounter("Rays", (double)totalRayCount);
+	}
+}
+
+void gpuStatsReadBack(const char *stage, size_t bytes)
+{
+	stages[stageIndex(stage)].bytesReadBack += bytes;
+}
+
+void gpuStatsReset()
+{
+	collectQueries(true);
+	stages.clear();
+	totalRayCount = 0;
+}
+
+const std::vector<GPUStageStats>& gpuStatsCollect()
+{
+	collectQueries(true);
+	return stages;
+}
+
+std::string gpuStatsReport()
+{
+	collectQueries(true);
+	std::string report;
+	char line[256];
+	snprintf(line, sizeof(line), "%-24s %12s %10s %14s %14s\n", "Stage", "GPU ms", "Dispatches", "MRays/s", "Read back MB");
+	report += line;
+	double totalMs = 0.0;
+	for (const auto &stats : stages)
+	{
+		snprintf(line, sizeof(line), "%-24s %12.3f %10zu %14.3f %14.3f\n",
+			stats.name.c_str(),
+			stats.gpuMilliseconds,
+			stats.dispatchCount,
+			stats.raysPerSecond() / 1000000.0,
+			(double)stats.bytesReadBack / (1024.0 * 1024.0));
+		report += line;
+		totalMs += stats.gpuMilliseconds;
+	}
+	snprintf(line, sizeof(line), "%-24s %12.3f\n", "Total", totalMs);
+	report += line;
+	return report;
+}
+
+bool gpuStatsExportJson(const char *path)
+{
+	collectQueries(true);
+	std::ofstream ofs(path);
+	if (!ofs) return false;
+
+	double totalMs = 0.0;
+	ofs << "{\n\t\"stages\": [\n";
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		const auto &stats = stages[i];
+		ofs << "\t\t{ \"name\": " << jsonString(stats.name)
+			<< ", \"gpu_ms\": " << stats.gpuMilliseconds
+			<< ", \"dispatches\": " << stats.dispatchCount
+			<< ", \"rays\": " << stats.rayCount
+			<< ", \"rays_per_second\": " << stats.raysPerSecond()
+			<< ", \"bytes_read_back\": " << stats.bytesReadBack
+			<< " }" << (i + 1 < stages.size() ? ",\n" : "\n");
+		totalMs += stats.gpuMilliseconds;
+	}
+	ofs << "\t],\n\t\"total_gpu_ms\": " << totalMs << "\n}\n";
+	return (bool)ofs;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+/// Accumulated GPU work of one stage (a kernel of a solver) during a bake
+struct GPUStageStats
+{
+	std::string name;
+	double gpuMilliseconds = 0.0;
+	size_t dispatchCount = 0;
+	size_t rayCount = 0;
+	size_t bytesReadBack = 0;
+
+	double raysPerSecond() const
+	{
+		return gpuMilliseconds > 0.0 ? (double)rayCount / (gpuMilliseconds / 1000.0) : 0.0;
+	}
+};
+
+/// Runs glDispatchCompute wrapped in a GL_TIME_ELAPSED query accounted to the given stage.
+/// Query results are collected asynchronously on later calls, so dispatches never stall.
+void gpuDispatchCompute(const char *stage, GLuint groupsX, size_t rayCount = 0);
+
+/// Accounts bytes copied back from GPU memory to the given stage
+void gpuStatsReadBack(const char *stage, size_t bytes);
+
+/// Clears all the statistics. Blocks until the pending queries are available, their results are dropped
+/// with the rest so the query objects can be reused without mixing old times into the new stats.
+void gpuStatsReset();
+
+/// Blocks until all pending queries are available and returns the stats in dispatch order
+const std::vector<GPUStageStats>& gpuStatsCollect();
+
+/// Human readable table with the stats of all stages
+std::string gpuStatsReport();
+
+/// Writes the stats of all stages as a JSON document
+bool gpuStatsExportJson(const char *path);
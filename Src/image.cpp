@@ -24,8 +24,11 @@ SOFTWARE.
 #include "compute.h"
 #include "logging.h"
 #include "math.h"
+#include "profiler.h"
 #include "timing.h"
 #include <cassert>
+#include <memory>
+#include <vector>
 
 #pragma warning(disable:4996)
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -33,18 +36,6 @@ SOFTWARE.
 
 #include "tinyexr.h"
 
-Vector2 getMinMax(const float *data, const size_t count)
-{
-	Vector2 minmax(FLT_MAX, -FLT_MAX);
-	for (size_t i = 0; i < count; ++i)
-	{
-		const float r = data[i];
-		minmax.x = std::fminf(minmax.x, r);
-		minmax.y = std::fmaxf(minmax.y, r);
-	}
-	return minmax;
-}
-
 enum class Extension
 {
 	Unknown,
@@ -89,52 +80,30 @@ struct PixPos
 	PixPos operator *(const PixPos &o) const { return PixPos{ x * o.x, y * o.y }; }
 };
 
-std::vector<bool> createValidPixelsTable(const CompressedMapUV *map)
+// Averages the samples of a supersampled map, data and map are replaced by the resolved ones
+template <typename T>
+void resolveSamples(const T *&data, const CompressedMapUV *&map, std::vector<T> &resolved, std::unique_ptr<CompressedMapUV> &resolvedMap)
 {
-	std::vector<bool> validPixels(map->width * map->height);
-	for (const auto idx : map->indices)
-	{
-		validPixels[idx] = true;
-	}
-	return validPixels;
-}
-
-std::vector<bool> createValidPixelsTableRGB
-(
-	const CompressedMapUV *map, 
-	const uint8_t *data, 
-	uint8_t invalidR, 
-	uint8_t invalidG, 
-	uint8_t invalidB
-)
-{
-	const size_t w = map->width;
-	const size_t h = map->height;
-	std::vector<bool> validPixels(w * h);
-	for (const auto idx : map->indices)
-	{
-		const size_t x = idx % w;
-		const size_t y = idx / h;
-		const size_t pixIdx = ((h - y - 1) * w + x) * 3;
-		const uint8_t r = data[pixIdx + 0];
-		const uint8_t g = data[pixIdx + 1];
-		const uint8_t b = data[pixIdx + 2];
-		validPixels[idx] = (r != invalidR) | (g != invalidG) | (b != invalidB);
-	}
-	return validPixels;
+	if (!map->supersampled()) return;
+	PROFILE_ZONE("Resolve samples");
+	resolvedMap.reset(new CompressedMapUV(map->width, map->height));
+	map->resolve(data, resolved, resolvedMap->indices);
+	data = resolved.data();
+	map = resolvedMap.get();
 }
 
 #define DEBUG 1
 
-void dilateRGB(uint8_t *data, const CompressedMapUV *map, const std::vector<bool> &validPixels, const size_t maxDist)
+void dilateRGB(uint8_t *data, size_t width, size_t height, const std::vector<bool> &validPixels, const size_t maxDist)
 {
+	PROFILE_ZONE("Image dilation");
 	Timing timing;
 	timing.begin();
 
 	const PixPos offsets[] = { { 1,0 },{ -1,0 },{ 0,1 },{ 0,-1 },{ 1,1 },{ 1,-1 },{ -1,1 },{ -1,-1 } };
 
-	const int w = int(map->width);
-	const int h = int(map->height);
+	const int w = int(width);
+	const int h = int(height);
 
 #pragma omp parallel for
 	for (int y = 0; y < h; ++y)
@@ -185,163 +154,37 @@ void dilateRGB(uint8_t *data, const CompressedMapUV *map, const std::vector<bool
 	logDebug("Image", "Image dilation took " + std::to_string(timing.elapsedSeconds()) + " seconds.");
 }
 
-void exportFloatImage(const float *data, const CompressedMapUV *map, const char *path, Vector2 filterRange, bool normalize, int dilate, Vector2 *o_minmax)
+// Encodes an 8-bit RGB image stored in image order
+void saveRGB(const char *path, Extension ext, const uint8_t *rgb, size_t w, size_t h)
 {
-	assert(data);
-	assert(map);
-	assert(path);
-
-	Extension ext = getExtension(path);
-	if (ext == Extension::Unknown) return; // TODO: Error handling
-
-	const size_t count = map->indices.size();
-	const size_t w = map->width;
-	const size_t h = map->height;
-
-	const bool filter = filterRange.y > filterRange.x;
-
-	const Vector2 texminmax = getMinMax(data, count);
-	const Vector2 minmax =
-		filter ?
-		Vector2(std::fmaxf(texminmax.x, filterRange.x), std::fminf(texminmax.y, filterRange.y)) :
-		texminmax;
-	if (o_minmax) *o_minmax = minmax;
-	const Vector2 scaleBias = computeScaleBias(minmax, normalize);
-
-	if (ext == Extension::Png || ext == Extension::Tga)
-	{
-		// Unnormalized quantized data is not a great option...
-		if (!normalize)
-		{
-			logWarning("Image", "Forced value normalization as a non float texture format is used");
-		}
-
-		uint8_t *rgb = new uint8_t[w * h * 3];
-		memset(rgb, 0, sizeof(uint8_t) * w * h * 3);
-		for (size_t i = 0; i < count; ++i)
-		{
-			const float d = data[i];
-			//const float df = filter ? std::fminf(std::fmaxf(d, filterRange.x), filterRange.y) : d;
-			const float df = filter && (d < filterRange.x || d > filterRange.y) ? 0 : d;
-			const float t = df * scaleBias.x + scaleBias.y;
-			const uint8_t c = (uint8_t)(std::min(std::max(t, 0.0f), 1.0f) * 255.0f);
-			const size_t index = map->indices[i];
-			const size_t x = index % w;
-			const size_t y = index / w;
-			const size_t pixidx = ((h - y - 1) * w + x) * 3;
-			rgb[pixidx + 0] = c;
-			rgb[pixidx + 1] = c;
-			rgb[pixidx + 2] = c;
-		}
-
-		if (dilate > 0)
-		{
-			const auto validPixels = createValidPixelsTable(map);
-			dilateRGB(rgb, map, validPixels, dilate);
-		}
-
-		if (ext == Extension::Png) stbi_write_png(path, (int)w, (int)h, 3, rgb, (int)w * 3);
-		else stbi_write_tga(path, (int)w, (int)h, 3, rgb);
-
-		delete[] rgb;
-	}
-	else if (ext == Extension::Exr)
-	{
-		EXRHeader header;
-		InitEXRHeader(&header);
-		EXRImage image;
-		InitEXRImage(&image);
-		image.num_channels = 1;
-
-		float *f = new float[w * h];
-		memset(f, 0, sizeof(float) * w * h);
-		for (size_t i = 0; i < count; ++i)
-		{
-			const float d = data[i];
-			const float df = filter ? std::fminf(std::fmaxf(d, filterRange.x), filterRange.y) : d;
-			const float t = normalize ? df * scaleBias.x + scaleBias.y : df;
-			const size_t index = map->indices[i];
-			const size_t x = index % w;
-			const size_t y = index / w;
-			const size_t pixidx = ((h - y - 1) * w + x);
-			f[pixidx] = t;
-		}
-
-		image.images = (unsigned char **)(&f);
-		image.width = (int)w;
-		image.height = (int)h;
-		header.num_channels = 1;
-		header.channels = new EXRChannelInfo[header.num_channels];
-		strncpy(header.channels[0].name, "B", 255); header.channels[0].name[strlen("B")] = '\0';
-		header.pixel_types = new int[header.num_channels];
-		header.requested_pixel_types = new int[header.num_channels];
-		header.pixel_types[0] = TINYEXR_PIXELTYPE_FLOAT;
-		header.requested_pixel_types[0] = TINYEXR_PIXELTYPE_HALF;
-		const char *err;
-		int ret = SaveEXRImageToFile(&image, &header, path, &err);
-		if (ret != TINYEXR_SUCCESS)
-		{
-			// TODO: Error handling
-		}
-
-		delete[] f;
-		delete[] header.channels;
-		delete[] header.pixel_types;
-		delete[] header.requested_pixel_types;
-	}
+	PROFILE_ZONE("Image encoding");
+	if (ext == Extension::Png) stbi_write_png(path, (int)w, (int)h, 3, rgb, (int)w * 3);
+	else stbi_write_tga(path, (int)w, (int)h, 3, rgb);
 }
 
-void exportVectorImage(const Vector3 *data, const CompressedMapUV *map, const char *path)
+// Encodes float channels stored in image order, as half floats
+void saveEXR(const char *path, std::vector<float> *channels, const char *const *names, int count, size_t w, size_t h)
 {
-	assert(data);
-	assert(map);
-	assert(path);
-
-	Extension ext = getExtension(path);
-	if (ext != Extension::Exr) return; // TODO: Error handling
-
-	const size_t count = map->indices.size();
-	const size_t w = map->width;
-	const size_t h = map->height;
-
+	PROFILE_ZONE("Image encoding");
 	EXRHeader header;
 	InitEXRHeader(&header);
 	EXRImage image;
 	InitEXRImage(&image);
-	image.num_channels = 1;
-
-	std::vector<float> images[3];
-	images[0].resize(w * h);
-	images[1].resize(w * h);
-	images[2].resize(w * h);
 
-	for (size_t i = 0; i < count; ++i)
-	{
-		const size_t index = map->indices[i];
-		const size_t x = index % w;
-		const size_t y = index / w;
-		const size_t pixidx = ((h - y - 1) * w + x);
-		images[0][pixidx] = data[i].z;
-		images[1][pixidx] = data[i].y;
-		images[2][pixidx] = data[i].x;
-	}
-
-	float *image_ptr[3] = { &images[0][0], &images[1][0], &images[2][0] };
-	image.images = (unsigned char **)(image_ptr);
+	std::vector<float*> images(count);
+	for (int i = 0; i < count; ++i) images[i] = channels[i].data();
+	image.num_channels = count;
+	image.images = (unsigned char **)images.data();
 	image.width = (int)w;
 	image.height = (int)h;
 
-	header.num_channels = 3;
+	header.num_channels = count;
 	header.channels = new EXRChannelInfo[header.num_channels];
-	strncpy(header.channels[0].name, "B", 255); header.channels[0].name[strlen("B")] = '\0';
-	strncpy(header.channels[1].name, "G", 255); header.channels[1].name[strlen("G")] = '\0';
-	strncpy(header.channels[2].name, "R", 255); header.channels[2].name[strlen("R")] = '\0';
-
 	header.pixel_types = new int[header.num_channels];
 	header.requested_pixel_types = new int[header.num_channels];
-
-	for (size_t i = 0; i < header.num_channels; ++i)
+	for (int i = 0; i < count; ++i)
 	{
+		strncpy(header.channels[i].name, names[i], 255); header.channels[i].name[strlen(names[i])] = '\0';
 		header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
 		header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
 	}
@@ -358,48 +201,227 @@ void exportVectorImage(const Vector3 *data, const CompressedMapUV *map, const ch
 	delete[] header.requested_pixel_types;
 }
 
-void exportNormalImage(const Vector3 *data, const CompressedMapUV *map, const char *path, int dilate)
+ImageWriter::ImageWriter(Type type, const char *path, uint32_t width, uint32_t height, int dilate, Vector2 filterRange, bool normalize)
+	: _type(type)
+	, _path(path)
+	, _width(width)
+	, _height(height)
+	, _dilate(dilate)
+	, _filterRange(filterRange)
+	, _normalize(normalize)
+	, _minmax(FLT_MAX, -FLT_MAX)
 {
+	assert(path);
+	const Extension ext = getExtension(path);
+	if (ext == Extension::Unknown) return; // TODO: Error handling
+	if (type == Type::Vector && ext != Extension::Exr) return; // TODO: Error handling
+
+	const size_t count = _width * _height;
+	_written.resize(count);
+	if (type == Type::Float)
+	{
+		_values.resize(count);
+	}
+	else if (ext == Extension::Exr)
+	{
+		for (auto &channel : _channels) channel.resize(count);
+	}
+	else
+	{
+		_rgb.resize(count * 3);
+	}
+}
+
+void ImageWriter::write(const float *data, const CompressedMapUV *map)
+{
+	PROFILE_ZONE("ImageWriter::write");
 	assert(data);
 	assert(map);
-	assert(path);
+	assert(_type == Type::Float);
+	if (_written.empty()) return;
 
-	Extension ext = getExtension(path);
-	if (ext == Extension::Unknown) return; // TODO: Error handling
+	std::vector<float> resolved;
+	std::unique_ptr<CompressedMapUV> resolvedMap;
+	resolveSamples(data, map, resolved, resolvedMap);
 
 	const size_t count = map->indices.size();
-	const size_t w = map->width;
-	const size_t h = map->height;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float d = data[i];
+		const size_t index = map->indices[i];
+		_values[index] = d;
+		_written[index] = true;
+		_minmax.x = std::fminf(_minmax.x, d);
+		_minmax.y = std::fmaxf(_minmax.y, d);
+	}
+}
 
-	if (ext == Extension::Png || ext == Extension::Tga)
+void ImageWriter::write(const Vector3 *data, const CompressedMapUV *map)
+{
+	PROFILE_ZONE("ImageWriter::write");
+	assert(data);
+	assert(map);
+	assert(_type != Type::Float);
+	if (_written.empty()) return;
+
+	std::vector<Vector3> resolved;
+	std::unique_ptr<CompressedMapUV> resolvedMap;
+	resolveSamples(data, map, resolved, resolvedMap);
+	if (_type == Type::Normal)
 	{
-		uint8_t *rgb = new uint8_t[w * h * 3];
-		memset(rgb, 0, sizeof(uint8_t) * w * h * 3);
-		for (size_t i = 0; i < count; ++i)
+		// Averaged normals are renormalized
+		for (auto &n : resolved)
+		{
+			if (dot(n, n) > 0.0f) n = normalize(n);
+		}
+	}
+
+	const size_t count = map->indices.size();
+	const size_t w = _width;
+	const size_t h = _height;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const size_t index = map->indices[i];
+		const size_t x = index % w;
+		const size_t y = index / w;
+		const size_t pixidx = ((h - y - 1) * w + x);
+		_written[index] = true;
+		if (_rgb.empty())
+		{
+			_channels[0][pixidx] = data[i].z;
+			_channels[1][pixidx] = data[i].y;
+			_channels[2][pixidx] = data[i].x;
+		}
+		else
 		{
 			const Vector3 n = data[i] * 0.5f + Vector3(0.5f);
-			const size_t index = map->indices[i];
+			_rgb[pixidx * 3 + 0] = uint8_t(n.x * 255.0f);
+			_rgb[pixidx * 3 + 1] = uint8_t(n.y * 255.0f);
+			_rgb[pixidx * 3 + 2] = uint8_t(n.z * 255.0f);
+		}
+	}
+}
+
+void ImageWriter::save(Vector2 *o_minmax)
+{
+	PROFILE_ZONE("ImageWriter::save");
+	if (_written.empty()) return;
+
+	const Extension ext = getExtension(_path.c_str());
+	const size_t w = _width;
+	const size_t h = _height;
+
+	if (_type != Type::Float)
+	{
+		if (_rgb.empty())
+		{
+			static const char *const names[] = { "B", "G", "R" };
+			saveEXR(_path.c_str(), _channels, names, 3, w, h);
+			return;
+		}
+
+		if (_dilate > 0)
+		{
+			// Black texels are filled too
+			std::vector<bool> validPixels(w * h);
+			for (size_t index = 0; index < w * h; ++index)
+			{
+				if (!_written[index]) continue;
+				const size_t pixidx = ((h - index / w - 1) * w + index % w) * 3;
+				validPixels[index] = (_rgb[pixidx + 0] != 0) | (_rgb[pixidx + 1] != 0) | (_rgb[pixidx + 2] != 0);
+			}
+			dilateRGB(_rgb.data(), w, h, validPixels, _dilate);
+		}
+		saveRGB(_path.c_str(), ext, _rgb.data(), w, h);
+		return;
+	}
+
+	const bool filter = _filterRange.y > _filterRange.x;
+	const Vector2 minmax =
+		filter ?
+		Vector2(std::fmaxf(_minmax.x, _filterRange.x), std::fminf(_minmax.y, _filterRange.y)) :
+		_minmax;
+	if (o_minmax) *o_minmax = minmax;
+	const Vector2 scaleBias = computeScaleBias(minmax, _normalize);
+
+	if (ext == Extension::Png || ext == Extension::Tga)
+	{
+		// Unnormalized quantized data is not a great option...
+		if (!_normalize)
+		{
+			logWarning("Image", "Forced value normalization as a non float texture format is used");
+		}
+
+		std::vector<uint8_t> rgb(w * h * 3);
+		for (size_t index = 0; index < w * h; ++index)
+		{
+			if (!_written[index]) continue;
+			const float d = _values[index];
+			//const float df = filter ? std::fminf(std::fmaxf(d, _filterRange.x), _filterRange.y) : d;
+			const float df = filter && (d < _filterRange.x || d > _filterRange.y) ? 0 : d;
+			const float t = df * scaleBias.x + scaleBias.y;
+			const uint8_t c = (uint8_t)(std::min(std::max(t, 0.0f), 1.0f) * 255.0f);
 			const size_t x = index % w;
 			const size_t y = index / w;
 			const size_t pixidx = ((h - y - 1) * w + x) * 3;
-			rgb[pixidx + 0] = uint8_t(n.x * 255.0f);
-			rgb[pixidx + 1] = uint8_t(n.y * 255.0f);
-			rgb[pixidx + 2] = uint8_t(n.z * 255.0f);
+			rgb[pixidx + 0] = c;
+			rgb[pixidx + 1] = c;
+			rgb[pixidx + 2] = c;
 		}
+		_values = std::vector<float>(); // Only the 8-bit image is needed from here
 
-		if (dilate > 0)
+		if (_dilate > 0)
 		{
-			const auto validPixels = createValidPixelsTableRGB(map, rgb, 0, 0, 0);
-			dilateRGB(rgb, map, validPixels, dilate);
+			dilateRGB(rgb.data(), w, h, _written, _dilate);
 		}
-
-		if (ext == Extension::Png) stbi_write_png(path, (int)w, (int)h, 3, rgb, (int)w * 3);
-		else stbi_write_tga(path, (int)w, (int)h, 3, rgb);
-
-		delete[] rgb;
+		saveRGB(_path.c_str(), ext, rgb.data(), w, h);
 	}
 	else if (ext == Extension::Exr)
 	{
-		exportVectorImage(data, map, path);
+		std::vector<float> f(w * h);
+		for (size_t index = 0; index < w * h; ++index)
+		{
+			if (!_written[index]) continue;
+			const float d = _values[index];
+			const float df = filter ? std::fminf(std::fmaxf(d, _filterRange.x), _filterRange.y) : d;
+			const float t = _normalize ? df * scaleBias.x + scaleBias.y : df;
+			const size_t x = index % w;
+			const size_t y = index / w;
+			f[(h - y - 1) * w + x] = t;
+		}
+		_values = std::vector<float>();
+
+		static const char *const names[] = { "B" };
+		saveEXR(_path.c_str(), &f, names, 1, w, h);
 	}
-}
\ No newline at end of file
+}
+
+void exportFloatImage(const float *data, const CompressedMapUV *map, const char *path, Vector2 filterRange, bool normalize, int dilate, Vector2 *o_minmax)
+{
+	PROFILE_ZONE("exportFloatImage");
+	assert(data);
+	assert(map);
+	ImageWriter image(ImageWriter::Type::Float, path, map->width, map->height, dilate, filterRange, normalize);
+	image.write(data, map);
+	image.save(o_minmax);
+}
+
+void exportVectorImage(const Vector3 *data, const CompressedMapUV *map, const char *path)
+{
+	PROFILE_ZONE("exportVectorImage");
+	assert(data);
+	assert(map);
+	ImageWriter image(ImageWriter::Type::Vector, path, map->width, map->height);
+	image.write(data, map);
+	image.save();
+}
+
+void exportNormalImage(const Vector3 *data, const CompressedMapUV *map, const char *path, int dilate)
+{
+	PROFILE_ZONE("exportNormalImage");
+	assert(data);
+	assert(map);
+	ImageWriter image(ImageWriter::Type::Normal, path, map->width, map->height, dilate);
+	image.write(data, map);
+	image.save();
+}
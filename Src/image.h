@@ -24,6 +24,9 @@ SOFTWARE.
 #pragma once
 
 #include "math.h"
+#include <cstdint>
+#include <string>
+#include <vector>
 
 struct CompressedMapUV;
 
@@ -47,4 +50,45 @@ void exportVectorImage(const Vector3 *data, const CompressedMapUV *map, const ch
 /// @param data Normals data
 /// @param map How the data should be stored on the map
 /// @param path Path to the file
-void exportNormalImage(const Vector3 *data, const CompressedMapUV *map, const char *path, int dilate = 0);
\ No newline at end of file
+void exportNormalImage(const Vector3 *data, const CompressedMapUV *map, const char *path, int dilate = 0);
+
+/// Image exported a part at a time: every part is resolved and stored as soon as it is written, so only the
+/// image itself is kept between the parts. Normal maps saved as PNG or TGA are stored quantized, the float maps
+/// keep a float per texel until they are saved as they are normalized with the range of every part.
+/// The export functions above write the whole map as a single part.
+class ImageWriter
+{
+public:
+	enum class Type
+	{
+		Float, // Single channel, see exportFloatImage
+		Vector, // Raw 3-channel-float data, see exportVectorImage
+		Normal // See exportNormalImage
+	};
+
+	ImageWriter(Type type, const char *path, uint32_t width, uint32_t height,
+		int dilate = 0, Vector2 filterRange = Vector2(0, 0), bool normalize = false);
+
+	/// Stores the texels of a part, the map has the size of the image
+	void write(const float *data, const CompressedMapUV *map);
+	void write(const Vector3 *data, const CompressedMapUV *map);
+
+	/// Dilates and encodes the image
+	/// @param o_minmax Range of the values of a float map
+	void save(Vector2 *o_minmax = nullptr);
+
+private:
+	const Type _type;
+	const std::string _path;
+	const size_t _width;
+	const size_t _height;
+	const int _dilate;
+	const Vector2 _filterRange;
+	const bool _normalize;
+
+	std::vector<bool> _written; // Texels covered by any part
+	std::vector<float> _values; // Float maps, in texel order
+	std::vector<float> _channels[3]; // Vector maps saved as EXR, one per channel in image order
+	std::vector<uint8_t> _rgb; // Normal maps saved as PNG or TGA, in image order
+	Vector2 _minmax;
+};
@@ -0,0 +1,538 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "instancedmesh.h"
+#include "logging.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+static const size_t k_instancesPerLeaf = 4;
+static const size_t k_maxTreeDepth = 8192;
+static const float k_positionTolerance = 1e-4f; // Relative to the part size
+static const float k_normalTolerance = 0.999f; // Minimum cosine between the normals of a repeated group
+
+namespace
+{
+	/// Appends a range of triangles of a mesh as a new part, with positions and normals numbered by first use
+	void appendPart(InstancedMesh &instanced, const Mesh &mesh, uint32_t firstTriangle, uint32_t triangleCount, const std::string &name)
+	{
+		Mesh &parts = instanced.mesh;
+		InstancedMesh::Part part;
+		part.name = name;
+		part.firstTriangle = (uint32_t)parts.triangles.size();
+		part.triangleCount = triangleCount;
+
+		std::unordered_map<uint32_t, uint32_t> vertexMap;
+		std::unordered_map<uint32_t, uint32_t> positionMap;
+		std::unordered_map<uint32_t, uint32_t> normalMap;
+		auto remap = [](std::unordered_map<uint32_t, uint32_t> &map, uint32_t idx, uint32_t next)
+		{
+			return map.emplace(idx, next).first->second;
+		};
+
+		for (uint32_t t = firstTriangle; t < firstTriangle + triangleCount; ++t)
+		{
+			Mesh::Triangle tri = mesh.triangles[t];
+			uint32_t *corners[3] = { &tri.vertexIndex0, &tri.vertexIndex1, &tri.vertexIndex2 };
+			for (uint32_t *corner : corners)
+			{
+				const uint32_t vidx = remap(vertexMap, *corner, (uint32_t)parts.vertices.size());
+				if (vidx == parts.vertices.size())
+				{
+					const Mesh::Vertex &v = mesh.vertices[*corner];
+					Mesh::Vertex pv;
+					pv.positionIndex = remap(positionMap, v.positionIndex, (uint32_t)parts.positions.size());
+					if (pv.positionIndex == parts.positions.size()) parts.positions.push_back(mesh.positions[v.positionIndex]);
+					pv.texcoordIndex = UINT32_MAX;
+					pv.normalIndex = UINT32_MAX;
+					if (v.normalIndex != UINT32_MAX)
+					{
+						pv.normalIndex = remap(normalMap, v.normalIndex, (uint32_t)parts.normals.size());
+						if (pv.normalIndex == parts.normals.size()) parts.normals.push_back(mesh.normals[v.normalIndex]);
+					}
+					parts.vertices.push_back(pv);
+				}
+				*corner = vidx;
+			}
+			parts.triangles.push_back(tri);
+		}
+
+		instanced.parts.push_back(part);
+	}
+
+	/// Topology of a group: corners refer to the group positions numbered by first use
+	struct GroupShape
+	{
+		std::vector<uint32_t> corners;
+		std::vector<uint32_t> positions; // Mesh position of every group position
+		uint64_t hash;
+	};
+
+	GroupShape groupShape(const Mesh &mesh, const Mesh::Group &group)
+	{
+		GroupShape shape;
+		shape.corners.reserve(group.triangleCount * 3);
+		std::unordered_map<uint32_t, uint32_t> local;
+		uint64_t h = 0x9E3779B97F4A7C15ull ^ group.triangleCount;
+		for (uint32_t t = group.firstTriangle; t < group.firstTriangle + group.triangleCount; ++t)
+		{
+			const Mesh::Triangle &tri = mesh.triangles[t];
+			const uint32_t vertices[3] = { tri.vertexIndex0, tri.vertexIndex1, tri.vertexIndex2 };
+			for (uint32_t v : vertices)
+			{
+				const uint32_t pidx = mesh.vertices[v].positionIndex;
+				const uint32_t lidx = local.emplace(pidx, (uint32_t)shape.positions.size()).first->second;
+				if (lidx == shape.positions.size()) shape.positions.push_back(pidx);
+				shape.corners.push_back(lidx);
+				h = (h ^ lidx) * 0x100000001B3ull;
+			}
+		}
+		shape.hash = h;
+		return shape;
+	}
+
+	/// Unique part found in the groups and the reference positions that fix its transforms
+	struct PartShape
+	{
+		uint32_t part;
+		std::vector<uint32_t> corners;
+		std::vector<Vector3> positions;
+		uint32_t reference[4]; // The last one is missing for planar parts
+		float size;
+		bool instanceable;
+	};
+
+	Vector3 planarReference(const Vector3 &p0, const Vector3 &p1, const Vector3 &p2)
+	{
+		return p0 + normalize(cross(p1 - p0, p2 - p0)) * length(p1 - p0);
+	}
+
+	/// Spread positions of the part: far apart, off the line of the first two and off their plane
+	void findReferencePositions(PartShape &shape)
+	{
+		const std::vector<Vector3> &p = shape.positions;
+		Vector3 mins(FLT_MAX);
+		Vector3 maxs(-FLT_MAX);
+		for (const Vector3 &v : p)
+		{
+			mins = min(mins, v);
+			maxs = max(maxs, v);
+		}
+		shape.size = length(maxs - mins);
+		shape.instanceable = false;
+		if (p.size() < 3 || shape.size <= 0.0f) return;
+
+		uint32_t *ref = shape.reference;
+		ref[0] = 0;
+		ref[1] = 0;
+		ref[2] = 0;
+		ref[3] = UINT32_MAX;
+		float best = 0.0f;
+		for (uint32_t i = 1; i < p.size(); ++i)
+		{
+			const float d = length(p[i] - p[0]);
+			if (d > best) { best = d; ref[1] = i; }
+		}
+		const Vector3 e = p[ref[1]] - p[0];
+		best = 0.0f;
+		for (uint32_t i = 1; i < p.size(); ++i)
+		{
+			const float d = length(cross(e, p[i] - p[0]));
+			if (d > best) { best = d; ref[2] = i; }
+		}
+		if (best < 1e-4f * dot(e, e)) return; // Collinear
+
+		const Vector3 n = normalize(cross(e, p[ref[2]] - p[0]));
+		best = k_positionTolerance * shape.size;
+		for (uint32_t i = 1; i < p.size(); ++i)
+		{
+			const float d = std::fabs(dot(n, p[i] - p[0]));
+			if (d > best) { best = d; ref[3] = i; }
+		}
+		shape.instanceable = true;
+	}
+
+	/// Affine transform that takes four points to other four, false if they are degenerate
+	bool solveTransform(const Vector3 p[4], const Vector3 q[4], Transform &o_transform)
+	{
+		double a[3][3], b[3][3];
+		for (int c = 0; c < 3; ++c)
+		{
+			const Vector3 dp = p[c + 1] - p[0];
+			const Vector3 dq = q[c + 1] - q[0];
+			a[0][c] = dp.x; a[1][c] = dp.y; a[2][c] = dp.z;
+			b[0][c] = dq.x; b[1][c] = dq.y; b[2][c] = dq.z;
+		}
+
+		const double det =
+			a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+			a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+			a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+		if (std::fabs(det) < 1e-30) return false;
+
+		double inv[3][3];
+		for (int r = 0; r < 3; ++r)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				const int r0 = (c + 1) % 3, r1 = (c + 2) % 3;
+				const int c0 = (r + 1) % 3, c1 = (r + 2) % 3;
+				inv[r][c] = (a[r0][c0] * a[r1][c1] - a[r0][c1] * a[r1][c0]) / det;
+			}
+		}
+
+		for (int r = 0; r < 3; ++r)
+		{
+			double t = q[0].x * (r == 0) + q[0].y * (r == 1) + q[0].z * (r == 2);
+			for (int c = 0; c < 3; ++c)
+			{
+				const double m = b[r][0] * inv[0][c] + b[r][1] * inv[1][c] + b[r][2] * inv[2][c];
+				o_transform.m[r * 4 + c] = (float)m;
+				t -= m * (c == 0 ? p[0].x : c == 1 ? p[0].y : p[0].z);
+			}
+			o_transform.m[r * 4 + 3] = (float)t;
+		}
+		return std::fabs(o_transform.determinant()) > 0.0f;
+	}
+
+	/// Transform that takes the part to the group, false if the group isn't a copy of the part
+	bool matchPart(const Mesh &mesh, const Mesh::Group &group, const GroupShape &groupShape,
+		const PartShape &part, const InstancedMesh &instanced, Transform &o_transform)
+	{
+		if (!part.instanceable || part.corners != groupShape.corners) return false;
+
+		Vector3 p[4], q[4];
+		for (int i = 0; i < 3; ++i)
+		{
+			p[i] = part.positions[part.reference[i]];
+			q[i] = mesh.positions[groupShape.positions[part.reference[i]]];
+		}
+		if (part.reference[3] != UINT32_MAX)
+		{
+			p[3] = part.positions[part.reference[3]];
+			q[3] = mesh.positions[groupShape.positions[part.reference[3]]];
+		}
+		else
+		{
+			p[3] = planarReference(p[0], p[1], p[2]);
+			q[3] = planarReference(q[0], q[1], q[2]);
+		}
+		if (!solveTransform(p, q, o_transform)) return false;
+
+		// Tolerance for the part size and for the precision of the group coordinates
+		float magnitude = 0.0f;
+		for (uint32_t pidx : groupShape.positions)
+		{
+			const Vector3 &v = mesh.positions[pidx];
+			magnitude = std::fmax(magnitude, std::fmax(std::fabs(v.x), std::fmax(std::fabs(v.y), std::fabs(v.z))));
+		}
+		const float tolerance = k_positionTolerance * part.size + 8.0f * FLT_EPSILON * magnitude;
+		for (size_t i = 0; i < part.positions.size(); ++i)
+		{
+			const Vector3 diff = o_transform.point(part.positions[i]) - mesh.positions[groupShape.positions[i]];
+			if (dot(diff, diff) > tolerance * tolerance) return false;
+		}
+
+		if (!mesh.normals.empty())
+		{
+			const Transform inverse = o_transform.inverse();
+			const InstancedMesh::Part &p = instanced.parts[part.part];
+			for (uint32_t t = 0; t < group.triangleCount; ++t)
+			{
+				const Mesh::Triangle &gt = mesh.triangles[group.firstTriangle + t];
+				const Mesh::Triangle &pt = instanced.mesh.triangles[p.firstTriangle + t];
+				const uint32_t gv[3] = { gt.vertexIndex0, gt.vertexIndex1, gt.vertexIndex2 };
+				const uint32_t pv[3] = { pt.vertexIndex0, pt.vertexIndex1, pt.vertexIndex2 };
+				for (int c = 0; c < 3; ++c)
+				{
+					const uint32_t gn = mesh.vertices[gv[c]].normalIndex;
+					const uint32_t pn = instanced.mesh.vertices[pv[c]].normalIndex;
+					if ((gn == UINT32_MAX) != (pn == UINT32_MAX)) return false;
+					if (gn == UINT32_MAX) continue;
+					const Vector3 expected = inverse.transposedDirection(instanced.mesh.normals[pn]);
+					const Vector3 actual = mesh.normals[gn];
+					if (dot(expected, actual) < k_normalTolerance * length(expected) * length(actual)) return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/// Box around the transformed box
+	AABB transformBox(const AABB &box, const Transform &transform)
+	{
+		const float *m = transform.m;
+		const Vector3 &s = box.size;
+		return AABB(transform.point(box.center), Vector3(
+			std::fabs(m[0]) * s.x + std::fabs(m[1]) * s.y + std::fabs(m[2]) * s.z,
+			std::fabs(m[4]) * s.x + std::fabs(m[5]) * s.y + std::fabs(m[6]) * s.z,
+			std::fabs(m[8]) * s.x + std::fabs(m[9]) * s.y + std::fabs(m[10]) * s.z));
+	}
+
+	bool intersectPart(const Mesh &mesh, const BVH &node, const Vector3 &o, const Vector3 &d, IntersectResult &io_result, bool &io_hit)
+	{
+		if (!RayAABB(Ray(o, d), node.aabb)) return false;
+		bool hit = false;
+		for (const BVH &child : node.children)
+		{
+			hit |= intersectPart(mesh, child, o, d, io_result, io_hit);
+		}
+		for (uint32_t tidx : node.triangles)
+		{
+			IntersectResult r;
+			if (mesh.intersect(o, d, tidx, r) && (!io_hit || r.distance < io_result.distance))
+			{
+				io_result = r;
+				io_hit = true;
+				hit = true;
+			}
+		}
+		return hit;
+	}
+
+	std::string directoryOf(const std::string &path)
+	{
+		const size_t sep = path.find_last_of("/\\");
+		return sep == std::string::npos ? std::string() : path.substr(0, sep + 1);
+	}
+
+	bool isAbsolutePath(const std::string &path)
+	{
+		return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+	}
+}
+
+InstancedMesh* InstancedMesh::loadDescription(const char *path)
+{
+	PROFILE_ZONE("InstancedMesh::loadDescription");
+	std::ifstream file(path);
+	if (!file)
+	{
+		logError("Instances", std::string("Can't open ") + path);
+		return nullptr;
+	}
+
+	const std::string directory = directoryOf(path);
+	std::unique_ptr<InstancedMesh> instanced(new InstancedMesh());
+	std::unordered_map<std::string, uint32_t> partIndices;
+	std::string line;
+	size_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		std::istringstream ss(line);
+		std::string keyword, name;
+		if (!(ss >> keyword) || keyword[0] == '#') continue;
+		auto fail = [&](const std::string &why) -> InstancedMesh*
+		{
+			logError("Instances", std::string(path) + ":" + std::to_string(lineNumber) + ": " + why);
+			return nullptr;
+		};
+		if (!(ss >> name)) return fail("Missing name");
+
+		if (keyword == "part")
+		{
+			std::string meshPath;
+			std::getline(ss >> std::ws, meshPath);
+			while (!meshPath.empty() && std::isspace((unsigned char)meshPath.back())) meshPath.pop_back();
+			if (meshPath.empty()) return fail("Missing mesh of part " + name);
+			if (partIndices.count(name)) return fail("Repeated part " + name);
+			if (!isAbsolutePath(meshPath)) meshPath = directory + meshPath;
+			std::unique_ptr<Mesh> mesh(Mesh::loadFile(meshPath.c_str()));
+			if (!mesh || mesh->triangles.empty()) return fail("Can't load " + meshPath);
+			partIndices[name] = (uint32_t)instanced->parts.size();
+			appendPart(*instanced, *mesh, 0, (uint32_t)mesh->triangles.size(), name);
+		}
+		else if (keyword == "instance")
+		{
+			auto it = partIndices.find(name);
+			if (it == partIndices.end()) return fail("Unknown part " + name);
+			std::vector<float> values;
+			float value;
+			while (ss >> value) values.push_back(value);
+			if (!ss.eof()) return fail("Invalid transform");
+
+			Instance instance;
+			instance.part = it->second;
+			instance.transform = Transform::identity();
+			if (values.size() == 3)
+			{
+				instance.transform.m[3] = values[0];
+				instance.transform.m[7] = values[1];
+				instance.transform.m[11] = values[2];
+			}
+			else if (values.size() == 12)
+			{
+				std::copy(values.begin(), values.end(), instance.transform.m);
+			}
+			else if (!values.empty())
+			{
+				return fail("The transform needs 3 or 12 numbers");
+			}
+			if (instance.transform.determinant() == 0.0f) return fail("Singular transform");
+			instanced->instances.push_back(instance);
+		}
+		else
+		{
+			return fail("Unknown keyword " + keyword);
+		}
+	}
+
+	if (instanced->instances.empty())
+	{
+		logError("Instances", std::string(path) + " has no instances");
+		return nullptr;
+	}
+	logDebug("Instances",
+		std::to_string(instanced->parts.size()) + " parts and " +
+		std::to_string(instanced->instances.size()) + " instances in " + path);
+	return instanced.release();
+}
+
+InstancedMesh* InstancedMesh::createFromRepeatedGroups(const Mesh *mesh)
+{
+	PROFILE_ZONE("InstancedMesh::createFromRepeatedGroups");
+	assert(mesh);
+	if (mesh->groups.empty()) return nullptr;
+
+	size_t groupTriangles = 0;
+	for (const Mesh::Group &group : mesh->groups) groupTriangles += group.triangleCount;
+	if (groupTriangles != mesh->triangles.size()) return nullptr;
+
+	std::unique_ptr<InstancedMesh> instanced(new InstancedMesh());
+	std::vector<PartShape> shapes;
+	std::unordered_multimap<uint64_t, uint32_t> shapesByHash;
+
+	for (const Mesh::Group &group : mesh->groups)
+	{
+		if (group.triangleCount == 0) continue;
+		GroupShape shape = groupShape(*mesh, group);
+
+		Instance instance;
+		instance.part = UINT32_MAX;
+		auto range = shapesByHash.equal_range(shape.hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			const PartShape &part = shapes[it->second];
+			if (matchPart(*mesh, group, shape, part, *instanced, instance.transform))
+			{
+				instance.part = part.part;
+				break;
+			}
+		}
+
+		if (instance.part == UINT32_MAX)
+		{
+			PartShape part;
+			part.part = (uint32_t)instanced->parts.size();
+			part.corners = std::move(shape.corners);
+			part.positions.reserve(shape.positions.size());
+			for (uint32_t pidx : shape.positions) part.positions.push_back(mesh->positions[pidx]);
+			findReferencePositions(part);
+			shapesByHash.emplace(shape.hash, (uint32_t)shapes.size());
+			shapes.push_back(std::move(part));
+
+			appendPart(*instanced, *mesh, group.firstTriangle, group.triangleCount, group.name);
+			instance.part = shapes.back().part;
+			instance.transform = Transform::identity();
+		}
+		instanced->instances.push_back(instance);
+	}
+
+	if (instanced->parts.size() == instanced->instances.size()) return nullptr;
+
+	logDebug("Instances",
+		std::to_string(mesh->groups.size()) + " groups are " +
+		std::to_string(instanced->instances.size()) + " instances of " +
+		std::to_string(instanced->parts.size()) + " parts");
+	return instanced.release();
+}
+
+bool InstancedMesh::isDescription(const char *path)
+{
+	const std::string str(path);
+	const std::string ending(".instances");
+	return str.size() >= ending.size() && std::equal(ending.rbegin(), ending.rend(), str.rbegin());
+}
+
+void InstancedMesh::buildBVH(const size_t maxTriangleCount)
+{
+	PROFILE_ZONE("InstancedMesh::buildBVH");
+	partBVHs.clear();
+	for (const Part &part : parts)
+	{
+		partBVHs.emplace_back(BVH::createBinary(&mesh, part.firstTriangle, part.triangleCount, maxTriangleCount, k_maxTreeDepth));
+	}
+
+	std::vector<AABB> boxes;
+	boxes.reserve(instances.size());
+	for (const Instance &instance : instances)
+	{
+		boxes.push_back(transformBox(partBVHs[instance.part]->aabb, instance.transform));
+	}
+	instanceBVH.reset(BVH::createBinary(boxes, k_instancesPerLeaf, k_maxTreeDepth));
+}
+
+bool InstancedMesh::intersect(const Vector3 &o, const Vector3 &d, InstanceIntersectResult &o_result) const
+{
+	assert(instanceBVH);
+	bool hit = false;
+	IntersectResult closest;
+	std::vector<const BVH*> stack(1, instanceBVH.get());
+	while (!stack.empty())
+	{
+		const BVH *node = stack.back();
+		stack.pop_back();
+		if (!RayAABB(Ray(o, d), node->aabb)) continue;
+		for (const BVH &child : node->children) stack.push_back(&child);
+
+		for (uint32_t idx : node->triangles)
+		{
+			// The direction isn't normalized in part space, so distances are the same in both spaces
+			const Instance &instance = instances[idx];
+			const Transform inverse = instance.transform.inverse();
+			if (intersectPart(mesh, *partBVHs[instance.part], inverse.point(o), inverse.direction(d), closest, hit))
+			{
+				o_result.instance = idx;
+			}
+		}
+	}
+	if (hit)
+	{
+		o_result.tidx = (uint32_t)closest.tidx;
+		o_result.distance = closest.distance;
+	}
+	return hit;
+}
+
+size_t InstancedMesh::instancedTriangleCount() const
+{
+	size_t count = 0;
+	for (const Instance &instance : instances) count += parts[instance.part].triangleCount;
+	return count;
+}
@@ -0,0 +1,87 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include "bvh.h"
+#include "math.h"
+#include "mesh.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Triangle hit by a ray in an instanced mesh
+struct InstanceIntersectResult
+{
+	uint32_t instance;
+	uint32_t tidx; // Triangle of the parts mesh
+	float distance;
+};
+
+/// Mesh made of transformed instances of shared parts.
+/// Every part is stored and gets its BVH once, a top level BVH over the instance bounds finds
+/// the instances a ray reaches and the ray descends into their parts in part space.
+class InstancedMesh
+{
+public:
+	/// Range of triangles of the parts mesh
+	struct Part
+	{
+		std::string name;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+	};
+
+	struct Instance
+	{
+		uint32_t part;
+		Transform transform; // Part space to mesh space
+	};
+
+	Mesh mesh; // Triangles of all the parts, one part after another, in part space
+	std::vector<Part> parts;
+	std::vector<Instance> instances;
+
+	// Built by buildBVH
+	std::vector<std::unique_ptr<BVH> > partBVHs;
+	std::unique_ptr<BVH> instanceBVH; // The leaves list instance indices
+
+	/// Loads an instance description: "part NAME MESH_PATH" and "instance NAME [TRANSFORM]" lines.
+	/// Mesh paths are relative to the description file. The transform is missing (identity),
+	/// a translation (3 numbers) or the upper 3x4 rows of a matrix (12 numbers, row major).
+	static InstancedMesh* loadDescription(const char *path);
+
+	/// Groups of the mesh that repeat another group with an affine transform become instances of it.
+	/// Returns nullptr if the mesh has no groups or none of them repeats.
+	static InstancedMesh* createFromRepeatedGroups(const Mesh *mesh);
+
+	/// Instance descriptions are loaded with loadDescription instead of Mesh::loadFile
+	static bool isDescription(const char *path);
+
+	void buildBVH(const size_t maxTriangleCount);
+
+	/// Closest hit of the ray, needs buildBVH
+	bool intersect(const Vector3 &o, const Vector3 &d, InstanceIntersectResult &o_result) const;
+
+	/// Triangles of the mesh if every instance was flattened
+	size_t instancedTriangleCount() const;
+};
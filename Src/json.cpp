@@ -0,0 +1,288 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "json.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const JsonValue k_null;
+
+	// Deeper documents are rejected instead of running out of stack
+	static const int k_maxDepth = 256;
+}
+
+class JsonParser
+{
+public:
+	JsonParser(const char *begin, const char *end) : _ptr(begin), _end(end) {}
+
+	bool parseDocument(JsonValue &o_value)
+	{
+		if (!parseValue(o_value, 0)) return false;
+		skipSpaces();
+		return _ptr == _end;
+	}
+
+private:
+	void skipSpaces()
+	{
+		while (_ptr != _end && (*_ptr == ' ' || *_ptr == '\t' || *_ptr == '\n' || *_ptr == '\r')) ++_ptr;
+	}
+
+	bool consume(char c)
+	{
+		skipSpaces();
+		if (_ptr == _end || *_ptr != c) return false;
+		++_ptr;
+		return true;
+	}
+
+	bool consumeWord(const char *word)
+	{
+		const size_t length = strlen(word);
+		if ((size_t)(_end - _ptr) < length || memcmp(_ptr, word, length) != 0) return false;
+		_ptr += length;
+		return true;
+	}
+
+	bool parseValue(JsonValue &o_value, int depth)
+	{
+		if (depth > k_maxDepth) return false;
+		skipSpaces();
+		if (_ptr == _end) return false;
+
+		switch (*_ptr)
+		{
+		case '{': return parseObject(o_value, depth);
+		case '[': return parseArray(o_value, depth);
+		case '"':
+			o_value._type = JsonValue::Type::String;
+			return parseString(o_value._string);
+		case 't':
+			o_value._type = JsonValue::Type::Bool;
+			o_value._bool = true;
+			return consumeWord("true");
+		case 'f':
+			o_value._type = JsonValue::Type::Bool;
+			o_value._bool = false;
+			return consumeWord("false");
+		case 'n':
+			o_value._type = JsonValue::Type::Null;
+			return consumeWord("null");
+		default:
+			o_value._type = JsonValue::Type::Number;
+			return parseNumber(o_value._number);
+		}
+	}
+
+	bool parseObject(JsonValue &o_value, int depth)
+	{
+		o_value._type = JsonValue::Type::Object;
+		++_ptr;
+		if (consume('}')) return true;
+		do
+		{
+			std::string key;
+			skipSpaces();
+			if (!parseString(key) || !consume(':')) return false;
+			o_value._members.emplace_back(std::move(key), JsonValue());
+			if (!parseValue(o_value._members.back().second, depth + 1)) return false;
+		} while (consume(','));
+		return consume('}');
+	}
+
+	bool parseArray(JsonValue &o_value, int depth)
+	{
+		o_value._type = JsonValue::Type::Array;
+		++_ptr;
+		if (consume(']')) return true;
+		do
+		{
+			o_value._array.emplace_back();
+			if (!parseValue(o_value._array.back(), depth + 1)) return false;
+		} while (consume(','));
+		return consume(']');
+	}
+
+	bool parseNumber(double &o_number)
+	{
+		char buffer[64];
+		size_t length = 0;
+		while (_ptr + length != _end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", _ptr[length]))
+		{
+			buffer[length] = _ptr[length];
+			++length;
+		}
+		buffer[length] = '\0';
+		char *numberEnd;
+		o_number = strtod(buffer, &numberEnd);
+		if (numberEnd == buffer) return false;
+		_ptr += numberEnd - buffer;
+		return true;
+	}
+
+	bool parseHex4(unsigned &o_code)
+	{
+		if (_end - _ptr < 4) return false;
+		o_code = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			const char c = *_ptr++;
+			o_code <<= 4;
+			if (c >= '0' && c <= '9') o_code |= c - '0';
+			else if (c >= 'a' && c <= 'f') o_code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') o_code |= c - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	static void appendUtf8(std::string &str, unsigned code)
+	{
+		if (code < 0x80)
+		{
+			str += (char)code;
+		}
+		else if (code < 0x800)
+		{
+			str += (char)(0xC0 | (code >> 6));
+			str += (char)(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			str += (char)(0xE0 | (code >> 12));
+			str += (char)(0x80 | ((code >> 6) & 0x3F));
+			str += (char)(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			str += (char)(0xF0 | (code >> 18));
+			str += (char)(0x80 | ((code >> 12) & 0x3F));
+			str += (char)(0x80 | ((code >> 6) & 0x3F));
+			str += (char)(0x80 | (code & 0x3F));
+		}
+	}
+
+	bool parseString(std::string &o_str)
+	{
+		if (_ptr == _end || *_ptr != '"') return false;
+		++_ptr;
+		while (_ptr != _end && *_ptr != '"')
+		{
+			const char c = *_ptr++;
+			if (c != '\\')
+			{
+				o_str += c;
+				continue;
+			}
+			if (_ptr == _end) return false;
+			const char escaped = *_ptr++;
+			switch (escaped)
+			{
+			case '"': case '\\': case '/': o_str += escaped; break;
+			case 'b': o_str += '\b'; break;
+			case 'f': o_str += '\f'; break;
+			case 'n': o_str += '\n'; break;
+			case 'r': o_str += '\r'; break;
+			case 't': o_str += '\t'; break;
+			case 'u':
+			{
+				unsigned code;
+				if (!parseHex4(code)) return false;
+				// Surrogate pairs
+				if (code >= 0xD800 && code < 0xDC00)
+				{
+					unsigned low;
+					if (!consumeWord("\\u") || !parseHex4(low) || low < 0xDC00 || low >= 0xE000) return false;
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(o_str, code);
+			} break;
+			default:
+				return false;
+			}
+		}
+		if (_ptr == _end) return false;
+		++_ptr;
+		return true;
+	}
+
+	const char *_ptr;
+	const char *_end;
+};
+
+bool JsonValue::parse(const char *begin, const char *end, JsonValue &o_value)
+{
+	o_value = JsonValue();
+	JsonParser parser(begin, end);
+	return parser.parseDocument(o_value);
+}
+
+const JsonValue& JsonValue::at(size_t index) const
+{
+	if (_type != Type::Array || index >= _array.size()) return k_null;
+	return _array[index];
+}
+
+const JsonValue& JsonValue::operator[](const char *key) const
+{
+	if (_type != Type::Object) return k_null;
+	for (const auto &member : _members)
+	{
+		if (member.first == key) return member.second;
+	}
+	return k_null;
+}
+
+std::string jsonString(const std::string &str)
+{
+	static const char k_hex[] = "0123456789abcdef";
+
+	std::string res = "\"";
+	for (char c : str)
+	{
+		switch (c)
+		{
+		case '"': res += "\\\""; break;
+		case '\\': res += "\\\\"; break;
+		case '\b': res += "\\b"; break;
+		case '\f': res += "\\f"; break;
+		case '\n': res += "\\n"; break;
+		case '\r': res += "\\r"; break;
+		case '\t': res += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20)
+			{
+				res += "\\u00";
+				res += k_hex[(unsigned char)c >> 4];
+				res += k_hex[(unsigned char)c & 0xf];
+			}
+			else
+			{
+				res += c;
+			}
+		}
+	}
+	return res + "\"";
+}
@@ -0,0 +1,71 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Read only JSON document, enough for the scene descriptions of glTF files.
+/// Missing members and out of range elements return a null value instead of failing.
+class JsonValue
+{
+public:
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	JsonValue() : _type(Type::Null), _bool(false), _number(0.0) {}
+
+	/// @return False if the text is not valid JSON
+	static bool parse(const char *begin, const char *end, JsonValue &o_value);
+
+	Type type() const { return _type; }
+	bool isNull() const { return _type == Type::Null; }
+	bool isNumber() const { return _type == Type::Number; }
+	bool isString() const { return _type == Type::String; }
+	bool isArray() const { return _type == Type::Array; }
+	bool isObject() const { return _type == Type::Object; }
+
+	bool boolean(bool fallback = false) const { return _type == Type::Bool ? _bool : fallback; }
+	double number(double fallback = 0.0) const { return _type == Type::Number ? _number : fallback; }
+	const std::string& string() const { return _string; }
+
+	/// Number of elements of an array or members of an object
+	size_t size() const { return _type == Type::Array ? _array.size() : _members.size(); }
+	const JsonValue& at(size_t index) const;
+	const JsonValue& operator[](const char *key) const;
+	bool has(const char *key) const { return !(*this)[key].isNull(); }
+
+private:
+	friend class JsonParser;
+
+	Type _type;
+	bool _bool;
+	double _number;
+	std::string _string;
+	std::vector<JsonValue> _array;
+	std::vector<std::pair<std::string, JsonValue> > _members;
+};
+
+/// Quoted JSON string, with the quotes, the backslashes and the control characters escaped
+std::string jsonString(const std::string &str);
@@ -22,9 +22,11 @@ SOFTWARE.
 
 #include "logging.h"
 #include <iostream>
+#include <mutex>
 
 static std::string logBuffer;
 static bool logBufferEnabled = true;
+static std::mutex logMutex; // Bakes log from worker threads too
 
 #define DEBUG 0
 
@@ -43,6 +45,7 @@ namespace
 void logDebug(const std::string &module, const std::string &msg)
 {
 	const auto str = makeString("DEBG", module, msg);
+	std::lock_guard<std::mutex> lock(logMutex);
 #if _WIN32 && DEBUG
 	OutputDebugString(str.c_str());
 #else
@@ -54,6 +57,7 @@ void logDebug(const std::string &module, const std::string &msg)
 void logWarning(const std::string &module, const std::string &msg)
 {
 	const auto str = makeString("WARN", module, msg);
+	std::lock_guard<std::mutex> lock(logMutex);
 #if _WIN32 && DEBUG
 	OutputDebugString(str.c_str());
 #else
@@ -65,6 +69,7 @@ void logWarning(const std::string &module, const std::string &msg)
 void logError(const std::string &module, const std::string &msg)
 {
 	const auto str = makeString("ERRO", module, msg);
+	std::lock_guard<std::mutex> lock(logMutex);
 #if _WIN32 && DEBUG
 	OutputDebugString(str.c_str());
 #else
@@ -75,21 +80,25 @@ void logError(const std::string &module, const std::string &msg)
 
 void enableLogBuffer()
 {
+	std::lock_guard<std::mutex> lock(logMutex);
 	logBufferEnabled = true;
 }
 
 void disableLogBuffer()
 {
+	std::lock_guard<std::mutex> lock(logMutex);
 	logBufferEnabled = false;
 	logBuffer.clear();
 }
 
 void clearLogBuffer()
 {
+	std::lock_guard<std::mutex> lock(logMutex);
 	logBuffer.clear();
 }
 
-const std::string& getLogBuffer()
+std::string getLogBuffer()
 {
+	std::lock_guard<std::mutex> lock(logMutex);
 	return logBuffer;
 }
\ No newline at end of file
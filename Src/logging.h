@@ -30,4 +30,4 @@ void logError(const std::string &module, const std::string &str);
 void enableLogBuffer();
 void disableLogBuffer();
 void clearLogBuffer();
-const std::string& getLogBuffer();
\ No newline at end of file
+std::string getLogBuffer();
\ No newline at end of file
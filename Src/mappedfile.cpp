@@ -0,0 +1,127 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "mappedfile.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char *path)
+	: _data(nullptr)
+	, _size(0)
+	, _valid(false)
+	, _file(INVALID_HANDLE_VALUE)
+	, _mapping(nullptr)
+{
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size)) return;
+	_size = (size_t)size.QuadPart;
+	_valid = true;
+	if (_size == 0) return; // Empty files can't be mapped
+
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping) _data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	_valid = _data != nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data) UnmapViewOfFile(_data);
+	if (_mapping) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+}
+
+bool fileStamp(const char *path, uint64_t &o_size, int64_t &o_modified)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return false;
+	o_size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	o_modified = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+	return true;
+}
+
+bool replaceFile(const char *from, const char *to)
+{
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+MappedFile::MappedFile(const char *path)
+	: _data(nullptr)
+	, _size(0)
+	, _valid(false)
+	, _fd(-1)
+{
+	_fd = open(path, O_RDONLY);
+	if (_fd < 0) return;
+
+	struct stat st;
+	if (fstat(_fd, &st) != 0) return;
+	_size = (size_t)st.st_size;
+	_valid = true;
+	if (_size == 0) return; // Empty files can't be mapped
+
+	void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (data == MAP_FAILED)
+	{
+		_valid = false;
+		return;
+	}
+	madvise(data, _size, MADV_SEQUENTIAL);
+	_data = (const char*)data;
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data) munmap((void*)_data, _size);
+	if (_fd >= 0) close(_fd);
+}
+
+bool fileStamp(const char *path, uint64_t &o_size, int64_t &o_modified)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) return false;
+	o_size = (uint64_t)st.st_size;
+	o_modified = (int64_t)st.st_mtime;
+	return true;
+}
+
+bool replaceFile(const char *from, const char *to)
+{
+	return rename(from, to) == 0;
+}
+
+#endif
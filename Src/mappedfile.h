@@ -0,0 +1,58 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Read only view of a whole file mapped in memory
+class MappedFile
+{
+public:
+	MappedFile(const char *path);
+	~MappedFile();
+
+	bool valid() const { return _valid; }
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile& operator=(const MappedFile &) = delete;
+
+	const char *_data;
+	size_t _size;
+	bool _valid;
+#ifdef _WIN32
+	void *_file;
+	void *_mapping;
+#else
+	int _fd;
+#endif
+};
+
+/// Size and last modification time of a file (in the units of the platform), false if it can't be found
+bool fileStamp(const char *path, uint64_t &o_size, int64_t &o_modified);
+
+/// Renames a file over another one, the readers of the destination see either the old file or the new one
+bool replaceFile(const char *from, const char *to);
@@ -153,6 +153,69 @@ struct AABB
 	AABB(const Vector3 &center, const Vector3 &size) : center(center), size(size) {}
 };
 
+/// Affine transform: the upper 3x4 rows of a 4x4 matrix, row major
+struct Transform
+{
+	float m[12];
+
+	static Transform identity()
+	{
+		Transform t;
+		for (int i = 0; i < 12; ++i) t.m[i] = (i % 5) == 0 ? 1.0f : 0.0f;
+		return t;
+	}
+
+	Vector3 point(const Vector3 &p) const
+	{
+		return direction(p) + Vector3(m[3], m[7], m[11]);
+	}
+
+	Vector3 direction(const Vector3 &d) const
+	{
+		return Vector3(
+			m[0] * d.x + m[1] * d.y + m[2] * d.z,
+			m[4] * d.x + m[5] * d.y + m[6] * d.z,
+			m[8] * d.x + m[9] * d.y + m[10] * d.z);
+	}
+
+	/// Direction transformed by the transpose, normals use the transpose of the inverse transform
+	Vector3 transposedDirection(const Vector3 &d) const
+	{
+		return Vector3(
+			m[0] * d.x + m[4] * d.y + m[8] * d.z,
+			m[1] * d.x + m[5] * d.y + m[9] * d.z,
+			m[2] * d.x + m[6] * d.y + m[10] * d.z);
+	}
+
+	float determinant() const
+	{
+		return
+			m[0] * (m[5] * m[10] - m[6] * m[9]) -
+			m[1] * (m[4] * m[10] - m[6] * m[8]) +
+			m[2] * (m[4] * m[9] - m[5] * m[8]);
+	}
+
+	Transform inverse() const
+	{
+		const float invDet = 1.0f / determinant();
+		Transform r;
+		r.m[0] = (m[5] * m[10] - m[6] * m[9]) * invDet;
+		r.m[1] = (m[2] * m[9] - m[1] * m[10]) * invDet;
+		r.m[2] = (m[1] * m[6] - m[2] * m[5]) * invDet;
+		r.m[4] = (m[6] * m[8] - m[4] * m[10]) * invDet;
+		r.m[5] = (m[0] * m[10] - m[2] * m[8]) * invDet;
+		r.m[6] = (m[2] * m[4] - m[0] * m[6]) * invDet;
+		r.m[8] = (m[4] * m[9] - m[5] * m[8]) * invDet;
+		r.m[9] = (m[1] * m[8] - m[0] * m[9]) * invDet;
+		r.m[10] = (m[0] * m[5] - m[1] * m[4]) * invDet;
+		const Vector3 t = -r.direction(Vector3(m[3], m[7], m[11]));
+		r.m[3] = t.x;
+		r.m[7] = t.y;
+		r.m[11] = t.z;
+		return r;
+	}
+};
+
 struct Triangle
 {
 	Vector3 a;
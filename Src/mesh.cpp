@@ -21,15 +21,22 @@ SOFTWARE.
 */
 
 #include "mesh.h"
-#include <tinyply.h>
+#include "json.h"
+#include "logging.h"
+#include "mappedfile.h"
+#include "profiler.h"
 #include <algorithm>
 #include <cctype>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include <cerrno>
 #include <cstdint>
+#include <cstring>
+#include <cstdio>
 #include <iterator>
-#include <fstream>
 #include <functional>
-#include <map>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -42,18 +49,6 @@ bool operator <(const Vector3 &lhs, const Vector3 &rhs)
 
 namespace
 {
-	enum class WavefrontWarning
-	{
-		UnknownToken = (1 << 0),
-		NotImplemented = (1 << 1),
-	};
-
-	enum class WavefrontError
-	{
-		Syntax = (1 << 0),
-		InvalidStatement = (1 << 1),
-	};
-
 	enum class WavefrontToken
 	{
 		Unknown,
@@ -65,9 +60,11 @@ namespace
 		PolygonPoint,
 		PolygonLine,
 		PolygonFace,
+		Group,
+		Object,
 	};
 
-	WavefrontToken str2token(const std::string::const_iterator begin, const std::string::const_iterator end)
+	WavefrontToken str2token(const char *begin, const char *end)
 	{
 		const auto length = std::distance(begin, end);
 
@@ -101,42 +98,45 @@ namespace
 		{
 			if (length == 1) return WavefrontToken::PolygonFace;
 		}
+		if (*begin == 'g')
+		{
+			if (length == 1) return WavefrontToken::Group;
+		}
+		if (*begin == 'o')
+		{
+			if (length == 1) return WavefrontToken::Object;
+		}
 		return WavefrontToken::Unknown;
 	}
 
-	std::string::const_iterator findFirstNoEmpty(const std::string::const_iterator &begin, const std::string::const_iterator &end)
+	// Lines are parsed in place in the mapped file, they are never null terminated
+	inline bool isBlank(char c)
 	{
-		return std::find_if(begin, end, std::not1(std::ptr_fun<int, int>(std::isspace)));
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 	}
 
-	std::string::const_iterator findFirstEmpty(const std::string::const_iterator &begin, const std::string::const_iterator &end)
+	inline bool isDigit(char c)
 	{
-		return std::find_if(begin, end, std::isspace);
+		return c >= '0' && c <= '9';
 	}
 
-	bool readFloat(const char *&strPtr, float &value, bool required = true)
+	void consumeSpaces(const char *&strPtr, const char *end)
 	{
-		char *end;
-		errno = 0;
-		value = static_cast<float>(std::strtod(strPtr, &end));
-		if (required && strPtr == end) return false;
-		strPtr = end;
-		return errno == 0;
+		while (strPtr != end && isBlank(*strPtr))
+		{
+			++strPtr;
+		}
 	}
 
-	bool readInt(const char *&strPtr, int &value, bool required = true)
+	bool isEndOfLine(const char *strPtr, const char *end)
 	{
-		char *end;
-		errno = 0;
-		value = static_cast<int>(std::strtol(strPtr, &end, 10));
-		if (required && strPtr == end) return false;
-		strPtr = end;
-		return errno == 0;
+		consumeSpaces(strPtr, end);
+		return strPtr == end;
 	}
 
-	bool consumeCharacter(const char *&strPtr, char c)
+	bool consumeCharacter(const char *&strPtr, const char *end, char c)
 	{
-		if (*strPtr == c)
+		if (strPtr != end && *strPtr == c)
 		{
 			++strPtr;
 			return true;
@@ -144,51 +144,114 @@ namespace
 		return false;
 	}
 
-	void consumeSpaces(const char *&strPtr)
+	// Slow path for numbers the fast path can't round exactly, inf, nan and hex floats
+	bool readFloatStrtod(const char *&strPtr, const char *end, float &value, bool required)
 	{
-		while (std::isspace(*strPtr))
-		{
-			++strPtr;
-		}
+		char buffer[128];
+		const size_t length = std::min((size_t)(end - strPtr), sizeof(buffer) - 1);
+		memcpy(buffer, strPtr, length);
+		buffer[length] = '\0';
+
+		char *numberEnd;
+		errno = 0;
+		value = static_cast<float>(std::strtod(buffer, &numberEnd));
+		if (required && numberEnd == buffer) return false;
+		strPtr += numberEnd - buffer;
+		return errno == 0;
 	}
 
-	bool isEndOfLine(const char *strPtr)
+	/// Parses a decimal number with the same result as strtod.
+	/// Numbers with up to 15 significant digits and small exponents are exactly representable
+	/// as a mantissa and a power of ten in a double, so a single operation rounds them correctly.
+	bool readFloat(const char *&strPtr, const char *end, float &value, bool required = true)
 	{
-		while (*strPtr)
+		static const double k_powers[] =
 		{
-			if (!std::isspace(*strPtr)) return false;
-			++strPtr;
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		static const uint64_t k_maxMantissa = (1ull << 53) - 1;
+
+		consumeSpaces(strPtr, end);
+		const char *ptr = strPtr;
+
+		const bool negative = ptr != end && *ptr == '-';
+		if (ptr != end && (*ptr == '-' || *ptr == '+')) ++ptr;
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		bool exact = true;
+		for (; ptr != end && isDigit(*ptr); ++ptr, ++digits)
+		{
+			if (mantissa > (k_maxMantissa - 9) / 10) exact = false;
+			else mantissa = mantissa * 10 + (*ptr - '0');
+		}
+		if (ptr != end && *ptr == '.')
+		{
+			for (++ptr; ptr != end && isDigit(*ptr); ++ptr, ++digits)
+			{
+				if (mantissa > (k_maxMantissa - 9) / 10) exact = false;
+				else { mantissa = mantissa * 10 + (*ptr - '0'); --exponent; }
+			}
+		}
+		if (digits == 0)
+		{
+			if (ptr != end && std::isalpha((unsigned char)*ptr)) return readFloatStrtod(strPtr, end, value, required);
+			return !required;
+		}
+		if (ptr != end && (*ptr == 'e' || *ptr == 'E'))
+		{
+			const char *expPtr = ptr + 1;
+			const bool expNegative = expPtr != end && *expPtr == '-';
+			if (expPtr != end && (*expPtr == '-' || *expPtr == '+')) ++expPtr;
+			if (expPtr != end && isDigit(*expPtr))
+			{
+				int expValue = 0;
+				for (; expPtr != end && isDigit(*expPtr); ++expPtr)
+				{
+					if (expValue < 10000) expValue = expValue * 10 + (*expPtr - '0');
+				}
+				exponent += expNegative ? -expValue : expValue;
+				ptr = expPtr;
+			}
+		}
+		if ((ptr != end && (*ptr == 'x' || *ptr == 'X')) || !exact || exponent < -22 || exponent > 22)
+		{
+			return readFloatStrtod(strPtr, end, value, required);
 		}
+
+		double result = (double)mantissa;
+		if (exponent < 0) result /= k_powers[-exponent];
+		else result *= k_powers[exponent];
+		value = static_cast<float>(negative ? -result : result);
+		strPtr = ptr;
 		return true;
 	}
 
-	struct WavefrontVertex
-	{
-		float x, y, z, w;
-	};
-
-	struct WavefrontTexcoord
-	{
-		float u, v, w;
-	};
-
-	struct WavefrontNormal
+	bool readInt(const char *&strPtr, const char *end, int &value, bool required = true)
 	{
-		float i, j, k;
-	};
+		consumeSpaces(strPtr, end);
+		const char *ptr = strPtr;
 
-	struct WavefrontFaceVertex
-	{
-		int vertexIndex;
-		int texcoordIndex;
-		int normalIndex;
-	};
+		const bool negative = ptr != end && *ptr == '-';
+		if (ptr != end && (*ptr == '-' || *ptr == '+')) ++ptr;
 
-	struct WavefrontFaceEntryPoint
-	{
-		size_t start;
-		size_t vertexCount;
-	};
+		if (ptr == end || !isDigit(*ptr))
+		{
+			value = 0;
+			return !required;
+		}
+		int64_t result = 0;
+		for (; ptr != end && isDigit(*ptr); ++ptr)
+		{
+			result = result * 10 + (*ptr - '0');
+			if (result > INT32_MAX) return false;
+		}
+		value = static_cast<int>(negative ? -result : result);
+		strPtr = ptr;
+		return true;
+	}
 
 	enum class WavefrontFaceOptions
 	{
@@ -196,12 +259,6 @@ namespace
 		HasNormal = (1 << 1),
 	};
 
-	bool operator <(const WavefrontFaceVertex &lhs, const WavefrontFaceVertex &rhs)
-	{
-		return std::tie(lhs.vertexIndex, lhs.texcoordIndex, lhs.normalIndex) < std::tie(rhs.vertexIndex, rhs.texcoordIndex, rhs.normalIndex);
-	}
-
-
 	template <typename T, typename E>
 	class Bitmask
 	{
@@ -212,6 +269,8 @@ namespace
 		Bitmask operator|(Bitmask b) { return Bitmask(mask | b.mask); }
 		Bitmask& operator|=(E e) { mask |= static_cast<T>(e); return *this; }
 		Bitmask& operator|=(Bitmask rhs) { mask |= rhs.mask; return *this; }
+		bool operator==(Bitmask rhs) const { return mask == rhs.mask; }
+		bool operator!=(Bitmask rhs) const { return mask != rhs.mask; }
 		bool has(E e) { return mask & static_cast<T>(e); }
 
 	private:
@@ -223,185 +282,158 @@ namespace
 	using Bitmask_ ## E = Bitmask<T, E>;
 
 	DeclareBitmask(uint32_t, WavefrontFaceOptions)
-}
 
-#if DEBUG
-#define exit_on_fail(x) if (!(x)) { errors |= static_cast<uint32_t>(WavefrontError::Syntax); return nullptr; }
-#else
-#define exit_on_fail(x) if (!(x)) { return nullptr; }
-#endif
+	// The file is split in chunks of about this size (ending at a new line) parsed in parallel
+	static const size_t k_wavefrontChunkSize = 4 * 1024 * 1024;
 
+	/// Range of lines of the file and the number of elements of each kind in it.
+	/// The offsets are the first element of the chunk in the mesh arrays.
+	struct WavefrontChunk
+	{
+		const char *begin;
+		const char *end;
+
+		size_t positionCount = 0;
+		size_t texcoordCount = 0;
+		size_t normalCount = 0;
+		size_t faceVertexCount = 0;
+		size_t triangleCount = 0;
+
+		size_t positionOffset = 0;
+		size_t texcoordOffset = 0;
+		size_t normalOffset = 0;
+		size_t faceVertexOffset = 0;
+		size_t triangleOffset = 0;
+
+		bool failed = false;
+		bool hasFaces = false;
+		Bitmask_WavefrontFaceOptions faceOptions;
+
+		// Groups and objects started in the chunk, at the chunk triangle count when they are found
+		std::vector<Mesh::Group> groups;
+	};
 
-Mesh* Mesh::loadWavefrontObj(const char *path)
-{
-#if DEBUG
-	uint32_t warnings = 0u;
-	uint32_t errors = 0u;
-#endif
-
-	Bitmask_WavefrontFaceOptions faceOptions;
-	bool faceOptionsInitialzed = false;
-
-	std::vector<WavefrontVertex> vertices;
-	std::vector<WavefrontTexcoord> texcoords;
-	std::vector<WavefrontNormal> normals;
-	std::vector<WavefrontFaceEntryPoint> faces;
-	std::vector<WavefrontFaceVertex> faceVertices;
-
-	std::ifstream ifs;
-	ifs.open(path, std::ifstream::in);
-
-	std::string line;
-
-	while (std::getline(ifs, line))
-	{
-		if (line.size() == 0) continue; // Empty line
-
-		const auto firstTokenBegin = findFirstNoEmpty(line.begin(), line.end());
-		const auto firstTokenEnd = findFirstEmpty(firstTokenBegin, line.end());
-
-		if (firstTokenBegin == line.end()) continue; // Empty line
-
-		const WavefrontToken token = str2token(firstTokenBegin, firstTokenEnd);
-		switch (token)
-		{
-		case WavefrontToken::Comment:
-		{
-			continue;
-		} break;
-		case WavefrontToken::Vertex:
-		{
-			float x, y, z, w;
-			const char *ptr = &(*firstTokenEnd);
-			exit_on_fail(readFloat(ptr, x));
-			exit_on_fail(readFloat(ptr, y));
-			exit_on_fail(readFloat(ptr, z));
-			exit_on_fail(readFloat(ptr, w, false));
-			exit_on_fail(isEndOfLine(ptr));
-			vertices.emplace_back(WavefrontVertex{ x, y, z, w });
-		} break;
-		case WavefrontToken::VertexTexture:
-		{
-			float u, v, w;
-			const char *ptr = &(*firstTokenEnd);
-			exit_on_fail(readFloat(ptr, u));
-			exit_on_fail(readFloat(ptr, v));
-			exit_on_fail(readFloat(ptr, w, false));
-			exit_on_fail(isEndOfLine(ptr));
-			texcoords.emplace_back(WavefrontTexcoord{ u, v, w });
-		} break;
-		case WavefrontToken::VertexNormal:
-		{
-			float i, j, k;
-			const char *ptr = &(*firstTokenEnd);
-			exit_on_fail(readFloat(ptr, i));
-			exit_on_fail(readFloat(ptr, j));
-			exit_on_fail(readFloat(ptr, k));
-			exit_on_fail(isEndOfLine(ptr));
-			normals.emplace_back(WavefrontNormal{ i, j, k });
-		} break;
-		case WavefrontToken::PolygonFace:
-		{
-			WavefrontFaceEntryPoint entryPoint;
-			entryPoint.start = faceVertices.size();
-			entryPoint.vertexCount = 0;
-			const char *ptr = &(*firstTokenEnd);
-
-			while (!isEndOfLine(ptr))
-			{
-				WavefrontFaceVertex v;
-				v.texcoordIndex = 0;
-				v.normalIndex = 0;
-				exit_on_fail(readInt(ptr, v.vertexIndex));
-				if (consumeCharacter(ptr, '/')) exit_on_fail(readInt(ptr, v.texcoordIndex, false));
-				if (consumeCharacter(ptr, '/')) exit_on_fail(readInt(ptr, v.normalIndex));
-
-				if (!faceOptionsInitialzed)
-				{
-					if (v.texcoordIndex != 0) faceOptions |= WavefrontFaceOptions::HasTexcoord;
-					if (v.normalIndex != 0) faceOptions |= WavefrontFaceOptions::HasNormal;
-					faceOptionsInitialzed = true;
-				}
-				else
-				{
-					exit_on_fail((v.texcoordIndex != 0) == faceOptions.has(WavefrontFaceOptions::HasTexcoord));
-					exit_on_fail((v.normalIndex != 0) == faceOptions.has(WavefrontFaceOptions::HasNormal));
-				}
-
-				++entryPoint.vertexCount;
-				faceVertices.emplace_back(v);
+	std::vector<WavefrontChunk> splitWavefrontChunks(const char *data, size_t size)
+	{
+		std::vector<WavefrontChunk> chunks;
+		const char *end = data + size;
+		const char *begin = data;
+		while (begin != end)
+		{
+			const char *chunkEnd = begin + std::min(k_wavefrontChunkSize, (size_t)(end - begin));
+			chunkEnd = std::find(chunkEnd, end, '\n');
+			if (chunkEnd != end) ++chunkEnd;
+			WavefrontChunk chunk;
+			chunk.begin = begin;
+			chunk.end = chunkEnd;
+			chunks.push_back(chunk);
+			begin = chunkEnd;
+		}
+		return chunks;
+	}
 
-				consumeSpaces(ptr);
-			}
+	/// Calls fn(token, tokenEnd, lineEnd) for every non empty line of the chunk
+	template <typename Fn>
+	void forEachWavefrontLine(const WavefrontChunk &chunk, Fn fn)
+	{
+		const char *ptr = chunk.begin;
+		while (ptr != chunk.end)
+		{
+			const char *lineEnd = (const char*)memchr(ptr, '\n', chunk.end - ptr);
+			if (!lineEnd) lineEnd = chunk.end;
 
-			if (entryPoint.vertexCount < 3)
+			const char *tokenBegin = ptr;
+			consumeSpaces(tokenBegin, lineEnd);
+			if (tokenBegin != lineEnd)
 			{
-#if DEBUG
-				errors |= static_cast<uint32_t>(WavefrontError::InvalidStatement);
-				return nullptr;
-#endif
+				const char *tokenEnd = tokenBegin;
+				while (tokenEnd != lineEnd && !isBlank(*tokenEnd)) ++tokenEnd;
+				if (!fn(str2token(tokenBegin, tokenEnd), tokenEnd, lineEnd)) return;
 			}
 
-			faces.emplace_back(entryPoint);
-		} break;
-		case WavefrontToken::VertexParameter:
-		case WavefrontToken::PolygonPoint:
-		case WavefrontToken::PolygonLine:
-		{
-#if DEBUG
-			warnings |= static_cast<uint32_t>(WavefrontWarning::NotImplemented);
-#endif
+			ptr = lineEnd == chunk.end ? lineEnd : lineEnd + 1;
 		}
-		case WavefrontToken::Unknown:
-		default:
+	}
+
+	// First pass: counts the elements of the chunk so every chunk can be parsed in place
+	void countWavefrontChunk(WavefrontChunk &chunk)
+	{
+		forEachWavefrontLine(chunk, [&chunk](WavefrontToken token, const char *ptr, const char *end)
 		{
-#if DEBUG
-			warnings |= static_cast<uint32_t>(WavefrontWarning::UnknownToken);
-#endif
-		}
-		}
+			switch (token)
+			{
+			case WavefrontToken::Vertex: ++chunk.positionCount; break;
+			case WavefrontToken::VertexTexture: ++chunk.texcoordCount; break;
+			case WavefrontToken::VertexNormal: ++chunk.normalCount; break;
+			case WavefrontToken::PolygonFace:
+			{
+				size_t vertexCount = 0;
+				for (;;)
+				{
+					consumeSpaces(ptr, end);
+					if (ptr == end) break;
+					while (ptr != end && !isBlank(*ptr)) ++ptr;
+					++vertexCount;
+				}
+				chunk.faceVertexCount += vertexCount;
+				if (vertexCount > 2) chunk.triangleCount += vertexCount - 2;
+			} break;
+			default:
+				break;
+			}
+			return true;
+		});
 	}
 
-	ifs.close();
+	/// Cursor of the second pass in the mesh arrays
+	struct WavefrontOutput
+	{
+		Vector3 *positions;
+		Vector2 *texcoords;
+		Vector3 *normals;
+		Mesh::Vertex *vertices;
+		Mesh::Triangle *triangles;
+		uint32_t vertexIdx;
+		uint32_t vertexEnd;
+	};
 
-	Mesh *mesh = new Mesh();
-	
-	mesh->positions.reserve(vertices.size());
-	for (const auto &v : vertices) mesh->positions.push_back(Vector3(v.x, v.y, v.z));
-	mesh->texcoords.reserve(texcoords.size());
-	for (const auto &t : texcoords) mesh->texcoords.push_back(Vector2(t.u, t.v));
-	mesh->normals.reserve(normals.size());
-	for (const auto &n : normals) mesh->normals.push_back(Vector3(n.i, n.j, n.k));
-
-#if 0
-	std::map<WavefrontFaceVertex, uint32_t> vertexIndices; // Shared vertices map
-	
-	for (const auto &face : faces)
+	// Every face vertex is a new mesh vertex, the face is triangulated as a fan
+	bool parseWavefrontFace(const char *ptr, const char *end, WavefrontChunk &chunk, WavefrontOutput &out)
 	{
 		uint32_t firstVertexIdx = UINT32_MAX;
 		uint32_t previousVertexIdx = UINT32_MAX;
 
-		for (size_t i = 0; i < face.vertexCount; ++i)
+		while (!isEndOfLine(ptr, end))
 		{
-			uint32_t vertexIdx = UINT32_MAX;
+			int vertexIndex;
+			int texcoordIndex = 0;
+			int normalIndex = 0;
+			if (!readInt(ptr, end, vertexIndex)) return false;
+			if (consumeCharacter(ptr, end, '/') && !readInt(ptr, end, texcoordIndex, false)) return false;
+			if (consumeCharacter(ptr, end, '/') && !readInt(ptr, end, normalIndex)) return false;
+
+			Bitmask_WavefrontFaceOptions options;
+			if (texcoordIndex != 0) options |= WavefrontFaceOptions::HasTexcoord;
+			if (normalIndex != 0) options |= WavefrontFaceOptions::HasNormal;
+			if (!chunk.hasFaces)
 			{
-				const auto &v = faceVertices[face.start + i];
-				auto it = vertexIndices.find(v);
-				if (it == vertexIndices.end())
-				{
-					const uint32_t pidx = (uint32_t)(v.vertexIndex - 1);
-					const uint32_t tidx = v.texcoordIndex != 0 ? (uint32_t)(v.texcoordIndex - 1) : UINT32_MAX;
-					const uint32_t nidx = v.normalIndex != 0 ? (uint32_t)(v.normalIndex - 1) : UINT32_MAX;
-					vertexIdx = (uint32_t)mesh->vertices.size();
-					vertexIndices[v] = vertexIdx;
-					mesh->vertices.emplace_back(Mesh::Vertex{ pidx, tidx, nidx });
-				}
-				else
-				{
-					vertexIdx = it->second;
-				}
+				chunk.faceOptions = options;
+				chunk.hasFaces = true;
+			}
+			else if (options != chunk.faceOptions)
+			{
+				return false;
 			}
 
+			// The first pass counted the face vertices differently
+			if (out.vertexIdx == out.vertexEnd) return false;
+
+			const uint32_t pidx = (uint32_t)(vertexIndex - 1);
+			const uint32_t tidx = texcoordIndex != 0 ? (uint32_t)(texcoordIndex - 1) : UINT32_MAX;
+			const uint32_t nidx = normalIndex != 0 ? (uint32_t)(normalIndex - 1) : UINT32_MAX;
+			const uint32_t vertexIdx = out.vertexIdx++;
+			*out.vertices++ = Mesh::Vertex{ pidx, tidx, nidx };
+
 			if (firstVertexIdx == UINT32_MAX)
 			{
 				firstVertexIdx = vertexIdx;
@@ -412,358 +444,2144 @@ Mesh* Mesh::loadWavefrontObj(const char *path)
 			}
 			else
 			{
-				mesh->triangles.emplace_back(Mesh::Triangle{ firstVertexIdx, previousVertexIdx, vertexIdx });
+				*out.triangles++ = Mesh::Triangle{ firstVertexIdx, previousVertexIdx, vertexIdx };
 				previousVertexIdx = vertexIdx;
 			}
 		}
+		return true;
 	}
-#else
-	for (const auto &face : faces)
-	{
-		uint32_t firstVertexIdx = UINT32_MAX;
-		uint32_t previousVertexIdx = UINT32_MAX;
 
-		for (size_t i = 0; i < face.vertexCount; ++i)
+	// Second pass: parses the chunk straight into the mesh arrays
+	void parseWavefrontChunk(WavefrontChunk &chunk, Mesh *mesh)
+	{
+		WavefrontOutput out;
+		out.positions = mesh->positions.data() + chunk.positionOffset;
+		out.texcoords = mesh->texcoords.data() + chunk.texcoordOffset;
+		out.normals = mesh->normals.data() + chunk.normalOffset;
+		out.vertices = mesh->vertices.data() + chunk.faceVertexOffset;
+		out.triangles = mesh->triangles.data() + chunk.triangleOffset;
+		out.vertexIdx = (uint32_t)chunk.faceVertexOffset;
+		out.vertexEnd = (uint32_t)(chunk.faceVertexOffset + chunk.faceVertexCount);
+
+		forEachWavefrontLine(chunk, [&](WavefrontToken token, const char *ptr, const char *end)
 		{
-			uint32_t vertexIdx = UINT32_MAX;
+			bool valid = true;
+			switch (token)
 			{
-				const auto &v = faceVertices[face.start + i];
-				const uint32_t pidx = (uint32_t)(v.vertexIndex - 1);
-				const uint32_t tidx = v.texcoordIndex != 0 ? (uint32_t)(v.texcoordIndex - 1) : UINT32_MAX;
-				const uint32_t nidx = v.normalIndex != 0 ? (uint32_t)(v.normalIndex - 1) : UINT32_MAX;
-				vertexIdx = (uint32_t)mesh->vertices.size();
-				mesh->vertices.emplace_back(Mesh::Vertex{ pidx, tidx, nidx });
-			}
-
-			if (firstVertexIdx == UINT32_MAX)
+			case WavefrontToken::Vertex:
 			{
-				firstVertexIdx = vertexIdx;
-			}
-			else if (previousVertexIdx == UINT32_MAX)
+				float x, y, z, w;
+				valid = readFloat(ptr, end, x) && readFloat(ptr, end, y) && readFloat(ptr, end, z) &&
+					readFloat(ptr, end, w, false) && isEndOfLine(ptr, end);
+				if (valid) *out.positions++ = Vector3(x, y, z);
+			} break;
+			case WavefrontToken::VertexTexture:
 			{
-				previousVertexIdx = vertexIdx;
-			}
-			else
+				float u, v, w;
+				valid = readFloat(ptr, end, u) && readFloat(ptr, end, v) &&
+					readFloat(ptr, end, w, false) && isEndOfLine(ptr, end);
+				if (valid) *out.texcoords++ = Vector2(u, v);
+			} break;
+			case WavefrontToken::VertexNormal:
 			{
-				mesh->triangles.emplace_back(Mesh::Triangle{ firstVertexIdx, previousVertexIdx, vertexIdx });
-				previousVertexIdx = vertexIdx;
+				float i, j, k;
+				valid = readFloat(ptr, end, i) && readFloat(ptr, end, j) && readFloat(ptr, end, k) &&
+					isEndOfLine(ptr, end);
+				if (valid) *out.normals++ = Vector3(i, j, k);
+			} break;
+			case WavefrontToken::PolygonFace:
+			{
+				valid = parseWavefrontFace(ptr, end, chunk, out);
+			} break;
+			case WavefrontToken::Group:
+			case WavefrontToken::Object:
+			{
+				consumeSpaces(ptr, end);
+				const char *nameEnd = end;
+				while (nameEnd != ptr && isBlank(*(nameEnd - 1))) --nameEnd;
+				const uint32_t triangle = (uint32_t)(out.triangles - (mesh->triangles.data() + chunk.triangleOffset));
+				chunk.groups.push_back(Mesh::Group{ std::string(ptr, nameEnd), triangle, 0 });
+			} break;
+			default:
+				break;
 			}
-		}
+			if (!valid) chunk.failed = true;
+			return valid;
+		});
+
+		if (out.vertexIdx != out.vertexEnd) chunk.failed = true;
 	}
-#endif
 
-	return mesh;
-}
+	// Welding splits the vertices in partitions of their hash, each one is deduplicated by a thread
+	static const int k_weldPartitionBits = 6;
 
-namespace
-{
-	void copyPlyData(std::shared_ptr<tinyply::PlyData> src, std::vector<Vector3> &dst)
+	inline uint64_t hashVertex(const Mesh::Vertex &v)
 	{
-		dst.clear();
-		dst.reserve(src->count);
-		switch (src->t)
-		{
-		case tinyply::Type::FLOAT32:
+		uint64_t h = (uint64_t)v.positionIndex * 0x9E3779B97F4A7C15ull;
+		h = (h ^ (h >> 29) ^ v.texcoordIndex) * 0xBF58476D1CE4E5B9ull;
+		h = (h ^ (h >> 32) ^ v.normalIndex) * 0x94D049BB133111EBull;
+		return h ^ (h >> 31);
+	}
+
+	inline bool operator ==(const Mesh::Vertex &a, const Mesh::Vertex &b)
+	{
+		return a.positionIndex == b.positionIndex && a.texcoordIndex == b.texcoordIndex && a.normalIndex == b.normalIndex;
+	}
+
+	/// Shares the face vertices with the same position, texture coordinate and normal indices.
+	/// Welded vertices keep the order of their first use, as a sequential weld would number them.
+	void weldWavefrontVertices(const std::vector<WavefrontChunk> &chunks, Mesh *mesh)
+	{
+		PROFILE_ZONE("Weld vertices");
+		const int chunkCount = (int)chunks.size();
+		const int partitionCount = 1 << k_weldPartitionBits;
+		const std::vector<Mesh::Vertex> &vertices = mesh->vertices;
+		std::vector<uint64_t> hashes(vertices.size());
+
+		// Counting sort of the vertices by partition, chunks are the blocks of the parallel passes
+		std::vector<size_t> offsets(chunkCount * partitionCount, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
 		{
-			const Vector3 *data = reinterpret_cast<const Vector3 *>(src->buffer.get());
-			for (size_t i = 0; i < src->count; ++i)
+			const size_t begin = chunks[c].faceVertexOffset;
+			const size_t end = begin + chunks[c].faceVertexCount;
+			for (size_t i = begin; i < end; ++i)
 			{
-				dst.push_back(data[i]);
+				hashes[i] = hashVertex(vertices[i]);
+				++offsets[c * partitionCount + (hashes[i] >> (64 - k_weldPartitionBits))];
 			}
-		} break;
+		}
 
-		case tinyply::Type::FLOAT64:
+		std::vector<size_t> partitions(partitionCount + 1);
+		size_t sum = 0;
+		for (int p = 0; p < partitionCount; ++p)
 		{
-			struct Vector3d { double x, y, z; };
-			const Vector3d *data = reinterpret_cast<const Vector3d *>(src->buffer.get());
-			for (size_t i = 0; i < src->count; ++i)
+			partitions[p] = sum;
+			for (int c = 0; c < chunkCount; ++c)
 			{
-				dst.push_back(Vector3(float(data[i].x), float(data[i].y), float(data[i].z)));
+				const size_t count = offsets[c * partitionCount + p];
+				offsets[c * partitionCount + p] = sum;
+				sum += count;
 			}
-		} break;
 		}
-	}
+		partitions[partitionCount] = sum;
 
-	void copyPlyData(std::shared_ptr<tinyply::PlyData> src, std::vector<Vector2> &dst)
-	{
-		dst.clear();
-		dst.reserve(src->count);
-		switch (src->t)
-		{
-		case tinyply::Type::FLOAT32:
+		std::vector<uint32_t> sorted(vertices.size());
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
 		{
-			const Vector2 *data = reinterpret_cast<const Vector2 *>(src->buffer.get());
-			for (size_t i = 0; i < src->count; ++i)
+			const size_t begin = chunks[c].faceVertexOffset;
+			const size_t end = begin + chunks[c].faceVertexCount;
+			for (size_t i = begin; i < end; ++i)
 			{
-				dst.push_back(data[i]);
+				sorted[offsets[c * partitionCount + (hashes[i] >> (64 - k_weldPartitionBits))]++] = (uint32_t)i;
 			}
-		} break;
+		}
 
-		case tinyply::Type::FLOAT64:
+		// Partitions keep the vertex order, the first vertex of every key is the one kept
+		std::vector<uint32_t> first(vertices.size());
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int p = 0; p < partitionCount; ++p)
 		{
-			struct Vector2d { double x, y; };
-			const Vector2d *data = reinterpret_cast<const Vector2d *>(src->buffer.get());
-			for (size_t i = 0; i < src->count; ++i)
+			const size_t begin = partitions[p];
+			const size_t end = partitions[p + 1];
+			size_t tableSize = 16;
+			while (tableSize < (end - begin) * 2) tableSize *= 2;
+			const size_t mask = tableSize - 1;
+			std::vector<uint32_t> table(tableSize, UINT32_MAX);
+
+			for (size_t k = begin; k < end; ++k)
 			{
-				dst.push_back(Vector2(float(data[i].x), float(data[i].y)));
+				const uint32_t i = sorted[k];
+				size_t slot = hashes[i] & mask;
+				while (table[slot] != UINT32_MAX && !(vertices[table[slot]] == vertices[i]))
+				{
+					slot = (slot + 1) & mask;
+				}
+				if (table[slot] == UINT32_MAX) table[slot] = i;
+				first[i] = table[slot];
 			}
-		} break;
 		}
-	}
-}
-
-Mesh* Mesh::loadPly(const char *path)
-{
-	enum class NormalsFrom { Nowhere, Face, Vertex };
-	try
-	{
-		std::ifstream ss(path, std::ios::binary);
-		tinyply::PlyFile file;
-		file.parse_header(ss);
-
-		std::shared_ptr<tinyply::PlyData> verts;
-		std::shared_ptr<tinyply::PlyData> norms;
-		std::shared_ptr<tinyply::PlyData> uvs;
-		std::shared_ptr<tinyply::PlyData> faces;
-
-		verts = file.request_properties_from_element("vertex", { "x", "y", "z" });
-		faces = file.request_properties_from_element("face", { "vertex_indices" });
-
-		try { uvs = file.request_properties_from_element("vertex", { "s", "t" }); }
-		catch (const std::exception &e) {}
+		std::vector<uint64_t>().swap(hashes);
 
-		NormalsFrom normalsFrom = NormalsFrom::Nowhere;
-		if (!norms)
+		// New index of every kept vertex
+		std::vector<uint32_t> &newIndices = sorted;
+		std::vector<size_t> chunkStarts(chunkCount + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
 		{
-			try
+			const size_t begin = chunks[c].faceVertexOffset;
+			const size_t end = begin + chunks[c].faceVertexCount;
+			size_t count = 0;
+			for (size_t i = begin; i < end; ++i)
 			{
-				norms = file.request_properties_from_element("vertex", { "nx", "ny", "nz" });
-				normalsFrom = NormalsFrom::Vertex;
+				if (first[i] == i) ++count;
 			}
-			catch (const std::exception &e) {}
+			chunkStarts[c + 1] = count;
 		}
-		if (!norms)
+		for (int c = 0; c < chunkCount; ++c) chunkStarts[c + 1] += chunkStarts[c];
+
+		std::vector<Mesh::Vertex> welded(chunkStarts[chunkCount]);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
 		{
-			try
+			const size_t begin = chunks[c].faceVertexOffset;
+			const size_t end = begin + chunks[c].faceVertexCount;
+			uint32_t index = (uint32_t)chunkStarts[c];
+			for (size_t i = begin; i < end; ++i)
 			{
-				norms = file.request_properties_from_element("face", { "nx", "ny", "nz" });
-				normalsFrom = NormalsFrom::Face;
+				if (first[i] != i) continue;
+				welded[index] = vertices[i];
+				newIndices[i] = index++;
 			}
-			catch (const std::exception &e) {}
 		}
 
-		file.read(ss);
-
-		Mesh *mesh = new Mesh();
-
-		copyPlyData(verts, mesh->positions);
-		copyPlyData(uvs, mesh->texcoords);
-		copyPlyData(norms, mesh->normals);
-
-		const size_t tricount = faces->count;
-		mesh->triangles.reserve(tricount);
-
-		uint32_t normal_idx = UINT32_MAX;
-
-		auto &get_face_vertex_idx = [&](const size_t i)
+		// Every vertex points to its first copy, the one with a new index
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < chunkCount; ++c)
 		{
-			switch (faces->t)
+			const size_t begin = chunks[c].triangleOffset;
+			const size_t end = begin + chunks[c].triangleCount;
+			for (size_t t = begin; t < end; ++t)
 			{
-			case tinyply::Type::UINT32: return reinterpret_cast<const uint32_t*>(faces->buffer.get())[i];
-			case tinyply::Type::UINT16: return uint32_t(reinterpret_cast<const uint16_t*>(faces->buffer.get())[i]);
+				auto &tri = mesh->triangles[t];
+				tri.vertexIndex0 = newIndices[first[tri.vertexIndex0]];
+				tri.vertexIndex1 = newIndices[first[tri.vertexIndex1]];
+				tri.vertexIndex2 = newIndices[first[tri.vertexIndex2]];
 			}
-			return UINT32_MAX;
-		};
-
-		for (size_t i = 0; i < tricount; ++i)
-		{
-			const uint32_t vstart = (uint32_t)mesh->vertices.size();
+		}
 
-			if (normalsFrom == NormalsFrom::Face) { normal_idx = (uint32_t)i * 3; }
+		mesh->vertices.swap(welded);
+	}
 
-			for (size_t j = 0; j < 3; ++j)
+	/// Groups end where the next one starts, triangles before the first one are in the "default" group
+	void collectWavefrontGroups(const std::vector<WavefrontChunk> &chunks, Mesh *mesh)
+	{
+		std::vector<Mesh::Group> starts;
+		for (const auto &chunk : chunks)
+		{
+			for (const auto &group : chunk.groups)
 			{
-				const uint32_t vidx = get_face_vertex_idx(i * 3 + j);
-
-				if (normalsFrom == NormalsFrom::Vertex) { normal_idx = vidx; }
-
-				mesh->vertices.emplace_back(Mesh::Vertex{ vidx, (!uvs) ? UINT32_MAX : vidx, normal_idx });
+				starts.push_back(group);
+				starts.back().firstTriangle += (uint32_t)chunk.triangleOffset;
 			}
-			mesh->triangles.emplace_back(Mesh::Triangle{ vstart, vstart + 1, vstart + 2 });
 		}
+		if (starts.empty()) return;
+		if (starts[0].firstTriangle > 0) starts.insert(starts.begin(), Mesh::Group{ "default", 0, 0 });
 
-		return mesh;
-	}
-	catch (const std::exception &e)
-	{
-		return nullptr;
+		const uint32_t triangleCount = (uint32_t)mesh->triangles.size();
+		for (size_t i = 0; i < starts.size(); ++i)
+		{
+			const uint32_t end = i + 1 < starts.size() ? starts[i + 1].firstTriangle : triangleCount;
+			if (end == starts[i].firstTriangle) continue;
+			starts[i].triangleCount = end - starts[i].firstTriangle;
+			mesh->groups.push_back(starts[i]);
+		}
 	}
 }
 
-namespace
+Mesh* Mesh::loadWavefrontObj(const char *path, bool weldVertices)
 {
-	bool endsWith(const std::string &str, const std::string &ending)
+	PROFILE_ZONE("Mesh::loadWavefrontObj");
+
+	MappedFile file(path);
+	if (!file.valid()) return nullptr;
+
+	std::vector<WavefrontChunk> chunks = splitWavefrontChunks(file.data(), file.size());
+	const int chunkCount = (int)chunks.size();
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
 	{
-		if (ending.size() > str.size()) return false;
-		return std::equal(ending.rbegin(), ending.rend(), str.rbegin());
+		countWavefrontChunk(chunks[i]);
 	}
-}
 
-Mesh * Mesh::loadFile(const char * path)
-{
-	if (endsWith(path, ".obj")) return loadWavefrontObj(path);
-	if (endsWith(path, ".ply")) return loadPly(path);
-	return nullptr;
-}
+	// Offsets of every chunk in the mesh arrays
+	size_t positionCount = 0;
+	size_t texcoordCount = 0;
+	size_t normalCount = 0;
+	size_t faceVertexCount = 0;
+	size_t triangleCount = 0;
+	for (auto &chunk : chunks)
+	{
+		chunk.positionOffset = positionCount;
+		chunk.texcoordOffset = texcoordCount;
+		chunk.normalOffset = normalCount;
+		chunk.faceVertexOffset = faceVertexCount;
+		chunk.triangleOffset = triangleCount;
+		positionCount += chunk.positionCount;
+		texcoordCount += chunk.texcoordCount;
+		normalCount += chunk.normalCount;
+		faceVertexCount += chunk.faceVertexCount;
+		triangleCount += chunk.triangleCount;
+	}
+	if (faceVertexCount > UINT32_MAX) return nullptr;
 
-Mesh* Mesh::createCopy(const Mesh *mesh)
-{
-	assert(mesh);
-	Mesh* r = new Mesh();
-	*r = *mesh;
-	return r;
-}
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->positions.resize(positionCount);
+	mesh->texcoords.resize(texcoordCount);
+	mesh->normals.resize(normalCount);
+	mesh->vertices.resize(faceVertexCount);
+	mesh->triangles.resize(triangleCount);
 
-void Mesh::computeFaceNormals()
-{
-	normals.clear();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		parseWavefrontChunk(chunks[i], mesh.get());
+	}
 
-	for (const auto &tri : triangles)
+	// The first face vertex of the file decides if faces have texture coordinates and normals
+	const WavefrontChunk *firstFaces = nullptr;
+	for (const auto &chunk : chunks)
 	{
-		auto &v0 = vertices[tri.vertexIndex0];
-		auto &v1 = vertices[tri.vertexIndex1];
-		auto &v2 = vertices[tri.vertexIndex2];
-		const Vector3 p0 = positions[v0.positionIndex];
-		const Vector3 p1 = positions[v1.positionIndex];
-		const Vector3 p2 = positions[v2.positionIndex];
-		const Vector3 n = normalize(cross(p1 - p0, p2 - p0));
-		const uint32_t nidx = (uint32_t)normals.size();
-		normals.emplace_back(n);
-		v0.normalIndex = nidx;
-		v1.normalIndex = nidx;
-		v2.normalIndex = nidx;
+		if (chunk.failed) return nullptr;
+		if (!chunk.hasFaces) continue;
+		if (!firstFaces) firstFaces = &chunk;
+		else if (chunk.faceOptions != firstFaces->faceOptions) return nullptr;
 	}
+
+	collectWavefrontGroups(chunks, mesh.get());
+	if (weldVertices) weldWavefrontVertices(chunks, mesh.get());
+
+	return mesh.release();
 }
 
-// TODO: Improve algorithm
-// Face weighting?
-void Mesh::computeVertexNormals()
+namespace
 {
-	normals.clear();
-	normals.resize(positions.size());
+	enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+	enum class PlyType { Invalid, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
 
-	for (const auto &tri : triangles)
+	PlyType plyType(const std::string &name)
 	{
-		auto &v0 = vertices[tri.vertexIndex0];
-		auto &v1 = vertices[tri.vertexIndex1];
-		auto &v2 = vertices[tri.vertexIndex2];
-		const Vector3 p0 = positions[v0.positionIndex];
-		const Vector3 p1 = positions[v1.positionIndex];
-		const Vector3 p2 = positions[v2.positionIndex];
-		const Vector3 n = normalize(cross(p1 - p0, p2 - p0));
-		normals[v0.positionIndex] += n;
-		normals[v1.positionIndex] += n;
-		normals[v2.positionIndex] += n;
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
 	}
 
-	for (auto &n : normals)
+	bool isPlyFloat(PlyType type)
 	{
-		n = normalize(n);
+		return type == PlyType::Float32 || type == PlyType::Float64;
 	}
 
-	for (auto &v : vertices)
+	size_t plyTypeSize(PlyType type)
 	{
-		v.normalIndex = v.positionIndex;
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		case PlyType::Float64: return 8;
+		default: return 0;
+		}
 	}
-}
 
-void Mesh::computeVertexNormalsAggressive()
-{
-	struct NormalData { Vector3 normal = Vector3(); uint32_t index = 0; };
-	std::map<Vector3, NormalData> normalsMap;
+	// Where the values of a property go in the mesh
+	enum class PlyTarget { Skip, PositionX, PositionY, PositionZ, NormalX, NormalY, NormalZ, TexcoordU, TexcoordV, Indices };
 
-	auto addNormal = [&](const Vector3 &p, const Vector3 &n)
+	struct PlyProperty
 	{
-		auto it = normalsMap.find(p);
-		if (it != normalsMap.end())
-		{
-			it->second.normal += n;
-			return it->second.index;
-		}
-		else
+		PlyType type = PlyType::Invalid;
+		PlyType countType = PlyType::Invalid; // Only for lists
+		PlyTarget target = PlyTarget::Skip;
+		std::string name;
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+
+		const PlyProperty* find(const char *name) const
 		{
-			const uint32_t index = uint32_t(normalsMap.size());
-			normalsMap[p] = NormalData{ n, index };
-			return index;
+			for (const auto &p : properties) if (p.name == name) return &p;
+			return nullptr;
 		}
 	};
 
-	for (const auto &tri : triangles)
+	/// Reads the header and leaves ptr at the first element
+	bool readPlyHeader(const char *&ptr, const char *end, PlyFormat &o_format, std::vector<PlyElement> &o_elements)
 	{
-		auto &v0 = vertices[tri.vertexIndex0];
-		auto &v1 = vertices[tri.vertexIndex1];
-		auto &v2 = vertices[tri.vertexIndex2];
-		const Vector3 p0 = positions[v0.positionIndex];
-		const Vector3 p1 = positions[v1.positionIndex];
-		const Vector3 p2 = positions[v2.positionIndex];
-		const Vector3 n = normalize(cross(p1 - p0, p2 - p0));
-		v0.normalIndex = addNormal(p0, n);
-		v1.normalIndex = addNormal(p1, n);
-		v2.normalIndex = addNormal(p2, n);
-	}
+		bool first = true;
+		bool hasFormat = false;
+		while (ptr != end)
+		{
+			const char *lineEnd = (const char*)memchr(ptr, '\n', end - ptr);
+			if (!lineEnd) return false;
+			std::vector<std::string> words;
+			for (const char *word = ptr; ; )
+			{
+				consumeSpaces(word, lineEnd);
+				if (word == lineEnd) break;
+				const char *wordEnd = word;
+				while (wordEnd != lineEnd && !isBlank(*wordEnd)) ++wordEnd;
+				words.emplace_back(word, wordEnd);
+				word = wordEnd;
+			}
+			ptr = lineEnd + 1;
 
-	normals.clear();
-	normals.resize(normalsMap.size());
-	for (auto &n : normalsMap)
+			if (first)
+			{
+				if (words.size() != 1 || words[0] != "ply") return false;
+				first = false;
+			}
+			else if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+			{
+				continue;
+			}
+			else if (words[0] == "end_header")
+			{
+				return hasFormat;
+			}
+			else if (words[0] == "format" && words.size() == 3)
+			{
+				if (words[1] == "ascii") o_format = PlyFormat::Ascii;
+				else if (words[1] == "binary_little_endian") o_format = PlyFormat::BinaryLittleEndian;
+				else if (words[1] == "binary_big_endian") o_format = PlyFormat::BinaryBigEndian;
+				else return false;
+				hasFormat = true;
+			}
+			else if (words[0] == "element" && words.size() == 3)
+			{
+				PlyElement element;
+				element.name = words[1];
+				element.count = (size_t)std::strtoull(words[2].c_str(), nullptr, 10);
+				o_elements.push_back(element);
+			}
+			else if (words[0] == "property" && !o_elements.empty())
+			{
+				PlyProperty property;
+				if (words.size() == 5 && words[1] == "list")
+				{
+					property.countType = plyType(words[2]);
+					property.type = plyType(words[3]);
+					property.name = words[4];
+					if (property.countType == PlyType::Invalid || isPlyFloat(property.countType)) return false;
+				}
+				else if (words.size() == 3)
+				{
+					property.type = plyType(words[1]);
+					property.name = words[2];
+				}
+				if (property.type == PlyType::Invalid) return false;
+				o_elements.back().properties.push_back(property);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return false;
+	}
+
+	/// Decodes the values of the elements one by one straight from the file
+	class PlyReader
+	{
+	public:
+		PlyReader(const char *ptr, const char *end, PlyFormat format)
+			: _ptr(ptr)
+			, _end(end)
+			, _format(format)
+			, _swap(false)
+		{
+			const uint16_t one = 1;
+			const bool littleEndian = *(const uint8_t*)&one == 1;
+			_swap = format == (littleEndian ? PlyFormat::BinaryBigEndian : PlyFormat::BinaryLittleEndian);
+		}
+
+		bool readFloat(PlyType type, float &o_value)
+		{
+			if (_format == PlyFormat::Ascii)
+			{
+				if (!isPlyFloat(type))
+				{
+					int64_t value;
+					if (!readAsciiInt(value)) return false;
+					o_value = (float)value;
+					return true;
+				}
+				skipAsciiSpaces();
+				return ::readFloat(_ptr, _end, o_value) && endOfAsciiValue();
+			}
+			switch (type)
+			{
+			case PlyType::Float32: { float v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::Float64: { double v; if (!readBinary(v)) return false; o_value = (float)v; return true; }
+			default: { int64_t v; if (!readInt(type, v)) return false; o_value = (float)v; return true; }
+			}
+		}
+
+		bool readInt(PlyType type, int64_t &o_value)
+		{
+			if (_format == PlyFormat::Ascii)
+			{
+				if (isPlyFloat(type)) return false;
+				return readAsciiInt(o_value);
+			}
+			switch (type)
+			{
+			case PlyType::Int8: { int8_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::UInt8: { uint8_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::Int16: { int16_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::UInt16: { uint16_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::Int32: { int32_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			case PlyType::UInt32: { uint32_t v; if (!readBinary(v)) return false; o_value = v; return true; }
+			default: return false;
+			}
+		}
+
+		bool skip(PlyType type)
+		{
+			if (_format == PlyFormat::Ascii)
+			{
+				skipAsciiSpaces();
+				const char *start = _ptr;
+				while (_ptr != _end && !isAsciiSpace(*_ptr)) ++_ptr;
+				return _ptr != start;
+			}
+			const size_t size = plyTypeSize(type);
+			if ((size_t)(_end - _ptr) < size) return false;
+			_ptr += size;
+			return true;
+		}
+
+	private:
+		static bool isAsciiSpace(char c) { return isBlank(c) || c == '\n'; }
+
+		void skipAsciiSpaces()
+		{
+			while (_ptr != _end && isAsciiSpace(*_ptr)) ++_ptr;
+		}
+
+		bool endOfAsciiValue() const
+		{
+			return _ptr == _end || isAsciiSpace(*_ptr);
+		}
+
+		bool readAsciiInt(int64_t &o_value)
+		{
+			skipAsciiSpaces();
+			const bool negative = _ptr != _end && *_ptr == '-';
+			if (_ptr != _end && (*_ptr == '-' || *_ptr == '+')) ++_ptr;
+			if (_ptr == _end || !isDigit(*_ptr)) return false;
+			int64_t value = 0;
+			for (; _ptr != _end && isDigit(*_ptr); ++_ptr)
+			{
+				value = value * 10 + (*_ptr - '0');
+				if (value > UINT32_MAX) return false;
+			}
+			o_value = negative ? -value : value;
+			return endOfAsciiValue();
+		}
+
+		template <typename T>
+		bool readBinary(T &o_value)
+		{
+			if ((size_t)(_end - _ptr) < sizeof(T)) return false;
+			char bytes[sizeof(T)];
+			memcpy(bytes, _ptr, sizeof(T));
+			if (_swap) std::reverse(bytes, bytes + sizeof(T));
+			memcpy(&o_value, bytes, sizeof(T));
+			_ptr += sizeof(T);
+			return true;
+		}
+
+		const char *_ptr;
+		const char *_end;
+		PlyFormat _format;
+		bool _swap;
+	};
+
+	void setPlyTarget(PlyElement &element, const char *name, PlyTarget target)
+	{
+		for (auto &p : element.properties)
+		{
+			if (p.name == name && (target == PlyTarget::Indices) == (p.countType != PlyType::Invalid))
+			{
+				p.target = target;
+				return;
+			}
+		}
+	}
+
+	bool hasPlyTarget(const PlyElement *element, PlyTarget target)
+	{
+		if (!element) return false;
+		for (const auto &p : element->properties) if (p.target == target) return true;
+		return false;
+	}
+
+	/// PLY mesh with the properties of its vertices and faces bound to their targets, ready to read its elements
+	struct PlyMesh
+	{
+		PlyFormat format;
+		std::vector<PlyElement> elements;
+		const PlyElement *vertexElement = nullptr;
+		const PlyElement *faceElement = nullptr;
+		bool hasTexcoords = false;
+		bool vertexNormals = false; // Per vertex normals win over per face normals
+		bool faceNormals = false;
+		const char *data = nullptr; // First element
+		const char *end = nullptr;
+
+		PlyMesh() {}
+		PlyMesh(const PlyMesh &) = delete; // The elements are pointed at
+		PlyMesh& operator=(const PlyMesh &) = delete;
+	};
+
+	bool openPly(const char *ptr, const char *end, PlyMesh &o_ply)
+	{
+		if (!readPlyHeader(ptr, end, o_ply.format, o_ply.elements)) return false;
+
+		PlyElement *vertexElement = nullptr;
+		PlyElement *faceElement = nullptr;
+		for (auto &element : o_ply.elements)
+		{
+			if (element.name == "vertex") vertexElement = &element;
+			if (element.name == "face") faceElement = &element;
+		}
+		if (!vertexElement || !faceElement) return false;
+
+		setPlyTarget(*vertexElement, "x", PlyTarget::PositionX);
+		setPlyTarget(*vertexElement, "y", PlyTarget::PositionY);
+		setPlyTarget(*vertexElement, "z", PlyTarget::PositionZ);
+		setPlyTarget(*vertexElement, "nx", PlyTarget::NormalX);
+		setPlyTarget(*vertexElement, "ny", PlyTarget::NormalY);
+		setPlyTarget(*vertexElement, "nz", PlyTarget::NormalZ);
+		const char *texcoordNames[][2] = { { "s", "t" }, { "u", "v" }, { "texture_u", "texture_v" } };
+		for (const auto &names : texcoordNames)
+		{
+			if (hasPlyTarget(vertexElement, PlyTarget::TexcoordU)) break;
+			setPlyTarget(*vertexElement, names[0], PlyTarget::TexcoordU);
+			setPlyTarget(*vertexElement, names[1], PlyTarget::TexcoordV);
+		}
+		setPlyTarget(*faceElement, "vertex_indices", PlyTarget::Indices);
+		setPlyTarget(*faceElement, "vertex_index", PlyTarget::Indices);
+
+		o_ply.hasTexcoords = hasPlyTarget(vertexElement, PlyTarget::TexcoordU) && hasPlyTarget(vertexElement, PlyTarget::TexcoordV);
+		o_ply.vertexNormals = hasPlyTarget(vertexElement, PlyTarget::NormalX);
+		if (!o_ply.vertexNormals)
+		{
+			setPlyTarget(*faceElement, "nx", PlyTarget::NormalX);
+			setPlyTarget(*faceElement, "ny", PlyTarget::NormalY);
+			setPlyTarget(*faceElement, "nz", PlyTarget::NormalZ);
+		}
+		o_ply.faceNormals = hasPlyTarget(faceElement, PlyTarget::NormalX);
+		if (!hasPlyTarget(faceElement, PlyTarget::Indices)) return false;
+		if (vertexElement->count > UINT32_MAX || faceElement->count > UINT32_MAX) return false;
+
+		o_ply.vertexElement = vertexElement;
+		o_ply.faceElement = faceElement;
+		o_ply.data = ptr;
+		o_ply.end = end;
+		return true;
+	}
+
+	/// Decodes every element straight from the file. Calls onVertex(index, position, normal, texcoord) for
+	/// the vertices and onFace(index, normal, vertexIndices) for the faces, with their vertex indices checked.
+	template <typename OnVertex, typename OnFace>
+	bool readPlyElements(const PlyMesh &ply, OnVertex onVertex, OnFace onFace)
+	{
+		PlyReader reader(ply.data, ply.end, ply.format);
+		std::vector<uint32_t> face;
+
+		for (const auto &element : ply.elements)
+		{
+			for (size_t i = 0; i < element.count; ++i)
+			{
+				Vector3 position(0.0f);
+				Vector3 normal(0.0f);
+				Vector2 texcoord(0.0f);
+				face.clear();
+
+				for (const auto &p : element.properties)
+				{
+					if (p.countType != PlyType::Invalid)
+					{
+						int64_t count;
+						if (!reader.readInt(p.countType, count) || count < 0) return false;
+						for (int64_t j = 0; j < count; ++j)
+						{
+							if (p.target != PlyTarget::Indices)
+							{
+								if (!reader.skip(p.type)) return false;
+								continue;
+							}
+							int64_t index;
+							if (!reader.readInt(p.type, index)) return false;
+							if (index < 0 || (size_t)index >= ply.vertexElement->count) return false;
+							face.push_back((uint32_t)index);
+						}
+						continue;
+					}
+
+					float value;
+					if (p.target == PlyTarget::Skip)
+					{
+						if (!reader.skip(p.type)) return false;
+						continue;
+					}
+					if (!reader.readFloat(p.type, value)) return false;
+					switch (p.target)
+					{
+					case PlyTarget::PositionX: position.x = value; break;
+					case PlyTarget::PositionY: position.y = value; break;
+					case PlyTarget::PositionZ: position.z = value; break;
+					case PlyTarget::NormalX: normal.x = value; break;
+					case PlyTarget::NormalY: normal.y = value; break;
+					case PlyTarget::NormalZ: normal.z = value; break;
+					case PlyTarget::TexcoordU: texcoord.x = value; break;
+					case PlyTarget::TexcoordV: texcoord.y = value; break;
+					default: break;
+					}
+				}
+
+				if (&element == ply.vertexElement) onVertex(i, position, normal, texcoord);
+				else if (&element == ply.faceElement) onFace(i, normal, face);
+			}
+		}
+		return true;
+	}
+
+	// Positions, normals and triangles of a PLY file, the faces are triangulated as fans like loadPly does
+	bool readPlyGeometry(const char *path, MeshGeometrySink &sink)
+	{
+		MappedFile file(path);
+		if (!file.valid()) return false;
+		PlyMesh ply;
+		if (!openPly(file.data(), file.data() + file.size(), ply)) return false;
+
+		const size_t normalCount = ply.vertexNormals ? ply.vertexElement->count : ply.faceNormals ? ply.faceElement->count : 0;
+		sink.reserve(ply.vertexElement->count, normalCount, ply.faceElement->count);
+		return readPlyElements(ply,
+			[&](size_t i, const Vector3 &position, const Vector3 &normal, const Vector2&)
+			{
+				sink.position(i, position);
+				if (ply.vertexNormals) sink.normal(i, normal);
+			},
+			[&](size_t i, const Vector3 &normal, const std::vector<uint32_t> &face)
+			{
+				if (ply.faceNormals) sink.normal(i, normal);
+				for (size_t j = 2; j < face.size(); ++j)
+				{
+					const uint32_t positions[3] = { face[0], face[j - 1], face[j] };
+					const uint32_t faceNormal = ply.faceNormals ? (uint32_t)i : UINT32_MAX;
+					const uint32_t normals[3] =
+					{
+						ply.vertexNormals ? positions[0] : faceNormal,
+						ply.vertexNormals ? positions[1] : faceNormal,
+						ply.vertexNormals ? positions[2] : faceNormal,
+					};
+					sink.triangle(positions, normals);
+				}
+			});
+	}
+}
+
+Mesh* Mesh::loadPly(const char *path)
+{
+	PROFILE_ZONE("Mesh::loadPly");
+
+	MappedFile file(path);
+	if (!file.valid()) return nullptr;
+	PlyMesh ply;
+	if (!openPly(file.data(), file.data() + file.size(), ply)) return nullptr;
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->positions.resize(ply.vertexElement->count);
+	if (ply.hasTexcoords) mesh->texcoords.resize(ply.vertexElement->count);
+	if (ply.vertexNormals) mesh->normals.resize(ply.vertexElement->count);
+	if (ply.faceNormals) mesh->normals.resize(ply.faceElement->count);
+	mesh->vertices.reserve(ply.faceElement->count * 3);
+	mesh->triangles.reserve(ply.faceElement->count);
+
+	Mesh &m = *mesh;
+	const bool ok = readPlyElements(ply,
+		[&](size_t i, const Vector3 &position, const Vector3 &normal, const Vector2 &texcoord)
+		{
+			m.positions[i] = position;
+			if (ply.hasTexcoords) m.texcoords[i] = texcoord;
+			if (ply.vertexNormals) m.normals[i] = normal;
+		},
+		[&](size_t i, const Vector3 &normal, const std::vector<uint32_t> &face)
+		{
+			if (ply.faceNormals) m.normals[i] = normal;
+
+			// Every face vertex is a new mesh vertex, the face is triangulated as a fan
+			if (face.size() < 3) return;
+			const uint32_t vstart = (uint32_t)m.vertices.size();
+			for (const uint32_t vidx : face)
+			{
+				const uint32_t nidx = ply.vertexNormals ? vidx : ply.faceNormals ? (uint32_t)i : UINT32_MAX;
+				m.vertices.emplace_back(Mesh::Vertex{ vidx, ply.hasTexcoords ? vidx : UINT32_MAX, nidx });
+			}
+			for (uint32_t j = 2; j < (uint32_t)face.size(); ++j)
+			{
+				m.triangles.emplace_back(Mesh::Triangle{ vstart, vstart + j - 1, vstart + j });
+			}
+		});
+	return ok ? mesh.release() : nullptr;
+}
+
+namespace
+{
+	static const uint32_t k_fmeshMagic = 0x48534d46; // "FMSH" in a little endian file
+	static const uint32_t k_fmeshVersion = 2;
+
+	/// The header is followed by the arrays, in this order and without padding, as laid out in
+	/// memory by Mesh: positions, texcoords, normals, tangents, bitangents, vertices and triangles.
+	/// The groups come last, each one as a FmeshGroup followed by the characters of its name.
+	struct FmeshHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t positionCount;
+		uint64_t texcoordCount;
+		uint64_t normalCount;
+		uint64_t tangentCount;
+		uint64_t bitangentCount;
+		uint64_t vertexCount;
+		uint64_t triangleCount;
+		uint64_t groupCount;
+	};
+
+	struct FmeshGroup
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		uint32_t nameLength;
+	};
+
+	template <typename T>
+	bool writeArray(FILE *f, const std::vector<T> &v)
+	{
+		return v.empty() || fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+	}
+
+	template <typename T>
+	bool readArray(const char *&ptr, const char *end, uint64_t count, std::vector<T> &o_v)
+	{
+		if (count > (uint64_t)(end - ptr) / sizeof(T)) return false;
+		const T *data = reinterpret_cast<const T*>(ptr);
+		o_v.assign(data, data + count);
+		ptr += count * sizeof(T);
+		return true;
+	}
+
+	bool writeGroups(FILE *f, const std::vector<Mesh::Group> &groups)
+	{
+		for (const Mesh::Group &group : groups)
+		{
+			const FmeshGroup g{ group.firstTriangle, group.triangleCount, (uint32_t)group.name.size() };
+			if (fwrite(&g, sizeof(g), 1, f) != 1) return false;
+			if (!group.name.empty() && fwrite(group.name.data(), 1, group.name.size(), f) != group.name.size()) return false;
+		}
+		return true;
+	}
+
+	bool readGroups(const char *&ptr, const char *end, uint64_t count, uint64_t triangleCount, std::vector<Mesh::Group> &o_groups)
+	{
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			FmeshGroup g;
+			if ((size_t)(end - ptr) < sizeof(g)) return false;
+			memcpy(&g, ptr, sizeof(g));
+			ptr += sizeof(g);
+			if (g.nameLength > (size_t)(end - ptr)) return false;
+			if ((uint64_t)g.firstTriangle + g.triangleCount > triangleCount) return false;
+			o_groups.emplace_back(Mesh::Group{ std::string(ptr, g.nameLength), g.firstTriangle, g.triangleCount });
+			ptr += g.nameLength;
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool viewArray(const char *&ptr, const char *end, uint64_t count, const T *&o_data)
+	{
+		if (count > (uint64_t)(end - ptr) / sizeof(T)) return false;
+		o_data = reinterpret_cast<const T*>(ptr);
+		ptr += count * sizeof(T);
+		return true;
+	}
+
+	// Missing texture coordinates and normals are UINT32_MAX, tangents are per vertex or absent
+	bool validIndices(const FmeshHeader &header, const Mesh::Vertex *vertices, const Mesh::Triangle *triangles)
+	{
+		for (uint64_t i = 0; i < header.vertexCount; ++i)
+		{
+			const Mesh::Vertex &v = vertices[i];
+			if (v.positionIndex >= header.positionCount) return false;
+			if (v.texcoordIndex != UINT32_MAX && v.texcoordIndex >= header.texcoordCount) return false;
+			if (v.normalIndex != UINT32_MAX && v.normalIndex >= header.normalCount) return false;
+		}
+		for (uint64_t i = 0; i < header.triangleCount; ++i)
+		{
+			const Mesh::Triangle &t = triangles[i];
+			if (t.vertexIndex0 >= header.vertexCount || t.vertexIndex1 >= header.vertexCount || t.vertexIndex2 >= header.vertexCount) return false;
+		}
+		if (header.tangentCount != header.bitangentCount) return false;
+		return header.tangentCount == 0 || header.tangentCount == header.vertexCount;
+	}
+
+	// Positions, normals and triangles of a .fmesh file, read in place from the mapped file
+	bool readFmeshGeometry(const char *path, MeshGeometrySink &sink)
+	{
+		MappedFile file(path);
+		if (!file.valid() || file.size() < sizeof(FmeshHeader)) return false;
+
+		FmeshHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+		if (header.magic != k_fmeshMagic || header.version != k_fmeshVersion) return false;
+
+		const char *ptr = file.data() + sizeof(header);
+		const char *end = file.data() + file.size();
+		const Vector3 *positions;
+		const Vector2 *texcoords;
+		const Vector3 *normals;
+		const Vector3 *tangents;
+		const Vector3 *bitangents;
+		const Mesh::Vertex *vertices;
+		const Mesh::Triangle *triangles;
+		std::vector<Mesh::Group> groups;
+		if (!viewArray(ptr, end, header.positionCount, positions) ||
+			!viewArray(ptr, end, header.texcoordCount, texcoords) ||
+			!viewArray(ptr, end, header.normalCount, normals) ||
+			!viewArray(ptr, end, header.tangentCount, tangents) ||
+			!viewArray(ptr, end, header.bitangentCount, bitangents) ||
+			!viewArray(ptr, end, header.vertexCount, vertices) ||
+			!viewArray(ptr, end, header.triangleCount, triangles) ||
+			!readGroups(ptr, end, header.groupCount, header.triangleCount, groups) ||
+			!validIndices(header, vertices, triangles))
+		{
+			return false;
+		}
+
+		sink.reserve((size_t)header.positionCount, (size_t)header.normalCount, (size_t)header.triangleCount);
+		for (uint64_t i = 0; i < header.positionCount; ++i) sink.position((size_t)i, positions[i]);
+		for (uint64_t i = 0; i < header.normalCount; ++i) sink.normal((size_t)i, normals[i]);
+		for (uint64_t i = 0; i < header.triangleCount; ++i)
+		{
+			const Mesh::Triangle &t = triangles[i];
+			const Mesh::Vertex *v[3] = { &vertices[t.vertexIndex0], &vertices[t.vertexIndex1], &vertices[t.vertexIndex2] };
+			const uint32_t triPositions[3] = { v[0]->positionIndex, v[1]->positionIndex, v[2]->positionIndex };
+			const uint32_t triNormals[3] = { v[0]->normalIndex, v[1]->normalIndex, v[2]->normalIndex };
+			sink.triangle(triPositions, triNormals);
+		}
+		return true;
+	}
+}
+
+Mesh* Mesh::loadFmesh(const char *path)
+{
+	PROFILE_ZONE("Mesh::loadFmesh");
+
+	MappedFile file(path);
+	if (!file.valid() || file.size() < sizeof(FmeshHeader)) return nullptr;
+
+	FmeshHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != k_fmeshMagic || header.version != k_fmeshVersion) return nullptr;
+
+	const char *ptr = file.data() + sizeof(header);
+	const char *end = file.data() + file.size();
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	if (!readArray(ptr, end, header.positionCount, mesh->positions) ||
+		!readArray(ptr, end, header.texcoordCount, mesh->texcoords) ||
+		!readArray(ptr, end, header.normalCount, mesh->normals) ||
+		!readArray(ptr, end, header.tangentCount, mesh->tangents) ||
+		!readArray(ptr, end, header.bitangentCount, mesh->bitangents) ||
+		!readArray(ptr, end, header.vertexCount, mesh->vertices) ||
+		!readArray(ptr, end, header.triangleCount, mesh->triangles) ||
+		!readGroups(ptr, end, header.groupCount, header.triangleCount, mesh->groups) ||
+		!validIndices(header, mesh->vertices.data(), mesh->triangles.data()))
+	{
+		return nullptr;
+	}
+	return mesh.release();
+}
+
+bool Mesh::saveFmesh(const char *path) const
+{
+	PROFILE_ZONE("Mesh::saveFmesh");
+
+	FILE *f = fopen(path, "wb");
+	if (!f) return false;
+
+	FmeshHeader header;
+	header.magic = k_fmeshMagic;
+	header.version = k_fmeshVersion;
+	header.positionCount = positions.size();
+	header.texcoordCount = texcoords.size();
+	header.normalCount = normals.size();
+	header.tangentCount = tangents.size();
+	header.bitangentCount = bitangents.size();
+	header.vertexCount = vertices.size();
+	header.triangleCount = triangles.size();
+	header.groupCount = groups.size();
+
+	const bool ok =
+		fwrite(&header, sizeof(header), 1, f) == 1 &&
+		writeArray(f, positions) &&
+		writeArray(f, texcoords) &&
+		writeArray(f, normals) &&
+		writeArray(f, tangents) &&
+		writeArray(f, bitangents) &&
+		writeArray(f, vertices) &&
+		writeArray(f, triangles) &&
+		writeGroups(f, groups);
+	const bool closed = fclose(f) == 0;
+	if (!ok || !closed) remove(path); // Don't leave a partial file behind as the converted mesh
+	return ok && closed;
+}
+
+namespace
+{
+	static const uint32_t k_glbMagic = 0x46546C67; // "glTF"
+	static const uint32_t k_glbChunkJson = 0x4E4F534A; // "JSON"
+	static const uint32_t k_glbChunkBin = 0x004E4942; // "BIN\0"
+	static const double k_gltfMaxInteger = 9007199254740991.0; // Largest integer a JSON number holds exactly
+	static const char k_gltfZeros[16] = {}; // Data of the accessors without a buffer view, one element of any type
+
+	enum GltfComponentType
+	{
+		GltfByte = 5120,
+		GltfUnsignedByte = 5121,
+		GltfShort = 5122,
+		GltfUnsignedShort = 5123,
+		GltfUnsignedInt = 5125,
+		GltfFloat = 5126,
+	};
+
+	enum GltfPrimitiveMode
+	{
+		GltfTriangles = 4,
+		GltfTriangleStrip = 5,
+		GltfTriangleFan = 6,
+	};
+
+	/// Data of the glTF buffers: the binary chunk of a GLB file, mapped external files or decoded data URIs
+	struct GltfBuffers
+	{
+		struct Range
+		{
+			const char *data;
+			size_t size;
+		};
+		std::vector<Range> ranges;
+		std::vector<std::unique_ptr<MappedFile> > files;
+		std::vector<std::vector<char> > decoded;
+	};
+
+	bool decodeBase64(const char *ptr, const char *end, std::vector<char> &o_data)
+	{
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (; ptr != end && *ptr != '='; ++ptr)
+		{
+			const char c = *ptr;
+			uint32_t value;
+			if (c >= 'A' && c <= 'Z') value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+' || c == '-') value = 62;
+			else if (c == '/' || c == '_') value = 63;
+			else return false;
+			bits = (bits << 6) | value;
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				o_data.push_back((char)((bits >> bitCount) & 0xFF));
+			}
+		}
+		return true;
+	}
+
+	std::string decodeUri(const std::string &uri)
+	{
+		std::string path;
+		for (size_t i = 0; i < uri.size(); ++i)
+		{
+			if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1]) && std::isxdigit((unsigned char)uri[i + 2]))
+			{
+				path += (char)std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+				i += 2;
+			}
+			else
+			{
+				path += uri[i];
+			}
+		}
+		return path;
+	}
+
+	/// Reads an index, a count or a byte size, which must be a non-negative integer
+	bool gltfInteger(const JsonValue &value, size_t &o_value)
+	{
+		const double number = value.number(-1.0);
+		if (!value.isNumber() || !(number >= 0.0) || number > k_gltfMaxInteger || number != std::floor(number)) return false;
+		o_value = (size_t)number;
+		return true;
+	}
+
+	/// Same as gltfInteger for the properties that can be omitted
+	bool gltfInteger(const JsonValue &value, size_t fallback, size_t &o_value)
+	{
+		if (value.isNull())
+		{
+			o_value = fallback;
+			return true;
+		}
+		return gltfInteger(value, o_value);
+	}
+
+	bool loadGltfBuffers(const JsonValue &doc, const std::string &directory, const char *binChunk, size_t binChunkSize, GltfBuffers &o_buffers)
+	{
+		const JsonValue &buffers = doc["buffers"];
+		for (size_t i = 0; i < buffers.size(); ++i)
+		{
+			const JsonValue &buffer = buffers.at(i);
+			size_t byteLength;
+			if (!gltfInteger(buffer["byteLength"], byteLength)) return false;
+			GltfBuffers::Range range = { nullptr, 0 };
+
+			if (!buffer.has("uri"))
+			{
+				// Only the first buffer of a GLB file can be its binary chunk
+				if (i != 0 || !binChunk) return false;
+				range = { binChunk, binChunkSize };
+			}
+			else
+			{
+				const std::string &uri = buffer["uri"].string();
+				if (uri.compare(0, 5, "data:") == 0)
+				{
+					const size_t comma = uri.find(";base64,");
+					if (comma == std::string::npos) return false;
+					std::vector<char> data;
+					if (!decodeBase64(uri.data() + comma + 8, uri.data() + uri.size(), data)) return false;
+					o_buffers.decoded.push_back(std::move(data));
+					range = { o_buffers.decoded.back().data(), o_buffers.decoded.back().size() };
+				}
+				else
+				{
+					std::unique_ptr<MappedFile> file(new MappedFile((directory + decodeUri(uri)).c_str()));
+					if (!file->valid()) return false;
+					range = { file->data(), file->size() };
+					o_buffers.files.push_back(std::move(file));
+				}
+			}
+
+			if (range.size < byteLength) return false;
+			range.size = byteLength;
+			o_buffers.ranges.push_back(range);
+		}
+		return true;
+	}
+
+	size_t gltfComponentSize(int componentType)
+	{
+		switch (componentType)
+		{
+		case GltfByte: case GltfUnsignedByte: return 1;
+		case GltfShort: case GltfUnsignedShort: return 2;
+		case GltfUnsignedInt: case GltfFloat: return 4;
+		default: return 0;
+		}
+	}
+
+	int gltfComponentCount(const std::string &type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		return 0;
+	}
+
+	/// Strided view of the elements of an accessor in its buffer
+	struct GltfAccessor
+	{
+		const char *data = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		int componentType = 0;
+		bool normalized = false;
+
+		float component(size_t i, int c) const
+		{
+			const char *ptr = data + i * stride + c * gltfComponentSize(componentType);
+			switch (componentType)
+			{
+			case GltfFloat: { float v; memcpy(&v, ptr, sizeof(v)); return v; }
+			case GltfByte: { int8_t v; memcpy(&v, ptr, sizeof(v)); return normalized ? std::max(v / 127.0f, -1.0f) : (float)v; }
+			case GltfUnsignedByte: { uint8_t v; memcpy(&v, ptr, sizeof(v)); return normalized ? v / 255.0f : (float)v; }
+			case GltfShort: { int16_t v; memcpy(&v, ptr, sizeof(v)); return normalized ? std::max(v / 32767.0f, -1.0f) : (float)v; }
+			case GltfUnsignedShort: { uint16_t v; memcpy(&v, ptr, sizeof(v)); return normalized ? v / 65535.0f : (float)v; }
+			case GltfUnsignedInt: { uint32_t v; memcpy(&v, ptr, sizeof(v)); return (float)v; }
+			default: return 0.0f;
+			}
+		}
+
+		uint32_t index(size_t i) const
+		{
+			const char *ptr = data + i * stride;
+			switch (componentType)
+			{
+			case GltfUnsignedByte: { uint8_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+			case GltfUnsignedShort: { uint16_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+			case GltfUnsignedInt: { uint32_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+			default: return UINT32_MAX;
+			}
+		}
+
+		Vector3 vector3(size_t i) const
+		{
+			return Vector3(component(i, 0), component(i, 1), component(i, 2));
+		}
+	};
+
+	/// Checks that the accessor has the expected type and lies inside its buffer
+	bool getGltfAccessor(const JsonValue &doc, const GltfBuffers &buffers, const JsonValue &index, int componentCount, GltfAccessor &o_accessor)
+	{
+		size_t accessorIndex;
+		if (!gltfInteger(index, accessorIndex)) return false;
+		const JsonValue &accessor = doc["accessors"].at(accessorIndex);
+		if (!accessor.isObject() || accessor.has("sparse")) return false;
+		if (gltfComponentCount(accessor["type"].string()) != componentCount) return false;
+
+		size_t componentType;
+		if (!gltfInteger(accessor["componentType"], componentType) || !gltfInteger(accessor["count"], o_accessor.count)) return false;
+		o_accessor.componentType = componentType <= INT_MAX ? (int)componentType : 0;
+		o_accessor.normalized = accessor["normalized"].boolean();
+		const size_t componentSize = gltfComponentSize(o_accessor.componentType);
+		if (componentSize == 0) return false;
+		const size_t elementSize = componentSize * componentCount;
+
+		// Without a buffer view every element is zero
+		if (!accessor.has("bufferView"))
+		{
+			o_accessor.data = k_gltfZeros;
+			o_accessor.stride = 0;
+			return !accessor.has("byteOffset");
+		}
+
+		size_t viewIndex, bufferIndex;
+		if (!gltfInteger(accessor["bufferView"], viewIndex)) return false;
+		const JsonValue &view = doc["bufferViews"].at(viewIndex);
+		if (!view.isObject() || !gltfInteger(view["buffer"], bufferIndex)) return false;
+		if (bufferIndex >= buffers.ranges.size()) return false;
+		const GltfBuffers::Range &buffer = buffers.ranges[bufferIndex];
+
+		size_t viewOffset, viewLength, offset;
+		if (!gltfInteger(view["byteStride"], elementSize, o_accessor.stride) ||
+			!gltfInteger(view["byteOffset"], 0, viewOffset) ||
+			!gltfInteger(view["byteLength"], viewLength) ||
+			!gltfInteger(accessor["byteOffset"], 0, offset))
+		{
+			return false;
+		}
+		if (viewOffset > buffer.size || viewLength > buffer.size - viewOffset) return false;
+		if (o_accessor.count > 0)
+		{
+			if (o_accessor.stride < elementSize || offset > viewLength || viewLength - offset < elementSize) return false;
+			if ((viewLength - offset - elementSize) / o_accessor.stride < o_accessor.count - 1) return false;
+		}
+		o_accessor.data = buffer.data + viewOffset + offset;
+		return true;
+	}
+
+	/// Column major affine transform of a node
+	struct GltfTransform
+	{
+		float m[16];
+
+		static GltfTransform identity()
+		{
+			GltfTransform t;
+			for (int i = 0; i < 16; ++i) t.m[i] = (i % 5) == 0 ? 1.0f : 0.0f;
+			return t;
+		}
+
+		GltfTransform operator *(const GltfTransform &o) const
+		{
+			GltfTransform t;
+			for (int c = 0; c < 4; ++c)
+			{
+				for (int r = 0; r < 4; ++r)
+				{
+					float v = 0.0f;
+					for (int k = 0; k < 4; ++k) v += m[k * 4 + r] * o.m[c * 4 + k];
+					t.m[c * 4 + r] = v;
+				}
+			}
+			return t;
+		}
+
+		Vector3 point(const Vector3 &p) const
+		{
+			return direction(p) + Vector3(m[12], m[13], m[14]);
+		}
+
+		Vector3 direction(const Vector3 &d) const
+		{
+			return Vector3(
+				m[0] * d.x + m[4] * d.y + m[8] * d.z,
+				m[1] * d.x + m[5] * d.y + m[9] * d.z,
+				m[2] * d.x + m[6] * d.y + m[10] * d.z);
+		}
+
+		float determinant() const
+		{
+			return dot(Vector3(m[0], m[1], m[2]), cross(Vector3(m[4], m[5], m[6]), Vector3(m[8], m[9], m[10])));
+		}
+
+		// Inverse transpose of the linear part up to a positive scale, normals are normalized anyway
+		Vector3 normal(const Vector3 &n) const
+		{
+			const Vector3 c0(m[0], m[1], m[2]);
+			const Vector3 c1(m[4], m[5], m[6]);
+			const Vector3 c2(m[8], m[9], m[10]);
+			const Vector3 r = cross(c1, c2) * n.x + cross(c2, c0) * n.y + cross(c0, c1) * n.z;
+			return determinant() < 0.0f ? -r : r;
+		}
+
+		static GltfTransform fromNode(const JsonValue &node)
+		{
+			GltfTransform t = identity();
+			const JsonValue &matrix = node["matrix"];
+			if (matrix.size() == 16)
+			{
+				for (size_t i = 0; i < 16; ++i) t.m[i] = (float)matrix.at(i).number();
+				return t;
+			}
+
+			const JsonValue &rotation = node["rotation"];
+			const JsonValue &scale = node["scale"];
+			const JsonValue &translation = node["translation"];
+			if (rotation.size() == 4)
+			{
+				const float x = (float)rotation.at(0).number(), y = (float)rotation.at(1).number();
+				const float z = (float)rotation.at(2).number(), w = (float)rotation.at(3).number();
+				t.m[0] = 1 - 2 * (y * y + z * z); t.m[4] = 2 * (x * y - z * w); t.m[8] = 2 * (x * z + y * w);
+				t.m[1] = 2 * (x * y + z * w); t.m[5] = 1 - 2 * (x * x + z * z); t.m[9] = 2 * (y * z - x * w);
+				t.m[2] = 2 * (x * z - y * w); t.m[6] = 2 * (y * z + x * w); t.m[10] = 1 - 2 * (x * x + y * y);
+			}
+			if (scale.size() == 3)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					for (int r = 0; r < 3; ++r) t.m[c * 4 + r] *= (float)scale.at(c).number(1.0);
+				}
+			}
+			if (translation.size() == 3)
+			{
+				for (int r = 0; r < 3; ++r) t.m[12 + r] = (float)translation.at(r).number();
+			}
+			return t;
+		}
+	};
+
+	struct GltfInstance
+	{
+		size_t mesh;
+		GltfTransform transform;
+	};
+
+	bool collectGltfInstances(const JsonValue &doc, const JsonValue &index, const GltfTransform &parent, size_t depth, std::vector<GltfInstance> &o_instances)
+	{
+		size_t nodeIndex;
+		if (!gltfInteger(index, nodeIndex)) return false;
+		const JsonValue &nodes = doc["nodes"];
+		const JsonValue &node = nodes.at(nodeIndex);
+		if (!node.isObject() || depth > nodes.size()) return true; // Cycles are invalid glTF
+
+		const GltfTransform transform = parent * GltfTransform::fromNode(node);
+		if (node.has("mesh"))
+		{
+			size_t mesh;
+			if (!gltfInteger(node["mesh"], mesh)) return false;
+			o_instances.push_back(GltfInstance{ mesh, transform });
+		}
+		const JsonValue &children = node["children"];
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			if (!collectGltfInstances(doc, children.at(i), transform, depth + 1, o_instances)) return false;
+		}
+		return true;
+	}
+
+	/// Meshes of the default scene with their world transforms, or every mesh once without a scene
+	bool gltfInstances(const JsonValue &doc, std::vector<GltfInstance> &o_instances)
+	{
+		const JsonValue &scenes = doc["scenes"];
+		if (scenes.size() == 0)
+		{
+			for (size_t i = 0; i < doc["meshes"].size(); ++i) o_instances.push_back(GltfInstance{ i, GltfTransform::identity() });
+			return true;
+		}
+		size_t scene;
+		if (!gltfInteger(doc["scene"], 0, scene)) return false;
+		const JsonValue &roots = scenes.at(scene)["nodes"];
+		for (size_t i = 0; i < roots.size(); ++i)
+		{
+			if (!collectGltfInstances(doc, roots.at(i), GltfTransform::identity(), 0, o_instances)) return false;
+		}
+		return true;
+	}
+
+	/// Drawing mode of a primitive, 0 (points) if it isn't a valid mode
+	int gltfPrimitiveMode(const JsonValue &primitive)
+	{
+		size_t mode;
+		return gltfInteger(primitive["mode"], GltfTriangles, mode) && mode <= GltfTriangleFan ? (int)mode : 0;
+	}
+
+	bool isGltfTriangles(const JsonValue &primitive)
+	{
+		const int mode = gltfPrimitiveMode(primitive);
+		return mode == GltfTriangles || mode == GltfTriangleStrip || mode == GltfTriangleFan;
+	}
+
+	/// Corners of the triangles of a primitive, as indices of its vertices
+	bool gltfTriangleCorners(const JsonValue &doc, const GltfBuffers &buffers, const JsonValue &primitive, size_t vertexCount, std::vector<uint32_t> &o_corners)
+	{
+		std::vector<uint32_t> indices;
+		if (primitive.has("indices"))
+		{
+			GltfAccessor accessor;
+			if (!getGltfAccessor(doc, buffers, primitive["indices"], 1, accessor)) return false;
+			indices.resize(accessor.count);
+			for (size_t i = 0; i < accessor.count; ++i)
+			{
+				indices[i] = accessor.index(i);
+				if (indices[i] >= vertexCount) return false;
+			}
+		}
+		else
+		{
+			indices.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; ++i) indices[i] = (uint32_t)i;
+		}
+
+		o_corners.clear();
+		const int mode = gltfPrimitiveMode(primitive);
+		if (mode == GltfTriangles)
+		{
+			o_corners.assign(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+		}
+		else
+		{
+			for (size_t i = 2; i < indices.size(); ++i)
+			{
+				const bool odd = (i & 1) == 1;
+				const uint32_t a = mode == GltfTriangleFan ? indices[0] : indices[odd ? i - 1 : i - 2];
+				const uint32_t b = mode == GltfTriangleFan ? indices[i - 1] : indices[odd ? i - 2 : i - 1];
+				o_corners.push_back(a);
+				o_corners.push_back(b);
+				o_corners.push_back(indices[i]);
+			}
+		}
+		return true;
+	}
+
+	Mesh* invalidGltf(const char *path)
+	{
+		logError("Mesh", std::string("Invalid glTF file ") + path);
+		return nullptr;
+	}
+}
+
+Mesh* Mesh::loadGltf(const char *path)
+{
+	PROFILE_ZONE("Mesh::loadGltf");
+
+	MappedFile file(path);
+	if (!file.valid()) return nullptr;
+
+	// A GLB file is a header and chunks: the JSON scene and an optional binary buffer
+	const char *json = file.data();
+	size_t jsonSize = file.size();
+	const char *binChunk = nullptr;
+	size_t binChunkSize = 0;
+	uint32_t magic = 0;
+	if (file.size() >= 12) memcpy(&magic, file.data(), sizeof(magic));
+	if (magic == k_glbMagic)
+	{
+		json = nullptr;
+		size_t offset = 12;
+		while (offset + 8 <= file.size())
+		{
+			uint32_t chunkLength, chunkType;
+			memcpy(&chunkLength, file.data() + offset, sizeof(chunkLength));
+			memcpy(&chunkType, file.data() + offset + 4, sizeof(chunkType));
+			offset += 8;
+			if (chunkLength > file.size() - offset) return invalidGltf(path);
+			if (chunkType == k_glbChunkJson && !json) { json = file.data() + offset; jsonSize = chunkLength; }
+			else if (chunkType == k_glbChunkBin && !binChunk) { binChunk = file.data() + offset; binChunkSize = chunkLength; }
+			offset += (chunkLength + 3) & ~3u;
+		}
+		if (!json) return invalidGltf(path);
+	}
+
+	JsonValue doc;
+	if (!JsonValue::parse(json, json + jsonSize, doc)) return invalidGltf(path);
+
+	const std::string pathStr(path);
+	const size_t slash = pathStr.find_last_of("/\\");
+	const std::string directory = slash == std::string::npos ? std::string() : pathStr.substr(0, slash + 1);
+	GltfBuffers buffers;
+	if (!loadGltfBuffers(doc, directory, binChunk, binChunkSize, buffers)) return invalidGltf(path);
+
+	// Attributes are only kept if every primitive has them
+	std::vector<GltfInstance> instances;
+	if (!gltfInstances(doc, instances)) return invalidGltf(path);
+	bool hasNormals = true;
+	bool hasTexcoords = true;
+	bool hasTangents = true;
+	bool hasPrimitives = false;
+	for (const auto &instance : instances)
+	{
+		const JsonValue &primitives = doc["meshes"].at(instance.mesh)["primitives"];
+		for (size_t i = 0; i < primitives.size(); ++i)
+		{
+			const JsonValue &attributes = primitives.at(i)["attributes"];
+			if (!isGltfTriangles(primitives.at(i)) || !attributes.has("POSITION")) continue;
+			hasNormals = hasNormals && attributes.has("NORMAL");
+			hasTexcoords = hasTexcoords && attributes.has("TEXCOORD_0");
+			hasTangents = hasTangents && attributes.has("TANGENT");
+			hasPrimitives = true;
+		}
+	}
+	if (!hasPrimitives) return invalidGltf(path);
+	hasTangents = hasTangents && hasNormals;
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	std::vector<uint32_t> corners;
+	std::vector<Vector3> tangents;
+	std::vector<Vector3> bitangents;
+
+	for (const auto &instance : instances)
+	{
+		const GltfTransform &transform = instance.transform;
+		const bool mirrored = transform.determinant() < 0.0f;
+		const JsonValue &primitives = doc["meshes"].at(instance.mesh)["primitives"];
+
+		for (size_t p = 0; p < primitives.size(); ++p)
+		{
+			const JsonValue &primitive = primitives.at(p);
+			const JsonValue &attributes = primitive["attributes"];
+			if (!isGltfTriangles(primitive) || !attributes.has("POSITION")) continue;
+
+			GltfAccessor positions, normals, texcoords, tangentsAccessor;
+			if (!getGltfAccessor(doc, buffers, attributes["POSITION"], 3, positions)) return invalidGltf(path);
+			if (hasNormals && !getGltfAccessor(doc, buffers, attributes["NORMAL"], 3, normals)) return invalidGltf(path);
+			if (hasTexcoords && !getGltfAccessor(doc, buffers, attributes["TEXCOORD_0"], 2, texcoords)) return invalidGltf(path);
+			if (hasTangents && !getGltfAccessor(doc, buffers, attributes["TANGENT"], 4, tangentsAccessor)) return invalidGltf(path);
+			const size_t count = positions.count;
+			if ((hasNormals && normals.count != count) || (hasTexcoords && texcoords.count != count) ||
+				(hasTangents && tangentsAccessor.count != count)) return invalidGltf(path);
+
+			if (!gltfTriangleCorners(doc, buffers, primitive, count, corners)) return invalidGltf(path);
+			if (mesh->vertices.size() + corners.size() > UINT32_MAX) return invalidGltf(path);
+
+			const uint32_t positionBase = (uint32_t)mesh->positions.size();
+			const uint32_t normalBase = (uint32_t)mesh->normals.size();
+			const uint32_t texcoordBase = (uint32_t)mesh->texcoords.size();
+			for (size_t i = 0; i < count; ++i)
+			{
+				mesh->positions.push_back(transform.point(positions.vector3(i)));
+			}
+			if (hasNormals)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					mesh->normals.push_back(normalize(transform.normal(normals.vector3(i))));
+				}
+			}
+			if (hasTexcoords)
+			{
+				// glTF texture coordinates start at the top of the image
+				for (size_t i = 0; i < count; ++i)
+				{
+					mesh->texcoords.push_back(Vector2(texcoords.component(i, 0), 1.0f - texcoords.component(i, 1)));
+				}
+			}
+			if (hasTangents)
+			{
+				// The bitangent is built before the transform so mirroring keeps the handedness
+				tangents.resize(count);
+				bitangents.resize(count);
+				for (size_t i = 0; i < count; ++i)
+				{
+					const Vector3 t = tangentsAccessor.vector3(i);
+					const Vector3 b = cross(normals.vector3(i), t) * (tangentsAccessor.component(i, 3) < 0.0f ? -1.0f : 1.0f);
+					tangents[i] = normalize(transform.direction(t));
+					bitangents[i] = normalize(transform.direction(b));
+				}
+			}
+
+			// Every corner is a new mesh vertex, like the other loaders
+			for (size_t i = 0; i < corners.size(); i += 3)
+			{
+				const uint32_t vstart = (uint32_t)mesh->vertices.size();
+				for (int j = 0; j < 3; ++j)
+				{
+					const uint32_t idx = corners[i + (mirrored && j > 0 ? 3 - j : j)];
+					mesh->vertices.emplace_back(Mesh::Vertex{
+						positionBase + idx,
+						hasTexcoords ? texcoordBase + idx : UINT32_MAX,
+						hasNormals ? normalBase + idx : UINT32_MAX });
+					if (hasTangents)
+					{
+						mesh->tangents.push_back(tangents[idx]);
+						mesh->bitangents.push_back(bitangents[idx]);
+					}
+				}
+				mesh->triangles.emplace_back(Mesh::Triangle{ vstart, vstart + 1, vstart + 2 });
+			}
+		}
+	}
+
+	return mesh.release();
+}
+
+namespace
+{
+	bool endsWith(const std::string &str, const std::string &ending)
+	{
+		if (ending.size() > str.size()) return false;
+		return std::equal(ending.rbegin(), ending.rend(), str.rbegin());
+	}
+}
+
+Mesh * Mesh::loadFile(const char * path, bool weldVertices)
+{
+	if (endsWith(path, ".obj")) return loadWavefrontObj(path, weldVertices);
+	if (endsWith(path, ".ply")) return loadPly(path);
+	if (endsWith(path, ".fmesh")) return loadFmesh(path);
+	if (endsWith(path, ".glb") || endsWith(path, ".gltf")) return loadGltf(path);
+	return nullptr;
+}
+
+bool Mesh::readsGeometry(const char *path)
+{
+	return endsWith(path, ".ply") || endsWith(path, ".fmesh");
+}
+
+bool Mesh::readGeometry(const char *path, MeshGeometrySink &sink)
+{
+	PROFILE_ZONE("Mesh::readGeometry");
+	if (endsWith(path, ".ply")) return readPlyGeometry(path, sink);
+	if (endsWith(path, ".fmesh")) return readFmeshGeometry(path, sink);
+	return false;
+}
+
+Mesh* Mesh::createCopy(const Mesh *mesh)
+{
+	assert(mesh);
+	Mesh* r = new Mesh();
+	*r = *mesh;
+	return r;
+}
+
+void Mesh::computeFaceNormals()
+{
+	PROFILE_ZONE("Mesh::computeFaceNormals");
+	normals.clear();
+	normals.reserve(triangles.size());
+
+	// Vertices can be shared by several faces, every face gets its own ones
+	std::vector<Vertex> faceVertices;
+	faceVertices.reserve(triangles.size() * 3);
+	std::vector<Vector3> faceTangents;
+	std::vector<Vector3> faceBitangents;
+
+	for (auto &tri : triangles)
 	{
-		normals[n.second.index] = normalize(n.second.normal);
+		const uint32_t indices[3] = { tri.vertexIndex0, tri.vertexIndex1, tri.vertexIndex2 };
+		const Vector3 p0 = positions[vertices[indices[0]].positionIndex];
+		const Vector3 p1 = positions[vertices[indices[1]].positionIndex];
+		const Vector3 p2 = positions[vertices[indices[2]].positionIndex];
+		const Vector3 n = normalize(cross(p1 - p0, p2 - p0));
+		const uint32_t nidx = (uint32_t)normals.size();
+		normals.emplace_back(n);
+
+		const uint32_t vstart = (uint32_t)faceVertices.size();
+		for (const uint32_t vidx : indices)
+		{
+			Vertex v = vertices[vidx];
+			v.normalIndex = nidx;
+			faceVertices.push_back(v);
+			if (!tangents.empty())
+			{
+				faceTangents.push_back(tangents[vidx]);
+				faceBitangents.push_back(bitangents[vidx]);
+			}
+		}
+		tri = Triangle{ vstart, vstart + 1, vstart + 2 };
 	}
+
+	vertices.swap(faceVertices);
+	tangents.swap(faceTangents);
+	bitangents.swap(faceBitangents);
 }
 
 // TODO: Improve algorithm
-void Mesh::computeTangentSpace()
+// Face weighting?
+void Mesh::computeVertexNormals()
 {
-	tangents.clear();
-	bitangents.clear();
-	tangents.resize(vertices.size());
-	bitangents.resize(vertices.size());
+	PROFILE_ZONE("Mesh::computeVertexNormals");
+	normals.clear();
+	normals.resize(positions.size());
 
 	for (const auto &tri : triangles)
 	{
-		const auto &v0 = vertices[tri.vertexIndex0];
-		const auto &v1 = vertices[tri.vertexIndex1];
-		const auto &v2 = vertices[tri.vertexIndex2];
+		auto &v0 = vertices[tri.vertexIndex0];
+		auto &v1 = vertices[tri.vertexIndex1];
+		auto &v2 = vertices[tri.vertexIndex2];
 		const Vector3 p0 = positions[v0.positionIndex];
 		const Vector3 p1 = positions[v1.positionIndex];
 		const Vector3 p2 = positions[v2.positionIndex];
-		const Vector2 u0 = texcoords[v0.texcoordIndex];
-		const Vector2 u1 = texcoords[v1.texcoordIndex];
-		const Vector2 u2 = texcoords[v2.texcoordIndex];
-
-		const Vector3 e0 = p1 - p0;
-		const Vector3 e1 = p2 - p0;
-		const Vector2 t0 = u1 - u0;
-		const Vector2 t1 = u2 - u0;
-
-		const float r = 1.0f / (t0.x * t1.y - t1.x * t0.y);
-		const Vector3 sdir = (e0 * t1.y - e1 * t0.y) * r;
-		const Vector3 tdir = (e1 * t0.x - e0 * t1.x) * r;
-
-		tangents[tri.vertexIndex0] += sdir;
-		tangents[tri.vertexIndex1] += sdir;
-		tangents[tri.vertexIndex2] += sdir;
-		bitangents[tri.vertexIndex0] += tdir;
-		bitangents[tri.vertexIndex1] += tdir;
-		bitangents[tri.vertexIndex2] += tdir;
-	}
-
-	for (size_t i = 0; i < vertices.size(); ++i)
-	{
-		const Vector3 n = normals[vertices[i].normalIndex];
-		const Vector3 t1 = tangents[i];
-		const Vector3 t2 = bitangents[i];
-		tangents[i] = normalize(t1 - n * dot(n, t1));
-		bitangents[i] = cross(n, tangents[i]);
+		const Vector3 n = normalize(cross(p1 - p0, p2 - p0));
+		normals[v0.positionIndex] += n;
+		normals[v1.positionIndex] += n;
+		normals[v2.positionIndex] += n;
+	}
+
+	for (auto &n : normals)
+	{
+		n = normalize(n);
+	}
+
+	for (auto &v : vertices)
+	{
+		v.normalIndex = v.positionIndex;
+	}
+}
+
+namespace
+{
+	// Sorts chunks of the values in parallel and merges them in pairs
+	template <typename T, typename Compare>
+	void parallelSort(std::vector<T> &values, Compare less)
+	{
+		static const size_t k_chunkCount = 64;
+		const size_t count = values.size();
+		const size_t chunkSize = std::max<size_t>((count + k_chunkCount - 1) / k_chunkCount, 1);
+		const int chunks = int((count + chunkSize - 1) / chunkSize);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < chunks; ++i)
+		{
+			const size_t begin = size_t(i) * chunkSize;
+			const size_t end = std::min(begin + chunkSize, count);
+			std::sort(values.begin() + begin, values.begin() + end, less);
+		}
+
+		std::vector<T> merged(count);
+		for (size_t width = chunkSize; width < count; width *= 2)
+		{
+			const int pairs = int((count + 2 * width - 1) / (2 * width));
+#pragma omp parallel for schedule(dynamic)
+			for (int i = 0; i < pairs; ++i)
+			{
+				const size_t begin = size_t(i) * 2 * width;
+				const size_t middle = std::min(begin + width, count);
+				const size_t end = std::min(begin + 2 * width, count);
+				std::merge(values.begin() + begin, values.begin() + middle,
+					values.begin() + middle, values.begin() + end, merged.begin() + begin, less);
+			}
+			values.swap(merged);
+		}
+	}
+}
+
+void Mesh::computeVertexNormalsAggressive()
+{
+	PROFILE_ZONE("Mesh::computeVertexNormalsAggressive");
+
+	// Triangle corners are sorted by position so every welded position is a consecutive segment.
+	// Ties keep the triangle order: normals are summed and numbered like a sequential pass would.
+	struct Corner { Vector3 position; uint32_t index; uint32_t vertexIndex; };
+	const int triangleCount = int(triangles.size());
+	std::vector<Vector3> faceNormals(triangleCount);
+	std::vector<Corner> corners(triangleCount * 3);
+
+#pragma omp parallel for
+	for (int t = 0; t < triangleCount; ++t)
+	{
+		const auto &tri = triangles[t];
+		const Vector3 p0 = positions[vertices[tri.vertexIndex0].positionIndex];
+		const Vector3 p1 = positions[vertices[tri.vertexIndex1].positionIndex];
+		const Vector3 p2 = positions[vertices[tri.vertexIndex2].positionIndex];
+		faceNormals[t] = normalize(cross(p1 - p0, p2 - p0));
+		corners[t * 3 + 0] = Corner{ p0, uint32_t(t * 3 + 0), tri.vertexIndex0 };
+		corners[t * 3 + 1] = Corner{ p1, uint32_t(t * 3 + 1), tri.vertexIndex1 };
+		corners[t * 3 + 2] = Corner{ p2, uint32_t(t * 3 + 2), tri.vertexIndex2 };
+	}
+
+	parallelSort(corners, [](const Corner &a, const Corner &b)
+	{
+		if (a.position < b.position) return true;
+		if (b.position < a.position) return false;
+		return a.index < b.index;
+	});
+
+	std::vector<uint32_t> segments;
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		if (i == 0 || corners[i - 1].position < corners[i].position) segments.push_back(uint32_t(i));
+	}
+	const int segmentCount = int(segments.size());
+	segments.push_back(uint32_t(corners.size()));
+
+	// Normals are numbered in the order their positions are first found
+	std::vector<uint32_t> order(segmentCount);
+	for (int i = 0; i < segmentCount; ++i) order[i] = uint32_t(i);
+	parallelSort(order, [&](uint32_t a, uint32_t b) { return corners[segments[a]].index < corners[segments[b]].index; });
+	std::vector<uint32_t> normalIndices(segmentCount);
+	for (int i = 0; i < segmentCount; ++i) normalIndices[order[i]] = uint32_t(i);
+
+	normals.clear();
+	normals.resize(segmentCount);
+
+	// A vertex has a single position, so it is only written by the segment of that position
+#pragma omp parallel for
+	for (int s = 0; s < segmentCount; ++s)
+	{
+		const uint32_t begin = segments[s];
+		const uint32_t end = segments[s + 1];
+		Vector3 n = faceNormals[corners[begin].index / 3];
+		for (uint32_t i = begin + 1; i < end; ++i)
+		{
+			n += faceNormals[corners[i].index / 3];
+		}
+		normals[normalIndices[s]] = normalize(n);
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			vertices[corners[i].vertexIndex].normalIndex = normalIndices[s];
+		}
+	}
+}
+
+namespace
+{
+	// Per triangle data of the tangent space generation
+	struct TangentTriangle
+	{
+		Vector3 tangent; // Derivative of the position along u, normalized if the triangle has texture area
+		bool orientPreserving;
+		bool groupWithAny; // Without texture area or derivatives, it joins the group of any neighbour and adds nothing to it
+		bool degenerate; // Two welded vertices, it takes the tangent space of another triangle
+	};
+
+	// Triangle corner with the welded vertices of the corner and its neighbours in the triangle
+	struct TangentCorner
+	{
+		uint32_t vertex;
+		uint32_t prev;
+		uint32_t next;
+		uint32_t index; // triangle * 3 + corner
+	};
+
+	uint32_t& cornerVertex(Mesh::Triangle &tri, uint32_t corner)
+	{
+		return corner == 0 ? tri.vertexIndex0 : (corner == 1 ? tri.vertexIndex1 : tri.vertexIndex2);
+	}
+
+	// Zero tests of MikkTSpace, only zeros and denormals are zero
+	bool notZero(float x)
+	{
+		return std::fabs(x) > FLT_MIN;
+	}
+
+	bool notZero(const Vector3 &v)
+	{
+		return notZero(v.x) || notZero(v.y) || notZero(v.z);
+	}
+
+	Vector3 normalizeNotZero(const Vector3 &v)
+	{
+		return notZero(v) ? normalize(v) : v;
+	}
+
+	Vector3 projectNormalized(const Vector3 &v, const Vector3 &n)
+	{
+		return normalizeNotZero(v - n * dot(n, v));
+	}
+}
+
+// Follows the MikkTSpace conventions with its default settings: vertices are welded by value, the
+// triangles around a vertex are grouped through shared edges with the same texture orientation and
+// every group gets the angle weighted average of the triangle tangents projected on the normal plane.
+// Vertices used by more than one group are split, bitangents carry the sign of the group orientation.
+void Mesh::computeTangentSpace()
+{
+	PROFILE_ZONE("Mesh::computeTangentSpace");
+	const int vertexCount = int(vertices.size());
+	const int triangleCount = int(triangles.size());
+
+	auto vertexPosition = [&](uint32_t v) { return positions[vertices[v].positionIndex]; };
+	auto vertexNormal = [&](uint32_t v)
+	{
+		const uint32_t i = vertices[v].normalIndex;
+		return i < normals.size() ? normals[i] : Vector3(0);
+	};
+	auto vertexTexcoord = [&](uint32_t v)
+	{
+		const uint32_t i = vertices[v].texcoordIndex;
+		return i < texcoords.size() ? texcoords[i] : Vector2(0);
+	};
+
+	// Vertices with the same position, normal and texture coordinates are the same vertex.
+	// They are sorted by a hash of their data, only vertices with the same hash are compared.
+	std::vector<uint32_t> weld(vertexCount);
+	{
+		auto sameData = [&](uint32_t a, uint32_t b)
+		{
+			const Vector3 pa = vertexPosition(a), pb = vertexPosition(b);
+			const Vector3 na = vertexNormal(a), nb = vertexNormal(b);
+			const Vector2 ta = vertexTexcoord(a), tb = vertexTexcoord(b);
+			return pa.x == pb.x && pa.y == pb.y && pa.z == pb.z &&
+				na.x == nb.x && na.y == nb.y && na.z == nb.z &&
+				ta.x == tb.x && ta.y == tb.y;
+		};
+
+		std::vector<std::pair<uint64_t, uint32_t> > keys(vertexCount);
+#pragma omp parallel for
+		for (int i = 0; i < vertexCount; ++i)
+		{
+			const Vector3 p = vertexPosition(i);
+			const Vector3 n = vertexNormal(i);
+			const Vector2 t = vertexTexcoord(i);
+			const float values[8] = { p.x, p.y, p.z, n.x, n.y, n.z, t.x, t.y };
+			uint64_t hash = 14695981039346656037ull;
+			for (float value : values)
+			{
+				uint32_t bits = 0;
+				if (value != 0.0f) memcpy(&bits, &value, sizeof(bits)); // -0 and 0 are the same
+				hash = (hash ^ bits) * 1099511628211ull;
+			}
+			keys[i] = std::make_pair(hash, uint32_t(i));
+		}
+		parallelSort(keys, std::less<std::pair<uint64_t, uint32_t> >());
+
+		for (int begin = 0, end = 0; begin < vertexCount; begin = end)
+		{
+			for (end = begin + 1; end < vertexCount && keys[end].first == keys[begin].first; ++end) {}
+			for (int i = begin; i < end; ++i)
+			{
+				const uint32_t v = keys[i].second;
+				weld[v] = v;
+				for (int j = begin; j < i; ++j)
+				{
+					if (weld[keys[j].second] == keys[j].second && sameData(keys[j].second, v))
+					{
+						weld[v] = keys[j].second;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<TangentTriangle> triangleData(triangleCount);
+	std::vector<TangentCorner> triangleCorners(triangleCount * 3);
+
+#pragma omp parallel for
+	for (int t = 0; t < triangleCount; ++t)
+	{
+		const auto &tri = triangles[t];
+		const Vector3 d1 = vertexPosition(tri.vertexIndex1) - vertexPosition(tri.vertexIndex0);
+		const Vector3 d2 = vertexPosition(tri.vertexIndex2) - vertexPosition(tri.vertexIndex0);
+		const Vector2 t21 = vertexTexcoord(tri.vertexIndex1) - vertexTexcoord(tri.vertexIndex0);
+		const Vector2 t31 = vertexTexcoord(tri.vertexIndex2) - vertexTexcoord(tri.vertexIndex0);
+		const float area = t21.x * t31.y - t21.y * t31.x;
+		const Vector3 os = d1 * t31.y - d2 * t21.y;
+		const Vector3 ot = d2 * t21.x - d1 * t31.x;
+		const float lenOs = length(os);
+		const float lenOt = length(ot);
+
+		TangentTriangle &data = triangleData[t];
+		data.orientPreserving = area > 0.0f;
+		data.groupWithAny = true;
+		data.tangent = os;
+		if (notZero(area))
+		{
+			const float absArea = std::fabs(area);
+			if (notZero(lenOs)) data.tangent = os * ((data.orientPreserving ? 1.0f : -1.0f) / lenOs);
+			data.groupWithAny = !notZero(lenOs / absArea) || !notZero(lenOt / absArea);
+		}
+
+		const uint32_t w0 = weld[tri.vertexIndex0];
+		const uint32_t w1 = weld[tri.vertexIndex1];
+		const uint32_t w2 = weld[tri.vertexIndex2];
+		data.degenerate = w0 == w1 || w1 == w2 || w2 == w0;
+		triangleCorners[t * 3 + 0] = TangentCorner{ w0, w2, w1, uint32_t(t * 3 + 0) };
+		triangleCorners[t * 3 + 1] = TangentCorner{ w1, w0, w2, uint32_t(t * 3 + 1) };
+		triangleCorners[t * 3 + 2] = TangentCorner{ w2, w1, w0, uint32_t(t * 3 + 2) };
+	}
+
+	// Corners around every welded vertex are made consecutive in triangle order (a counting sort),
+	// each of these fans is solved on its own
+	std::vector<uint32_t> fanStarts(vertexCount + 1, 0);
+	for (const auto &corner : triangleCorners) ++fanStarts[corner.vertex + 1];
+	for (int i = 0; i < vertexCount; ++i) fanStarts[i + 1] += fanStarts[i];
+	std::vector<TangentCorner> corners(triangleCorners.size());
+	{
+		std::vector<uint32_t> offsets(fanStarts.begin(), fanStarts.end() - 1);
+		for (const auto &corner : triangleCorners) corners[offsets[corner.vertex]++] = corner;
+	}
+	triangleCorners = std::vector<TangentCorner>();
+
+	std::vector<uint32_t> fans;
+	for (int i = 0; i < vertexCount; ++i)
+	{
+		if (fanStarts[i + 1] > fanStarts[i]) fans.push_back(fanStarts[i]);
+	}
+	const int fanCount = int(fans.size());
+	fans.push_back(uint32_t(corners.size()));
+
+	std::vector<Vector3> cornerTangents(corners.size());
+	std::vector<float> cornerSigns(corners.size(), 1.0f);
+
+#pragma omp parallel
+	{
+		std::vector<Vector3> weighted;
+		std::vector<int> groups;
+		std::vector<uint32_t> stack;
+
+#pragma omp for schedule(dynamic, 1024)
+		for (int f = 0; f < fanCount; ++f)
+		{
+			const uint32_t begin = fans[f];
+			const uint32_t count = fans[f + 1] - begin;
+			const TangentCorner *fan = &corners[begin];
+			const Vector3 n = vertexNormal(fan[0].vertex);
+
+			// Angle weighted tangent of every corner, triangles without a tangent add nothing
+			weighted.resize(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const uint32_t t = fan[i].index / 3;
+				if (triangleData[t].groupWithAny)
+				{
+					weighted[i] = Vector3(0);
+					continue;
+				}
+				const uint32_t c = fan[i].index % 3;
+				const auto &tri = triangles[t];
+				const Vector3 p = vertexPosition(c == 0 ? tri.vertexIndex0 : (c == 1 ? tri.vertexIndex1 : tri.vertexIndex2));
+				const Vector3 pPrev = vertexPosition(c == 0 ? tri.vertexIndex2 : (c == 1 ? tri.vertexIndex0 : tri.vertexIndex1));
+				const Vector3 pNext = vertexPosition(c == 0 ? tri.vertexIndex1 : (c == 1 ? tri.vertexIndex2 : tri.vertexIndex0));
+				const Vector3 v1 = projectNormalized(pPrev - p, n);
+				const Vector3 v2 = projectNormalized(pNext - p, n);
+				const float angle = std::acos(std::min(std::max(dot(v1, v2), -1.0f), 1.0f));
+				weighted[i] = projectNormalized(triangleData[t].tangent, n) * angle;
+			}
+
+			// Groups of triangles connected by an edge around the vertex with the same orientation
+			groups.assign(count, -1);
+			int groupCount = 0;
+			int firstGroup = -1;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (groups[i] >= 0 || triangleData[fan[i].index / 3].degenerate) continue;
+
+				const int group = groupCount++;
+				const TangentTriangle &first = triangleData[fan[i].index / 3];
+				bool orientPreserving = first.orientPreserving;
+				bool orientKnown = !first.groupWithAny;
+				Vector3 tangent(0);
+
+				groups[i] = group;
+				stack.push_back(i);
+				while (!stack.empty())
+				{
+					const uint32_t j = stack.back();
+					stack.pop_back();
+					tangent += weighted[j];
+					for (uint32_t k = 0; k < count; ++k)
+					{
+						if (groups[k] >= 0) continue;
+						const TangentTriangle &data = triangleData[fan[k].index / 3];
+						if (data.degenerate) continue;
+						if (fan[j].next != fan[k].prev && fan[j].prev != fan[k].next) continue;
+						if (!data.groupWithAny && orientKnown && data.orientPreserving != orientPreserving) continue;
+						if (!data.groupWithAny && !orientKnown)
+						{
+							orientPreserving = data.orientPreserving;
+							orientKnown = true;
+						}
+						groups[k] = group;
+						stack.push_back(k);
+					}
+				}
+
+				tangent = normalizeNotZero(tangent);
+				for (uint32_t k = 0; k < count; ++k)
+				{
+					if (groups[k] != group) continue;
+					cornerTangents[fan[k].index] = tangent;
+					cornerSigns[fan[k].index] = orientPreserving ? 1.0f : -1.0f;
+				}
+				if (firstGroup < 0) firstGroup = int(i);
+			}
+
+			// Degenerate triangles take the tangent space of the first valid corner of the vertex
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (groups[i] >= 0 || firstGroup < 0) continue;
+				cornerTangents[fan[i].index] = cornerTangents[fan[firstGroup].index];
+				cornerSigns[fan[i].index] = cornerSigns[fan[firstGroup].index];
+			}
+		}
+	}
+
+	// Corners of a vertex with different tangent spaces get their own copies of the vertex
+	tangents.clear();
+	bitangents.clear();
+	tangents.resize(vertexCount);
+	bitangents.resize(vertexCount);
+	std::vector<float> signs(vertexCount, 0.0f);
+	std::vector<uint32_t> copies(vertexCount, UINT32_MAX);
+	for (int t = 0; t < triangleCount; ++t)
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			uint32_t &vertexIndex = cornerVertex(triangles[t], c);
+			const Vector3 tangent = cornerTangents[t * 3 + c];
+			const float sign = cornerSigns[t * 3 + c];
+			uint32_t v = vertexIndex;
+			while (signs[v] != 0.0f &&
+				(tangents[v].x != tangent.x || tangents[v].y != tangent.y || tangents[v].z != tangent.z || signs[v] != sign))
+			{
+				if (copies[v] == UINT32_MAX)
+				{
+					copies[v] = uint32_t(vertices.size());
+					vertices.push_back(vertices[vertexIndex]);
+					tangents.push_back(Vector3(0));
+					bitangents.push_back(Vector3(0));
+					signs.push_back(0.0f);
+					copies.push_back(UINT32_MAX);
+				}
+				v = copies[v];
+			}
+			if (signs[v] == 0.0f)
+			{
+				tangents[v] = tangent;
+				bitangents[v] = cross(vertexNormal(v), tangent) * sign;
+				signs[v] = sign;
+			}
+			vertexIndex = v;
+		}
 	}
 }
 
@@ -25,6 +25,7 @@ SOFTWARE.
 
 #include "math.h"
 #include <cstdint>
+#include <string>
 #include <vector>
 
 struct IntersectResult
@@ -33,6 +34,19 @@ struct IntersectResult
 	float distance;
 };
 
+/// Receives the geometry of a mesh file as it is decoded, for the meshes that are only traced and never need
+/// a Mesh. The positions and normals come with their index, the triangles with the positions and normals of
+/// their corners (UINT32_MAX for a corner without a normal). Triangles can come before the data they index.
+class MeshGeometrySink
+{
+public:
+	virtual ~MeshGeometrySink() {}
+	virtual void reserve(size_t positionCount, size_t normalCount, size_t triangleCount) = 0;
+	virtual void position(size_t index, const Vector3 &position) = 0;
+	virtual void normal(size_t index, const Vector3 &normal) = 0;
+	virtual void triangle(const uint32_t positions[3], const uint32_t normals[3]) = 0;
+};
+
 class Mesh
 {
 public:
@@ -50,6 +64,14 @@ public:
 		uint32_t vertexIndex2;
 	};
 
+	/// Named range of triangles, the groups and objects of Wavefront OBJ files
+	struct Group
+	{
+		std::string name;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+	};
+
 	std::vector<Vector3> positions;
 	std::vector<Vector2> texcoords;
 	std::vector<Vector3> normals;
@@ -57,22 +79,38 @@ public:
 	std::vector<Vector3> bitangents;
 	std::vector<Vertex> vertices;
 	std::vector<Triangle> triangles;
+	std::vector<Group> groups; // Empty if the file doesn't name any
 
 public:
-	static Mesh* loadWavefrontObj(const char *path);
+	/// Face vertices with the same position, texture coordinate and normal are shared if welded
+	static Mesh* loadWavefrontObj(const char *path, bool weldVertices = true);
 	static Mesh* loadPly(const char *path);
-	static Mesh* loadFile(const char *path);
+	/// Native binary format (.fmesh) with the arrays stored as laid out in memory.
+	/// Nothing is parsed, every array is copied once out of the mapped file.
+	static Mesh* loadFmesh(const char *path);
+	/// glTF 2.0 (.gltf and .glb), the triangles of every mesh in the default scene are merged
+	static Mesh* loadGltf(const char *path);
+	/// @param weldVertices Only used by Wavefront OBJ files, see loadWavefrontObj
+	static Mesh* loadFile(const char *path, bool weldVertices = true);
+
+	/// True for the files readGeometry can decode: PLY and .fmesh
+	static bool readsGeometry(const char *path);
+	/// Decodes the positions, normals and triangles of a file without building a Mesh, the texture coordinates,
+	/// tangents and groups are skipped. False if the file can't be read or its format isn't supported.
+	static bool readGeometry(const char *path, MeshGeometrySink &sink);
 	static Mesh* createCopy(const Mesh *mesh);
 
+	bool saveFmesh(const char *path) const;
+
 	void computeFaceNormals();
 	void computeVertexNormals();
 	void computeVertexNormalsAggressive();
+	/// MikkTSpace compatible tangent space per vertex, vertices shared by different tangent spaces are split
 	void computeTangentSpace();
 
 	bool intersect(const Vector3 &o, const Vector3 &d, IntersectResult &o_result) const;
 	void intersectAll(const Vector3 *origins, const Vector3 *directions, IntersectResult *o_results, size_t count) const;
-
-private:
+	/// Ray against a single triangle, the direction doesn't need to be normalized
 	bool intersect(const Vector3 &o, const Vector3 &d, const uint32_t tidx, IntersectResult &o_result) const;
 };
 
@@ -22,13 +22,23 @@ SOFTWARE.
 
 #include "meshmapping.h"
 #include "bvh.h"
+#include "compactmesh.h"
 #include "computeshaders.h"
+#include "gpustats.h"
+#include "instancedmesh.h"
 #include "logging.h"
+#include "mappedfile.h"
 #include "mesh.h"
+#include "profiler.h"
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024 * 2;
 
 namespace
 {
@@ -59,12 +69,14 @@ namespace
 		return pixels;
 	}
 
+	// Flattens the BVH in depth first order, the triangles are listed in the order their corners are uploaded.
+	// Node ranges count stride elements per triangle: its three corners, or one for the instances of a top level BVH.
 	void fillMeshData(
-		const Mesh *mesh,
 		const BVH& bvh,
 		std::vector<BVHGPUData> &bvhs,
-		std::vector<Vector4> &positions,
-		std::vector<Vector4> &normals)
+		std::vector<uint32_t> &triangles,
+		uint32_t &maxLeafSize,
+		uint32_t stride = 3)
 	{
 		if (bvh.children.empty() &&
 			bvh.triangles.empty())
@@ -81,12 +93,12 @@ namespace
 			// for nothing
 			if (bvh.children[0].subtreeTriangleCount > 0 && bvh.children[1].subtreeTriangleCount == 0)
 			{
-				fillMeshData(mesh, bvh.children[0], bvhs, positions, normals);
+				fillMeshData(bvh.children[0], bvhs, triangles, maxLeafSize, stride);
 				return;
 			}
 			if (bvh.children[1].subtreeTriangleCount > 0 && bvh.children[0].subtreeTriangleCount == 0)
 			{
-				fillMeshData(mesh, bvh.children[1], bvhs, positions, normals);
+				fillMeshData(bvh.children[1], bvhs, triangles, maxLeafSize, stride);
 				return;
 			}
 		}
@@ -96,30 +108,16 @@ namespace
 		BVHGPUData &d = bvhs.back();
 		d.aabbMin = bvh.aabb.center - bvh.aabb.size;
 		d.aabbMax = bvh.aabb.center + bvh.aabb.size;
-		d.start = (uint32_t)positions.size();
-		for (uint32_t tidx : bvh.triangles)
-		{
-			const auto &tri = mesh->triangles[tidx];
-			const auto &v0 = mesh->vertices[tri.vertexIndex0];
-			const auto &v1 = mesh->vertices[tri.vertexIndex1];
-			const auto &v2 = mesh->vertices[tri.vertexIndex2];
-			const auto p0 = mesh->positions[v0.positionIndex];
-			const auto p1 = mesh->positions[v1.positionIndex];
-			const auto p2 = mesh->positions[v2.positionIndex];
-			positions.push_back(p0);
-			positions.push_back(p1);
-			positions.push_back(p2);
-			normals.push_back(mesh->normals[v0.normalIndex]);
-			normals.push_back(mesh->normals[v1.normalIndex]);
-			normals.push_back(mesh->normals[v2.normalIndex]);
-		}
-		d.end = (uint32_t)positions.size();
+		d.start = (uint32_t)triangles.size() * stride;
+		triangles.insert(triangles.end(), bvh.triangles.begin(), bvh.triangles.end());
+		d.end = (uint32_t)triangles.size() * stride;
+		if (bvh.triangles.size() > maxLeafSize) maxLeafSize = (uint32_t)bvh.triangles.size();
 
 		const size_t index = bvhs.size() - 1; // Because d gets invalidated by fillMeshData!
 		if (bvh.children.size() > 0)
 		{
-			fillMeshData(mesh, bvh.children[0], bvhs, positions, normals);
-			fillMeshData(mesh, bvh.children[1], bvhs, positions, normals);
+			fillMeshData(bvh.children[0], bvhs, triangles, maxLeafSize, stride);
+			fillMeshData(bvh.children[1], bvhs, triangles, maxLeafSize, stride);
 		}
 		bvhs[index].jump = (uint32_t)bvhs.size();
 	}
@@ -133,6 +131,191 @@ void MeshMapping::init
 	bool cullBackfaces
 )
 {
+	PROFILE_ZONE("MeshMapping::init");
+	initMesh(mesh.get(), *rootBVH, cullBackfaces);
+	setMap(map);
+}
+
+void MeshMapping::initMesh(const Mesh *mesh, const BVH &rootBVH, bool cullBackfaces)
+{
+	PROFILE_ZONE("MeshMapping::initMesh");
+
+	std::vector<uint32_t> triangles;
+	initBVH(rootBVH, triangles);
+	uploadMesh(mesh, triangles);
+	initProgram(cullBackfaces);
+}
+
+void MeshMapping::initMesh(const InstancedMesh *mesh, bool cullBackfaces)
+{
+	PROFILE_ZONE("MeshMapping::initMesh");
+	assert(mesh->instanceBVH);
+
+	// Every part BVH is flattened once, its nodes jump to absolute indices so they share the buffer
+	std::vector<BVHGPUData> bvhs;
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> partNodes(mesh->parts.size() * 2);
+	_bvhLeafSize = 0;
+	for (size_t i = 0; i < mesh->parts.size(); ++i)
+	{
+		partNodes[i * 2 + 0] = (uint32_t)bvhs.size();
+		fillMeshData(*mesh->partBVHs[i], bvhs, triangles, _bvhLeafSize);
+		partNodes[i * 2 + 1] = (uint32_t)bvhs.size();
+	}
+	_bvh = std::shared_ptr<ComputeBuffer<BVHGPUData> >(
+		new ComputeBuffer<BVHGPUData>(&bvhs[0], bvhs.size(), GL_STATIC_DRAW));
+	uploadMesh(&mesh->mesh, triangles);
+
+	// The instances are uploaded in the order the top level leaves list them
+	std::vector<BVHGPUData> instanceBvhs;
+	std::vector<uint32_t> order;
+	uint32_t maxInstances = 0;
+	fillMeshData(*mesh->instanceBVH, instanceBvhs, order, maxInstances, 1);
+	std::vector<InstanceGPUData> instances(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const InstancedMesh::Instance &instance = mesh->instances[order[i]];
+		const Transform inverse = instance.transform.inverse();
+		InstanceGPUData &data = instances[i];
+		for (int r = 0; r < 3; ++r)
+		{
+			const float *m = instance.transform.m + r * 4;
+			const float *n = inverse.m + r * 4;
+			data.partToWorld[r].x = m[0]; data.partToWorld[r].y = m[1]; data.partToWorld[r].z = m[2]; data.partToWorld[r].w = m[3];
+			data.worldToPart[r].x = n[0]; data.worldToPart[r].y = n[1]; data.worldToPart[r].z = n[2]; data.worldToPart[r].w = n[3];
+		}
+		data.bvhStart = partNodes[instance.part * 2 + 0];
+		data.bvhEnd = partNodes[instance.part * 2 + 1];
+		data.facing = instance.transform.determinant() < 0.0f ? -1.0f : 1.0f;
+		data._pad0 = 0.0f;
+	}
+	_instanceBvh = std::shared_ptr<ComputeBuffer<BVHGPUData> >(
+		new ComputeBuffer<BVHGPUData>(&instanceBvhs[0], instanceBvhs.size(), GL_STATIC_DRAW));
+	_instances = std::shared_ptr<ComputeBuffer<InstanceGPUData> >(
+		new ComputeBuffer<InstanceGPUData>(&instances[0], instances.size(), GL_STATIC_DRAW));
+
+	initProgram(cullBackfaces);
+}
+
+void MeshMapping::uploadMesh(const Mesh *mesh, const std::vector<uint32_t> &triangles)
+{
+	const int count = (int)triangles.size();
+	std::vector<Vector4> positions(triangles.size() * 3);
+	std::vector<Vector4> normals(triangles.size() * 3);
+#pragma omp parallel for
+	for (int i = 0; i < count; ++i)
+	{
+		const auto &tri = mesh->triangles[triangles[i]];
+		const uint32_t vidx[3] = { tri.vertexIndex0, tri.vertexIndex1, tri.vertexIndex2 };
+		for (int c = 0; c < 3; ++c)
+		{
+			const auto &v = mesh->vertices[vidx[c]];
+			positions[i * 3 + c] = mesh->positions[v.positionIndex];
+			normals[i * 3 + c] = mesh->normals[v.normalIndex];
+		}
+	}
+	_meshPositions = std::shared_ptr<ComputeBuffer<Vector4> >(
+		new ComputeBuffer<Vector4>(&positions[0], positions.size(), GL_STATIC_DRAW));
+	_meshNormals = std::shared_ptr<ComputeBuffer<Vector4> >(
+		new ComputeBuffer<Vector4>(&normals[0], normals.size(), GL_STATIC_DRAW));
+	_meshCompactPositions.reset();
+	_meshCompactNormals.reset();
+}
+
+void MeshMapping::initMesh(const CompactMesh *mesh, const BVH &rootBVH, bool cullBackfaces)
+{
+	PROFILE_ZONE("MeshMapping::initMesh");
+
+	std::vector<uint32_t> triangles;
+	initBVH(rootBVH, triangles);
+
+	// Positions are split in two words (uvec2 in the shaders), x | y << 21 | z << 42 as stored in the mesh
+	const int count = (int)triangles.size();
+	std::vector<uint32_t> positions(triangles.size() * 6);
+	std::vector<uint32_t> normals(triangles.size() * 3);
+#pragma omp parallel for
+	for (int i = 0; i < count; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			const uint64_t q = mesh->positions[mesh->positionIndex(triangles[i], c)];
+			positions[(i * 3 + c) * 2 + 0] = (uint32_t)q;
+			positions[(i * 3 + c) * 2 + 1] = (uint32_t)(q >> 32);
+			normals[i * 3 + c] = mesh->normals[mesh->normalIndex(triangles[i], c)];
+		}
+	}
+	_meshCompactPositions = std::shared_ptr<ComputeBuffer<uint32_t> >(
+		new ComputeBuffer<uint32_t>(&positions[0], positions.size(), GL_STATIC_DRAW));
+	_meshCompactNormals = std::shared_ptr<ComputeBuffer<uint32_t> >(
+		new ComputeBuffer<uint32_t>(&normals[0], normals.size(), GL_STATIC_DRAW));
+	_meshOrigin = mesh->origin;
+	_meshScale = mesh->scale;
+	_meshPositions.reset();
+	_meshNormals.reset();
+
+	initProgram(cullBackfaces);
+}
+
+void MeshMapping::initBVH(const BVH &rootBVH, std::vector<uint32_t> &triangles)
+{
+	std::vector<BVHGPUData> bvhs;
+	_bvhLeafSize = 0;
+	fillMeshData(rootBVH, bvhs, triangles, _bvhLeafSize);
+	_bvh = std::shared_ptr<ComputeBuffer<BVHGPUData> >(
+		new ComputeBuffer<BVHGPUData>(&bvhs[0], bvhs.size(), GL_STATIC_DRAW));
+	_instanceBvh.reset();
+	_instances.reset();
+}
+
+void MeshMapping::initProgram(bool cullBackfaces)
+{
+	ComputeShaderDefines defines;
+	defines.define("CULL_BACKFACES", cullBackfaces);
+	defines.define("BVH_LEAF_SIZE", _bvhLeafSize);
+	defineMeshFormat(defines);
+	_program = LoadComputeShader_MeshMapping(defines);
+}
+
+void MeshMapping::defineMeshFormat(ComputeShaderDefines &defines) const
+{
+	if (_meshCompactPositions)
+	{
+		defines.define("COMPACT_MESH", true);
+		defines.define("MESH_ORIGIN", _meshOrigin);
+		defines.define("MESH_SCALE", _meshScale);
+	}
+	if (_instances)
+	{
+		defines.define("INSTANCED_MESH", true);
+	}
+}
+
+void MeshMapping::init(std::shared_ptr<const CompressedMapUV> map, const MeshMapping &meshSource)
+{
+	PROFILE_ZONE("MeshMapping::init");
+	_meshPositions = meshSource._meshPositions;
+	_meshNormals = meshSource._meshNormals;
+	_meshCompactPositions = meshSource._meshCompactPositions;
+	_meshCompactNormals = meshSource._meshCompactNormals;
+	_meshOrigin = meshSource._meshOrigin;
+	_meshScale = meshSource._meshScale;
+	_bvh = meshSource._bvh;
+	_instanceBvh = meshSource._instanceBvh;
+	_instances = meshSource._instances;
+	_bvhLeafSize = meshSource._bvhLeafSize;
+	_program = meshSource._program;
+	setMap(map);
+}
+
+void MeshMapping::setMap(std::shared_ptr<const CompressedMapUV> map)
+{
+	// Release the previous map before allocating the new one
+	_pixels.reset();
+	_pixelst.reset();
+	_coords.reset();
+	_tidx.reset();
+	_instanceIdx.reset();
+
 	// Pixels data
 	{
 		auto pixels = computePixels(map.get());
@@ -148,21 +331,8 @@ void MeshMapping::init
 		}
 	}
 
-	// Mesh data
-	{
-		std::vector<BVHGPUData> bvhs;
-		std::vector<Vector4> positions;
-		std::vector<Vector4> normals;
-		fillMeshData(mesh.get(), *rootBVH, bvhs, positions, normals);
-		_meshPositions = std::unique_ptr<ComputeBuffer<Vector4> >(
-			new ComputeBuffer<Vector4>(&positions[0], positions.size(), GL_STATIC_DRAW));
-		_meshNormals = std::unique_ptr<ComputeBuffer<Vector4> >(
-			new ComputeBuffer<Vector4>(&normals[0], normals.size(), GL_STATIC_DRAW));
-		_bvh = std::unique_ptr<ComputeBuffer<BVHGPUData> >(
-			new ComputeBuffer<BVHGPUData>(&bvhs[0], bvhs.size(), GL_STATIC_DRAW));
-	}
-
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
+	_workSize.reset(new StepWorkSize(k_groupSize, k_maxWorkPerStep));
 
 	// Results data
 	{
@@ -170,16 +340,13 @@ void MeshMapping::init
 			new ComputeBuffer<Vector4>(_workCount, GL_STATIC_DRAW));
 		_tidx = std::unique_ptr<ComputeBuffer<uint32_t> >(
 			new ComputeBuffer<uint32_t>(_workCount, GL_STATIC_DRAW));
+		if (_instances)
+		{
+			_instanceIdx = std::unique_ptr<ComputeBuffer<uint32_t> >(
+				new ComputeBuffer<uint32_t>(_workCount, GL_STATIC_DRAW));
+		}
 	}
 
-	// Shader
-	{
-		_program = LoadComputeShader_MeshMapping();
-		_programCullBackfaces = LoadComputeShader_MeshMappingCullBackfaces();
-	}
-
-	_cullBackfaces = cullBackfaces;
-
 	_workOffset = 0;
 }
 
@@ -187,41 +354,305 @@ bool MeshMapping::runStep()
 {
 	assert(_workOffset < _workCount);
 	const size_t workLeft = _workCount - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
-	if (_cullBackfaces) glUseProgram(_programCullBackfaces);
-	else glUseProgram(_program);
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
+	glUseProgram(_program);
 
 	glUniform1ui(1, (GLuint)_workOffset);
 	glUniform1ui(2, (GLuint)_coords->size());
 	glUniform1ui(3, (GLuint)_bvh->size());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _pixels->bo());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshPositions->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, meshPositions());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _bvh->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _coords->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _tidx->bo());
+	if (_instances)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _instanceBvh->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, _instances->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, _instanceIdx->bo());
+	}
 
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+	// Every texel casts a ray forward and another backward
+	gpuDispatchCompute("Mesh mapping", (GLuint)(work / k_groupSize), work * 2);
+	_workSize->endStep();
 
 	_workOffset += work;
 
 	if (_workOffset == _workCount)
 	{
 		_timing.end();
-		logDebug("MeshMap", "Mesh mapping took " + std::to_string(_timing.elapsedSeconds()) + " seconds.");
+		logDebug("MeshMap", "Mesh mapping took " + std::to_string(_timing.elapsedSeconds()) + " seconds in " +
+			std::to_string(_workSize->stepCount()) + " steps.");
 	}
 
 	return _workOffset >= _workCount;
 }
 
+namespace
+{
+	static const uint32_t k_cacheMagic = 0x50414d46; // "FMAP" in a little endian file
+	static const uint32_t k_cacheVersion = 2;
+
+	/// The header is followed by the arrays, in this order and without padding: the map (positions, directions,
+	/// normals, tangents, bitangents, indices and weights), the mapping results (coords, tidx and instance index)
+	/// and the mesh as uploaded (positions, normals, compact positions, compact normals, BVH, instance BVH and instances).
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint64_t sourceSizes[2];
+		int64_t sourceModified[2];
+		uint32_t width;
+		uint32_t height;
+		uint32_t bvhLeafSize;
+		uint32_t _pad0;
+		Vector3 meshOrigin;
+		Vector3 meshScale;
+		uint64_t counts[17];
+	};
+
+	template <typename T>
+	bool writeArray(FILE *f, const std::vector<T> &v)
+	{
+		return v.empty() || fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+	}
+
+	template <typename T>
+	bool readArray(const char *&ptr, const char *end, uint64_t count, std::vector<T> &o_v)
+	{
+		if (count > (uint64_t)(end - ptr) / sizeof(T)) return false;
+		const T *data = reinterpret_cast<const T*>(ptr);
+		o_v.assign(data, data + count);
+		ptr += count * sizeof(T);
+		return true;
+	}
+
+	template <typename T>
+	std::vector<T> readBuffer(const ComputeBuffer<T> *buffer)
+	{
+		std::vector<T> data;
+		if (!buffer) return data;
+		data.resize(buffer->size());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer->bo());
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(T) * data.size(), data.data());
+		return data;
+	}
+
+	template <typename T, typename Ptr>
+	void createBuffer(const std::vector<T> &data, Ptr &o_buffer)
+	{
+		if (data.empty()) o_buffer.reset();
+		else o_buffer.reset(new ComputeBuffer<T>(data.data(), data.size(), GL_STATIC_DRAW));
+	}
+}
+
+MeshMappingCacheData* MeshMapping::readCacheData() const
+{
+	PROFILE_ZONE("MeshMapping::readCacheData");
+	assert(_workOffset >= _workCount);
+
+	std::unique_ptr<MeshMappingCacheData> data(new MeshMappingCacheData());
+	data->bvhLeafSize = _bvhLeafSize;
+	data->meshOrigin = _meshOrigin;
+	data->meshScale = _meshScale;
+	data->coords = readBuffer(_coords.get());
+	data->tidx = readBuffer(_tidx.get());
+	data->instanceIdx = readBuffer(_instanceIdx.get());
+	data->meshPositions = readBuffer(_meshPositions.get());
+	data->meshNormals = readBuffer(_meshNormals.get());
+	data->meshCompactPositions = readBuffer(_meshCompactPositions.get());
+	data->meshCompactNormals = readBuffer(_meshCompactNormals.get());
+	data->bvh = readBuffer(_bvh.get());
+	data->instanceBvh = readBuffer(_instanceBvh.get());
+	data->instances = readBuffer(_instances.get());
+	gpuStatsReadBack("Mapping cache", sizeof(Vector4) * data->coords.size() +
+		sizeof(uint32_t) * (data->tidx.size() + data->instanceIdx.size()));
+	return data.release();
+}
+
+bool MeshMapping::saveCache(const char *path, uint64_t key, const MeshMappingSources &sources, const CompressedMapUV &map, const MeshMappingCacheData &data)
+{
+	PROFILE_ZONE("MeshMapping::saveCache");
+
+	// Written next to the cache and renamed once complete, the bakes reading the cache never see a partial file.
+	// The name is unique to the thread, the runners of a bake server can save the same cache.
+	const std::string tempPath = std::string(path) + "." +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	FILE *f = fopen(tempPath.c_str(), "wb");
+	if (!f) return false;
+
+	CacheHeader header{};
+	header.magic = k_cacheMagic;
+	header.version = k_cacheVersion;
+	header.key = key;
+	memcpy(header.sourceSizes, sources.sizes, sizeof(header.sourceSizes));
+	memcpy(header.sourceModified, sources.modified, sizeof(header.sourceModified));
+	header.width = map.width;
+	header.height = map.height;
+	header.bvhLeafSize = data.bvhLeafSize;
+	header.meshOrigin = data.meshOrigin;
+	header.meshScale = data.meshScale;
+	const uint64_t counts[] =
+	{
+		map.positions.size(), map.directions.size(), map.normals.size(), map.tangents.size(), map.bitangents.size(),
+		map.indices.size(), map.weights.size(),
+		data.coords.size(), data.tidx.size(), data.instanceIdx.size(),
+		data.meshPositions.size(), data.meshNormals.size(), data.meshCompactPositions.size(), data.meshCompactNormals.size(),
+		data.bvh.size(), data.instanceBvh.size(), data.instances.size(),
+	};
+	static_assert(sizeof(counts) == sizeof(header.counts), "Every array needs its count in the header");
+	memcpy(header.counts, counts, sizeof(counts));
+
+	const bool ok =
+		fwrite(&header, sizeof(header), 1, f) == 1 &&
+		writeArray(f, map.positions) &&
+		writeArray(f, map.directions) &&
+		writeArray(f, map.normals) &&
+		writeArray(f, map.tangents) &&
+		writeArray(f, map.bitangents) &&
+		writeArray(f, map.indices) &&
+		writeArray(f, map.weights) &&
+		writeArray(f, data.coords) &&
+		writeArray(f, data.tidx) &&
+		writeArray(f, data.instanceIdx) &&
+		writeArray(f, data.meshPositions) &&
+		writeArray(f, data.meshNormals) &&
+		writeArray(f, data.meshCompactPositions) &&
+		writeArray(f, data.meshCompactNormals) &&
+		writeArray(f, data.bvh) &&
+		writeArray(f, data.instanceBvh) &&
+		writeArray(f, data.instances);
+	const bool closed = fclose(f) == 0;
+	if (ok && closed && replaceFile(tempPath.c_str(), path)) return true;
+	remove(tempPath.c_str());
+	return false;
+}
+
+MeshMappingCacheData* MeshMapping::readCache(const char *path, uint64_t key, const MeshMappingSources &sources, std::shared_ptr<CompressedMapUV> &o_map)
+{
+	PROFILE_ZONE("MeshMapping::readCache");
+
+	MappedFile file(path);
+	if (!file.valid() || file.size() < sizeof(CacheHeader)) return nullptr;
+
+	CacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != k_cacheMagic || header.version != k_cacheVersion || header.key != key) return nullptr;
+	if (memcmp(header.sourceSizes, sources.sizes, sizeof(header.sourceSizes)) != 0 ||
+		memcmp(header.sourceModified, sources.modified, sizeof(header.sourceModified)) != 0)
+	{
+		return nullptr;
+	}
+
+	const char *ptr = file.data() + sizeof(header);
+	const char *end = file.data() + file.size();
+	const uint64_t *counts = header.counts;
+	std::shared_ptr<CompressedMapUV> map(new CompressedMapUV(header.width, header.height));
+	std::unique_ptr<MeshMappingCacheData> data(new MeshMappingCacheData());
+	if (!readArray(ptr, end, counts[0], map->positions) ||
+		!readArray(ptr, end, counts[1], map->directions) ||
+		!readArray(ptr, end, counts[2], map->normals) ||
+		!readArray(ptr, end, counts[3], map->tangents) ||
+		!readArray(ptr, end, counts[4], map->bitangents) ||
+		!readArray(ptr, end, counts[5], map->indices) ||
+		!readArray(ptr, end, counts[6], map->weights) ||
+		!readArray(ptr, end, counts[7], data->coords) ||
+		!readArray(ptr, end, counts[8], data->tidx) ||
+		!readArray(ptr, end, counts[9], data->instanceIdx) ||
+		!readArray(ptr, end, counts[10], data->meshPositions) ||
+		!readArray(ptr, end, counts[11], data->meshNormals) ||
+		!readArray(ptr, end, counts[12], data->meshCompactPositions) ||
+		!readArray(ptr, end, counts[13], data->meshCompactNormals) ||
+		!readArray(ptr, end, counts[14], data->bvh) ||
+		!readArray(ptr, end, counts[15], data->instanceBvh) ||
+		!readArray(ptr, end, counts[16], data->instances))
+	{
+		return nullptr;
+	}
+	// The arrays are uploaded and indexed by texel as they are, a file that doesn't match its header is rejected
+	const size_t count = map->positions.size();
+	const bool tangentSpace = !map->tangents.empty();
+	if (count == 0 ||
+		map->directions.size() != count ||
+		map->normals.size() != count ||
+		map->tangents.size() != (tangentSpace ? count : 0) ||
+		map->bitangents.size() != (tangentSpace ? count : 0) ||
+		map->indices.size() != count ||
+		(!map->weights.empty() && map->weights.size() != count))
+	{
+		return nullptr;
+	}
+	const uint64_t texelCount = (uint64_t)map->width * map->height;
+	for (const uint32_t index : map->indices)
+	{
+		if (index >= texelCount) return nullptr;
+	}
+	const size_t workCount = ((count + k_groupSize - 1) / k_groupSize) * k_groupSize;
+	if (data->coords.size() != workCount || data->tidx.size() != workCount || data->bvh.empty()) return nullptr;
+	data->bvhLeafSize = header.bvhLeafSize;
+	data->meshOrigin = header.meshOrigin;
+	data->meshScale = header.meshScale;
+
+	// Only the results and the tangent space are read by the solvers, the pixels are left out
+	if (!map->tangents.empty()) data->pixelst = computePixelsT(map.get());
+
+	o_map = map;
+	return data.release();
+}
+
+MeshMapping* MeshMapping::createFromCache(const MeshMappingCacheData &data, bool cullBackfaces)
+{
+	PROFILE_ZONE("MeshMapping::createFromCache");
+
+	std::unique_ptr<MeshMapping> meshMapping(new MeshMapping());
+	createBuffer(data.meshPositions, meshMapping->_meshPositions);
+	createBuffer(data.meshNormals, meshMapping->_meshNormals);
+	createBuffer(data.meshCompactPositions, meshMapping->_meshCompactPositions);
+	createBuffer(data.meshCompactNormals, meshMapping->_meshCompactNormals);
+	meshMapping->_meshOrigin = data.meshOrigin;
+	meshMapping->_meshScale = data.meshScale;
+	createBuffer(data.bvh, meshMapping->_bvh);
+	createBuffer(data.instanceBvh, meshMapping->_instanceBvh);
+	createBuffer(data.instances, meshMapping->_instances);
+	meshMapping->_bvhLeafSize = data.bvhLeafSize;
+	meshMapping->initProgram(cullBackfaces);
+
+	createBuffer(data.pixelst, meshMapping->_pixelst);
+	createBuffer(data.coords, meshMapping->_coords);
+	createBuffer(data.tidx, meshMapping->_tidx);
+	createBuffer(data.instanceIdx, meshMapping->_instanceIdx);
+	meshMapping->_workCount = data.coords.size();
+	meshMapping->_workOffset = data.coords.size();
+	return meshMapping.release();
+}
+
 MeshMappingTask::MeshMappingTask(std::shared_ptr<MeshMapping> meshmapping)
 	: _meshMapping(meshmapping)
 {
 }
 
+MeshMappingTask::MeshMappingTask
+(
+	std::shared_ptr<MeshMapping> meshmapping,
+	std::shared_ptr<const CompressedMapUV> map,
+	const std::string &cachePath,
+	uint64_t cacheKey,
+	const MeshMappingSources &cacheSources
+)
+	: _meshMapping(meshmapping)
+	, _cacheMap(map)
+	, _cachePath(cachePath)
+	, _cacheKey(cacheKey)
+	, _cacheSources(cacheSources)
+{
+}
+
 MeshMappingTask::~MeshMappingTask()
 {
 }
@@ -235,6 +666,15 @@ bool MeshMappingTask::runStep()
 void MeshMappingTask::finish()
 {
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	if (!_cachePath.empty()) _cacheData.reset(_meshMapping->readCacheData());
+}
+
+void MeshMappingTask::exportResults()
+{
+	if (!_cacheData) return;
+	if (MeshMapping::saveCache(_cachePath.c_str(), _cacheKey, _cacheSources, *_cacheMap, *_cacheData)) logDebug("Cache", "Mesh mapping saved to " + _cachePath);
+	else logError("Cache", "Cannot write the mesh mapping cache " + _cachePath);
+	_cacheData.reset();
 }
 
 float MeshMappingTask::progress() const
@@ -5,10 +5,16 @@
 #include "fornos.h"
 #include "math.h"
 #include "timing.h"
+#include "worksize.h"
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 struct CompressedMapUV;
+class CompactMesh;
+class ComputeShaderDefines;
+class InstancedMesh;
 class Mesh;
 class BVH;
 
@@ -39,38 +45,127 @@ struct BVHGPUData
 	BVHGPUData() : aabbMin(), aabbMax(), start(0), end(0), jump(0) {}
 };
 
+struct InstanceGPUData
+{
+	Vector4 worldToPart[3]; // Rows of the affine transforms
+	Vector4 partToWorld[3];
+	uint32_t bvhStart, bvhEnd; // Nodes of the part in the mesh BVH
+	float facing; // -1 for mirrored instances, their triangles are wound the other way
+	float _pad0;
+};
+
+/// Sizes and modification times of the mesh files a mapping cache is built from. A cache isn't loaded if its
+/// files changed since it was written, even if their contents hash to the same key.
+struct MeshMappingSources
+{
+	uint64_t sizes[2] = {}; // Low and high poly mesh files
+	int64_t modified[2] = {};
+};
+
+/// Mapping results and mesh data of a mapping cache, read back from the GPU for saveCache or read from a file
+struct MeshMappingCacheData
+{
+	uint32_t bvhLeafSize;
+	Vector3 meshOrigin;
+	Vector3 meshScale;
+	std::vector<Vector4> coords;
+	std::vector<uint32_t> tidx;
+	std::vector<uint32_t> instanceIdx;
+	std::vector<Vector4> meshPositions;
+	std::vector<Vector4> meshNormals;
+	std::vector<uint32_t> meshCompactPositions;
+	std::vector<uint32_t> meshCompactNormals;
+	std::vector<BVHGPUData> bvh;
+	std::vector<BVHGPUData> instanceBvh;
+	std::vector<InstanceGPUData> instances;
+	std::vector<PixT_GPUData> pixelst; // Tangent space of the mapped pixels, only computed when read from a file
+};
+
 class MeshMapping
 {
 public:
 	void init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<const Mesh> mesh, std::shared_ptr<const BVH> rootBVH, bool cullBackfaces = false);
+
+	/// Uploads the mesh in the BVH order without any pixels to map yet, setMap or other mappings init from it
+	void initMesh(const Mesh *mesh, const BVH &rootBVH, bool cullBackfaces = false);
+
+	/// Uploads the compact mesh as it is: quantized positions and octahedral normals per triangle corner
+	void initMesh(const CompactMesh *mesh, const BVH &rootBVH, bool cullBackfaces = false);
+
+	/// Uploads the parts once with their BVHs one after another, and the instances with a top level BVH.
+	/// The mesh needs InstancedMesh::buildBVH. Hits are in part space, coords_instance takes them to the mesh.
+	void initMesh(const InstancedMesh *mesh, bool cullBackfaces = false);
+
+	/// Maps other pixels to the mesh of an initialized mapping, sharing its GPU mesh data (UDIM tiles)
+	void init(std::shared_ptr<const CompressedMapUV> map, const MeshMapping &meshSource);
+
+	/// Replaces the mapped pixels keeping the mesh data, tiled bakes map one tile after another
+	void setMap(std::shared_ptr<const CompressedMapUV> map);
 	bool runStep();
 
+	/// Reads back the mapping results and the mesh data from the GPU for saveCache, once the mapping is done
+	MeshMappingCacheData* readCacheData() const;
+
+	/// Writes the mapped pixels with the data read back, it doesn't need the context
+	static bool saveCache(const char *path, uint64_t key, const MeshMappingSources &sources, const CompressedMapUV &map, const MeshMappingCacheData &data);
+
+	/// Reads a cache file written with the same key, it doesn't need the context
+	/// @param o_map Mapped pixels of the cache
+	/// @return nullptr if the file is missing, from another version or key, or its mesh files changed
+	static MeshMappingCacheData* readCache(const char *path, uint64_t key, const MeshMappingSources &sources, std::shared_ptr<CompressedMapUV> &o_map);
+
+	/// Mapping of the data of a cache file, already done so the solvers can run right away.
+	/// The mesh can still map other texels with setMap.
+	static MeshMapping* createFromCache(const MeshMappingCacheData &data, bool cullBackfaces = false);
+
 	inline float progress() const { return (float)_workOffset / (float)_workCount; }
+	inline bool done() const { return _workOffset >= _workCount; }
 
 	inline const ComputeBuffer<Vector4>* coords() const { return _coords.get(); }
 	inline const ComputeBuffer<uint32_t>* coords_tidx() const { return _tidx.get(); }
 	inline const ComputeBuffer<Pix_GPUData>* pixels() const { return _pixels.get(); }
 	inline const ComputeBuffer<PixT_GPUData>* pixelst() const { return _pixelst.get(); }
-	inline const ComputeBuffer<Vector4>* meshPositions() const { return _meshPositions.get(); }
-	inline const ComputeBuffer<Vector4>* meshNormals() const { return _meshNormals.get(); }
+	inline GLuint meshPositions() const { return _meshCompactPositions ? _meshCompactPositions->bo() : _meshPositions->bo(); }
+	inline GLuint meshNormals() const { return _meshCompactNormals ? _meshCompactNormals->bo() : _meshNormals->bo(); }
 	inline const ComputeBuffer<BVHGPUData>* meshBVH() const { return _bvh.get(); }
 
+	inline bool instanced() const { return (bool)_instances; }
+	inline const ComputeBuffer<uint32_t>* coords_instance() const { return _instanceIdx.get(); }
+	inline const ComputeBuffer<BVHGPUData>* instanceBVH() const { return _instanceBvh.get(); }
+	inline const ComputeBuffer<InstanceGPUData>* instances() const { return _instances.get(); }
+
+	/// Maximum number of triangles in a BVH leaf, used to specialize the raycasting shaders
+	inline uint32_t bvhLeafSize() const { return _bvhLeafSize; }
+
+	/// Definitions the shaders reading meshPositions or meshNormals need to decode them
+	void defineMeshFormat(ComputeShaderDefines &defines) const;
 
 private:
+	void initBVH(const BVH &rootBVH, std::vector<uint32_t> &triangles);
+	void uploadMesh(const Mesh *mesh, const std::vector<uint32_t> &triangles);
+	void initProgram(bool cullBackfaces);
+
 	size_t _workOffset;
 	size_t _workCount;
-	bool _cullBackfaces = false;
+	uint32_t _bvhLeafSize = 0;
 
 	std::unique_ptr<ComputeBuffer<Vector4> > _coords;
 	std::unique_ptr<ComputeBuffer<uint32_t> > _tidx;
+	std::unique_ptr<ComputeBuffer<uint32_t> > _instanceIdx;
 	std::unique_ptr<ComputeBuffer<Pix_GPUData> > _pixels;
 	std::unique_ptr<ComputeBuffer<PixT_GPUData> > _pixelst;
-	std::unique_ptr<ComputeBuffer<Vector4> > _meshPositions;
-	std::unique_ptr<ComputeBuffer<Vector4> > _meshNormals;
-	std::unique_ptr<ComputeBuffer<BVHGPUData> > _bvh;
+	std::shared_ptr<ComputeBuffer<Vector4> > _meshPositions;
+	std::shared_ptr<ComputeBuffer<Vector4> > _meshNormals;
+	std::shared_ptr<ComputeBuffer<uint32_t> > _meshCompactPositions;
+	std::shared_ptr<ComputeBuffer<uint32_t> > _meshCompactNormals;
+	Vector3 _meshOrigin;
+	Vector3 _meshScale;
+	std::shared_ptr<ComputeBuffer<BVHGPUData> > _bvh;
+	std::shared_ptr<ComputeBuffer<BVHGPUData> > _instanceBvh;
+	std::shared_ptr<ComputeBuffer<InstanceGPUData> > _instances;
 	GLuint _program;
-	GLuint _programCullBackfaces;
 
+	std::unique_ptr<StepWorkSize> _workSize;
 	Timing _timing;
 };
 
@@ -78,13 +173,21 @@ class MeshMappingTask : public FornosTask
 {
 public:
 	MeshMappingTask(std::shared_ptr<MeshMapping> meshmapping);
+	/// Saves the mapping of the map to the cache path when it is done
+	MeshMappingTask(std::shared_ptr<MeshMapping> meshmapping, std::shared_ptr<const CompressedMapUV> map, const std::string &cachePath, uint64_t cacheKey, const MeshMappingSources &cacheSources);
 	~MeshMappingTask();
 
 	bool runStep();
 	void finish();
+	void exportResults();
 	float progress() const;
 	const char* name() const { return "Mesh mapping"; }
 
 private:
 	std::shared_ptr<MeshMapping> _meshMapping;
+	std::shared_ptr<const CompressedMapUV> _cacheMap;
+	std::string _cachePath;
+	uint64_t _cacheKey = 0;
+	MeshMappingSources _cacheSources;
+	std::unique_ptr<MeshMappingCacheData> _cacheData;
 };
\ No newline at end of file
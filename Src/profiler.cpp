@@ -0,0 +1,180 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "profiler.h"
+#include "json.h"
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#elif __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct TraceEvent
+	{
+		std::string name;
+		char phase; // 'X' complete zone, 'C' counter
+		double timestamp; // Microseconds since the profiler was enabled/reset
+		double duration;
+		double value;
+		unsigned threadId;
+	};
+
+	std::atomic<bool> enabled(false);
+	std::mutex eventsMutex;
+	std::vector<TraceEvent> events;
+	std::map<std::thread::id, unsigned> threadIds;
+	Clock::time_point epoch = Clock::now();
+
+	double microsecondsSinceEpoch(Clock::time_point t)
+	{
+		return std::chrono::duration<double, std::micro>(t - epoch).count();
+	}
+
+	// Must be called with eventsMutex locked
+	unsigned currentThreadId()
+	{
+		auto it = threadIds.find(std::this_thread::get_id());
+		if (it != threadIds.end()) return it->second;
+		const unsigned id = (unsigned)threadIds.size() + 1;
+		threadIds[std::this_thread::get_id()] = id;
+		return id;
+	}
+
+	void addEvent(const char *name, char phase, Clock::time_point begin, double duration, double value)
+	{
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		TraceEvent e;
+		e.name = name;
+		e.phase = phase;
+		e.timestamp = microsecondsSinceEpoch(begin);
+		e.duration = duration;
+		e.value = value;
+		e.threadId = currentThreadId();
+		events.push_back(e);
+	}
+}
+
+void profilerEnable(bool enable)
+{
+	enabled = enable;
+}
+
+bool profilerEnabled()
+{
+	return enabled;
+}
+
+void profilerReset()
+{
+	std::lock_guard<std::mutex> lock(eventsMutex);
+	events.clear();
+	epoch = Clock::now();
+}
+
+void profilerCounter(const char *name, double value)
+{
+	if (!enabled) return;
+	addEvent(name, 'C', Clock::now(), 0.0, value);
+}
+
+size_t profilerMemoryUsage()
+{
+#if _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return (size_t)counters.WorkingSetSize;
+	}
+	return 0;
+#elif __linux__
+	std::ifstream ifs("/proc/self/statm");
+	size_t pages = 0, residentPages = 0;
+	if (ifs >> pages >> residentPages) return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+size_t profilerPeakMemoryUsage()
+{
+#if _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return (size_t)counters.PeakWorkingSetSize;
+	}
+	return 0;
+#elif __linux__
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) return (size_t)usage.ru_maxrss * 1024; // Kilobytes
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+bool profilerExportTrace(const char *path)
+{
+	std::lock_guard<std::mutex> lock(eventsMutex);
+	std::ofstream ofs(path);
+	if (!ofs) return false;
+
+	ofs.precision(3);
+	ofs << std::fixed;
+	ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const auto &e = events[i];
+		ofs << "{\"name\": " << jsonString(e.name)
+			<< ", \"ph\": \"" << e.phase << "\""
+			<< ", \"ts\": " << e.timestamp
+			<< ", \"pid\": 1, \"tid\": " << e.threadId;
+		if (e.phase == 'X') ofs << ", \"dur\": " << e.duration;
+		else ofs << ", \"args\": {\"value\": " << e.value << "}";
+		ofs << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+	}
+	ofs << "]}\n";
+	return (bool)ofs;
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (!_name) return;
+	const auto end = Clock::now();
+	const double duration = std::chrono::duration<double, std::micro>(end - _begin).count();
+	addEvent(_name, 'X', _begin, duration, 0.0);
+}
@@ -0,0 +1,67 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+/// Scoped CPU zones and counters exported as Chrome trace events (chrome://tracing, Perfetto).
+/// Nothing is recorded until the profiler is enabled.
+
+void profilerEnable(bool enable);
+bool profilerEnabled();
+
+/// Drops all the recorded events
+void profilerReset();
+
+/// Records a counter sample, shown as a track in the trace viewer
+void profilerCounter(const char *name, double value);
+
+/// Resident memory of the process in bytes (0 if unknown)
+size_t profilerMemoryUsage();
+
+/// Peak resident memory of the process in bytes (0 if unknown)
+size_t profilerPeakMemoryUsage();
+
+/// Writes the recorded events in the Chrome trace event format
+bool profilerExportTrace(const char *path);
+
+class ProfileZone
+{
+public:
+	ProfileZone(const char *name)
+		: _name(profilerEnabled() ? name : nullptr)
+	{
+		if (_name) _begin = std::chrono::high_resolution_clock::now();
+	}
+
+	~ProfileZone();
+
+private:
+	const char *_name;
+	std::chrono::high_resolution_clock::time_point _begin;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
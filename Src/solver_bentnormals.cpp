@@ -23,13 +23,14 @@ SOFTWARE.
 #include "solver_bentnormals.h"
 #include "compute.h"
 #include "computeshaders.h"
+#include "gpustats.h"
 #include "image.h"
 #include "logging.h"
 #include "meshmapping.h"
 #include <cassert>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024;
 static const size_t k_samplePermCount = 64 * 64;
 
 namespace
@@ -45,15 +46,31 @@ namespace
 
 void BentNormalsSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> meshMapping)
 {
-	_rayProgram = LoadComputeShader_BN_GenData();
-	_bentnormalsProgram = LoadComputeShader_BN_Sampling();
-	_avgProgram = LoadComputeShader_BN_Aggregate();
-	_tanspaceProgram = LoadComputeShader_ToTangentSpace();
+	{
+		ComputeShaderDefines defines;
+		defines.define("SAMPLE_COUNT", (uint32_t)_params.sampleCount);
+		defines.define("SAMPLE_PERM_COUNT", (uint32_t)k_samplePermCount);
+		defines.define("BVH_LEAF_SIZE", meshMapping->bvhLeafSize());
+		meshMapping->defineMeshFormat(defines);
+		ComputeShaderDefines meshDefines;
+		meshMapping->defineMeshFormat(meshDefines);
+		_rayProgram = LoadComputeShader_BN_GenData(meshDefines);
+		_bentnormalsProgram = LoadComputeShader_BN_Sampling(defines);
+	}
+	{
+		ComputeShaderDefines defines;
+		defines.define("SAMPLE_COUNT", (uint32_t)_params.sampleCount);
+		defines.define("TANGENT_SPACE", _params.tangentSpace);
+		_avgProgram = LoadComputeShader_BN_Aggregate(defines);
+	}
 
 	_uvMap = map;
 	_meshMapping = meshMapping;
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
 
+	// Every step samples whole groups of texels
+	_workSize.reset(new StepWorkSize(k_groupSize * _params.sampleCount, k_maxWorkPerStep));
+
 	{
 		ShaderParams params;
 		params.sampleCount = (uint32_t)_params.sampleCount;
@@ -70,9 +87,9 @@ void BentNormalsSolver::init(std::shared_ptr<const CompressedMapUV> map, std::sh
 		new ComputeBuffer<Vector4>(&samplesData[0], samplesData.size(), GL_STATIC_DRAW));
 
 	_rayDataCB = std::unique_ptr<ComputeBuffer<RayData> >(
-		new ComputeBuffer<RayData>(k_workPerFrame / _params.sampleCount, GL_STATIC_READ));
+		new ComputeBuffer<RayData>(_workSize->maxWork() / _params.sampleCount, GL_STATIC_READ));
 	_resultsMiddleCB = std::unique_ptr<ComputeBuffer<Vector4> >(
-		new ComputeBuffer<Vector4>(k_workPerFrame, GL_STATIC_READ)); // TODO: static read?
+		new ComputeBuffer<Vector4>(_workSize->maxWork(), GL_STATIC_READ)); // TODO: static read?
 	_resultsFinalCB = std::unique_ptr<ComputeBuffer<Vector3> >(
 		new ComputeBuffer<Vector3>(_workCount, GL_STATIC_READ));
 
@@ -84,31 +101,42 @@ bool BentNormalsSolver::runStep()
 	const size_t totalWork = _workCount * _params.sampleCount;
 	assert(_workOffset < totalWork);
 	const size_t workLeft = totalWork - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
 	glUseProgram(_rayProgram);
 	glUniform1ui(1, GLuint(_workOffset / _params.sampleCount));
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions()->bo());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->meshNormals()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->meshNormals());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->coords()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshMapping->coords_tidx()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _rayDataCB->bo());
-	glDispatchCompute((GLuint)(work / _params.sampleCount / k_groupSize), 1, 1);
+	if (_meshMapping->instanced())
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _meshMapping->coords_instance()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _meshMapping->instances()->bo());
+	}
+	gpuDispatchCompute("Bent normals ray setup", (GLuint)(work / _params.sampleCount / k_groupSize));
 
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	glUseProgram(_bentnormalsProgram);
 	glUniform1ui(1, GLuint(_workOffset / _params.sampleCount));
 	glUniform1ui(2, (GLuint)_meshMapping->meshBVH()->size());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _paramsCB->bo());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->meshPositions()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->meshPositions());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshMapping->meshBVH()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _samplesCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _rayDataCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _resultsMiddleCB->bo());
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+	if (_meshMapping->instanced())
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _meshMapping->instanceBVH()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, _meshMapping->instances()->bo());
+	}
+	gpuDispatchCompute("Bent normals sampling", (GLuint)(work / k_groupSize), work);
 
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	glUseProgram(_avgProgram);
@@ -116,17 +144,9 @@ bool BentNormalsSolver::runStep()
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _paramsCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _resultsMiddleCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _resultsFinalCB->bo());
-	glDispatchCompute((GLuint)(work / _params.sampleCount / k_groupSize), 1, 1);
-
-	if (_params.tangentSpace)
-	{
-		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-		glUseProgram(_tanspaceProgram);
-		glUniform1ui(1, GLuint(_workOffset / _params.sampleCount));
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->pixelst()->bo());
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _resultsFinalCB->bo());
-		glDispatchCompute((GLuint)(work / _params.sampleCount / k_groupSize), 1, 1);
-	}
+	if (_params.tangentSpace) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshMapping->pixelst()->bo());
+	gpuDispatchCompute("Bent normals aggregate", (GLuint)(work / _params.sampleCount / k_groupSize));
+	_workSize->endStep();
 
 	_workOffset += work;
 
@@ -135,7 +155,8 @@ bool BentNormalsSolver::runStep()
 		_timing.end();
 		logDebug("BNorm",
 			"Bent Normals map took " + std::to_string(_timing.elapsedSeconds()) +
-			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height));
+			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height) +
+			" in " + std::to_string(_workSize->stepCount()) + " steps");
 	}
 
 	return _workOffset >= totalWork;
@@ -145,6 +166,7 @@ Vector3* BentNormalsSolver::getResults()
 {
 	//assert(_sampleIndex >= _params.sampleCount);
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	gpuStatsReadBack("Bent normals aggregate", sizeof(Vector3) * _resultsFinalCB->size());
 	return _resultsFinalCB->readData();
 }
 
@@ -157,6 +179,7 @@ BentNormalsTask::BentNormalsTask(std::unique_ptr<BentNormalsSolver> solver, cons
 
 BentNormalsTask::~BentNormalsTask()
 {
+	delete[] _results;
 }
 
 bool BentNormalsTask::runStep()
@@ -168,9 +191,15 @@ bool BentNormalsTask::runStep()
 void BentNormalsTask::finish()
 {
 	assert(_solver);
-	Vector3 *results = _solver->getResults();
-	exportNormalImage(results, _solver->uvMap().get(), _outputPath.c_str(), _dilation);
-	delete[] results;
+	_results = _solver->getResults();
+}
+
+void BentNormalsTask::exportResults()
+{
+	assert(_results);
+	exportNormalImage(_results, _solver->uvMap().get(), _outputPath.c_str(), _dilation);
+	delete[] _results;
+	_results = nullptr;
 }
 
 float BentNormalsTask::progress() const
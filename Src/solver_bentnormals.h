@@ -26,6 +26,7 @@ SOFTWARE.
 #include "fornos.h"
 #include "math.h"
 #include "timing.h"
+#include "worksize.h"
 #include <glad/glad.h>
 #include <memory>
 #include <vector>
@@ -84,7 +85,6 @@ private:
 	GLuint _rayProgram;
 	GLuint _bentnormalsProgram;
 	GLuint _avgProgram;
-	GLuint _tanspaceProgram;
 	std::unique_ptr<ComputeBuffer<ShaderParams> > _paramsCB;
 	std::unique_ptr<ComputeBuffer<Vector4> > _samplesCB;
 	std::unique_ptr<ComputeBuffer<RayData> > _rayDataCB;
@@ -94,6 +94,7 @@ private:
 	std::shared_ptr<const CompressedMapUV> _uvMap;
 	std::shared_ptr<MeshMapping> _meshMapping;
 
+	std::unique_ptr<StepWorkSize> _workSize;
 	Timing _timing;
 };
 
@@ -105,11 +106,13 @@ public:
 
 	bool runStep();
 	void finish();
+	void exportResults();
 	float progress() const;
 	const char* name() const { return "Bent normals"; }
 
 private:
 	std::unique_ptr<BentNormalsSolver> _solver;
+	Vector3 *_results = nullptr; // Read back by finish, exported on a worker thread
 	std::string _outputPath;
 	int _dilation;
 };
\ No newline at end of file
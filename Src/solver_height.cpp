@@ -24,6 +24,7 @@ SOFTWARE.
 #include "bvh.h"
 #include "compute.h"
 #include "computeshaders.h"
+#include "gpustats.h"
 #include "image.h"
 #include "logging.h"
 #include "math.h"
@@ -32,7 +33,7 @@ SOFTWARE.
 #include <cassert>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024 * 2;
 
 void HeightSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> meshMapping)
 {
@@ -40,6 +41,7 @@ void HeightSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_
 	_uvMap = map;
 	_meshMapping = meshMapping;
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
+	_workSize.reset(new StepWorkSize(k_groupSize, k_maxWorkPerStep));
 	_resultsCB = std::unique_ptr<ComputeBuffer<float> >(
 		new ComputeBuffer<float>(3 * _workCount, GL_STATIC_READ));
 	_workOffset = 0;
@@ -49,16 +51,18 @@ bool HeightSolver::runStep()
 {
 	assert(_workOffset < _workCount);
 	const size_t workLeft = _workCount - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
 	glUseProgram(_heightProgram);
 	glUniform1ui(1, (GLuint)_workOffset);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->coords()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _resultsCB->bo());
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+	gpuDispatchCompute("Height", (GLuint)(work / k_groupSize));
+	_workSize->endStep();
 
 	_workOffset += work;
 
@@ -67,7 +71,8 @@ bool HeightSolver::runStep()
 		_timing.end();
 		logDebug("Height",
 			"Height map took " + std::to_string(_timing.elapsedSeconds()) +
-			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height));
+			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height) +
+			" in " + std::to_string(_workSize->stepCount()) + " steps");
 	}
 
 	return _workOffset >= _workCount;
@@ -80,6 +85,7 @@ float* HeightSolver::getResults()
 	float *results = new float[_workCount];
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _resultsCB->bo());
 	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * _workCount, results);
+	gpuStatsReadBack("Height", sizeof(float) * _workCount);
 	return results;
 }
 
@@ -92,6 +98,7 @@ HeightTask::HeightTask(std::unique_ptr<HeightSolver> solver, const char *outputP
 
 HeightTask::~HeightTask()
 {
+	delete[] _results;
 }
 
 bool HeightTask::runStep()
@@ -103,18 +110,23 @@ bool HeightTask::runStep()
 void HeightTask::finish()
 {
 	assert(_solver);
-	float *results = _solver->getResults();
-	auto map = _solver->uvMap();
+	_results = _solver->getResults();
+}
+
+void HeightTask::exportResults()
+{
+	assert(_results);
 	Vector2 minmax;
 	exportFloatImage(
-		results,
+		_results,
 		_solver->uvMap().get(),
 		_outputPath.c_str(),
 		Vector2(0, _solver->parameters().maxDistance),
 		_solver->parameters().normalizeOutput, 
 		_dilation, 
 		&minmax);
-	delete[] results;
+	delete[] _results;
+	_results = nullptr;
 	logDebug("Height", "Height map range: " + std::to_string(minmax.x) + " to " + std::to_string(minmax.y));
 }
 
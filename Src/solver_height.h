@@ -26,6 +26,7 @@ SOFTWARE.
 #include "compute.h"
 #include "fornos.h"
 #include "timing.h"
+#include "worksize.h"
 #include <memory>
 
 struct CompressedMapUV;
@@ -64,6 +65,7 @@ private:
 	std::shared_ptr<const CompressedMapUV> _uvMap;
 	std::shared_ptr<MeshMapping> _meshMapping;
 
+	std::unique_ptr<StepWorkSize> _workSize;
 	Timing _timing;
 };
 
@@ -75,11 +77,13 @@ public:
 
 	bool runStep();
 	void finish();
+	void exportResults();
 	float progress() const;
 	const char* name() const { return "Height"; }
 
 private:
 	std::unique_ptr<HeightSolver> _solver;
+	float *_results = nullptr; // Read back by finish, exported on a worker thread
 	std::string _outputPath;
 	int _dilation;
 };
@@ -24,6 +24,7 @@ SOFTWARE.
 #include "bvh.h"
 #include "compute.h"
 #include "computeshaders.h"
+#include "gpustats.h"
 #include "image.h"
 #include "logging.h"
 #include "math.h"
@@ -32,15 +33,20 @@ SOFTWARE.
 #include <cassert>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024 * 2;
 
 void NormalsSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> meshMapping)
 {
-	_normalsProgram = LoadComputeShader_Normal();
-	_tanspaceProgram = LoadComputeShader_ToTangentSpace();
+	{
+		ComputeShaderDefines defines;
+		defines.define("TANGENT_SPACE", _params.tangentSpace);
+		meshMapping->defineMeshFormat(defines);
+		_normalsProgram = LoadComputeShader_Normal(defines);
+	}
 	_uvMap = map;
 	_meshMapping = meshMapping;
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
+	_workSize.reset(new StepWorkSize(k_groupSize, k_maxWorkPerStep));
 	_resultsCB = std::unique_ptr<ComputeBuffer<float> >(
 		new ComputeBuffer<float>(3 * _workCount, GL_STATIC_READ));
 	_workOffset = 0;
@@ -50,28 +56,26 @@ bool NormalsSolver::runStep()
 {
 	assert(_workOffset < _workCount);
 	const size_t workLeft = _workCount - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
 	glUseProgram(_normalsProgram);
 	glUniform1ui(1, (GLuint)_workOffset);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshNormals()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshNormals());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->coords()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->coords_tidx()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _resultsCB->bo());
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
-
-	if (_params.tangentSpace)
+	if (_params.tangentSpace) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _meshMapping->pixelst()->bo());
+	if (_meshMapping->instanced())
 	{
-		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-		glUseProgram(_tanspaceProgram);
-		glUniform1ui(1, GLuint(_workOffset));
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->pixelst()->bo());
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _resultsCB->bo());
-		glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _meshMapping->coords_instance()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _meshMapping->instances()->bo());
 	}
+	gpuDispatchCompute("Normals", (GLuint)(work / k_groupSize));
+	_workSize->endStep();
 
 	_workOffset += work;
 
@@ -80,19 +84,21 @@ bool NormalsSolver::runStep()
 		_timing.end();
 		logDebug("Norms",
 			"Normal map took " + std::to_string(_timing.elapsedSeconds()) +
-			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height));
+			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height) +
+			" in " + std::to_string(_workSize->stepCount()) + " steps");
 	}
 
 	return _workOffset >= _workCount;
 }
 
-float* NormalsSolver::getResults()
+Vector3* NormalsSolver::getResults()
 {
 	assert(_workOffset == _workCount);
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-	float *results = new float[_workCount * 3];
+	Vector3 *results = new Vector3[_workCount];
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _resultsCB->bo());
 	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 3 * _workCount, results);
+	gpuStatsReadBack("Normals", sizeof(float) * 3 * _workCount);
 	return results;
 }
 
@@ -105,6 +111,7 @@ NormalsTask::NormalsTask(std::unique_ptr<NormalsSolver> solver, const char *outp
 
 NormalsTask::~NormalsTask()
 {
+	delete[] _results;
 }
 
 bool NormalsTask::runStep()
@@ -116,10 +123,15 @@ bool NormalsTask::runStep()
 void NormalsTask::finish()
 {
 	assert(_solver);
-	Vector3 *results = (Vector3*)_solver->getResults();
-	auto map = _solver->uvMap();
-	exportNormalImage(results, _solver->uvMap().get(), _outputPath.c_str(), _dilation);
-	delete[] results;
+	_results = _solver->getResults();
+}
+
+void NormalsTask::exportResults()
+{
+	assert(_results);
+	exportNormalImage(_results, _solver->uvMap().get(), _outputPath.c_str(), _dilation);
+	delete[] _results;
+	_results = nullptr;
 }
 
 float NormalsTask::progress() const
@@ -26,6 +26,7 @@ SOFTWARE.
 #include "compute.h"
 #include "fornos.h"
 #include "timing.h"
+#include "worksize.h"
 #include <memory>
 
 struct CompressedMapUV;
@@ -44,7 +45,7 @@ public:
 
 	void init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> mesh);
 	bool runStep();
-	float* getResults();
+	Vector3* getResults();
 
 	inline float progress() const { return (float)_workOffset / (float)_workCount; }
 
@@ -56,12 +57,12 @@ private:
 	size_t _workCount;
 
 	GLuint _normalsProgram;
-	GLuint _tanspaceProgram;
 	std::unique_ptr<ComputeBuffer<float> > _resultsCB;
 
 	std::shared_ptr<const CompressedMapUV> _uvMap;
 	std::shared_ptr<MeshMapping> _meshMapping;
 
+	std::unique_ptr<StepWorkSize> _workSize;
 	Timing _timing;
 };
 
@@ -73,11 +74,13 @@ public:
 
 	bool runStep();
 	void finish();
+	void exportResults();
 	float progress() const;
 	const char* name() const { return "Normals"; }
 
 private:
 	std::unique_ptr<NormalsSolver> _solver;
+	Vector3 *_results = nullptr; // Read back by finish, exported on a worker thread
 	std::string _outputPath;
 	int _dilation;
 };
@@ -24,6 +24,7 @@ SOFTWARE.
 #include "bvh.h"
 #include "compute.h"
 #include "computeshaders.h"
+#include "gpustats.h"
 #include "image.h"
 #include "logging.h"
 #include "math.h"
@@ -32,14 +33,19 @@ SOFTWARE.
 #include <cassert>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024 * 2;
 
 void PositionSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> meshMapping)
 {
-	_positionProgram = LoadComputeShader_Position();
+	{
+		ComputeShaderDefines defines;
+		meshMapping->defineMeshFormat(defines);
+		_positionProgram = LoadComputeShader_Position(defines);
+	}
 	_uvMap = map;
 	_meshMapping = meshMapping;
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
+	_workSize.reset(new StepWorkSize(k_groupSize, k_maxWorkPerStep));
 	_resultsCB = std::unique_ptr<ComputeBuffer<Vector3> >(
 		new ComputeBuffer<Vector3>(_workCount, GL_STATIC_READ));
 	_workOffset = 0;
@@ -49,18 +55,25 @@ bool PositionSolver::runStep()
 {
 	assert(_workOffset < _workCount);
 	const size_t workLeft = _workCount - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
 	glUseProgram(_positionProgram);
 	glUniform1ui(1, (GLuint)_workOffset);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->coords()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->coords_tidx()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _resultsCB->bo());
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+	if (_meshMapping->instanced())
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _meshMapping->coords_instance()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _meshMapping->instances()->bo());
+	}
+	gpuDispatchCompute("Position", (GLuint)(work / k_groupSize));
+	_workSize->endStep();
 
 	_workOffset += work;
 
@@ -69,7 +82,8 @@ bool PositionSolver::runStep()
 		_timing.end();
 		logDebug("Position",
 			"Position map took " + std::to_string(_timing.elapsedSeconds()) +
-			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height));
+			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height) +
+			" in " + std::to_string(_workSize->stepCount()) + " steps");
 	}
 
 	return _workOffset >= _workCount;
@@ -82,6 +96,7 @@ Vector3* PositionSolver::getResults()
 	Vector3 *results = new Vector3[_workCount];
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _resultsCB->bo());
 	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Vector3) * _workCount, results);
+	gpuStatsReadBack("Position", sizeof(Vector3) * _workCount);
 	return results;
 }
 
@@ -93,6 +108,7 @@ PositionTask::PositionTask(std::unique_ptr<PositionSolver> solver, const char *o
 
 PositionTask::~PositionTask()
 {
+	delete[] _results;
 }
 
 bool PositionTask::runStep()
@@ -104,10 +120,15 @@ bool PositionTask::runStep()
 void PositionTask::finish()
 {
 	assert(_solver);
-	Vector3 *results = _solver->getResults();
-	auto map = _solver->uvMap();
-	exportVectorImage(results, _solver->uvMap().get(), _outputPath.c_str());
-	delete[] results;
+	_results = _solver->getResults();
+}
+
+void PositionTask::exportResults()
+{
+	assert(_results);
+	exportVectorImage(_results, _solver->uvMap().get(), _outputPath.c_str());
+	delete[] _results;
+	_results = nullptr;
 }
 
 float PositionTask::progress() const
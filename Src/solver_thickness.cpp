@@ -23,13 +23,14 @@ SOFTWARE.
 #include "solver_thickness.h"
 #include "compute.h"
 #include "computeshaders.h"
+#include "gpustats.h"
 #include "logging.h"
 #include "meshmapping.h"
 #include "image.h"
 #include <cassert>
 
 static const size_t k_groupSize = 64;
-static const size_t k_workPerFrame = 1024 * 128;
+static const size_t k_maxWorkPerStep = 1024 * 1024;
 static const size_t k_samplePermCount = 64 * 64;
 
 namespace
@@ -45,14 +46,30 @@ namespace
 
 void ThicknessSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shared_ptr<MeshMapping> meshMapping)
 {
-	_rayProgram = LoadComputeShader_Thick_GenData();
-	_thicknessProgram = LoadComputeShader_Thick_Sampling();
-	_avgProgram = LoadComputeShader_Thick_Aggregate();
+	{
+		ComputeShaderDefines defines;
+		defines.define("SAMPLE_COUNT", (uint32_t)_params.sampleCount);
+		defines.define("SAMPLE_PERM_COUNT", (uint32_t)k_samplePermCount);
+		defines.define("BVH_LEAF_SIZE", meshMapping->bvhLeafSize());
+		meshMapping->defineMeshFormat(defines);
+		ComputeShaderDefines meshDefines;
+		meshMapping->defineMeshFormat(meshDefines);
+		_rayProgram = LoadComputeShader_Thick_GenData(meshDefines);
+		_thicknessProgram = LoadComputeShader_Thick_Sampling(defines);
+	}
+	{
+		ComputeShaderDefines defines;
+		defines.define("SAMPLE_COUNT", (uint32_t)_params.sampleCount);
+		_avgProgram = LoadComputeShader_Thick_Aggregate(defines);
+	}
 
 	_uvMap = map;
 	_meshMapping = meshMapping;
 	_workCount = ((map->positions.size() + k_groupSize - 1) / k_groupSize) * k_groupSize;
 
+	// Every step samples whole groups of texels
+	_workSize.reset(new StepWorkSize(k_groupSize * _params.sampleCount, k_maxWorkPerStep));
+
 	{
 		ShaderParams params;
 		params.sampleCount = (uint32_t)_params.sampleCount;
@@ -69,9 +86,9 @@ void ThicknessSolver::init(std::shared_ptr<const CompressedMapUV> map, std::shar
 		new ComputeBuffer<Vector4>(&samplesData[0], samplesData.size(), GL_STATIC_DRAW));
 
 	_rayDataCB = std::unique_ptr<ComputeBuffer<RayData> >(
-		new ComputeBuffer<RayData>(k_workPerFrame / _params.sampleCount, GL_STATIC_READ));
+		new ComputeBuffer<RayData>(_workSize->maxWork() / _params.sampleCount, GL_STATIC_READ));
 	_resultsMiddleCB = std::unique_ptr<ComputeBuffer<float> >(
-		new ComputeBuffer<float>(k_workPerFrame, GL_STATIC_READ)); // TODO: static read?
+		new ComputeBuffer<float>(_workSize->maxWork(), GL_STATIC_READ)); // TODO: static read?
 	_resultsFinalCB = std::unique_ptr<ComputeBuffer<float> >(
 		new ComputeBuffer<float>(_workCount, GL_STATIC_READ));
 
@@ -83,31 +100,42 @@ bool ThicknessSolver::runStep()
 	const size_t totalWork = _workCount * _params.sampleCount;
 	assert(_workOffset < totalWork);
 	const size_t workLeft = totalWork - _workOffset;
-	const size_t work = workLeft < k_workPerFrame ? workLeft : k_workPerFrame;
-	assert(work % k_groupSize == 0);
 
 	if (_workOffset == 0) _timing.begin();
 
+	const size_t work = _workSize->beginStep(workLeft);
+	assert(work % k_groupSize == 0);
+
 	glUseProgram(_rayProgram);
 	glUniform1ui(1, GLuint(_workOffset / _params.sampleCount));
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions()->bo());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->meshNormals()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _meshMapping->meshPositions());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _meshMapping->meshNormals());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->coords()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshMapping->coords_tidx()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _rayDataCB->bo());
-	glDispatchCompute((GLuint)(work / _params.sampleCount / k_groupSize), 1, 1);
+	if (_meshMapping->instanced())
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _meshMapping->coords_instance()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _meshMapping->instances()->bo());
+	}
+	gpuDispatchCompute("Thickness ray setup", (GLuint)(work / _params.sampleCount / k_groupSize));
 
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	glUseProgram(_thicknessProgram);
 	glUniform1ui(1, GLuint(_workOffset / _params.sampleCount));
 	glUniform1ui(2, (GLuint)_meshMapping->meshBVH()->size());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _paramsCB->bo());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->meshPositions()->bo());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _meshMapping->meshPositions());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _meshMapping->meshBVH()->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _samplesCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _rayDataCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _resultsMiddleCB->bo());
-	glDispatchCompute((GLuint)(work / k_groupSize), 1, 1);
+	if (_meshMapping->instanced())
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _meshMapping->instanceBVH()->bo());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, _meshMapping->instances()->bo());
+	}
+	gpuDispatchCompute("Thickness sampling", (GLuint)(work / k_groupSize), work);
 
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	glUseProgram(_avgProgram);
@@ -115,7 +143,8 @@ bool ThicknessSolver::runStep()
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _paramsCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _resultsMiddleCB->bo());
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _resultsFinalCB->bo());
-	glDispatchCompute((GLuint)(work / _params.sampleCount / k_groupSize), 1, 1);
+	gpuDispatchCompute("Thickness aggregate", (GLuint)(work / _params.sampleCount / k_groupSize));
+	_workSize->endStep();
 
 	_workOffset += work;
 
@@ -124,7 +153,8 @@ bool ThicknessSolver::runStep()
 		_timing.end();
 		logDebug("Thickness",
 			"Thickness map took " + std::to_string(_timing.elapsedSeconds()) +
-			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height));
+			" seconds for " + std::to_string(_uvMap->width) + "x" + std::to_string(_uvMap->height) +
+			" in " + std::to_string(_workSize->stepCount()) + " steps");
 	}
 
 	return _workOffset >= totalWork;
@@ -134,6 +164,7 @@ float* ThicknessSolver::getResults()
 {
 	//assert(_sampleIndex >= _params.sampleCount);
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	gpuStatsReadBack("Thickness aggregate", sizeof(float) * _resultsFinalCB->size());
 	return _resultsFinalCB->readData();
 }
 
@@ -146,6 +177,7 @@ ThicknessTask::ThicknessTask(std::unique_ptr<ThicknessSolver> solver, const char
 
 ThicknessTask::~ThicknessTask()
 {
+	delete[] _results;
 }
 
 bool ThicknessTask::runStep()
@@ -157,10 +189,16 @@ bool ThicknessTask::runStep()
 void ThicknessTask::finish()
 {
 	assert(_solver);
-	float *results = _solver->getResults();
+	_results = _solver->getResults();
+}
+
+void ThicknessTask::exportResults()
+{
+	assert(_results);
 	Vector2 minmax;
-	exportFloatImage(results, _solver->uvMap().get(), _outputPath.c_str(), Vector2(0, 0), true, _dilation, &minmax);
-	delete[] results;
+	exportFloatImage(_results, _solver->uvMap().get(), _outputPath.c_str(), Vector2(0, 0), true, _dilation, &minmax);
+	delete[] _results;
+	_results = nullptr;
 	logDebug("Thickness", "Thickness map range: " + std::to_string(minmax.x) + " to " + std::to_string(minmax.y));
 }
 
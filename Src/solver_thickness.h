@@ -26,6 +26,7 @@ SOFTWARE.
 #include "fornos.h"
 #include "math.h"
 #include "timing.h"
+#include "worksize.h"
 #include <glad/glad.h>
 #include <memory>
 #include <vector>
@@ -92,6 +93,7 @@ private:
 	std::shared_ptr<const CompressedMapUV> _uvMap;
 	std::shared_ptr<MeshMapping> _meshMapping;
 
+	std::unique_ptr<StepWorkSize> _workSize;
 	Timing _timing;
 };
 
@@ -103,11 +105,13 @@ public:
 
 	bool runStep();
 	void finish();
+	void exportResults();
 	float progress() const;
 	const char* name() const { return "Thickness"; }
 
 private:
 	std::unique_ptr<ThicknessSolver> _solver;
+	float *_results = nullptr; // Read back by finish, exported on a worker thread
 	std::string _outputPath;
 	int _dilation;
 };
\ No newline at end of file
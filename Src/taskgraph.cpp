@@ -0,0 +1,287 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "taskgraph.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+
+static const auto k_idleWait = std::chrono::milliseconds(5); // Longest wait for the workers in a run
+
+namespace
+{
+	double secondsSince(const std::chrono::steady_clock::time_point &begin)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		const size_t hardwareThreads = (size_t)std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 3 ? hardwareThreads - 1 : 2;
+	}
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		_threads.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_jobReady.notify_all();
+	for (auto &thread : _threads) thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_jobReady.notify_one();
+}
+
+void ThreadPool::work()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_jobReady.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+			if (_jobs.empty()) return; // Stopped
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+const TaskGraph::Node TaskGraph::k_noNode;
+
+TaskGraph::TaskGraph()
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+	clear();
+}
+
+TaskGraph::Node TaskGraph::addContextTask(FornosTask *task, const std::vector<Node> &dependencies)
+{
+	return add(task, true, dependencies);
+}
+
+TaskGraph::Node TaskGraph::addWorkerTask(FornosTask *task, const std::vector<Node> &dependencies)
+{
+	return add(task, false, dependencies);
+}
+
+TaskGraph::Node TaskGraph::addContextJob(const char *name, FunctionTask::Function job, const std::vector<Node> &dependencies)
+{
+	return add(new FunctionTask(name, std::move(job)), true, dependencies);
+}
+
+TaskGraph::Node TaskGraph::addWorkerJob(const char *name, FunctionTask::Function job, const std::vector<Node> &dependencies)
+{
+	return add(new FunctionTask(name, std::move(job)), false, dependencies);
+}
+
+TaskGraph::Node TaskGraph::add(FornosTask *task, bool context, const std::vector<Node> &dependencies)
+{
+	const Node node = _tasks.size();
+	Task t;
+	t.task.reset(task);
+	t.context = context;
+	t.finished = false;
+	t.waitingFor = 0;
+	t.seconds = 0.0;
+	for (Node dependency : dependencies)
+	{
+		if (dependency == k_noNode) continue;
+		assert(dependency < node);
+		if (_tasks[dependency].finished) continue;
+		_tasks[dependency].dependents.push_back(node);
+		++t.waitingFor;
+	}
+	t.state = t.waitingFor == 0 ? State::Ready : State::Waiting;
+	_tasks.push_back(std::move(t));
+	++_unfinished;
+	return node;
+}
+
+bool TaskGraph::finished(Node node) const
+{
+	return node == k_noNode || node >= _tasks.size() || _tasks[node].finished;
+}
+
+const FornosTask* TaskGraph::currentTask() const
+{
+	if (_current != k_noNode) return _tasks[_current].task.get();
+	const FornosTask *exporting = nullptr;
+	const FornosTask *other = nullptr;
+	for (const auto &t : _tasks)
+	{
+		if (t.state == State::Running) return t.task.get();
+		if (t.state == State::Exporting && !exporting) exporting = t.task.get();
+		if (t.state != State::Done && !other) other = t.task.get();
+	}
+	return exporting ? exporting : other;
+}
+
+void TaskGraph::run()
+{
+	collectWorkers();
+
+	// Worker tasks start as soon as they are ready, the workers take them in order
+	for (Node node = 0; node < _tasks.size(); ++node)
+	{
+		if (!_tasks[node].context && _tasks[node].state == State::Ready) submit(node, false);
+	}
+
+	if (_current == k_noNode) _current = nextContextTask();
+	if (_current == k_noNode)
+	{
+		// Nothing for this thread, wait for the workers instead of spinning
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_inFlight > 0 && _workerFinished.empty()) _workerDone.wait_for(lock, k_idleWait);
+		return;
+	}
+
+	// Steps and finish can add tasks, only the task pointer stays valid
+	const Node node = _current;
+	FornosTask *task = _tasks[node].task.get();
+	if (_tasks[node].state == State::Ready) _tasks[node].begin = std::chrono::steady_clock::now();
+	_tasks[node].state = State::Running;
+	bool done;
+	{
+		PROFILE_ZONE(task->name());
+		done = task->runStep();
+	}
+	if (done)
+	{
+		{
+			PROFILE_ZONE("FornosTask::finish");
+			task->finish(); // Reads back the results or any other after-compute work with the context
+		}
+		_current = k_noNode;
+		_tasks[node].seconds = secondsSince(_tasks[node].begin);
+		finishTask(node);
+		submit(node, true);
+	}
+}
+
+void TaskGraph::clear()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_workerDone.wait(lock, [this]() { return _inFlight == 0; });
+		_workerFinished.clear();
+	}
+	_tasks.clear();
+	_unfinished = 0;
+	_current = k_noNode;
+}
+
+void TaskGraph::finishTask(Node node)
+{
+	_tasks[node].finished = true;
+	for (Node dependent : _tasks[node].dependents)
+	{
+		Task &t = _tasks[dependent];
+		assert(t.waitingFor > 0);
+		if (--t.waitingFor == 0 && t.state == State::Waiting) t.state = State::Ready;
+	}
+}
+
+// Worker tasks run every step and their export, context tasks only export
+void TaskGraph::submit(Node node, bool exportOnly)
+{
+	FornosTask *task = _tasks[node].task.get();
+	_tasks[node].state = exportOnly ? State::Exporting : State::Running;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_inFlight;
+	}
+	_pool.submit([this, node, task, exportOnly]()
+	{
+		WorkerResult result = { node, 0.0, 0.0 };
+		if (!exportOnly)
+		{
+			PROFILE_ZONE(task->name());
+			const auto begin = std::chrono::steady_clock::now();
+			while (!task->runStep()) {}
+			task->finish();
+			result.seconds = secondsSince(begin);
+		}
+		{
+			PROFILE_ZONE("FornosTask::exportResults");
+			const auto begin = std::chrono::steady_clock::now();
+			task->exportResults();
+			result.exportSeconds = secondsSince(begin);
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_workerFinished.push_back(result);
+			--_inFlight;
+		}
+		_workerDone.notify_all();
+	});
+}
+
+void TaskGraph::collectWorkers()
+{
+	std::vector<WorkerResult> results;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		results.swap(_workerFinished);
+	}
+	for (const WorkerResult &result : results)
+	{
+		const Node node = result.node;
+		if (!_tasks[node].context) _tasks[node].seconds = result.seconds;
+		if (!_tasks[node].finished) finishTask(node);
+		const TaskTiming timing = { _tasks[node].task->name(), _tasks[node].seconds, result.exportSeconds };
+		_timings.push_back(timing);
+		_tasks[node].state = State::Done;
+		_tasks[node].task.reset();
+		--_unfinished;
+	}
+	if (_unfinished == 0) _tasks.clear();
+}
+
+TaskGraph::Node TaskGraph::nextContextTask() const
+{
+	for (Node node = 0; node < _tasks.size(); ++node)
+	{
+		if (_tasks[node].context && _tasks[node].state == State::Ready) return node;
+	}
+	return k_noNode;
+}
@@ -0,0 +1,169 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include "fornos.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Worker threads running jobs in the order they were submitted
+class ThreadPool
+{
+public:
+	/// Without a thread count, one less than the hardware threads (the OpenGL context has its own) and at least two
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	void submit(std::function<void()> job);
+	size_t threadCount() const { return _threads.size(); }
+
+private:
+	void work();
+
+	std::vector<std::thread> _threads;
+	std::deque<std::function<void()> > _jobs;
+	std::mutex _mutex;
+	std::condition_variable _jobReady;
+	bool _stop = false;
+};
+
+/// Task of a single step running a function, for the stages that don't dispatch GPU work in steps.
+/// The function gets the task to report its progress.
+class FunctionTask : public FornosTask
+{
+public:
+	typedef std::function<void(FunctionTask &task)> Function;
+
+	FunctionTask(const char *name, Function function) : _name(name), _function(std::move(function)) {}
+
+	bool runStep() { _function(*this); _progress = 1.0f; return true; }
+	void finish() {}
+	float progress() const { return _progress; }
+	const char* name() const { return _name; }
+
+	void setProgress(float progress) { _progress = progress; }
+
+private:
+	const char *_name;
+	Function _function;
+	std::atomic<float> _progress{ 0.0f }; // Read from the context thread while a worker runs the function
+};
+
+/// Wall time of a done task: its steps and finish, and its export
+struct TaskTiming
+{
+	std::string name;
+	double seconds;
+	double exportSeconds;
+};
+
+/// Tasks of the bakes and the dependencies between them.
+/// Context tasks make OpenGL calls: they run a step at a time on the thread with the context, one task after
+/// another, in the order they were added. Worker tasks run all their steps and finish on the thread pool.
+/// A task is ready once all the tasks it depends on are finished. The exports of the finished tasks
+/// (FornosTask::exportResults) run on the thread pool too, without holding back the tasks that depend on them.
+/// Tasks are always deleted on the context thread, they can hold GPU buffers.
+class TaskGraph
+{
+public:
+	typedef size_t Node;
+	static const Node k_noNode = SIZE_MAX; // Ignored as a dependency
+
+	TaskGraph();
+	~TaskGraph();
+
+	Node addContextTask(FornosTask *task, const std::vector<Node> &dependencies = {});
+	Node addWorkerTask(FornosTask *task, const std::vector<Node> &dependencies = {});
+	Node addContextJob(const char *name, FunctionTask::Function job, const std::vector<Node> &dependencies = {});
+	Node addWorkerJob(const char *name, FunctionTask::Function job, const std::vector<Node> &dependencies = {});
+
+	bool pending() const { return _unfinished > 0; }
+	bool finished(Node node) const;
+
+	/// Tasks not done yet, including the running and exporting ones
+	size_t taskCount() const { return _unfinished; }
+
+	/// Running context task, or else a running worker task or export
+	const FornosTask* currentTask() const;
+
+	/// Collects the tasks the workers finished, starts the ready worker tasks and runs a step of the current
+	/// context task. Waits a little for the workers when no context task is ready.
+	void run();
+
+	/// Waits for the tasks running on the workers and removes all the tasks
+	void clear();
+
+	/// Timings of the tasks done since the last reset, in the order they were done
+	const std::vector<TaskTiming>& timings() const { return _timings; }
+	void resetTimings() { _timings.clear(); }
+
+private:
+	enum class State { Waiting, Ready, Running, Exporting, Done };
+
+	struct Task
+	{
+		std::unique_ptr<FornosTask> task;
+		bool context;
+		State state;
+		bool finished; // The dependent tasks can start
+		size_t waitingFor; // Dependencies not finished yet
+		std::vector<Node> dependents;
+		std::chrono::steady_clock::time_point begin;
+		double seconds;
+	};
+
+	struct WorkerResult
+	{
+		Node node;
+		double seconds; // Only for worker tasks
+		double exportSeconds;
+	};
+
+	Node add(FornosTask *task, bool context, const std::vector<Node> &dependencies);
+	void finishTask(Node node);
+	void submit(Node node, bool exportOnly);
+	void collectWorkers();
+	Node nextContextTask() const;
+
+	std::vector<Task> _tasks; // Removed when all of them are done
+	size_t _unfinished = 0;
+	Node _current = k_noNode;
+	std::vector<TaskTiming> _timings;
+
+	std::mutex _mutex;
+	std::condition_variable _workerDone;
+	std::vector<WorkerResult> _workerFinished; // Tasks the workers finished running or exporting
+	size_t _inFlight = 0; // Tasks submitted to the workers still running
+
+	ThreadPool _pool;
+};
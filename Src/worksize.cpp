@@ -0,0 +1,136 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "worksize.h"
+#include <algorithm>
+#include <cassert>
+
+static const size_t k_initialWork = 1024 * 128;
+
+// A step grows at most this much from a measure, so a slow step is never much longer than the target.
+// It shrinks as much as the measure asks for.
+static const double k_maxGrowth = 2.0;
+
+namespace
+{
+	double targetMilliseconds = k_interactiveStepMilliseconds;
+}
+
+void setStepTargetMilliseconds(double milliseconds)
+{
+	targetMilliseconds = milliseconds;
+}
+
+double stepTargetMilliseconds()
+{
+	return targetMilliseconds;
+}
+
+StepWorkSize::StepWorkSize(size_t unit, size_t maxWork)
+	: _unit(unit)
+	, _maxWork(std::max(maxWork / unit, (size_t)1) * unit)
+	, _targetMilliseconds(targetMilliseconds)
+	, _work(std::min(std::max(k_initialWork / unit, (size_t)1) * unit, _maxWork))
+{
+	assert(unit > 0);
+}
+
+StepWorkSize::~StepWorkSize()
+{
+	for (const Measure &measure : _pending)
+	{
+		_freeQueries.push_back(measure.begin);
+		_freeQueries.push_back(measure.end);
+	}
+	if (!_freeQueries.empty()) glDeleteQueries((GLsizei)_freeQueries.size(), _freeQueries.data());
+}
+
+size_t StepWorkSize::beginStep(size_t workLeft)
+{
+	assert(workLeft % _unit == 0);
+	collectMeasures();
+
+	Measure measure;
+	measure.begin = allocQuery();
+	measure.end = allocQuery();
+	measure.work = std::min(workLeft, _work);
+	glQueryCounter(measure.begin, GL_TIMESTAMP);
+	_pending.push_back(measure);
+	++_stepCount;
+	return measure.work;
+}
+
+void StepWorkSize::endStep()
+{
+	assert(!_pending.empty());
+	glQueryCounter(_pending.back().end, GL_TIMESTAMP);
+}
+
+GLuint StepWorkSize::allocQuery()
+{
+	if (_freeQueries.empty())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		return query;
+	}
+	const GLuint query = _freeQueries.back();
+	_freeQueries.pop_back();
+	return query;
+}
+
+// Measures finish in submission order, stop at the first one not available yet. The step being
+// submitted is never collected, its end query isn't issued.
+void StepWorkSize::collectMeasures()
+{
+	bool measured = false;
+	while (!_pending.empty())
+	{
+		const Measure &measure = _pending.front();
+		GLint available = 0;
+		glGetQueryObjectiv(measure.end, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(measure.begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(measure.end, GL_QUERY_RESULT, &end);
+		const double milliseconds = end > begin ? (double)(end - begin) / 1000000.0 : 0.0;
+		const double millisecondsPerWork = milliseconds / (double)measure.work;
+
+		// Smoothed, the time of a step changes with the region of the mesh its texels cover
+		_millisecondsPerWork = _millisecondsPerWork > 0.0 ?
+			0.5 * (_millisecondsPerWork + millisecondsPerWork) : millisecondsPerWork;
+		measured = true;
+
+		_freeQueries.push_back(measure.begin);
+		_freeQueries.push_back(measure.end);
+		_pending.pop_front();
+	}
+
+	if (measured && _millisecondsPerWork > 0.0)
+	{
+		const double work = std::min(_targetMilliseconds / _millisecondsPerWork, (double)_work * k_maxGrowth);
+		const size_t units = (size_t)(work / (double)_unit);
+		_work = std::min(std::max(units, (size_t)1) * _unit, _maxWork);
+	}
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2018 Oscar Sebio Cajaraville
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+/// GPU time a step of a solver aims for. Interactive bakes keep it short so the UI draws its frames while
+/// baking, headless bakes (the server and the benchmark) make it longer to spend less time in the overhead
+/// of every step.
+static const double k_interactiveStepMilliseconds = 10.0;
+static const double k_headlessStepMilliseconds = 100.0;
+
+/// Sets the GPU time of the steps of the solvers created after it
+void setStepTargetMilliseconds(double milliseconds);
+double stepTargetMilliseconds();
+
+/// Sizes the work of the steps of a solver so every step takes about the target GPU time. Every step is
+/// measured with timestamp queries, read once they are available so the steps never stall, and the time
+/// per work item of the steps measured so far sizes the next ones.
+class StepWorkSize
+{
+public:
+	/// @param unit The work of every step is a multiple of it, like the invocations of a work group
+	/// @param maxWork The work of a step is never above it, the buffers of a step are allocated with it
+	StepWorkSize(size_t unit, size_t maxWork);
+	~StepWorkSize();
+
+	StepWorkSize(const StepWorkSize&) = delete;
+	StepWorkSize& operator=(const StepWorkSize&) = delete;
+
+	/// Starts the measure of a step before its dispatches
+	/// @param workLeft Work left of the solver, a multiple of the unit
+	/// @return Work of the step
+	size_t beginStep(size_t workLeft);
+
+	/// Ends the measure of the step after its dispatches
+	void endStep();
+
+	inline size_t maxWork() const { return _maxWork; }
+	inline size_t stepCount() const { return _stepCount; }
+
+private:
+	struct Measure
+	{
+		GLuint begin;
+		GLuint end;
+		size_t work;
+	};
+
+	GLuint allocQuery();
+	void collectMeasures();
+
+	const size_t _unit;
+	const size_t _maxWork;
+	const double _targetMilliseconds;
+	size_t _work;
+	size_t _stepCount = 0;
+	double _millisecondsPerWork = 0.0;
+	std::deque<Measure> _pending;
+	std::vector<GLuint> _freeQueries;
+};